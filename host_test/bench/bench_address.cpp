@@ -0,0 +1,92 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Address and UUID, the value types every scan report and GATT lookup goes through.
+ */
+
+#include "bench_common.hpp"
+
+#include "nimble/Address.hpp"
+#include "nimble/AddressSet.hpp"
+#include "nimble/UUID.hpp"
+
+using namespace nimble;
+
+static void BM_AddressFromString(benchmark::State &state) {
+  for (auto _ : state) {
+    Address address("c0:ff:ee:12:34:56", BLE_ADDR_RANDOM);
+    benchmark::DoNotOptimize(address);
+  }
+}
+BENCHMARK(BM_AddressFromString);
+
+static void BM_AddressToChars(benchmark::State &state) {
+  const Address address(bench::peerAddress(0x123456));
+  char buf[18];
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(address.toChars(buf, sizeof(buf)));
+  }
+}
+BENCHMARK(BM_AddressToChars);
+
+static void BM_AddressEquals(benchmark::State &state) {
+  const Address lhs(bench::peerAddress(1));
+  const Address rhs(bench::peerAddress(2));
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs == rhs);
+  }
+}
+BENCHMARK(BM_AddressEquals);
+
+static void BM_UUIDFromString(benchmark::State &state) {
+  for (auto _ : state) {
+    UUID uuid = UUID::fromString("6e400001-b5a3-f393-e0a9-e50e24dcca9e");
+    benchmark::DoNotOptimize(uuid);
+  }
+}
+BENCHMARK(BM_UUIDFromString);
+
+static void BM_UUIDCompareMixedSize(benchmark::State &state) {
+  // A 16 bit UUID against its 128 bit form compares through the base UUID.
+  const UUID shortUuid((uint16_t) 0x180D);
+  const UUID longUuid = UUID::fromString("0000180d-0000-1000-8000-00805f9b34fb");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shortUuid == longUuid);
+  }
+}
+BENCHMARK(BM_UUIDCompareMixedSize);
+
+static void BM_AddressSetContains(benchmark::State &state) {
+  // The ignore list and white list lookup of every scan report, half of the lookups miss.
+  AddressSet set;
+  for (uint32_t i = 0; i < 64; i++) {
+    set.insert(Address(bench::peerAddress(i * 2)));
+  }
+
+  // The key is the 6 address bytes, a public and a random address with the same bytes are one entry.
+  ble_addr_t other = bench::peerAddress(0);
+  other.type = BLE_ADDR_PUBLIC;
+  bench::check(set.contains(Address(other)) && !set.insert(Address(other)) && set.size() == 64, "The address type is part of the key");
+
+  uint32_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(set.contains(Address(bench::peerAddress(next))));
+    next = (next + 1) & 127;
+  }
+}
+BENCHMARK(BM_AddressSetContains);
@@ -0,0 +1,91 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * AttributeValue, the buffer behind every local and remote attribute.
+ * The allocs/iter counter is the number of calls to the library allocator per iteration.
+ */
+
+#include "bench_common.hpp"
+
+#include "nimble/AttributeValue.hpp"
+
+using namespace nimble;
+
+static void BM_AttributeValueSetValue(benchmark::State &state) {
+  bench::initDevice();
+  const std::vector<uint8_t> data(state.range(0), 0xA5);
+  AttributeValue value;
+
+  bench::resetAllocations();
+  for (auto _ : state) {
+    value.setValue(data.data(), (uint16_t) data.size());
+    benchmark::ClobberMemory();
+  }
+
+  bench::reportAllocations(state);
+  state.SetBytesProcessed((int64_t) state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AttributeValueSetValue)->Arg(8)->Arg(20)->Arg(244)->Arg(512);
+
+static void BM_AttributeValueGrowing(benchmark::State &state) {
+  // A value written with ever larger payloads, like a characteristic fed by a sensor.
+  bench::initDevice();
+  const std::vector<uint8_t> data(BLE_ATT_ATTR_MAX_LEN, 0x5A);
+
+  bench::resetAllocations();
+  for (auto _ : state) {
+    AttributeValue value;
+    for (uint16_t len = 8; len <= BLE_ATT_ATTR_MAX_LEN; len *= 2) {
+      value.setValue(data.data(), len);
+    }
+    benchmark::DoNotOptimize(value.data());
+  }
+
+  bench::reportAllocations(state);
+}
+BENCHMARK(BM_AttributeValueGrowing);
+
+static void BM_AttributeValueCopy(benchmark::State &state) {
+  bench::initDevice();
+  const std::vector<uint8_t> data(state.range(0), 0x3C);
+  const AttributeValue source(data);
+
+  bench::resetAllocations();
+  for (auto _ : state) {
+    AttributeValue copy(source);
+    benchmark::DoNotOptimize(copy.data());
+  }
+
+  bench::reportAllocations(state);
+}
+BENCHMARK(BM_AttributeValueCopy)->Arg(20)->Arg(512);
+
+static void BM_AttributeValueFromMbuf(benchmark::State &state) {
+  bench::initDevice();
+  const std::vector<uint8_t> data(state.range(0), 0x77);
+  os_mbuf *om = ble_hs_mbuf_from_flat(data.data(), (uint16_t) data.size());
+  AttributeValue value;
+
+  bench::resetAllocations();
+  for (auto _ : state) {
+    value.setValue(om);
+    benchmark::ClobberMemory();
+  }
+
+  bench::reportAllocations(state);
+  os_mbuf_free_chain(om);
+  bench::checkNoLeakedMbufs();
+}
+BENCHMARK(BM_AttributeValueFromMbuf)->Arg(20)->Arg(244);
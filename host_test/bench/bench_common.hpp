@@ -0,0 +1,112 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "fake_control.h"
+#include "nimble/Device.hpp"
+#include "nimble/Memory.hpp"
+
+namespace bench {
+
+/** Allocations made through the library allocator since the last resetAllocations(). */
+inline std::atomic<size_t> g_allocations{0};
+
+inline void *countingAllocate(size_t size, uint32_t caps) {
+  (void) caps;
+  g_allocations++;
+  return malloc(size);
+}
+
+inline void *countingReallocate(void *ptr, size_t size, uint32_t caps) {
+  (void) caps;
+  g_allocations++;
+  return realloc(ptr, size);
+}
+
+inline void countingRelease(void *ptr) {
+  free(ptr);
+}
+
+/**
+ * @brief Initialise the stack once for every bench of the process.
+ * @details The library allocator is replaced by one counting the calls, read with allocations().
+ */
+inline void initDevice() {
+  static bool initialized = false;
+  if (initialized) {
+    return;
+  }
+
+  static const nimble::MemoryAllocator allocator = {countingAllocate, countingReallocate, countingRelease};
+  nimble::Memory::setAllocator(&allocator);
+  nimble::Device::init("nimble-bench");
+  initialized = true;
+}
+
+inline void resetAllocations() {
+  g_allocations = 0;
+}
+
+inline size_t allocations() {
+  return g_allocations;
+}
+
+/**
+ * @brief Report the library allocations made per iteration of the bench.
+ */
+inline void reportAllocations(benchmark::State &state) {
+  state.counters["allocs/iter"] = benchmark::Counter((double) allocations(), benchmark::Counter::kAvgIterations);
+}
+
+/**
+ * @brief Abort the run when a check does not hold.
+ * @details SkipWithError() only marks the bench as failed in the report, the process still exits 0.
+ * Aborting makes the ctest entry fail.
+ */
+inline void check(bool condition, const char *message) {
+  if (!condition) {
+    fprintf(stderr, "Check failed: %s\n", message);
+    std::abort();
+  }
+}
+
+/**
+ * @brief Abort the run when a bench left fake mbufs allocated.
+ */
+inline void checkNoLeakedMbufs() {
+  check(fake::mbufsInUse() == 0, "Fake mbufs were not freed");
+}
+
+/**
+ * @brief A peer address with the given index in its low bytes.
+ */
+inline ble_addr_t peerAddress(uint32_t index) {
+  ble_addr_t addr{};
+  addr.type = BLE_ADDR_RANDOM;
+  addr.val[0] = (uint8_t) index;
+  addr.val[1] = (uint8_t) (index >> 8);
+  addr.val[2] = (uint8_t) (index >> 16);
+  addr.val[5] = 0xC0;
+  return addr;
+}
+
+}// namespace bench
@@ -0,0 +1,114 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Notification fan-out of a server characteristic to its subscribed peers.
+ * Peers connect and subscribe through the GAP handler the server registered when advertising started.
+ */
+
+#include "bench_common.hpp"
+
+#include "nimble/Characteristic.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Service.hpp"
+
+using namespace nimble;
+
+namespace {
+
+constexpr uint16_t FIRST_CONN_HANDLE = 1;
+
+Characteristic *s_pCharacteristic = nullptr;
+
+Characteristic *startServer() {
+  bench::initDevice();
+  if (s_pCharacteristic != nullptr) {
+    return s_pCharacteristic;
+  }
+
+  Server *pServer = Device::createServer();
+  Service *pService = pServer->createService(UUID((uint16_t) 0x180D));
+  s_pCharacteristic = pService->createCharacteristic((uint16_t) 0x2A37, Property::READ | Property::NOTIFY);
+  pService->start();
+  pServer->start();
+  pServer->startAdvertising();
+  return s_pCharacteristic;
+}
+
+void connectPeers(Characteristic *pCharacteristic, size_t count, uint16_t mtu) {
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t connHandle = FIRST_CONN_HANDLE + i;
+    fake::addConnection(connHandle, bench::peerAddress(i), mtu);
+
+    ble_gap_event event{};
+    event.type = BLE_GAP_EVENT_CONNECT;
+    event.connect.conn_handle = connHandle;
+    fake::sendAdvEvent(event);
+
+    event = {};
+    event.type = BLE_GAP_EVENT_SUBSCRIBE;
+    event.subscribe.conn_handle = connHandle;
+    event.subscribe.attr_handle = pCharacteristic->getHandle();
+    event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_WRITE;
+    event.subscribe.cur_notify = 1;
+    fake::sendAdvEvent(event);
+  }
+}
+
+void disconnectPeers(size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t connHandle = FIRST_CONN_HANDLE + i;
+
+    ble_gap_event event{};
+    event.type = BLE_GAP_EVENT_DISCONNECT;
+    event.disconnect.reason = BLE_HS_HCI_ERR(BLE_ERR_REM_USER_CONN_TERM);
+    ble_gap_conn_find(connHandle, &event.disconnect.conn);
+    fake::removeConnection(connHandle);
+    fake::sendAdvEvent(event);
+  }
+  fake::reset();
+}
+
+}// namespace
+
+static void BM_NotifyFanOut(benchmark::State &state) {
+  Characteristic *pCharacteristic = startServer();
+  const size_t peers = (size_t) state.range(0);
+  const std::vector<uint8_t> value(state.range(1), 0x42);
+  connectPeers(pCharacteristic, peers, 247);
+  bench::check(pCharacteristic->getSubscribedCount() == peers, "The peers did not subscribe");
+
+  for (auto _ : state) {
+    pCharacteristic->notify(value.data(), value.size());
+  }
+
+  state.SetItemsProcessed((int64_t) fake::notifyCount());
+  state.counters["notify/iter"] = benchmark::Counter((double) fake::notifyCount(), benchmark::Counter::kAvgIterations);
+  disconnectPeers(peers);
+  bench::checkNoLeakedMbufs();
+}
+BENCHMARK(BM_NotifyFanOut)->ArgsProduct({{1, 2, 4}, {20, 244}});
+
+static void BM_NotifyNoSubscribers(benchmark::State &state) {
+  // The early return when nobody subscribed, the cost paid by every periodic notify of an idle server.
+  Characteristic *pCharacteristic = startServer();
+  const uint8_t value[20] = {};
+
+  for (auto _ : state) {
+    pCharacteristic->notify(value, sizeof(value));
+  }
+
+  bench::checkNoLeakedMbufs();
+}
+BENCHMARK(BM_NotifyNoSubscribers);
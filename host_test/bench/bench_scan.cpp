@@ -0,0 +1,145 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * The scan report path: discovery events delivered to the handler registered by Scan::start(),
+ * and the getters of the advertised devices it stores.
+ */
+
+#include <algorithm>
+
+#include "bench_common.hpp"
+
+#include "nimble/AdvertisedDevice.hpp"
+#include "nimble/Scan.hpp"
+
+using namespace nimble;
+
+namespace {
+
+/** Flags, a 16 bit service UUID, a manufacturer data field and a complete name. */
+const uint8_t PAYLOAD[] = {
+    0x02, BLE_HS_ADV_TYPE_FLAGS, 0x06,
+    0x03, BLE_HS_ADV_TYPE_COMP_UUIDS16, 0x0D, 0x18,
+    0x07, BLE_HS_ADV_TYPE_MFG_DATA, 0xE5, 0x02, 0x01, 0x02, 0x03, 0x04,
+    0x0D, BLE_HS_ADV_TYPE_COMP_NAME, 'b', 'e', 'n', 'c', 'h', '-', 'd', 'e', 'v', 'i', 'c', 'e',
+};
+
+ble_gap_event discEvent(uint32_t index) {
+  ble_gap_event event{};
+  event.type = BLE_GAP_EVENT_DISC;
+  event.disc.event_type = BLE_HCI_ADV_RPT_EVTYPE_ADV_IND;
+  event.disc.addr = bench::peerAddress(index);
+  event.disc.rssi = (int8_t) (-40 - (int8_t) (index % 40));
+  event.disc.data = PAYLOAD;
+  event.disc.length_data = sizeof(PAYLOAD);
+  return event;
+}
+
+Scan *startScan() {
+  bench::initDevice();
+  Scan *pScan = Device::getScan();
+  pScan->stop();
+  pScan->start(0);
+  return pScan;
+}
+
+}// namespace
+
+static void BM_ScanReport(benchmark::State &state) {
+  // Reports from a population of devices, each one seen again once every range(0) reports.
+  Scan *pScan = startScan();
+  const uint32_t devices = (uint32_t) state.range(0);
+  std::vector<ble_gap_event> events;
+  for (uint32_t i = 0; i < devices; i++) {
+    events.push_back(discEvent(i));
+  }
+
+  size_t next = 0;
+  bench::resetAllocations();
+  for (auto _ : state) {
+    fake::sendDiscEvent(events[next]);
+    next = next + 1 < events.size() ? next + 1 : 0;
+  }
+
+  bench::reportAllocations(state);
+  state.SetItemsProcessed((int64_t) state.iterations());
+  state.counters["stored"] = (double) pScan->getResults().getCount();
+  // Short runs do not get through the whole population.
+  const size_t expected = std::min<size_t>(devices, (size_t) state.iterations());
+  bench::check(pScan->getResults().getCount() == expected, "A device was not stored or stored twice");
+  pScan->stop();
+  pScan->clearResults();
+}
+BENCHMARK(BM_ScanReport)->Arg(1)->Arg(16)->Arg(64)->Arg(256);
+
+static void BM_ScanReportFiltered(benchmark::State &state) {
+  // Reports rejected by the filters before anything is looked up.
+  Scan *pScan = startScan();
+  ScanFilter filter;
+  filter.setMinRSSI(-20);
+  pScan->setFilters(filter);
+  ble_gap_event event = discEvent(1);
+
+  for (auto _ : state) {
+    fake::sendDiscEvent(event);
+  }
+
+  state.SetItemsProcessed((int64_t) state.iterations());
+  bench::check(pScan->getResults().getCount() == 0, "A filtered report was stored");
+  pScan->setFilters(ScanFilter());
+  pScan->stop();
+  pScan->clearResults();
+}
+BENCHMARK(BM_ScanReportFiltered);
+
+static void BM_AdvertisedDeviceGetters(benchmark::State &state) {
+  Scan *pScan = startScan();
+  ble_gap_event event = discEvent(7);
+  fake::sendDiscEvent(event);
+  AdvertisedDevice *pDevice = pScan->getResults().getDevice(Address(event.disc.addr));
+  bench::check(pDevice != nullptr, "The report was not stored");
+
+  bench::resetAllocations();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pDevice->getNameView());
+    benchmark::DoNotOptimize(pDevice->getManufacturerDataView());
+    benchmark::DoNotOptimize(pDevice->getServiceUUID());
+    benchmark::DoNotOptimize(pDevice->getAdvFlags());
+    benchmark::DoNotOptimize(pDevice->getRSSI());
+  }
+
+  bench::reportAllocations(state);
+  pScan->stop();
+  pScan->clearResults();
+}
+BENCHMARK(BM_AdvertisedDeviceGetters);
+
+static void BM_AdvertisedDeviceStringGetters(benchmark::State &state) {
+  // The std::string getters copy the field, compare with the view getters above.
+  Scan *pScan = startScan();
+  ble_gap_event event = discEvent(8);
+  fake::sendDiscEvent(event);
+  AdvertisedDevice *pDevice = pScan->getResults().getDevice(Address(event.disc.addr));
+  bench::check(pDevice != nullptr, "The report was not stored");
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pDevice->getName());
+    benchmark::DoNotOptimize(pDevice->getManufacturerData());
+  }
+
+  pScan->stop();
+  pScan->clearResults();
+}
+BENCHMARK(BM_AdvertisedDeviceStringGetters);
@@ -0,0 +1,76 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * The side of the fake NimBLE layer the benches drive: the peers the fake controller reports as connected
+ * and the counters of what the library handed to the stack.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fake_nimble.h"
+
+namespace fake {
+
+/**
+ * @brief Add a connection that ble_gap_conn_find() and ble_att_mtu() will report.
+ * @param [in] connHandle The handle of the connection.
+ * @param [in] peer The address of the peer.
+ * @param [in] mtu The ATT MTU of the connection.
+ * @param [in] encrypted Whether the link is reported as encrypted.
+ * @details No GAP event is sent, the caller passes BLE_GAP_EVENT_CONNECT to the handler under test.
+ */
+void addConnection(uint16_t connHandle, const ble_addr_t &peer, uint16_t mtu = BLE_ATT_MTU_DFLT, bool encrypted = false);
+
+/**
+ * @brief Remove a connection added with addConnection().
+ * @param [in] connHandle The handle of the connection.
+ */
+void removeConnection(uint16_t connHandle);
+
+/**
+ * @brief Deliver an event to the handler the library passed to ble_gap_disc().
+ * @param [in] event The event, a discovery report or BLE_GAP_EVENT_DISC_COMPLETE.
+ * @return The return code of the handler, BLE_HS_EALREADY if no scan is running.
+ */
+int sendDiscEvent(ble_gap_event &event);
+
+/**
+ * @brief Deliver an event to the handler the library passed to ble_gap_adv_start().
+ * @param [in] event The event, connection events of the peripheral role go to the advertising handler.
+ * @return The return code of the handler, BLE_HS_EALREADY if not advertising.
+ */
+int sendAdvEvent(ble_gap_event &event);
+
+/**
+ * @brief Remove every connection and clear the counters.
+ */
+void reset();
+
+/** @brief The number of ble_gattc_notify_custom() calls. */
+size_t notifyCount();
+
+/** @brief The number of ble_gattc_indicate_custom() calls. */
+size_t indicateCount();
+
+/** @brief The number of bytes sent by notifications and indications. */
+size_t notifyBytes();
+
+/** @brief The number of mbufs allocated and not yet freed. */
+int mbufsInUse();
+
+}// namespace fake
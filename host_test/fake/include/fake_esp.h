@@ -0,0 +1,219 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * The part of ESP-IDF and FreeRTOS the library uses, implemented on top of the C++ standard library
+ * in fake/src/fake_esp.cpp. Only what the host build compiles is declared, with the real names and types.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**************************** esp_idf_version.h ****************************/
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION_MAJOR 5
+#define ESP_IDF_VERSION_MINOR 1
+#define ESP_IDF_VERSION_PATCH 0
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH)
+
+/******************************** esp_err.h ********************************/
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_NO_FREE_PAGES 0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+
+#define ESP_ERROR_CHECK(x) (void) (x)
+
+const char *esp_err_to_name(esp_err_t code);
+
+/******************************** esp_log.h ********************************/
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+#endif
+
+esp_log_level_t esp_log_level_get(const char *tag);
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+uint32_t esp_log_timestamp();
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_LEVEL(level, tag, format, ...) esp_log_write(level, tag, "%s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...)        \
+  do {                                                      \
+    if (LOG_LOCAL_LEVEL >= level)                           \
+      ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__);     \
+  } while (0)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+/***************************** esp_attr.h *******************************/
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+/***************************** esp_timer.h ******************************/
+
+int64_t esp_timer_get_time();
+
+/**************************** esp_heap_caps.h *****************************/
+
+#define MALLOC_CAP_EXEC (1 << 0)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+
+/***************************** esp_rom_crc.h ******************************/
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/******************************** esp_bt.h ********************************/
+
+typedef enum {
+  ESP_BT_MODE_IDLE = 0x00,
+  ESP_BT_MODE_BLE = 0x01,
+  ESP_BT_MODE_CLASSIC_BT = 0x02,
+  ESP_BT_MODE_BTDM = 0x03,
+} esp_bt_mode_t;
+
+typedef enum {
+  ESP_PWR_LVL_N12 = 0,
+  ESP_PWR_LVL_N9 = 1,
+  ESP_PWR_LVL_N6 = 2,
+  ESP_PWR_LVL_N3 = 3,
+  ESP_PWR_LVL_N0 = 4,
+  ESP_PWR_LVL_P3 = 5,
+  ESP_PWR_LVL_P6 = 6,
+  ESP_PWR_LVL_P9 = 7,
+  ESP_PWR_LVL_INVALID = 0xFF,
+} esp_power_level_t;
+
+typedef enum {
+  ESP_BLE_PWR_TYPE_CONN_HDL0 = 0,
+  ESP_BLE_PWR_TYPE_ADV = 9,
+  ESP_BLE_PWR_TYPE_SCAN = 10,
+  ESP_BLE_PWR_TYPE_DEFAULT = 11,
+} esp_ble_power_type_t;
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode);
+esp_err_t esp_ble_tx_power_set(esp_ble_power_type_t power_type, esp_power_level_t power_level);
+esp_power_level_t esp_ble_tx_power_get(esp_ble_power_type_t power_type);
+
+/********************************* nvs.h **********************************/
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+  NVS_READONLY,
+  NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+/******************************* FreeRTOS ********************************/
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct FakeTask *TaskHandle_t;
+typedef struct FakeQueue *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define portNUM_PROCESSORS 2
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask, BaseType_t xCoreID);
+void vTaskDelete(TaskHandle_t xTask);
+void vTaskDelay(TickType_t xTicksToDelay);
+void vPortYield();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xPortGetCoreID();
+TickType_t xTaskGetTickCount();
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyValueClear(TaskHandle_t xTask, uint32_t ulBitsToClear);
+
+#define taskYIELD() vPortYield()
+#define ulTaskNotifyValueClear ulTaskNotifyValueClear
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+void vQueueDelete(QueueHandle_t xQueue);
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+#define vSemaphoreDelete(xSemaphore) vQueueDelete(xSemaphore)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1029 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * A thin fake of the NimBLE host API, enough to build every role of the library
+ * on a Linux host. Types, fields and constants keep their NimBLE names and values so the sources build
+ * unchanged, the functions are implemented in fake/src/fake_nimble.cpp and record what the library
+ * handed to the stack instead of talking to a controller.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "fake_esp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MYNEWT_VAL(x) MYNEWT_VAL_##x
+#define MYNEWT_VAL_BLE_STORE_MAX_BONDS 3
+#define MYNEWT_VAL_BLE_EXT_ADV 0
+
+/********************************** sys/queue.h **********************************/
+
+#ifndef SLIST_HEAD
+#define SLIST_HEAD(name, type) \
+  struct name {                \
+    struct type *slh_first;    \
+  }
+#define SLIST_ENTRY(type)   \
+  struct {                  \
+    struct type *sle_next;  \
+  }
+#define SLIST_FIRST(head) ((head)->slh_first)
+#define SLIST_NEXT(elm, field) ((elm)->field.sle_next)
+#endif
+
+/********************************** nimble/ble.h **********************************/
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+#define BLE_ADDR_PUBLIC_ID 0x02
+#define BLE_ADDR_RANDOM_ID 0x03
+
+typedef struct {
+  uint8_t type;
+  uint8_t val[6];
+} ble_addr_t;
+
+int ble_addr_cmp(const ble_addr_t *a, const ble_addr_t *b);
+
+#define BLE_ADDR_ANY (&(ble_addr_t){0, {0, 0, 0, 0, 0, 0}})
+
+/******************************** host/ble_uuid.h *********************************/
+
+#define BLE_UUID_TYPE_16 16
+#define BLE_UUID_TYPE_32 32
+#define BLE_UUID_TYPE_128 128
+#define BLE_UUID_STR_LEN 37
+
+typedef struct {
+  uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+  ble_uuid_t u;
+  uint16_t value;
+} ble_uuid16_t;
+
+typedef struct {
+  ble_uuid_t u;
+  uint32_t value;
+} ble_uuid32_t;
+
+typedef struct {
+  ble_uuid_t u;
+  uint8_t value[16];
+} ble_uuid128_t;
+
+typedef union {
+  ble_uuid_t u;
+  ble_uuid16_t u16;
+  ble_uuid32_t u32;
+  ble_uuid128_t u128;
+} ble_uuid_any_t;
+
+#define BLE_UUID16(u) ((ble_uuid16_t *) (u))
+#define BLE_UUID32(u) ((ble_uuid32_t *) (u))
+#define BLE_UUID128(u) ((ble_uuid128_t *) (u))
+
+int ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2);
+int ble_uuid_init_from_buf(ble_uuid_any_t *uuid, const void *buf, size_t len);
+char *ble_uuid_to_str(const ble_uuid_t *uuid, char *dst);
+uint16_t ble_uuid_u16(const ble_uuid_t *uuid);
+
+/********************************** os/os_mbuf.h **********************************/
+
+struct os_mbuf_pool;
+
+struct os_mbuf {
+  uint8_t *om_data;
+  uint8_t om_flags;
+  uint8_t om_pkthdr_len;
+  uint16_t om_len;
+  struct os_mbuf_pool *om_omp;
+  SLIST_ENTRY(os_mbuf) om_next;
+  uint8_t om_databuf[0];
+};
+
+struct os_mbuf_pkthdr {
+  uint16_t omp_len;
+  uint16_t omp_flags;
+  void *omp_next;
+};
+
+struct os_mempool {
+  uint32_t mp_block_size;
+  uint16_t mp_num_blocks;
+};
+
+struct os_mbuf_pool {
+  uint16_t omp_databuf_len;
+  struct os_mempool *omp_pool;
+};
+
+typedef uint32_t os_membuf_t;
+
+#define OS_MBUF_PKTHDR(om) ((struct os_mbuf_pkthdr *) (void *) &(om)->om_databuf[0])
+#define OS_MBUF_PKTLEN(om) (OS_MBUF_PKTHDR(om)->omp_len)
+#define OS_MBUF_DATA(om, type) ((type) (om)->om_data)
+#define OS_MEMPOOL_SIZE(n, blksize) ((((blksize) + sizeof(os_membuf_t) - 1) / sizeof(os_membuf_t)) * (n))
+
+struct os_mbuf *os_mbuf_get_pkthdr(struct os_mbuf_pool *omp, uint8_t pkthdr_len);
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+int os_mbuf_copydata(const struct os_mbuf *m, int off, int len, void *dst);
+int os_mbuf_free_chain(struct os_mbuf *om);
+int os_mbuf_pool_init(struct os_mbuf_pool *omp, struct os_mempool *mp, uint16_t buf_len, uint16_t nbufs);
+int os_mempool_init(struct os_mempool *mp, uint16_t blocks, uint32_t block_size, void *membuf, const char *name);
+int os_msys_num_free();
+
+/******************************* nimble/nimble_npl.h ******************************/
+
+typedef uint32_t ble_npl_time_t;
+typedef int32_t ble_npl_stime_t;
+
+typedef enum {
+  BLE_NPL_OK = 0,
+  BLE_NPL_ENOMEM = 1,
+  BLE_NPL_EINVAL = 2,
+  BLE_NPL_INVALID_PARAM = 3,
+  BLE_NPL_MEM_NOT_ALIGNED = 4,
+  BLE_NPL_BAD_MUTEX = 5,
+  BLE_NPL_TIMEOUT = 6,
+  BLE_NPL_ERR_IN_ISR = 7,
+  BLE_NPL_ERR_PRIV = 8,
+  BLE_NPL_OS_NOT_STARTED = 9,
+  BLE_NPL_ENOENT = 10,
+  BLE_NPL_EBUSY = 11,
+  BLE_NPL_ERROR = 12,
+} ble_npl_error_t;
+
+#define BLE_NPL_TIME_FOREVER (0xffffffffUL)
+
+struct ble_npl_event;
+typedef void ble_npl_event_fn(struct ble_npl_event *ev);
+
+struct ble_npl_event {
+  bool queued;
+  ble_npl_event_fn *fn;
+  void *arg;
+};
+
+struct ble_npl_eventq {
+  void *q;
+};
+
+struct ble_npl_callout {
+  struct ble_npl_event ev;
+  struct ble_npl_eventq *evq;
+  ble_npl_time_t ticks;
+  bool active;
+};
+
+uint32_t ble_npl_hw_enter_critical();
+void ble_npl_hw_exit_critical(uint32_t ctx);
+ble_npl_time_t ble_npl_time_get();
+ble_npl_error_t ble_npl_time_ms_to_ticks(uint32_t ms, ble_npl_time_t *out_ticks);
+ble_npl_time_t ble_npl_time_ms_to_ticks32(uint32_t ms);
+uint32_t ble_npl_time_ticks_to_ms32(ble_npl_time_t ticks);
+void ble_npl_time_delay(ble_npl_time_t ticks);
+void ble_npl_callout_init(struct ble_npl_callout *co, struct ble_npl_eventq *evq, ble_npl_event_fn *ev_cb, void *ev_arg);
+ble_npl_error_t ble_npl_callout_reset(struct ble_npl_callout *co, ble_npl_time_t ticks);
+void ble_npl_callout_stop(struct ble_npl_callout *co);
+bool ble_npl_callout_is_active(struct ble_npl_callout *co);
+void ble_npl_callout_deinit(struct ble_npl_callout *co);
+void *ble_npl_event_get_arg(struct ble_npl_event *ev);
+
+/******************************* nimble/nimble_port.h *****************************/
+
+esp_err_t nimble_port_init();
+int nimble_port_deinit();
+void nimble_port_run();
+int nimble_port_stop();
+struct ble_npl_eventq *nimble_port_get_dflt_eventq();
+void nimble_port_freertos_init(TaskFunction_t host_task_fn);
+void nimble_port_freertos_deinit();
+
+/********************************** host/ble_hs.h *********************************/
+
+#define BLE_HS_FOREVER INT32_MAX
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+#define BLE_HS_EAGAIN 1
+#define BLE_HS_EALREADY 2
+#define BLE_HS_EINVAL 3
+#define BLE_HS_EMSGSIZE 4
+#define BLE_HS_ENOENT 5
+#define BLE_HS_ENOMEM 6
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_ENOTSUP 8
+#define BLE_HS_EAPP 9
+#define BLE_HS_EBADDATA 10
+#define BLE_HS_EOS 11
+#define BLE_HS_ECONTROLLER 12
+#define BLE_HS_ETIMEOUT 13
+#define BLE_HS_EDONE 14
+#define BLE_HS_EBUSY 15
+#define BLE_HS_EREJECT 16
+#define BLE_HS_EUNKNOWN 17
+#define BLE_HS_EROLE 18
+#define BLE_HS_ETIMEOUT_HCI 19
+#define BLE_HS_ENOMEM_EVT 20
+#define BLE_HS_ENOADDR 21
+#define BLE_HS_ENOTSYNCED 22
+#define BLE_HS_EAUTHEN 23
+#define BLE_HS_EAUTHOR 24
+#define BLE_HS_EENCRYPT 25
+#define BLE_HS_EENCRYPT_KEY_SZ 26
+#define BLE_HS_ESTORE_CAP 27
+#define BLE_HS_ESTORE_FAIL 28
+#define BLE_HS_EPREEMPTED 29
+#define BLE_HS_EDISABLED 30
+#define BLE_HS_ESTALLED 31
+
+#define BLE_HS_ERR_ATT_BASE 0x100
+#define BLE_HS_ERR_HCI_BASE 0x200
+#define BLE_HS_ERR_L2C_BASE 0x300
+#define BLE_HS_ERR_SM_US_BASE 0x400
+#define BLE_HS_ERR_SM_PEER_BASE 0x500
+#define BLE_HS_ATT_ERR(x) ((x) ? BLE_HS_ERR_ATT_BASE + (x) : 0)
+#define BLE_HS_HCI_ERR(x) ((x) ? BLE_HS_ERR_HCI_BASE + (x) : 0)
+#define BLE_HS_SM_US_ERR(x) ((x) ? BLE_HS_ERR_SM_US_BASE + (x) : 0)
+#define BLE_HS_SM_PEER_ERR(x) ((x) ? BLE_HS_ERR_SM_PEER_BASE + (x) : 0)
+
+#define BLE_HS_IO_DISPLAY_ONLY 0x00
+#define BLE_HS_IO_DISPLAY_YESNO 0x01
+#define BLE_HS_IO_KEYBOARD_ONLY 0x02
+#define BLE_HS_IO_NO_INPUT_OUTPUT 0x03
+#define BLE_HS_IO_KEYBOARD_DISPLAY 0x04
+
+#define BLE_OWN_ADDR_PUBLIC 0x00
+#define BLE_OWN_ADDR_RANDOM 0x01
+#define BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT 0x02
+#define BLE_OWN_ADDR_RPA_RANDOM_DEFAULT 0x03
+
+#define BLE_ERR_UNKNOWN_HCI_CMD 0x01
+#define BLE_ERR_UNK_CONN_ID 0x02
+#define BLE_ERR_HW_FAIL 0x03
+#define BLE_ERR_PAGE_TMO 0x04
+#define BLE_ERR_AUTH_FAIL 0x05
+#define BLE_ERR_PINKEY_MISSING 0x06
+#define BLE_ERR_MEM_CAPACITY 0x07
+#define BLE_ERR_CONN_SPVN_TMO 0x08
+#define BLE_ERR_CONN_LIMIT 0x09
+#define BLE_ERR_SYNCH_CONN_LIMIT 0x0a
+#define BLE_ERR_ACL_CONN_EXISTS 0x0b
+#define BLE_ERR_CMD_DISALLOWED 0x0c
+#define BLE_ERR_CONN_REJ_RESOURCES 0x0d
+#define BLE_ERR_CONN_REJ_SECURITY 0x0e
+#define BLE_ERR_CONN_REJ_BD_ADDR 0x0f
+#define BLE_ERR_CONN_ACCEPT_TMO 0x10
+#define BLE_ERR_UNSUPPORTED 0x11
+#define BLE_ERR_INV_HCI_CMD_PARMS 0x12
+#define BLE_ERR_REM_USER_CONN_TERM 0x13
+#define BLE_ERR_RD_CONN_TERM_RESRCS 0x14
+#define BLE_ERR_RD_CONN_TERM_PWROFF 0x15
+#define BLE_ERR_CONN_TERM_LOCAL 0x16
+#define BLE_ERR_REPEATED_ATTEMPTS 0x17
+#define BLE_ERR_NO_PAIRING 0x18
+#define BLE_ERR_UNK_LMP 0x19
+#define BLE_ERR_UNSUPP_REM_FEATURE 0x1a
+#define BLE_ERR_SCO_OFFSET 0x1b
+#define BLE_ERR_SCO_ITVL 0x1c
+#define BLE_ERR_SCO_AIR_MODE 0x1d
+#define BLE_ERR_INV_LMP_LL_PARM 0x1e
+#define BLE_ERR_UNSPECIFIED 0x1f
+#define BLE_ERR_UNSUPP_LMP_LL_PARM 0x20
+#define BLE_ERR_NO_ROLE_CHANGE 0x21
+#define BLE_ERR_LMP_LL_RSP_TMO 0x22
+#define BLE_ERR_LMP_COLLISION 0x23
+#define BLE_ERR_LMP_PDU 0x24
+#define BLE_ERR_ENCRYPTION_MODE 0x25
+#define BLE_ERR_LINK_KEY_CHANGE 0x26
+#define BLE_ERR_UNSUPP_QOS 0x27
+#define BLE_ERR_INSTANT_PASSED 0x28
+#define BLE_ERR_UNIT_KEY_PAIRING 0x29
+#define BLE_ERR_DIFF_TRANS_COLL 0x2a
+#define BLE_ERR_QOS_PARM 0x2c
+#define BLE_ERR_QOS_REJECTED 0x2d
+#define BLE_ERR_CHAN_CLASS 0x2e
+#define BLE_ERR_INSUFFICIENT_SEC 0x2f
+#define BLE_ERR_PARM_OUT_OF_RANGE 0x30
+#define BLE_ERR_PENDING_ROLE_SW 0x32
+#define BLE_ERR_RESERVED_SLOT 0x34
+#define BLE_ERR_ROLE_SW_FAIL 0x35
+#define BLE_ERR_INQ_RSP_TOO_BIG 0x36
+#define BLE_ERR_SEC_SIMPLE_PAIR 0x37
+#define BLE_ERR_HOST_BUSY_PAIR 0x38
+#define BLE_ERR_CONN_REJ_CHANNEL 0x39
+#define BLE_ERR_CTLR_BUSY 0x3a
+#define BLE_ERR_CONN_PARMS 0x3b
+#define BLE_ERR_DIR_ADV_TMO 0x3c
+#define BLE_ERR_CONN_TERM_MIC 0x3d
+#define BLE_ERR_CONN_ESTABLISHMENT 0x3e
+#define BLE_ERR_MAC_CONN_FAIL 0x3f
+#define BLE_ERR_COARSE_CLK_ADJ 0x40
+
+#define BLE_HCI_LE_CONN_HANDLE_MAX 0x0eff
+#define BLE_HCI_CONN_ITVL_MIN 0x0006
+#define BLE_HCI_CONN_ITVL_MAX 0x0c80
+#define BLE_HCI_CONN_LATENCY_MAX 0x01f3
+#define BLE_HCI_CONN_SPVN_TIMEOUT_MIN 0x000a
+#define BLE_HCI_CONN_SPVN_TIMEOUT_MAX 0x0c80
+#define BLE_HCI_LE_PHY_1M 1
+#define BLE_HCI_LE_PHY_2M 2
+#define BLE_HCI_LE_PHY_CODED 3
+
+#define BLE_HCI_ADV_RPT_EVTYPE_ADV_IND 0
+#define BLE_HCI_ADV_RPT_EVTYPE_DIR_IND 1
+#define BLE_HCI_ADV_RPT_EVTYPE_SCAN_IND 2
+#define BLE_HCI_ADV_RPT_EVTYPE_NONCONN_IND 3
+#define BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP 4
+
+#define BLE_HCI_ADV_TYPE_ADV_IND 0
+#define BLE_HCI_ADV_TYPE_ADV_DIRECT_IND_HD 1
+#define BLE_HCI_ADV_TYPE_ADV_SCAN_IND 2
+#define BLE_HCI_ADV_TYPE_ADV_NONCONN_IND 3
+#define BLE_HCI_ADV_TYPE_ADV_DIRECT_IND_LD 4
+
+#define BLE_HCI_ADV_FILT_NONE 0
+#define BLE_HCI_ADV_FILT_SCAN 1
+#define BLE_HCI_ADV_FILT_CONN 2
+#define BLE_HCI_ADV_FILT_BOTH 3
+
+#define BLE_HCI_SCAN_FILT_NO_WL 0
+#define BLE_HCI_SCAN_FILT_USE_WL 1
+#define BLE_HCI_SCAN_FILT_NO_WL_INITA 2
+#define BLE_HCI_SCAN_FILT_USE_WL_INITA 3
+
+#define BLE_HCI_ADV_CONN_MASK 0x0001
+#define BLE_HCI_ADV_SCAN_MASK 0x0002
+#define BLE_HCI_ADV_DIRECT_MASK 0x0004
+#define BLE_HCI_ADV_SCAN_RSP_MASK 0x0008
+#define BLE_HCI_ADV_LEGACY_MASK 0x0010
+
+#define BLE_HS_ADV_MAX_SZ 31
+#define BLE_HS_ADV_TYPE_FLAGS 0x01
+#define BLE_HS_ADV_TYPE_INCOMP_UUIDS16 0x02
+#define BLE_HS_ADV_TYPE_COMP_UUIDS16 0x03
+#define BLE_HS_ADV_TYPE_INCOMP_UUIDS32 0x04
+#define BLE_HS_ADV_TYPE_COMP_UUIDS32 0x05
+#define BLE_HS_ADV_TYPE_INCOMP_UUIDS128 0x06
+#define BLE_HS_ADV_TYPE_COMP_UUIDS128 0x07
+#define BLE_HS_ADV_TYPE_INCOMP_NAME 0x08
+#define BLE_HS_ADV_TYPE_COMP_NAME 0x09
+#define BLE_HS_ADV_TYPE_TX_PWR_LVL 0x0a
+#define BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE 0x12
+#define BLE_HS_ADV_TYPE_SOL_UUIDS16 0x14
+#define BLE_HS_ADV_TYPE_SOL_UUIDS128 0x15
+#define BLE_HS_ADV_TYPE_SVC_DATA_UUID16 0x16
+#define BLE_HS_ADV_TYPE_PUBLIC_TGT_ADDR 0x17
+#define BLE_HS_ADV_TYPE_RANDOM_TGT_ADDR 0x18
+#define BLE_HS_ADV_TYPE_APPEARANCE 0x19
+#define BLE_HS_ADV_TYPE_ADV_ITVL 0x1a
+#define BLE_HS_ADV_TYPE_SVC_DATA_UUID32 0x20
+#define BLE_HS_ADV_TYPE_SVC_DATA_UUID128 0x21
+#define BLE_HS_ADV_TYPE_URI 0x24
+#define BLE_HS_ADV_TYPE_MFG_DATA 0xff
+
+struct ble_hs_adv_field {
+  uint8_t length;
+  uint8_t type;
+  uint8_t value[0];
+};
+
+struct ble_hs_adv_fields {
+  uint8_t flags;
+  const ble_uuid16_t *uuids16;
+  uint8_t num_uuids16;
+  unsigned uuids16_is_complete : 1;
+  const ble_uuid32_t *uuids32;
+  uint8_t num_uuids32;
+  unsigned uuids32_is_complete : 1;
+  const ble_uuid128_t *uuids128;
+  uint8_t num_uuids128;
+  unsigned uuids128_is_complete : 1;
+  const uint8_t *name;
+  uint8_t name_len;
+  unsigned name_is_complete : 1;
+  int8_t tx_pwr_lvl;
+  unsigned tx_pwr_lvl_is_present : 1;
+  const uint8_t *slave_itvl_range;
+  const uint8_t *svc_data_uuid16;
+  uint8_t svc_data_uuid16_len;
+  const uint8_t *public_tgt_addr;
+  uint8_t num_public_tgt_addrs;
+  uint16_t appearance;
+  unsigned appearance_is_present : 1;
+  uint16_t adv_itvl;
+  unsigned adv_itvl_is_present : 1;
+  const uint8_t *svc_data_uuid32;
+  uint8_t svc_data_uuid32_len;
+  const uint8_t *svc_data_uuid128;
+  uint8_t svc_data_uuid128_len;
+  const uint8_t *uri;
+  uint8_t uri_len;
+  const uint8_t *mfg_data;
+  uint8_t mfg_data_len;
+};
+
+int ble_hs_adv_set_fields(const struct ble_hs_adv_fields *adv_fields, uint8_t *dst, uint8_t *dst_len, uint8_t max_len);
+int ble_hs_adv_parse(const uint8_t *data, uint8_t length, int (*func)(const struct ble_hs_adv_field *, void *), void *user_data);
+
+#define BLE_HS_ADV_FLAGS_LEN 1
+#define BLE_HS_ADV_F_DISC_LTD 0x01
+#define BLE_HS_ADV_F_DISC_GEN 0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP 0x04
+#define BLE_HS_ADV_TX_PWR_LVL_LEN 1
+#define BLE_HS_ADV_TX_PWR_LVL_AUTO (-128)
+#define BLE_HS_ADV_SLAVE_ITVL_RANGE_LEN 4
+#define BLE_HS_ADV_PUBLIC_TGT_ADDR_ENTRY_LEN 6
+#define BLE_HS_ADV_APPEARANCE_LEN 2
+#define BLE_HS_ADV_ADV_ITVL_LEN 2
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+struct os_mbuf *ble_hs_mbuf_att_pkt();
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len);
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa);
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+int ble_hs_util_ensure_addr(int prefer_random);
+int ble_hs_pvcy_rpa_config(uint8_t enable);
+void ble_hs_sched_reset(int reason);
+int ble_hs_synced();
+
+typedef void ble_hs_reset_fn(int reason);
+typedef void ble_hs_sync_fn();
+struct ble_gatt_register_ctxt;
+typedef void ble_gatt_register_fn(struct ble_gatt_register_ctxt *ctxt, void *arg);
+
+struct ble_store_status_event;
+typedef int ble_store_status_fn(struct ble_store_status_event *event, void *arg);
+
+struct ble_hs_cfg {
+  ble_hs_reset_fn *reset_cb;
+  ble_hs_sync_fn *sync_cb;
+  ble_gatt_register_fn *gatts_register_cb;
+  void *gatts_register_arg;
+  ble_store_status_fn *store_status_cb;
+  void *store_read_cb;
+  void *store_write_cb;
+  void *store_delete_cb;
+  uint8_t sm_io_cap;
+  unsigned sm_oob_data_flag : 1;
+  unsigned sm_bonding : 1;
+  unsigned sm_mitm : 1;
+  unsigned sm_sc : 1;
+  unsigned sm_keypress : 1;
+  uint8_t sm_our_key_dist;
+  uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+/********************************* host/ble_att.h *********************************/
+
+#define BLE_ATT_MTU_DFLT 23
+#define BLE_ATT_MTU_MAX 527
+#define BLE_ATT_ATTR_MAX_LEN 512
+
+#define BLE_ATT_ERR_INVALID_HANDLE 0x01
+#define BLE_ATT_ERR_READ_NOT_PERMITTED 0x02
+#define BLE_ATT_ERR_WRITE_NOT_PERMITTED 0x03
+#define BLE_ATT_ERR_INVALID_PDU 0x04
+#define BLE_ATT_ERR_INSUFFICIENT_AUTHEN 0x05
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED 0x06
+#define BLE_ATT_ERR_INVALID_OFFSET 0x07
+#define BLE_ATT_ERR_INSUFFICIENT_AUTHOR 0x08
+#define BLE_ATT_ERR_PREPARE_QUEUE_FULL 0x09
+#define BLE_ATT_ERR_ATTR_NOT_FOUND 0x0a
+#define BLE_ATT_ERR_ATTR_NOT_LONG 0x0b
+#define BLE_ATT_ERR_INSUFFICIENT_KEY_SZ 0x0c
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY 0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_ENC 0x0f
+#define BLE_ATT_ERR_UNSUPPORTED_GROUP 0x10
+#define BLE_ATT_ERR_INSUFFICIENT_RES 0x11
+
+#define BLE_ATT_F_READ 0x01
+#define BLE_ATT_F_WRITE 0x02
+#define BLE_ATT_F_READ_ENC 0x04
+#define BLE_ATT_F_READ_AUTHEN 0x08
+#define BLE_ATT_F_READ_AUTHOR 0x10
+#define BLE_ATT_F_WRITE_ENC 0x20
+#define BLE_ATT_F_WRITE_AUTHEN 0x40
+#define BLE_ATT_F_WRITE_AUTHOR 0x80
+
+uint16_t ble_att_mtu(uint16_t conn_handle);
+uint16_t ble_att_preferred_mtu();
+int ble_att_set_preferred_mtu(uint16_t mtu);
+
+/********************************* host/ble_gap.h *********************************/
+
+#define BLE_GAP_EVENT_CONNECT 0
+#define BLE_GAP_EVENT_DISCONNECT 1
+#define BLE_GAP_EVENT_CONN_UPDATE 3
+#define BLE_GAP_EVENT_CONN_UPDATE_REQ 4
+#define BLE_GAP_EVENT_L2CAP_UPDATE_REQ 5
+#define BLE_GAP_EVENT_TERM_FAILURE 6
+#define BLE_GAP_EVENT_DISC 7
+#define BLE_GAP_EVENT_DISC_COMPLETE 8
+#define BLE_GAP_EVENT_ADV_COMPLETE 9
+#define BLE_GAP_EVENT_ENC_CHANGE 10
+#define BLE_GAP_EVENT_PASSKEY_ACTION 11
+#define BLE_GAP_EVENT_NOTIFY_RX 12
+#define BLE_GAP_EVENT_NOTIFY_TX 13
+#define BLE_GAP_EVENT_SUBSCRIBE 14
+#define BLE_GAP_EVENT_MTU 15
+#define BLE_GAP_EVENT_IDENTITY_RESOLVED 16
+#define BLE_GAP_EVENT_REPEAT_PAIRING 17
+#define BLE_GAP_EVENT_PHY_UPDATE_COMPLETE 18
+#define BLE_GAP_EVENT_EXT_DISC 19
+#define BLE_GAP_EVENT_PERIODIC_SYNC 20
+#define BLE_GAP_EVENT_PERIODIC_REPORT 21
+#define BLE_GAP_EVENT_PERIODIC_SYNC_LOST 22
+#define BLE_GAP_EVENT_SCAN_REQ_RCVD 23
+
+#define BLE_GAP_REPEAT_PAIRING_RETRY 1
+#define BLE_GAP_REPEAT_PAIRING_IGNORE 2
+
+#define BLE_GAP_SUBSCRIBE_REASON_WRITE 1
+#define BLE_GAP_SUBSCRIBE_REASON_TERM 2
+#define BLE_GAP_SUBSCRIBE_REASON_RESTORE 3
+
+#define BLE_GAP_ROLE_MASTER 0
+#define BLE_GAP_ROLE_SLAVE 1
+
+#define BLE_GAP_CONN_MODE_NON 0
+#define BLE_GAP_CONN_MODE_DIR 1
+#define BLE_GAP_CONN_MODE_UND 2
+#define BLE_GAP_DISC_MODE_NON 0
+#define BLE_GAP_DISC_MODE_LTD 1
+#define BLE_GAP_DISC_MODE_GEN 2
+
+#define BLE_GAP_INITIAL_CONN_ITVL_MIN 0x18
+#define BLE_GAP_INITIAL_CONN_ITVL_MAX 0x28
+#define BLE_GAP_INITIAL_CONN_LATENCY 0
+#define BLE_GAP_INITIAL_SUPERVISION_TIMEOUT 0x0100
+#define BLE_GAP_INITIAL_CONN_MIN_CE_LEN 0x0010
+#define BLE_GAP_INITIAL_CONN_MAX_CE_LEN 0x0300
+
+#define BLE_GAP_LE_PHY_1M_MASK 0x01
+#define BLE_GAP_LE_PHY_2M_MASK 0x02
+#define BLE_GAP_LE_PHY_CODED_MASK 0x04
+#define BLE_GAP_LE_PHY_CODED_ANY 0
+#define BLE_GAP_LE_PHY_CODED_S2 1
+#define BLE_GAP_LE_PHY_CODED_S8 2
+
+struct ble_gap_sec_state {
+  unsigned encrypted : 1;
+  unsigned authenticated : 1;
+  unsigned bonded : 1;
+  unsigned key_size : 5;
+};
+
+struct ble_gap_conn_desc {
+  struct ble_gap_sec_state sec_state;
+  ble_addr_t our_id_addr;
+  ble_addr_t peer_id_addr;
+  ble_addr_t our_ota_addr;
+  ble_addr_t peer_ota_addr;
+  uint16_t conn_handle;
+  uint16_t conn_itvl;
+  uint16_t conn_latency;
+  uint16_t supervision_timeout;
+  uint8_t role;
+  uint8_t master_clock_accuracy;
+};
+
+struct ble_gap_upd_params {
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint16_t min_ce_len;
+  uint16_t max_ce_len;
+};
+
+struct ble_gap_conn_params {
+  uint16_t scan_itvl;
+  uint16_t scan_window;
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint16_t min_ce_len;
+  uint16_t max_ce_len;
+};
+
+struct ble_gap_disc_params {
+  uint16_t itvl;
+  uint16_t window;
+  uint8_t filter_policy;
+  uint8_t limited : 1;
+  uint8_t passive : 1;
+  uint8_t filter_duplicates : 1;
+};
+
+struct ble_gap_adv_params {
+  uint8_t conn_mode;
+  uint8_t disc_mode;
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint8_t channel_map;
+  uint8_t filter_policy;
+  uint8_t high_duty_cycle : 1;
+};
+
+struct ble_gap_disc_desc {
+  uint8_t event_type;
+  uint8_t length_data;
+  ble_addr_t addr;
+  int8_t rssi;
+  const uint8_t *data;
+  ble_addr_t direct_addr;
+};
+
+struct ble_gap_ext_disc_desc {
+  uint8_t props;
+  uint8_t data_status;
+  uint8_t legacy_event_type;
+  ble_addr_t addr;
+  int8_t rssi;
+  int8_t tx_power;
+  uint8_t sid;
+  uint8_t prim_phy;
+  uint8_t sec_phy;
+  uint16_t periodic_adv_itvl;
+  uint8_t length_data;
+  const uint8_t *data;
+  ble_addr_t direct_addr;
+};
+
+struct ble_gap_passkey_params {
+  uint8_t action;
+  uint32_t numcmp;
+};
+
+struct ble_gap_event {
+  uint8_t type;
+
+  union {
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } connect;
+
+    struct {
+      int reason;
+      struct ble_gap_conn_desc conn;
+    } disconnect;
+
+    struct ble_gap_disc_desc disc;
+    struct ble_gap_ext_disc_desc ext_disc;
+
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } conn_update;
+
+    struct {
+      struct ble_gap_upd_params *peer_params;
+      struct ble_gap_upd_params *self_params;
+      uint16_t conn_handle;
+    } conn_update_req;
+
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } term_failure;
+
+    struct {
+      int reason;
+    } disc_complete;
+
+    struct {
+      int reason;
+      uint16_t conn_handle;
+      uint8_t instance;
+      uint8_t num_ext_adv_events;
+    } adv_complete;
+
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } enc_change;
+
+    struct {
+      struct ble_gap_passkey_params params;
+      uint16_t conn_handle;
+    } passkey;
+
+    struct {
+      struct os_mbuf *om;
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t indication : 1;
+    } notify_rx;
+
+    struct {
+      int status;
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t indication : 1;
+    } notify_tx;
+
+    struct {
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t reason;
+      uint8_t prev_notify : 1;
+      uint8_t cur_notify : 1;
+      uint8_t prev_indicate : 1;
+      uint8_t cur_indicate : 1;
+    } subscribe;
+
+    struct {
+      uint16_t conn_handle;
+      uint16_t channel_id;
+      uint16_t value;
+    } mtu;
+
+    struct {
+      uint16_t conn_handle;
+    } identity_resolved;
+
+    struct {
+      uint16_t conn_handle;
+      uint8_t cur_key_size;
+      uint8_t cur_authenticated : 1;
+      uint8_t cur_sc : 1;
+      uint8_t new_key_size;
+      uint8_t new_authenticated : 1;
+      uint8_t new_sc : 1;
+      uint8_t new_bonding : 1;
+    } repeat_pairing;
+
+    struct {
+      uint8_t status;
+      uint16_t conn_handle;
+      uint8_t tx_phy;
+      uint8_t rx_phy;
+    } phy_updated;
+  };
+};
+
+typedef int ble_gap_event_fn(struct ble_gap_event *event, void *arg);
+
+struct ble_gap_event_listener {
+  ble_gap_event_fn *fn;
+  void *arg;
+  SLIST_ENTRY(ble_gap_event_listener) link;
+};
+
+int ble_gap_adv_active();
+int ble_gap_adv_stop();
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg);
+int ble_gap_adv_set_data(const uint8_t *data, int data_len);
+int ble_gap_adv_rsp_set_data(const uint8_t *data, int data_len);
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc);
+int ble_gap_conn_find_by_addr(const ble_addr_t *addr, struct ble_gap_conn_desc *out_desc);
+int ble_gap_conn_rssi(uint16_t conn_handle, int8_t *out_rssi);
+int ble_gap_disc(uint8_t own_addr_type, int32_t duration_ms, const struct ble_gap_disc_params *disc_params,
+                 ble_gap_event_fn *cb, void *cb_arg);
+int ble_gap_disc_active();
+int ble_gap_disc_cancel();
+int ble_gap_connect(uint8_t own_addr_type, const ble_addr_t *peer_addr, int32_t duration_ms,
+                    const struct ble_gap_conn_params *params, ble_gap_event_fn *cb, void *cb_arg);
+int ble_gap_conn_cancel();
+int ble_gap_event_listener_register(struct ble_gap_event_listener *listener, ble_gap_event_fn *fn, void *arg);
+int ble_gap_read_le_phy(uint16_t conn_handle, uint8_t *tx_phy, uint8_t *rx_phy);
+int ble_gap_security_initiate(uint16_t conn_handle);
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time);
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts);
+int ble_gap_set_prefered_default_le_phy(uint8_t tx_phys_mask, uint8_t rx_phys_mask);
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason);
+int ble_gap_unpair(const ble_addr_t *peer_addr);
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params);
+int ble_gap_wl_set(const ble_addr_t *addrs, uint8_t white_list_count);
+
+/********************************* host/ble_gatt.h ********************************/
+
+#define BLE_GATT_ACCESS_OP_READ_CHR 0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR 1
+#define BLE_GATT_ACCESS_OP_READ_DSC 2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC 3
+
+#define BLE_GATT_CHR_F_BROADCAST 0x0001
+#define BLE_GATT_CHR_F_READ 0x0002
+#define BLE_GATT_CHR_F_WRITE_NO_RSP 0x0004
+#define BLE_GATT_CHR_F_WRITE 0x0008
+#define BLE_GATT_CHR_F_NOTIFY 0x0010
+#define BLE_GATT_CHR_F_INDICATE 0x0020
+#define BLE_GATT_CHR_F_AUTH_SIGN_WRITE 0x0040
+#define BLE_GATT_CHR_F_RELIABLE_WRITE 0x0080
+#define BLE_GATT_CHR_F_AUX_WRITE 0x0100
+#define BLE_GATT_CHR_F_READ_ENC 0x0200
+#define BLE_GATT_CHR_F_READ_AUTHEN 0x0400
+#define BLE_GATT_CHR_F_READ_AUTHOR 0x0800
+#define BLE_GATT_CHR_F_WRITE_ENC 0x1000
+#define BLE_GATT_CHR_F_WRITE_AUTHEN 0x2000
+#define BLE_GATT_CHR_F_WRITE_AUTHOR 0x4000
+
+#define BLE_GATT_CHR_PROP_BROADCAST 0x01
+#define BLE_GATT_CHR_PROP_READ 0x02
+#define BLE_GATT_CHR_PROP_WRITE_NO_RSP 0x04
+#define BLE_GATT_CHR_PROP_WRITE 0x08
+#define BLE_GATT_CHR_PROP_NOTIFY 0x10
+#define BLE_GATT_CHR_PROP_INDICATE 0x20
+#define BLE_GATT_CHR_PROP_AUTH_SIGN_WRITE 0x40
+#define BLE_GATT_CHR_PROP_EXTENDED 0x80
+
+#define BLE_GATT_SVC_TYPE_END 0
+#define BLE_GATT_SVC_TYPE_PRIMARY 1
+#define BLE_GATT_SVC_TYPE_SECONDARY 2
+
+#define BLE_GATT_READ_MAX_ATTRS 8
+
+typedef uint16_t ble_gatt_chr_flags;
+
+struct ble_gatt_access_ctxt;
+typedef int ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+struct ble_gatt_dsc_def {
+  const ble_uuid_t *uuid;
+  uint8_t att_flags;
+  uint8_t min_key_size;
+  ble_gatt_access_fn *access_cb;
+  void *arg;
+};
+
+struct ble_gatt_chr_def {
+  const ble_uuid_t *uuid;
+  ble_gatt_access_fn *access_cb;
+  void *arg;
+  struct ble_gatt_dsc_def *descriptors;
+  ble_gatt_chr_flags flags;
+  uint8_t min_key_size;
+  uint16_t *val_handle;
+};
+
+struct ble_gatt_svc_def {
+  uint8_t type;
+  const ble_uuid_t *uuid;
+  const struct ble_gatt_svc_def **includes;
+  const struct ble_gatt_chr_def *characteristics;
+};
+
+struct ble_gatt_access_ctxt {
+  uint8_t op;
+  struct os_mbuf *om;
+  union {
+    const struct ble_gatt_chr_def *chr;
+    const struct ble_gatt_dsc_def *dsc;
+  };
+};
+
+struct ble_gatt_error {
+  uint16_t status;
+  uint16_t att_handle;
+};
+
+struct ble_gatt_attr {
+  uint16_t handle;
+  uint16_t offset;
+  struct os_mbuf *om;
+};
+
+struct ble_gatt_svc {
+  uint16_t start_handle;
+  uint16_t end_handle;
+  ble_uuid_any_t uuid;
+};
+
+struct ble_gatt_chr {
+  uint16_t def_handle;
+  uint16_t val_handle;
+  uint8_t properties;
+  ble_uuid_any_t uuid;
+};
+
+struct ble_gatt_dsc {
+  uint16_t handle;
+  ble_uuid_any_t uuid;
+};
+
+typedef int ble_gatt_mtu_fn(uint16_t conn_handle, const struct ble_gatt_error *error, uint16_t mtu, void *arg);
+typedef int ble_gatt_disc_svc_fn(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_svc *service, void *arg);
+typedef int ble_gatt_chr_fn(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_chr *chr, void *arg);
+typedef int ble_gatt_dsc_fn(uint16_t conn_handle, const struct ble_gatt_error *error, uint16_t chr_val_handle,
+                            const struct ble_gatt_dsc *dsc, void *arg);
+typedef int ble_gatt_attr_fn(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attr, void *arg);
+typedef int ble_gatt_attr_mult_fn(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attrs,
+                                  uint8_t num_attrs, void *arg);
+
+int ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg);
+int ble_gattc_disc_all_svcs(uint16_t conn_handle, ble_gatt_disc_svc_fn *cb, void *cb_arg);
+int ble_gattc_disc_svc_by_uuid(uint16_t conn_handle, const ble_uuid_t *uuid, ble_gatt_disc_svc_fn *cb, void *cb_arg);
+int ble_gattc_disc_all_chrs(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, ble_gatt_chr_fn *cb, void *cb_arg);
+int ble_gattc_disc_chrs_by_uuid(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, const ble_uuid_t *uuid,
+                                ble_gatt_chr_fn *cb, void *cb_arg);
+int ble_gattc_disc_all_dscs(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, ble_gatt_dsc_fn *cb, void *cb_arg);
+int ble_gattc_read(uint16_t conn_handle, uint16_t attr_handle, ble_gatt_attr_fn *cb, void *cb_arg);
+int ble_gattc_read_long(uint16_t conn_handle, uint16_t handle, uint16_t offset, ble_gatt_attr_fn *cb, void *cb_arg);
+int ble_gattc_read_mult(uint16_t conn_handle, const uint16_t *handles, uint8_t num_handles, ble_gatt_attr_fn *cb, void *cb_arg);
+int ble_gattc_write_no_rsp_flat(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t data_len);
+int ble_gattc_write_flat(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t data_len, ble_gatt_attr_fn *cb,
+                         void *cb_arg);
+int ble_gattc_write_long(uint16_t conn_handle, uint16_t attr_handle, uint16_t offset, struct os_mbuf *om, ble_gatt_attr_fn *cb,
+                         void *cb_arg);
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om);
+int ble_gattc_indicate_custom(uint16_t conn_handle, uint16_t chr_val_handle, struct os_mbuf *txom);
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs);
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs);
+int ble_gatts_find_chr(const ble_uuid_t *svc_uuid, const ble_uuid_t *chr_uuid, uint16_t *out_def_handle, uint16_t *out_val_handle);
+int ble_gatts_find_svc(const ble_uuid_t *uuid, uint16_t *out_handle);
+int ble_gatts_reset();
+void ble_gatts_show_local();
+int ble_gatts_start();
+int ble_gatts_svc_set_visibility(uint16_t handle, int visible);
+
+/******************************** host/ble_sm.h ***********************************/
+
+#define BLE_SM_IOACT_NONE 0
+#define BLE_SM_IOACT_OOB 1
+#define BLE_SM_IOACT_INPUT 2
+#define BLE_SM_IOACT_DISP 3
+#define BLE_SM_IOACT_NUMCMP 4
+
+#define BLE_SM_PAIR_AUTHREQ_BOND 0x01
+#define BLE_SM_PAIR_AUTHREQ_MITM 0x04
+#define BLE_SM_PAIR_AUTHREQ_SC 0x08
+#define BLE_SM_PAIR_AUTHREQ_KEYPRESS 0x10
+
+#define BLE_SM_PAIR_KEY_DIST_ENC 0x01
+#define BLE_SM_PAIR_KEY_DIST_ID 0x02
+#define BLE_SM_PAIR_KEY_DIST_SIGN 0x04
+#define BLE_SM_PAIR_KEY_DIST_LINK 0x08
+
+#define BLE_SM_ERR_PASSKEY 0x01
+#define BLE_SM_ERR_OOB 0x02
+#define BLE_SM_ERR_AUTHREQ 0x03
+#define BLE_SM_ERR_CONFIRM_MISMATCH 0x04
+#define BLE_SM_ERR_PAIR_NOT_SUPP 0x05
+#define BLE_SM_ERR_ENC_KEY_SZ 0x06
+#define BLE_SM_ERR_CMD_NOT_SUPP 0x07
+#define BLE_SM_ERR_UNSPECIFIED 0x08
+#define BLE_SM_ERR_REPEATED 0x09
+#define BLE_SM_ERR_INVAL 0x0a
+#define BLE_SM_ERR_DHKEY 0x0b
+#define BLE_SM_ERR_NUMCMP 0x0c
+#define BLE_SM_ERR_ALREADY 0x0d
+#define BLE_SM_ERR_CROSS_TRANS 0x0e
+
+struct ble_sm_io {
+  uint8_t action;
+  union {
+    uint32_t passkey;
+    uint8_t oob[16];
+    uint8_t numcmp_accept;
+  };
+};
+
+int ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io *pkey);
+
+/******************************** host/ble_store.h ********************************/
+
+int ble_store_clear();
+int ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers, int max_peers);
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg);
+void ble_store_config_init();
+
+/***************************** services/gap, services/gatt *************************/
+
+const char *ble_svc_gap_device_name();
+int ble_svc_gap_device_name_set(const char *name);
+void ble_svc_gap_init();
+void ble_svc_gatt_init();
+void ble_svc_gatt_changed(uint16_t start_handle, uint16_t end_handle);
+
+#ifdef __cplusplus
+}
+#endif
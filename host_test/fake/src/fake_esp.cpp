@@ -0,0 +1,403 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * ESP-IDF and FreeRTOS on top of the C++ standard library.
+ * Tasks are threads, a tick is a millisecond, queues and semaphores are a deque guarded by a mutex.
+ */
+
+#include "fake_esp.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FakeTask {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifyValue = 0;
+};
+
+struct FakeQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+};
+
+namespace {
+
+/** Thrown by vTaskDelete(nullptr) to unwind the thread of the calling task. */
+struct TaskExit {};
+
+struct TaskStart {
+  TaskFunction_t fn;
+  void *param;
+  FakeTask *task;
+};
+
+thread_local FakeTask *t_currentTask = nullptr;
+
+esp_log_level_t s_logLevel = ESP_LOG_WARN;
+
+std::map<std::string, std::vector<uint8_t>> s_nvs;
+std::mutex s_nvsMutex;
+
+const auto s_start = std::chrono::steady_clock::now();
+
+/**
+ * @brief Wait on a condition for up to the given number of ticks.
+ * @return True if the condition became true.
+ */
+bool waitFor(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, const std::function<bool()> &ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}// waitFor
+
+}// namespace
+
+/******************************** esp_err.h ********************************/
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  default:
+    return "ESP_FAIL";
+  }
+}// esp_err_to_name
+
+/******************************** esp_log.h ********************************/
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+  (void) tag;
+  return s_logLevel;
+}// esp_log_level_get
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  (void) tag;
+  s_logLevel = level;
+}// esp_log_level_set
+
+uint32_t esp_log_timestamp() {
+  return (uint32_t) (esp_timer_get_time() / 1000);
+}// esp_log_timestamp
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+  if (level > esp_log_level_get(tag)) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}// esp_log_write
+
+/***************************** esp_timer.h ******************************/
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - s_start).count();
+}// esp_timer_get_time
+
+/**************************** esp_heap_caps.h *****************************/
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  (void) caps;
+  return malloc(size);
+}// heap_caps_malloc
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps) {
+  (void) caps;
+  return realloc(ptr, size);
+}// heap_caps_realloc
+
+void heap_caps_free(void *ptr) {
+  free(ptr);
+}// heap_caps_free
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  (void) caps;
+  return 256 * 1024;
+}// heap_caps_get_free_size
+
+/***************************** esp_rom_crc.h ******************************/
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}// esp_rom_crc32_le
+
+/******************************** esp_bt.h ********************************/
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode) {
+  (void) mode;
+  return ESP_OK;
+}// esp_bt_controller_mem_release
+
+esp_err_t esp_ble_tx_power_set(esp_ble_power_type_t power_type, esp_power_level_t power_level) {
+  (void) power_type;
+  (void) power_level;
+  return ESP_OK;
+}// esp_ble_tx_power_set
+
+esp_power_level_t esp_ble_tx_power_get(esp_ble_power_type_t power_type) {
+  (void) power_type;
+  return ESP_PWR_LVL_P3;
+}// esp_ble_tx_power_get
+
+/********************************* nvs.h **********************************/
+
+esp_err_t nvs_flash_init() {
+  return ESP_OK;
+}// nvs_flash_init
+
+esp_err_t nvs_flash_erase() {
+  std::lock_guard<std::mutex> lock(s_nvsMutex);
+  s_nvs.clear();
+  return ESP_OK;
+}// nvs_flash_erase
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+  (void) name;
+  (void) open_mode;
+  *out_handle = 1;
+  return ESP_OK;
+}// nvs_open
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+  (void) handle;
+  std::lock_guard<std::mutex> lock(s_nvsMutex);
+  auto it = s_nvs.find(key);
+  if (it == s_nvs.end()) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  if (out_value != nullptr) {
+    if (*length < it->second.size()) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(out_value, it->second.data(), it->second.size());
+  }
+
+  *length = it->second.size();
+  return ESP_OK;
+}// nvs_get_blob
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+  (void) handle;
+  std::lock_guard<std::mutex> lock(s_nvsMutex);
+  auto bytes = static_cast<const uint8_t *>(value);
+  s_nvs[key].assign(bytes, bytes + length);
+  return ESP_OK;
+}// nvs_set_blob
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+  (void) handle;
+  std::lock_guard<std::mutex> lock(s_nvsMutex);
+  return s_nvs.erase(key) != 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}// nvs_erase_key
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+  (void) handle;
+  return nvs_flash_erase();
+}// nvs_erase_all
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+  (void) handle;
+  return ESP_OK;
+}// nvs_commit
+
+void nvs_close(nvs_handle_t handle) {
+  (void) handle;
+}// nvs_close
+
+/******************************* FreeRTOS ********************************/
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth, void *pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask, BaseType_t xCoreID) {
+  (void) pcName;
+  (void) usStackDepth;
+  (void) uxPriority;
+  (void) xCoreID;
+
+  // Tasks are never joined, like a FreeRTOS task they live until they delete themselves.
+  auto pTask = new FakeTask();
+  if (pvCreatedTask != nullptr) {
+    *pvCreatedTask = pTask;
+  }
+
+  TaskStart start{pvTaskCode, pvParameters, pTask};
+  std::thread([start]() {
+    t_currentTask = start.task;
+    try {
+      start.fn(start.param);
+    } catch (const TaskExit &) {
+    }
+  }).detach();
+
+  return pdPASS;
+}// xTaskCreatePinnedToCore
+
+void vTaskDelete(TaskHandle_t xTask) {
+  if (xTask == nullptr || xTask == t_currentTask) {
+    throw TaskExit();
+  }
+}// vTaskDelete
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay));
+}// vTaskDelay
+
+void vPortYield() {
+  std::this_thread::yield();
+}// vPortYield
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  // Threads not created by xTaskCreatePinnedToCore, the main thread of a bench, get a task on first use.
+  if (t_currentTask == nullptr) {
+    t_currentTask = new FakeTask();
+  }
+  return t_currentTask;
+}// xTaskGetCurrentTaskHandle
+
+BaseType_t xPortGetCoreID() {
+  return 0;
+}// xPortGetCoreID
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t) (esp_timer_get_time() / 1000);
+}// xTaskGetTickCount
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  FakeTask *pTask = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(pTask->mutex);
+  waitFor(pTask->cv, lock, xTicksToWait, [pTask]() { return pTask->notifyValue != 0; });
+
+  uint32_t value = pTask->notifyValue;
+  if (value != 0) {
+    pTask->notifyValue = xClearCountOnExit ? 0 : value - 1;
+  }
+  return value;
+}// ulTaskNotifyTake
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  {
+    std::lock_guard<std::mutex> lock(xTaskToNotify->mutex);
+    xTaskToNotify->notifyValue++;
+  }
+  xTaskToNotify->cv.notify_all();
+  return pdPASS;
+}// xTaskNotifyGive
+
+uint32_t ulTaskNotifyValueClear(TaskHandle_t xTask, uint32_t ulBitsToClear) {
+  FakeTask *pTask = xTask != nullptr ? xTask : xTaskGetCurrentTaskHandle();
+  std::lock_guard<std::mutex> lock(pTask->mutex);
+  uint32_t value = pTask->notifyValue;
+  pTask->notifyValue &= ~ulBitsToClear;
+  return value;
+}// ulTaskNotifyValueClear
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+  auto pQueue = new FakeQueue();
+  pQueue->length = uxQueueLength;
+  pQueue->itemSize = uxItemSize;
+  return pQueue;
+}// xQueueCreate
+
+void vQueueDelete(QueueHandle_t xQueue) {
+  delete xQueue;
+}// vQueueDelete
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+  std::unique_lock<std::mutex> lock(xQueue->mutex);
+  if (!waitFor(xQueue->cv, lock, xTicksToWait, [xQueue]() { return xQueue->items.size() < xQueue->length; })) {
+    return pdFAIL;
+  }
+
+  auto bytes = static_cast<const uint8_t *>(pvItemToQueue);
+  xQueue->items.emplace_back(bytes, bytes + xQueue->itemSize);
+  lock.unlock();
+  xQueue->cv.notify_all();
+  return pdPASS;
+}// xQueueSend
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+  std::unique_lock<std::mutex> lock(xQueue->mutex);
+  if (!waitFor(xQueue->cv, lock, xTicksToWait, [xQueue]() { return !xQueue->items.empty(); })) {
+    return pdFAIL;
+  }
+
+  if (xQueue->itemSize > 0) {
+    memcpy(pvBuffer, xQueue->items.front().data(), xQueue->itemSize);
+  }
+  xQueue->items.pop_front();
+  lock.unlock();
+  xQueue->cv.notify_all();
+  return pdPASS;
+}// xQueueReceive
+
+BaseType_t xQueueReset(QueueHandle_t xQueue) {
+  {
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    xQueue->items.clear();
+  }
+  xQueue->cv.notify_all();
+  return pdPASS;
+}// xQueueReset
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+  // A counting semaphore is a queue of empty items, the count is the number of items.
+  QueueHandle_t xQueue = xQueueCreate(uxMaxCount, 0);
+  for (UBaseType_t i = 0; i < uxInitialCount; i++) {
+    xQueue->items.emplace_back();
+  }
+  return xQueue;
+}// xSemaphoreCreateCounting
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+  return xQueueReceive(xSemaphore, nullptr, xBlockTime);
+}// xSemaphoreTake
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+  return xQueueSend(xSemaphore, nullptr, 0);
+}// xSemaphoreGive
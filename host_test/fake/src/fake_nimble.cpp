@@ -0,0 +1,1087 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * The NimBLE host as seen by the library, without a controller behind it.
+ * Connections exist when a bench adds them with fake::addConnection(), notifications are counted and freed,
+ * GATT registration assigns handles the way ble_gatts_start() does. Client procedures fail with
+ * BLE_HS_ENOTCONN, there is no peer to run them against, and callouts are armed but never fire.
+ */
+
+#include "fake_control.h"
+#include "fake_nimble.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ble_hs_cfg ble_hs_cfg;
+
+namespace {
+
+/** The data room of a fake mbuf, one ATT packet of the largest MTU with room for the headers. */
+constexpr uint16_t MBUF_DATA_SIZE = BLE_ATT_MTU_MAX + 16;
+
+/** os_mbuf_append() error, OS_ENOMEM of the NimBLE porting layer. */
+constexpr int OS_ENOMEM = 1;
+
+std::recursive_mutex s_critical;
+
+std::mutex s_mutex;
+std::map<uint16_t, ble_gap_conn_desc> s_connections;
+std::map<uint16_t, uint16_t> s_mtus;
+
+std::atomic<size_t> s_notifyCount{0};
+std::atomic<size_t> s_indicateCount{0};
+std::atomic<size_t> s_notifyBytes{0};
+std::atomic<int> s_mbufsInUse{0};
+
+std::atomic<bool> s_discActive{false};
+std::atomic<bool> s_advActive{false};
+ble_gap_event_fn *s_discCb = nullptr;
+void *s_discArg = nullptr;
+ble_gap_event_fn *s_advCb = nullptr;
+void *s_advArg = nullptr;
+uint16_t s_preferredMtu = 256;
+std::string s_deviceName = "nimble";
+
+struct RegisteredAttr {
+  ble_uuid_any_t svcUuid;
+  ble_uuid_any_t chrUuid;
+  uint16_t defHandle;
+  uint16_t valHandle;
+};
+
+std::vector<const ble_gatt_svc_def *> s_pendingSvcs;
+std::vector<RegisteredAttr> s_svcs;
+std::vector<RegisteredAttr> s_chrs;
+
+// Never destroyed, the host task still waits on them when the process exits and destroying a waited
+// condition variable blocks in glibc.
+std::mutex &s_hostMutex = *new std::mutex;
+std::condition_variable &s_hostCv = *new std::condition_variable;
+bool s_hostRunning = false;
+bool s_synced = false;
+
+struct ble_npl_eventq s_dfltEventq;
+
+const uint8_t OWN_ADDRESS[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+
+/**
+ * @brief Copy a NimBLE uuid into a value that outlives the definition it came from.
+ */
+ble_uuid_any_t copyUuid(const ble_uuid_t *uuid) {
+  ble_uuid_any_t copy{};
+  switch (uuid->type) {
+  case BLE_UUID_TYPE_16:
+    copy.u16 = *BLE_UUID16(uuid);
+    break;
+  case BLE_UUID_TYPE_32:
+    copy.u32 = *BLE_UUID32(uuid);
+    break;
+  default:
+    copy.u128 = *BLE_UUID128(uuid);
+    break;
+  }
+  return copy;
+}// copyUuid
+
+/**
+ * @brief Append one AD structure to an advertising payload.
+ * @return 0 or BLE_HS_EMSGSIZE when it does not fit.
+ */
+int putField(uint8_t type, const void *data, size_t len, uint8_t *dst, uint8_t *dst_len, uint8_t max_len) {
+  if (*dst_len + 2 + len > max_len) {
+    return BLE_HS_EMSGSIZE;
+  }
+
+  dst[(*dst_len)++] = (uint8_t) (len + 1);
+  dst[(*dst_len)++] = type;
+  if (len > 0) {
+    memcpy(dst + *dst_len, data, len);
+  }
+  *dst_len += len;
+  return 0;
+}// putField
+
+}// namespace
+
+/*********************************** fake control ***********************************/
+
+namespace fake {
+
+void addConnection(uint16_t connHandle, const ble_addr_t &peer, uint16_t mtu, bool encrypted) {
+  ble_gap_conn_desc desc{};
+  desc.conn_handle = connHandle;
+  desc.peer_id_addr = peer;
+  desc.peer_ota_addr = peer;
+  desc.our_id_addr.type = BLE_ADDR_PUBLIC;
+  memcpy(desc.our_id_addr.val, OWN_ADDRESS, sizeof(OWN_ADDRESS));
+  desc.our_ota_addr = desc.our_id_addr;
+  desc.conn_itvl = BLE_GAP_INITIAL_CONN_ITVL_MIN;
+  desc.supervision_timeout = BLE_GAP_INITIAL_SUPERVISION_TIMEOUT;
+  desc.role = BLE_GAP_ROLE_SLAVE;
+  desc.sec_state.encrypted = encrypted;
+
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_connections[connHandle] = desc;
+  s_mtus[connHandle] = mtu;
+}// addConnection
+
+void removeConnection(uint16_t connHandle) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_connections.erase(connHandle);
+  s_mtus.erase(connHandle);
+}// removeConnection
+
+int sendDiscEvent(ble_gap_event &event) {
+  if (s_discCb == nullptr) {
+    return BLE_HS_EALREADY;
+  }
+  return s_discCb(&event, s_discArg);
+}// sendDiscEvent
+
+int sendAdvEvent(ble_gap_event &event) {
+  if (s_advCb == nullptr) {
+    return BLE_HS_EALREADY;
+  }
+  return s_advCb(&event, s_advArg);
+}// sendAdvEvent
+
+void reset() {
+  {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_connections.clear();
+    s_mtus.clear();
+  }
+  s_notifyCount = 0;
+  s_indicateCount = 0;
+  s_notifyBytes = 0;
+}// reset
+
+size_t notifyCount() {
+  return s_notifyCount;
+}// notifyCount
+
+size_t indicateCount() {
+  return s_indicateCount;
+}// indicateCount
+
+size_t notifyBytes() {
+  return s_notifyBytes;
+}// notifyBytes
+
+int mbufsInUse() {
+  return s_mbufsInUse;
+}// mbufsInUse
+
+}// namespace fake
+
+/********************************** nimble/ble.h **********************************/
+
+int ble_addr_cmp(const ble_addr_t *a, const ble_addr_t *b) {
+  int type_diff = a->type - b->type;
+  if (type_diff != 0) {
+    return type_diff;
+  }
+  return memcmp(a->val, b->val, sizeof(a->val));
+}// ble_addr_cmp
+
+/******************************** host/ble_uuid.h *********************************/
+
+int ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2) {
+  if (uuid1->type != uuid2->type) {
+    return uuid1->type - uuid2->type;
+  }
+
+  switch (uuid1->type) {
+  case BLE_UUID_TYPE_16:
+    return (int) BLE_UUID16(uuid1)->value - (int) BLE_UUID16(uuid2)->value;
+  case BLE_UUID_TYPE_32:
+    return BLE_UUID32(uuid1)->value == BLE_UUID32(uuid2)->value ? 0 : (BLE_UUID32(uuid1)->value < BLE_UUID32(uuid2)->value ? -1 : 1);
+  default:
+    return memcmp(BLE_UUID128(uuid1)->value, BLE_UUID128(uuid2)->value, 16);
+  }
+}// ble_uuid_cmp
+
+int ble_uuid_init_from_buf(ble_uuid_any_t *uuid, const void *buf, size_t len) {
+  auto bytes = static_cast<const uint8_t *>(buf);
+  switch (len) {
+  case 2:
+    uuid->u.type = BLE_UUID_TYPE_16;
+    uuid->u16.value = (uint16_t) (bytes[0] | bytes[1] << 8);
+    return 0;
+  case 4:
+    uuid->u.type = BLE_UUID_TYPE_32;
+    uuid->u32.value = (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+    return 0;
+  case 16:
+    uuid->u.type = BLE_UUID_TYPE_128;
+    memcpy(uuid->u128.value, bytes, 16);
+    return 0;
+  default:
+    return BLE_HS_EINVAL;
+  }
+}// ble_uuid_init_from_buf
+
+char *ble_uuid_to_str(const ble_uuid_t *uuid, char *dst) {
+  switch (uuid->type) {
+  case BLE_UUID_TYPE_16:
+    snprintf(dst, BLE_UUID_STR_LEN, "0x%04x", BLE_UUID16(uuid)->value);
+    break;
+  case BLE_UUID_TYPE_32:
+    snprintf(dst, BLE_UUID_STR_LEN, "0x%08" PRIx32, BLE_UUID32(uuid)->value);
+    break;
+  default: {
+    const uint8_t *u8p = BLE_UUID128(uuid)->value;
+    snprintf(dst, BLE_UUID_STR_LEN, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             u8p[15], u8p[14], u8p[13], u8p[12], u8p[11], u8p[10], u8p[9], u8p[8],
+             u8p[7], u8p[6], u8p[5], u8p[4], u8p[3], u8p[2], u8p[1], u8p[0]);
+    break;
+  }
+  }
+  return dst;
+}// ble_uuid_to_str
+
+uint16_t ble_uuid_u16(const ble_uuid_t *uuid) {
+  return uuid->type == BLE_UUID_TYPE_16 ? BLE_UUID16(uuid)->value : 0;
+}// ble_uuid_u16
+
+/********************************** os/os_mbuf.h **********************************/
+
+struct os_mbuf *os_mbuf_get_pkthdr(struct os_mbuf_pool *omp, uint8_t pkthdr_len) {
+  (void) pkthdr_len;
+
+  // A single segment with the packet header in front of the data, chains are not needed by the library.
+  auto om = static_cast<os_mbuf *>(malloc(sizeof(os_mbuf) + sizeof(os_mbuf_pkthdr) + MBUF_DATA_SIZE));
+  if (om == nullptr) {
+    return nullptr;
+  }
+
+  memset(om, 0, sizeof(os_mbuf) + sizeof(os_mbuf_pkthdr));
+  om->om_pkthdr_len = sizeof(os_mbuf_pkthdr);
+  om->om_data = om->om_databuf + om->om_pkthdr_len;
+  om->om_omp = omp;
+  s_mbufsInUse++;
+  return om;
+}// os_mbuf_get_pkthdr
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+  if (om->om_len + len > MBUF_DATA_SIZE) {
+    return OS_ENOMEM;
+  }
+
+  memcpy(om->om_data + om->om_len, data, len);
+  om->om_len += len;
+  OS_MBUF_PKTLEN(om) += len;
+  return 0;
+}// os_mbuf_append
+
+int os_mbuf_copydata(const struct os_mbuf *m, int off, int len, void *dst) {
+  if (off < 0 || len < 0 || off + len > m->om_len) {
+    return -1;
+  }
+
+  memcpy(dst, m->om_data + off, len);
+  return 0;
+}// os_mbuf_copydata
+
+int os_mbuf_free_chain(struct os_mbuf *om) {
+  if (om != nullptr) {
+    free(om);
+    s_mbufsInUse--;
+  }
+  return 0;
+}// os_mbuf_free_chain
+
+int os_mbuf_pool_init(struct os_mbuf_pool *omp, struct os_mempool *mp, uint16_t buf_len, uint16_t nbufs) {
+  (void) nbufs;
+  omp->omp_databuf_len = buf_len;
+  omp->omp_pool = mp;
+  return 0;
+}// os_mbuf_pool_init
+
+int os_mempool_init(struct os_mempool *mp, uint16_t blocks, uint32_t block_size, void *membuf, const char *name) {
+  (void) membuf;
+  (void) name;
+  mp->mp_block_size = block_size;
+  mp->mp_num_blocks = blocks;
+  return 0;
+}// os_mempool_init
+
+int os_msys_num_free() {
+  return 64;
+}// os_msys_num_free
+
+/******************************* nimble/nimble_npl.h ******************************/
+
+uint32_t ble_npl_hw_enter_critical() {
+  s_critical.lock();
+  return 0;
+}// ble_npl_hw_enter_critical
+
+void ble_npl_hw_exit_critical(uint32_t ctx) {
+  (void) ctx;
+  s_critical.unlock();
+}// ble_npl_hw_exit_critical
+
+ble_npl_time_t ble_npl_time_get() {
+  return xTaskGetTickCount();
+}// ble_npl_time_get
+
+ble_npl_error_t ble_npl_time_ms_to_ticks(uint32_t ms, ble_npl_time_t *out_ticks) {
+  *out_ticks = ms;
+  return BLE_NPL_OK;
+}// ble_npl_time_ms_to_ticks
+
+ble_npl_time_t ble_npl_time_ms_to_ticks32(uint32_t ms) {
+  return ms;
+}// ble_npl_time_ms_to_ticks32
+
+uint32_t ble_npl_time_ticks_to_ms32(ble_npl_time_t ticks) {
+  return ticks;
+}// ble_npl_time_ticks_to_ms32
+
+void ble_npl_time_delay(ble_npl_time_t ticks) {
+  vTaskDelay(ticks);
+}// ble_npl_time_delay
+
+void ble_npl_callout_init(struct ble_npl_callout *co, struct ble_npl_eventq *evq, ble_npl_event_fn *ev_cb, void *ev_arg) {
+  memset(co, 0, sizeof(*co));
+  co->ev.fn = ev_cb;
+  co->ev.arg = ev_arg;
+  co->evq = evq;
+}// ble_npl_callout_init
+
+ble_npl_error_t ble_npl_callout_reset(struct ble_npl_callout *co, ble_npl_time_t ticks) {
+  co->ticks = ticks;
+  co->active = true;
+  return BLE_NPL_OK;
+}// ble_npl_callout_reset
+
+void ble_npl_callout_stop(struct ble_npl_callout *co) {
+  co->active = false;
+}// ble_npl_callout_stop
+
+bool ble_npl_callout_is_active(struct ble_npl_callout *co) {
+  return co->active;
+}// ble_npl_callout_is_active
+
+void ble_npl_callout_deinit(struct ble_npl_callout *co) {
+  co->active = false;
+}// ble_npl_callout_deinit
+
+void *ble_npl_event_get_arg(struct ble_npl_event *ev) {
+  return ev->arg;
+}// ble_npl_event_get_arg
+
+/******************************* nimble/nimble_port.h *****************************/
+
+esp_err_t nimble_port_init() {
+  return ESP_OK;
+}// nimble_port_init
+
+int nimble_port_deinit() {
+  return 0;
+}// nimble_port_deinit
+
+void nimble_port_run() {
+  // The host syncs as soon as it runs, there is no controller to wait for.
+  {
+    std::lock_guard<std::mutex> lock(s_hostMutex);
+    s_hostRunning = true;
+    s_synced = true;
+  }
+
+  if (ble_hs_cfg.sync_cb != nullptr) {
+    ble_hs_cfg.sync_cb();
+  }
+
+  std::unique_lock<std::mutex> lock(s_hostMutex);
+  s_hostCv.wait(lock, []() { return !s_hostRunning; });
+}// nimble_port_run
+
+int nimble_port_stop() {
+  {
+    std::lock_guard<std::mutex> lock(s_hostMutex);
+    s_hostRunning = false;
+    s_synced = false;
+  }
+  s_hostCv.notify_all();
+  return 0;
+}// nimble_port_stop
+
+struct ble_npl_eventq *nimble_port_get_dflt_eventq() {
+  return &s_dfltEventq;
+}// nimble_port_get_dflt_eventq
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn) {
+  xTaskCreatePinnedToCore(host_task_fn, "nimble_host", 4096, nullptr, configMAX_PRIORITIES - 4, nullptr, 0);
+}// nimble_port_freertos_init
+
+void nimble_port_freertos_deinit() {}
+
+/********************************** host/ble_hs.h *********************************/
+
+int ble_hs_adv_set_fields(const struct ble_hs_adv_fields *adv_fields, uint8_t *dst, uint8_t *dst_len, uint8_t max_len) {
+  *dst_len = 0;
+  int rc = 0;
+
+  if (adv_fields->flags != 0) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_FLAGS, &adv_fields->flags, 1, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->num_uuids16 > 0) {
+    uint8_t buf[BLE_HS_ADV_MAX_SZ];
+    size_t len = 0;
+    for (uint8_t i = 0; i < adv_fields->num_uuids16 && len + 2 <= sizeof(buf); i++) {
+      buf[len++] = (uint8_t) adv_fields->uuids16[i].value;
+      buf[len++] = (uint8_t) (adv_fields->uuids16[i].value >> 8);
+    }
+    uint8_t type = adv_fields->uuids16_is_complete ? BLE_HS_ADV_TYPE_COMP_UUIDS16 : BLE_HS_ADV_TYPE_INCOMP_UUIDS16;
+    rc = rc ?: putField(type, buf, len, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->num_uuids32 > 0) {
+    uint8_t buf[BLE_HS_ADV_MAX_SZ];
+    size_t len = 0;
+    for (uint8_t i = 0; i < adv_fields->num_uuids32 && len + 4 <= sizeof(buf); i++) {
+      memcpy(buf + len, &adv_fields->uuids32[i].value, 4);
+      len += 4;
+    }
+    uint8_t type = adv_fields->uuids32_is_complete ? BLE_HS_ADV_TYPE_COMP_UUIDS32 : BLE_HS_ADV_TYPE_INCOMP_UUIDS32;
+    rc = rc ?: putField(type, buf, len, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->num_uuids128 > 0) {
+    uint8_t buf[BLE_HS_ADV_MAX_SZ];
+    size_t len = 0;
+    for (uint8_t i = 0; i < adv_fields->num_uuids128 && len + 16 <= sizeof(buf); i++) {
+      memcpy(buf + len, adv_fields->uuids128[i].value, 16);
+      len += 16;
+    }
+    uint8_t type = adv_fields->uuids128_is_complete ? BLE_HS_ADV_TYPE_COMP_UUIDS128 : BLE_HS_ADV_TYPE_INCOMP_UUIDS128;
+    rc = rc ?: putField(type, buf, len, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->name != nullptr) {
+    uint8_t type = adv_fields->name_is_complete ? BLE_HS_ADV_TYPE_COMP_NAME : BLE_HS_ADV_TYPE_INCOMP_NAME;
+    rc = rc ?: putField(type, adv_fields->name, adv_fields->name_len, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->tx_pwr_lvl_is_present) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_TX_PWR_LVL, &adv_fields->tx_pwr_lvl, 1, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->slave_itvl_range != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE, adv_fields->slave_itvl_range, BLE_HS_ADV_SLAVE_ITVL_RANGE_LEN, dst, dst_len,
+                        max_len);
+  }
+
+  if (adv_fields->svc_data_uuid16 != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_SVC_DATA_UUID16, adv_fields->svc_data_uuid16, adv_fields->svc_data_uuid16_len, dst, dst_len,
+                        max_len);
+  }
+
+  if (adv_fields->public_tgt_addr != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_PUBLIC_TGT_ADDR, adv_fields->public_tgt_addr,
+                        adv_fields->num_public_tgt_addrs * BLE_HS_ADV_PUBLIC_TGT_ADDR_ENTRY_LEN, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->appearance_is_present) {
+    uint8_t buf[2] = {(uint8_t) adv_fields->appearance, (uint8_t) (adv_fields->appearance >> 8)};
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_APPEARANCE, buf, sizeof(buf), dst, dst_len, max_len);
+  }
+
+  if (adv_fields->adv_itvl_is_present) {
+    uint8_t buf[2] = {(uint8_t) adv_fields->adv_itvl, (uint8_t) (adv_fields->adv_itvl >> 8)};
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_ADV_ITVL, buf, sizeof(buf), dst, dst_len, max_len);
+  }
+
+  if (adv_fields->svc_data_uuid32 != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_SVC_DATA_UUID32, adv_fields->svc_data_uuid32, adv_fields->svc_data_uuid32_len, dst, dst_len,
+                        max_len);
+  }
+
+  if (adv_fields->svc_data_uuid128 != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_SVC_DATA_UUID128, adv_fields->svc_data_uuid128, adv_fields->svc_data_uuid128_len, dst,
+                        dst_len, max_len);
+  }
+
+  if (adv_fields->uri != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_URI, adv_fields->uri, adv_fields->uri_len, dst, dst_len, max_len);
+  }
+
+  if (adv_fields->mfg_data != nullptr) {
+    rc = rc ?: putField(BLE_HS_ADV_TYPE_MFG_DATA, adv_fields->mfg_data, adv_fields->mfg_data_len, dst, dst_len, max_len);
+  }
+
+  return rc;
+}// ble_hs_adv_set_fields
+
+int ble_hs_adv_parse(const uint8_t *data, uint8_t length, int (*func)(const struct ble_hs_adv_field *, void *), void *user_data) {
+  uint8_t offset = 0;
+  while (offset < length) {
+    auto field = reinterpret_cast<const ble_hs_adv_field *>(data + offset);
+    if (field->length == 0 || offset + field->length + 1 > length) {
+      return BLE_HS_EBADDATA;
+    }
+
+    int rc = func(field, user_data);
+    if (rc != 0) {
+      return rc;
+    }
+    offset += field->length + 1;
+  }
+  return 0;
+}// ble_hs_adv_parse
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+  os_mbuf *om = os_mbuf_get_pkthdr(nullptr, 0);
+  if (om != nullptr && os_mbuf_append(om, buf, len) != 0) {
+    os_mbuf_free_chain(om);
+    return nullptr;
+  }
+  return om;
+}// ble_hs_mbuf_from_flat
+
+struct os_mbuf *ble_hs_mbuf_att_pkt() {
+  return os_mbuf_get_pkthdr(nullptr, 0);
+}// ble_hs_mbuf_att_pkt
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len) {
+  uint16_t len = om->om_len < max_len ? om->om_len : max_len;
+  memcpy(flat, om->om_data, len);
+  if (out_copy_len != nullptr) {
+    *out_copy_len = len;
+  }
+  return len < om->om_len ? BLE_HS_EMSGSIZE : 0;
+}// ble_hs_mbuf_to_flat
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa) {
+  (void) id_addr_type;
+  if (out_id_addr != nullptr) {
+    memcpy(out_id_addr, OWN_ADDRESS, sizeof(OWN_ADDRESS));
+  }
+  if (out_is_nrpa != nullptr) {
+    *out_is_nrpa = 0;
+  }
+  return 0;
+}// ble_hs_id_copy_addr
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type) {
+  (void) privacy;
+  *out_addr_type = BLE_OWN_ADDR_PUBLIC;
+  return 0;
+}// ble_hs_id_infer_auto
+
+int ble_hs_util_ensure_addr(int prefer_random) {
+  (void) prefer_random;
+  return 0;
+}// ble_hs_util_ensure_addr
+
+int ble_hs_pvcy_rpa_config(uint8_t enable) {
+  (void) enable;
+  return 0;
+}// ble_hs_pvcy_rpa_config
+
+void ble_hs_sched_reset(int reason) {
+  (void) reason;
+}// ble_hs_sched_reset
+
+int ble_hs_synced() {
+  std::lock_guard<std::mutex> lock(s_hostMutex);
+  return s_synced;
+}// ble_hs_synced
+
+/********************************* host/ble_att.h *********************************/
+
+uint16_t ble_att_mtu(uint16_t conn_handle) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  auto it = s_mtus.find(conn_handle);
+  return it != s_mtus.end() ? it->second : 0;
+}// ble_att_mtu
+
+uint16_t ble_att_preferred_mtu() {
+  return s_preferredMtu;
+}// ble_att_preferred_mtu
+
+int ble_att_set_preferred_mtu(uint16_t mtu) {
+  if (mtu < BLE_ATT_MTU_DFLT || mtu > BLE_ATT_MTU_MAX) {
+    return BLE_HS_EINVAL;
+  }
+  s_preferredMtu = mtu;
+  return 0;
+}// ble_att_set_preferred_mtu
+
+/********************************* host/ble_gap.h *********************************/
+
+int ble_gap_adv_active() {
+  return s_advActive;
+}// ble_gap_adv_active
+
+int ble_gap_adv_stop() {
+  return s_advActive.exchange(false) ? 0 : BLE_HS_EALREADY;
+}// ble_gap_adv_stop
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg) {
+  (void) own_addr_type;
+  (void) direct_addr;
+  (void) duration_ms;
+  (void) adv_params;
+  if (s_advActive.exchange(true)) {
+    return BLE_HS_EALREADY;
+  }
+
+  // The handler stays registered after advertising stops, it receives the events of the connections it made.
+  s_advCb = cb;
+  s_advArg = cb_arg;
+  return 0;
+}// ble_gap_adv_start
+
+int ble_gap_adv_set_data(const uint8_t *data, int data_len) {
+  (void) data;
+  return data_len > BLE_HS_ADV_MAX_SZ ? BLE_HS_EINVAL : 0;
+}// ble_gap_adv_set_data
+
+int ble_gap_adv_rsp_set_data(const uint8_t *data, int data_len) {
+  (void) data;
+  return data_len > BLE_HS_ADV_MAX_SZ ? BLE_HS_EINVAL : 0;
+}// ble_gap_adv_rsp_set_data
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  auto it = s_connections.find(handle);
+  if (it == s_connections.end()) {
+    return BLE_HS_ENOTCONN;
+  }
+
+  if (out_desc != nullptr) {
+    *out_desc = it->second;
+  }
+  return 0;
+}// ble_gap_conn_find
+
+int ble_gap_conn_find_by_addr(const ble_addr_t *addr, struct ble_gap_conn_desc *out_desc) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (auto &it : s_connections) {
+    if (ble_addr_cmp(&it.second.peer_id_addr, addr) == 0) {
+      if (out_desc != nullptr) {
+        *out_desc = it.second;
+      }
+      return 0;
+    }
+  }
+  return BLE_HS_ENOTCONN;
+}// ble_gap_conn_find_by_addr
+
+int ble_gap_conn_rssi(uint16_t conn_handle, int8_t *out_rssi) {
+  if (ble_gap_conn_find(conn_handle, nullptr) != 0) {
+    return BLE_HS_ENOTCONN;
+  }
+  *out_rssi = -50;
+  return 0;
+}// ble_gap_conn_rssi
+
+int ble_gap_disc(uint8_t own_addr_type, int32_t duration_ms, const struct ble_gap_disc_params *disc_params,
+                 ble_gap_event_fn *cb, void *cb_arg) {
+  (void) own_addr_type;
+  (void) duration_ms;
+  (void) disc_params;
+  if (s_discActive.exchange(true)) {
+    return BLE_HS_EALREADY;
+  }
+
+  s_discCb = cb;
+  s_discArg = cb_arg;
+  return 0;
+}// ble_gap_disc
+
+int ble_gap_disc_active() {
+  return s_discActive;
+}// ble_gap_disc_active
+
+int ble_gap_disc_cancel() {
+  if (!s_discActive.exchange(false)) {
+    return BLE_HS_EALREADY;
+  }
+
+  s_discCb = nullptr;
+  s_discArg = nullptr;
+  return 0;
+}// ble_gap_disc_cancel
+
+int ble_gap_connect(uint8_t own_addr_type, const ble_addr_t *peer_addr, int32_t duration_ms,
+                    const struct ble_gap_conn_params *params, ble_gap_event_fn *cb, void *cb_arg) {
+  (void) own_addr_type;
+  (void) peer_addr;
+  (void) duration_ms;
+  (void) params;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTSUP;
+}// ble_gap_connect
+
+int ble_gap_conn_cancel() {
+  return BLE_HS_EALREADY;
+}// ble_gap_conn_cancel
+
+int ble_gap_event_listener_register(struct ble_gap_event_listener *listener, ble_gap_event_fn *fn, void *arg) {
+  listener->fn = fn;
+  listener->arg = arg;
+  return 0;
+}// ble_gap_event_listener_register
+
+int ble_gap_read_le_phy(uint16_t conn_handle, uint8_t *tx_phy, uint8_t *rx_phy) {
+  if (ble_gap_conn_find(conn_handle, nullptr) != 0) {
+    return BLE_HS_ENOTCONN;
+  }
+  *tx_phy = BLE_HCI_LE_PHY_1M;
+  *rx_phy = BLE_HCI_LE_PHY_1M;
+  return 0;
+}// ble_gap_read_le_phy
+
+int ble_gap_security_initiate(uint16_t conn_handle) {
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gap_security_initiate
+
+int ble_gap_set_data_len(uint16_t conn_handle, uint16_t tx_octets, uint16_t tx_time) {
+  (void) tx_octets;
+  (void) tx_time;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gap_set_data_len
+
+int ble_gap_set_prefered_le_phy(uint16_t conn_handle, uint8_t tx_phys_mask, uint8_t rx_phys_mask, uint16_t phy_opts) {
+  (void) tx_phys_mask;
+  (void) rx_phys_mask;
+  (void) phy_opts;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gap_set_prefered_le_phy
+
+int ble_gap_set_prefered_default_le_phy(uint8_t tx_phys_mask, uint8_t rx_phys_mask) {
+  (void) tx_phys_mask;
+  (void) rx_phys_mask;
+  return 0;
+}// ble_gap_set_prefered_default_le_phy
+
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason) {
+  (void) hci_reason;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gap_terminate
+
+int ble_gap_unpair(const ble_addr_t *peer_addr) {
+  (void) peer_addr;
+  return 0;
+}// ble_gap_unpair
+
+int ble_gap_update_params(uint16_t conn_handle, const struct ble_gap_upd_params *params) {
+  (void) params;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gap_update_params
+
+int ble_gap_wl_set(const ble_addr_t *addrs, uint8_t white_list_count) {
+  (void) addrs;
+  (void) white_list_count;
+  return 0;
+}// ble_gap_wl_set
+
+/********************************* host/ble_gatt.h ********************************/
+
+int ble_gattc_exchange_mtu(uint16_t conn_handle, ble_gatt_mtu_fn *cb, void *cb_arg) {
+  (void) cb;
+  (void) cb_arg;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_gattc_exchange_mtu
+
+int ble_gattc_disc_all_svcs(uint16_t conn_handle, ble_gatt_disc_svc_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_disc_all_svcs
+
+int ble_gattc_disc_svc_by_uuid(uint16_t conn_handle, const ble_uuid_t *uuid, ble_gatt_disc_svc_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) uuid;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_disc_svc_by_uuid
+
+int ble_gattc_disc_all_chrs(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, ble_gatt_chr_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) start_handle;
+  (void) end_handle;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_disc_all_chrs
+
+int ble_gattc_disc_chrs_by_uuid(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, const ble_uuid_t *uuid,
+                                ble_gatt_chr_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) start_handle;
+  (void) end_handle;
+  (void) uuid;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_disc_chrs_by_uuid
+
+int ble_gattc_disc_all_dscs(uint16_t conn_handle, uint16_t start_handle, uint16_t end_handle, ble_gatt_dsc_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) start_handle;
+  (void) end_handle;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_disc_all_dscs
+
+int ble_gattc_read(uint16_t conn_handle, uint16_t attr_handle, ble_gatt_attr_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) attr_handle;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_read
+
+int ble_gattc_read_long(uint16_t conn_handle, uint16_t handle, uint16_t offset, ble_gatt_attr_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) handle;
+  (void) offset;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_read_long
+
+int ble_gattc_read_mult(uint16_t conn_handle, const uint16_t *handles, uint8_t num_handles, ble_gatt_attr_fn *cb, void *cb_arg) {
+  (void) conn_handle;
+  (void) handles;
+  (void) num_handles;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_read_mult
+
+int ble_gattc_write_no_rsp_flat(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t data_len) {
+  (void) conn_handle;
+  (void) attr_handle;
+  (void) data;
+  (void) data_len;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_write_no_rsp_flat
+
+int ble_gattc_write_flat(uint16_t conn_handle, uint16_t attr_handle, const void *data, uint16_t data_len, ble_gatt_attr_fn *cb,
+                         void *cb_arg) {
+  (void) conn_handle;
+  (void) attr_handle;
+  (void) data;
+  (void) data_len;
+  (void) cb;
+  (void) cb_arg;
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_write_flat
+
+int ble_gattc_write_long(uint16_t conn_handle, uint16_t attr_handle, uint16_t offset, struct os_mbuf *om, ble_gatt_attr_fn *cb,
+                         void *cb_arg) {
+  (void) conn_handle;
+  (void) attr_handle;
+  (void) offset;
+  (void) cb;
+  (void) cb_arg;
+  os_mbuf_free_chain(om);
+  return BLE_HS_ENOTCONN;
+}// ble_gattc_write_long
+
+int ble_gattc_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om) {
+  (void) att_handle;
+
+  // The stack consumes the mbuf whether or not the notification is sent.
+  int rc = ble_gap_conn_find(conn_handle, nullptr);
+  if (rc == 0 && om != nullptr) {
+    s_notifyCount++;
+    s_notifyBytes += OS_MBUF_PKTLEN(om);
+  }
+  os_mbuf_free_chain(om);
+  return rc;
+}// ble_gattc_notify_custom
+
+int ble_gattc_indicate_custom(uint16_t conn_handle, uint16_t chr_val_handle, struct os_mbuf *txom) {
+  (void) chr_val_handle;
+
+  int rc = ble_gap_conn_find(conn_handle, nullptr);
+  if (rc == 0 && txom != nullptr) {
+    s_indicateCount++;
+    s_notifyBytes += OS_MBUF_PKTLEN(txom);
+  }
+  os_mbuf_free_chain(txom);
+  return rc;
+}// ble_gattc_indicate_custom
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs) {
+  // Like NimBLE the definitions are kept by pointer and registered when the server starts.
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_pendingSvcs.push_back(svcs);
+  return 0;
+}// ble_gatts_add_svcs
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs) {
+  (void) defs;
+  return 0;
+}// ble_gatts_count_cfg
+
+int ble_gatts_find_chr(const ble_uuid_t *svc_uuid, const ble_uuid_t *chr_uuid, uint16_t *out_def_handle, uint16_t *out_val_handle) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (auto &chr : s_chrs) {
+    if (ble_uuid_cmp(&chr.svcUuid.u, svc_uuid) == 0 && ble_uuid_cmp(&chr.chrUuid.u, chr_uuid) == 0) {
+      if (out_def_handle != nullptr) {
+        *out_def_handle = chr.defHandle;
+      }
+      if (out_val_handle != nullptr) {
+        *out_val_handle = chr.valHandle;
+      }
+      return 0;
+    }
+  }
+  return BLE_HS_ENOENT;
+}// ble_gatts_find_chr
+
+int ble_gatts_find_svc(const ble_uuid_t *uuid, uint16_t *out_handle) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (auto &svc : s_svcs) {
+    if (ble_uuid_cmp(&svc.svcUuid.u, uuid) == 0) {
+      if (out_handle != nullptr) {
+        *out_handle = svc.defHandle;
+      }
+      return 0;
+    }
+  }
+  return BLE_HS_ENOENT;
+}// ble_gatts_find_svc
+
+int ble_gatts_reset() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_pendingSvcs.clear();
+  s_svcs.clear();
+  s_chrs.clear();
+  return 0;
+}// ble_gatts_reset
+
+void ble_gatts_show_local() {}
+
+int ble_gatts_start() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  s_svcs.clear();
+  s_chrs.clear();
+
+  // Handles are handed out in registration order: service, then declaration, value and CCCD of
+  // each characteristic, then its descriptors.
+  uint16_t handle = 1;
+  for (const ble_gatt_svc_def *svcs : s_pendingSvcs) {
+    for (const ble_gatt_svc_def *svc = svcs; svc->type != BLE_GATT_SVC_TYPE_END; ++svc) {
+      RegisteredAttr svcAttr{};
+      svcAttr.svcUuid = copyUuid(svc->uuid);
+      svcAttr.defHandle = handle++;
+      s_svcs.push_back(svcAttr);
+
+      if (svc->characteristics == nullptr) {
+        continue;
+      }
+
+      for (const ble_gatt_chr_def *chr = svc->characteristics; chr->uuid != nullptr; ++chr) {
+        RegisteredAttr chrAttr = svcAttr;
+        chrAttr.chrUuid = copyUuid(chr->uuid);
+        chrAttr.defHandle = handle++;
+        chrAttr.valHandle = handle++;
+        if (chr->val_handle != nullptr) {
+          *chr->val_handle = chrAttr.valHandle;
+        }
+        if (chr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE)) {
+          handle++;
+        }
+        for (const ble_gatt_dsc_def *dsc = chr->descriptors; dsc != nullptr && dsc->uuid != nullptr; ++dsc) {
+          handle++;
+        }
+        s_chrs.push_back(chrAttr);
+      }
+    }
+  }
+  return 0;
+}// ble_gatts_start
+
+int ble_gatts_svc_set_visibility(uint16_t handle, int visible) {
+  (void) handle;
+  (void) visible;
+  return 0;
+}// ble_gatts_svc_set_visibility
+
+/******************************** host/ble_sm.h ***********************************/
+
+int ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io *pkey) {
+  (void) pkey;
+  return ble_gap_conn_find(conn_handle, nullptr);
+}// ble_sm_inject_io
+
+/******************************** host/ble_store.h ********************************/
+
+int ble_store_clear() {
+  return 0;
+}// ble_store_clear
+
+int ble_store_util_bonded_peers(ble_addr_t *out_peer_id_addrs, int *out_num_peers, int max_peers) {
+  (void) out_peer_id_addrs;
+  (void) max_peers;
+  *out_num_peers = 0;
+  return 0;
+}// ble_store_util_bonded_peers
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr) {
+  (void) peer_id_addr;
+  return BLE_HS_ENOENT;
+}// ble_store_util_delete_peer
+
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg) {
+  (void) event;
+  (void) arg;
+  return 0;
+}// ble_store_util_status_rr
+
+void ble_store_config_init() {}
+
+/***************************** services/gap, services/gatt *************************/
+
+const char *ble_svc_gap_device_name() {
+  return s_deviceName.c_str();
+}// ble_svc_gap_device_name
+
+int ble_svc_gap_device_name_set(const char *name) {
+  s_deviceName = name;
+  return 0;
+}// ble_svc_gap_device_name_set
+
+void ble_svc_gap_init() {}
+
+void ble_svc_gatt_init() {}
+
+void ble_svc_gatt_changed(uint16_t start_handle, uint16_t end_handle) {
+  (void) start_handle;
+  (void) end_handle;
+}// ble_svc_gatt_changed
@@ -24,8 +24,12 @@
 #undef max
 /**************************/
 
-#include <string>
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
 
 namespace nimble {
 
@@ -36,16 +40,20 @@ namespace nimble {
  */
 class Address {
 public:
+  /// The buffer size toChars() needs, "xx:xx:xx:xx:xx:xx" and the terminator.
+  static constexpr size_t STR_LEN = 18;
+
   Address();
   explicit Address(ble_addr_t address);
   explicit Address(uint8_t address[6], uint8_t type = BLE_ADDR_PUBLIC);
-  explicit Address(const std::string &stringAddress, uint8_t type = BLE_ADDR_PUBLIC);
+  explicit Address(std::string_view stringAddress, uint8_t type = BLE_ADDR_PUBLIC);
   explicit Address(const uint64_t &address, uint8_t type = BLE_ADDR_PUBLIC);
 
 public:
   [[nodiscard]] bool equals(const Address &otherAddress) const;
   [[nodiscard]] const uint8_t *getNative() const;
   [[nodiscard]] std::string toString() const;
+  size_t toChars(char *buf, size_t size) const;
   [[nodiscard]] uint8_t getType() const;
 
 public:
@@ -59,6 +67,53 @@ private:
   uint8_t m_addrType;
 };
 
+/**
+ * @brief An address and its type packed in 64 bits, as the key of maps and sets.
+ * @details Unlike Address, two keys are only equal if the address types are equal too.
+ */
+class AddressKey {
+public:
+  constexpr AddressKey() : m_value(0) {}
+  explicit AddressKey(const Address &address);
+  explicit AddressKey(const ble_addr_t &address);
+
+  [[nodiscard]] Address toAddress() const;
+
+  /** @brief Returns the address bytes, little endian, with the type in byte 6 */
+  [[nodiscard]] constexpr uint64_t getValue() const { return m_value; }
+
+  constexpr bool operator==(const AddressKey &rhs) const { return m_value == rhs.m_value; }
+  constexpr bool operator!=(const AddressKey &rhs) const { return m_value != rhs.m_value; }
+  constexpr bool operator<(const AddressKey &rhs) const { return m_value < rhs.m_value; }
+
+private:
+  uint64_t m_value;
+};
+
 }
 
+namespace std {
+
+/**
+ * @brief Hash support, to use addresses as keys of unordered containers, the type is not hashed.
+ */
+template<>
+struct hash<nimble::Address> {
+  size_t operator()(const nimble::Address &address) const noexcept {
+    return (size_t) (((uint64_t) address * 0x9e3779b97f4a7c15ULL) >> 32);
+  }
+};
+
+/**
+ * @brief Hash support for AddressKey.
+ */
+template<>
+struct hash<nimble::AddressKey> {
+  size_t operator()(const nimble::AddressKey &key) const noexcept {
+    return (size_t) ((key.getValue() * 0x9e3779b97f4a7c15ULL) >> 32);
+  }
+};
+
+}// namespace std
+
 #endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,75 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include "nimble/Address.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS
+#define CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS 0
+#endif
+
+namespace nimble {
+
+/**
+ * @brief A set of %BLE addresses with constant time membership checks.
+ * @details The 6 bytes of an address are packed into a single 64 bit key and stored in a flat
+ * open addressing table, so no allocation is made per entry. As with Address::operator==() the
+ * address type is not part of the key. If CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS
+ * is non zero a Bloom filter is checked first so that lookups of addresses not in the set
+ * usually cost two bit tests.
+ */
+class AddressSet {
+public:
+  bool contains(const Address &address) const;
+  bool insert(const Address &address);
+  bool erase(const Address &address);
+  void clear();
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] bool empty() const;
+
+private:
+  static uint64_t pack(const Address &address);
+  static uint32_t hash(uint64_t key);
+  std::size_t findSlot(uint64_t key) const;
+  void rehash(std::size_t capacity);
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  void bloomAdd(uint32_t hash);
+  bool bloomTest(uint32_t hash) const;
+  void bloomRebuild();
+#endif
+
+private:
+  std::vector<uint64_t> m_slots;
+  std::size_t m_count = 0;
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  uint32_t m_bloom[(CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS + 31) / 32]{};
+#endif
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
@@ -18,6 +18,7 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
 
 #include "nimble/Address.hpp"
+#include "nimble/Memory.hpp"
 #include "nimble/Scan.hpp"
 #include "nimble/UUID.hpp"
 
@@ -25,6 +26,7 @@
 
 #include <ctime>
 #include <map>
+#include <string_view>
 #include <vector>
 
 /****  FIX COMPILATION ****/
@@ -32,6 +34,18 @@
 #undef max
 /**************************/
 
+#if CONFIG_BT_NIMBLE_EXT_ADV
+#ifndef CONFIG_NIMBLE_CPP_EXT_ADV_PAYLOAD_MAX
+#define CONFIG_NIMBLE_CPP_EXT_ADV_PAYLOAD_MAX 255
+#endif
+#define NIMBLE_CPP_ADV_PAYLOAD_MAX CONFIG_NIMBLE_CPP_EXT_ADV_PAYLOAD_MAX
+#else
+#define NIMBLE_CPP_ADV_PAYLOAD_MAX (BLE_HS_ADV_MAX_SZ * 2)
+#endif
+
+// Each AD structure takes at least 2 bytes.
+#define NIMBLE_CPP_ADV_FIELDS_MAX (NIMBLE_CPP_ADV_PAYLOAD_MAX / 2)
+
 namespace nimble {
 
 class Scan;
@@ -43,6 +57,8 @@ class Scan;
  */
 class AdvertisedDevice {
 public:
+  NIMBLE_MEMORY_SUBSYSTEM(SCAN)
+
   AdvertisedDevice();
 
   Address getAddress();
@@ -54,8 +70,11 @@ public:
   uint16_t getMaxInterval();
   uint8_t getManufacturerDataCount();
   std::string getManufacturerData(uint8_t index = 0);
+  std::string_view getManufacturerDataView(uint8_t index = 0);
   std::string getURI();
+  std::string_view getURIView();
   std::string getPayloadByType(uint16_t type);
+  std::string_view getPayloadByTypeView(uint16_t type);
 
   /**
      * @brief A template to convert the service data to <type\>.
@@ -75,11 +94,20 @@ public:
   }
 
   std::string getName();
+  std::string_view getNameView();
   int getRSSI();
+  int getRSSIAverage();
+  int getRSSIMedian();
+  uint32_t getSightings();
+  int64_t getFirstSeen();
+  int64_t getLastSeen();
+  uint32_t getAdvertisingInterval();
   Scan *getScan();
   uint8_t getServiceDataCount();
   std::string getServiceData(uint8_t index = 0);
   std::string getServiceData(const UUID &uuid);
+  std::string_view getServiceDataView(uint8_t index = 0);
+  std::string_view getServiceDataView(const UUID &uuid);
 
   /**
      * @brief A template to convert the service data to <tt><type\></tt>.
@@ -153,11 +181,13 @@ public:
 
 private:
   friend class Scan;
+  friend class ScanResults;
 
   void setAddress(Address address);
   void setAdvType(uint8_t advType, bool isLegacyAdv);
   void setPayload(const uint8_t *payload, uint8_t length, bool append);
   void setRSSI(int rssi);
+  void addSighting(int8_t rssi, int64_t now);
 #if CONFIG_BT_NIMBLE_EXT_ADV
   void setSetId(uint8_t sid) { m_sid = sid; }
   void setPrimaryPhy(uint8_t phy) { m_primPhy = phy; }
@@ -166,6 +196,9 @@ private:
 #endif
   uint8_t findAdvField(uint8_t type, uint8_t index = 0, size_t *data_loc = nullptr);
   size_t findServiceData(uint8_t index, uint8_t *bytes);
+  bool hasType(uint8_t type) const;
+  std::string_view getFieldView(uint8_t type, uint8_t index = 0);
+  void indexPayload(size_t offset);
 
   Address m_address = Address("");
   uint8_t m_advType;
@@ -181,7 +214,29 @@ private:
   uint16_t m_periodicItvl;
 #endif
 
-  std::vector<uint8_t> m_payload;
+  uint16_t m_payloadLength;
+  uint8_t m_payload[NIMBLE_CPP_ADV_PAYLOAD_MAX];
+
+  // Sighting aggregation, the RSSI average is kept in 1/16 dBm.
+  static constexpr uint8_t RSSI_HISTORY = 5;
+  int64_t m_firstSeen;
+  int64_t m_lastSeen;
+  int64_t m_reportedAt;
+  uint32_t m_sightings;
+  uint32_t m_advInterval;
+  int16_t m_rssiAverage;
+  int8_t m_rssiHistory[RSSI_HISTORY];
+  uint8_t m_rssiIndex;
+  int8_t m_reportedRSSI;
+
+  // Links of the least recently seen list of the scan results.
+  AdvertisedDevice *m_pOlder;
+  AdvertisedDevice *m_pNewer;
+
+  // Offsets of the AD structures in the payload and a bitmap of the AD types below 64 present.
+  uint16_t m_fieldCount;
+  uint16_t m_fieldOffset[NIMBLE_CPP_ADV_FIELDS_MAX];
+  uint64_t m_typeMask;
 };
 
 }// namespace nimble
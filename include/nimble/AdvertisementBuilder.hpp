@@ -0,0 +1,314 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "host/ble_hs_adv.h"
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/UUID.hpp"
+
+namespace nimble {
+
+/**
+ * @brief Serializes advertisement data (AD structures) into a fixed size buffer.
+ * @details No memory is allocated, the buffer is part of the object and can be handed to the
+ * controller as is with data() and size(). Fields of a fixed size, such as the Beacon and
+ * EddystoneTLM frames, are checked against the capacity at compile time.
+ * @tparam N The capacity in bytes, BLE_HS_ADV_MAX_SZ (31) for legacy advertising, up to 255 for
+ * extended advertising.
+ */
+template<size_t N>
+class AdvertisementBuilder {
+  static_assert(N >= 3 && N <= 255, "Advertisement capacity must be between 3 and 255 bytes");
+
+public:
+  static constexpr size_t CAPACITY = N;
+
+  constexpr AdvertisementBuilder() : m_data{}, m_length(0) {}
+
+  /**
+   * @brief Append an AD structure.
+   * @param [in] type The AD type, BLE_HS_ADV_TYPE_*.
+   * @param [in] data A pointer to the content of the field.
+   * @param [in] length The length of the content.
+   * @return True if the field fits in the remaining space.
+   */
+  bool addField(uint8_t type, const void *data, size_t length) {
+    uint8_t *dst = reserve(type, length);
+    if (dst == nullptr) {
+      return false;
+    }
+
+    memcpy(dst, data, length);
+    return true;
+  }
+
+  /**
+   * @brief Append an AD structure holding a fixed size value, such as a packed frame struct.
+   * @param [in] type The AD type, BLE_HS_ADV_TYPE_*.
+   * @param [in] value The content of the field.
+   * @return True if the field fits in the remaining space.
+   */
+  template<typename T>
+  bool addField(uint8_t type, const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Field content must be trivially copyable");
+    static_assert(sizeof(T) + 2 <= N, "Field does not fit in the advertisement");
+    return addField(type, &value, sizeof(T));
+  }
+
+  /**
+   * @brief Append raw, already encoded, AD structures.
+   * @param [in] data A pointer to the data.
+   * @param [in] length The length of the data.
+   * @return True if the data fits in the remaining space.
+   */
+  bool addData(const void *data, size_t length) {
+    if (length > N - m_length) {
+      return false;
+    }
+
+    memcpy(&m_data[m_length], data, length);
+    m_length += length;
+    return true;
+  }
+
+  /**
+   * @brief Set the advertisement flags, BLE_HS_ADV_F_BREDR_UNSUP is always added.
+   * @param [in] flags The flags, BLE_HS_ADV_F_DISC_LTD or BLE_HS_ADV_F_DISC_GEN.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setFlags(uint8_t flags) {
+    uint8_t value = flags | BLE_HS_ADV_F_BREDR_UNSUP;
+    return addField(BLE_HS_ADV_TYPE_FLAGS, value);
+  }
+
+  /**
+   * @brief Set the appearance.
+   * @param [in] appearance The appearance code value.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setAppearance(uint16_t appearance) {
+    uint8_t value[2] = {(uint8_t) appearance, (uint8_t) (appearance >> 8)};
+    return addField(BLE_HS_ADV_TYPE_APPEARANCE, value);
+  }
+
+  /**
+   * @brief Set the name of the device.
+   * @param [in] name The name to advertise.
+   * @param [in] complete True for the complete name, false for a shortened name.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setName(const std::string &name, bool complete = true) {
+    return addField(complete ? BLE_HS_ADV_TYPE_COMP_NAME : BLE_HS_ADV_TYPE_INCOMP_NAME, name.data(), name.length());
+  }
+
+  /**
+   * @brief Set the URI to advertise.
+   * @param [in] uri The uri to advertise.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setURI(const std::string &uri) {
+    return addField(BLE_HS_ADV_TYPE_URI, uri.data(), uri.length());
+  }
+
+  /**
+   * @brief Set manufacturer specific data.
+   * @param [in] data A pointer to the data, starting with the company identifier.
+   * @param [in] length The length of the data.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setManufacturerData(const void *data, size_t length) {
+    return addField(BLE_HS_ADV_TYPE_MFG_DATA, data, length);
+  }
+
+  /**
+   * @brief Set service data (UUID + data).
+   * @param [in] uuid The UUID of the service.
+   * @param [in] data A pointer to the data.
+   * @param [in] length The length of the data.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setServiceData(const UUID &uuid, const void *data, size_t length) {
+    uint8_t type;
+    const void *value;
+
+    switch (uuid.bitSize()) {
+    case 16:
+      type = BLE_HS_ADV_TYPE_SVC_DATA_UUID16;
+      value = &uuid.getNative()->u16.value;
+      break;
+    case 32:
+      type = BLE_HS_ADV_TYPE_SVC_DATA_UUID32;
+      value = &uuid.getNative()->u32.value;
+      break;
+    case 128:
+      type = BLE_HS_ADV_TYPE_SVC_DATA_UUID128;
+      value = uuid.getNative()->u128.value;
+      break;
+    default:
+      return false;
+    }
+
+    size_t uuidLen = uuid.bitSize() / 8;
+    uint8_t *dst = reserve(type, uuidLen + length);
+    if (dst == nullptr) {
+      return false;
+    }
+
+    memcpy(dst, value, uuidLen);
+    memcpy(dst + uuidLen, data, length);
+    return true;
+  }
+
+  /**
+   * @brief Set service data of a 16 bit UUID holding a fixed size value, such as an Eddystone frame.
+   * @param [in] uuid The 16 bit UUID of the service.
+   * @param [in] value The service data.
+   * @return True if the field fits in the remaining space.
+   */
+  template<typename T>
+  bool setServiceData16(uint16_t uuid, const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Service data must be trivially copyable");
+    static_assert(sizeof(T) + 4 <= N, "Service data does not fit in the advertisement");
+
+    uint8_t *dst = reserve(BLE_HS_ADV_TYPE_SVC_DATA_UUID16, sizeof(T) + 2);
+    if (dst == nullptr) {
+      return false;
+    }
+
+    dst[0] = uuid;
+    dst[1] = uuid >> 8;
+    memcpy(dst + 2, &value, sizeof(T));
+    return true;
+  }
+
+  /**
+   * @brief Set a single service as the complete or partial list of services.
+   * @param [in] uuid The service to advertise.
+   * @param [in] complete True if this is the complete list of services.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setServices(const UUID &uuid, bool complete = true) {
+    switch (uuid.bitSize()) {
+    case 16:
+      return addField(complete ? BLE_HS_ADV_TYPE_COMP_UUIDS16 : BLE_HS_ADV_TYPE_INCOMP_UUIDS16,
+                      &uuid.getNative()->u16.value, 2);
+    case 32:
+      return addField(complete ? BLE_HS_ADV_TYPE_COMP_UUIDS32 : BLE_HS_ADV_TYPE_INCOMP_UUIDS32,
+                      &uuid.getNative()->u32.value, 4);
+    case 128:
+      return addField(complete ? BLE_HS_ADV_TYPE_COMP_UUIDS128 : BLE_HS_ADV_TYPE_INCOMP_UUIDS128,
+                      uuid.getNative()->u128.value, 16);
+    default:
+      return false;
+    }
+  }
+
+  /**
+   * @brief Add the Tx power level.
+   * @param [in] power The transmit power in dBm.
+   * @return True if the field fits in the remaining space.
+   */
+  bool addTxPower(int8_t power) {
+    return addField(BLE_HS_ADV_TYPE_TX_PWR_LVL, power);
+  }
+
+  /**
+   * @brief Set the preferred connection interval parameters.
+   * @param [in] min The minimum interval desired.
+   * @param [in] max The maximum interval desired.
+   * @return True if the field fits in the remaining space.
+   */
+  bool setPreferredParams(uint16_t min, uint16_t max) {
+    uint8_t value[4] = {(uint8_t) min, (uint8_t) (min >> 8), (uint8_t) max, (uint8_t) (max >> 8)};
+    return addField(BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE, value);
+  }
+
+  /**
+   * @brief Remove all fields.
+   */
+  void clear() {
+    m_length = 0;
+  }
+
+  /**
+   * @brief Get a pointer to the encoded data.
+   */
+  [[nodiscard]] const uint8_t *data() const {
+    return m_data.data();
+  }
+
+  /**
+   * @brief Get the length of the encoded data.
+   */
+  [[nodiscard]] size_t size() const {
+    return m_length;
+  }
+
+  /**
+   * @brief Get the number of bytes still available.
+   */
+  [[nodiscard]] size_t remaining() const {
+    return N - m_length;
+  }
+
+private:
+  /**
+   * @brief Write the header of an AD structure and reserve space for its content.
+   * @return A pointer to the content of the field or nullptr if it does not fit.
+   */
+  uint8_t *reserve(uint8_t type, size_t length) {
+    if (length + 2 > N - m_length) {
+      return nullptr;
+    }
+
+    m_data[m_length] = length + 1;
+    m_data[m_length + 1] = type;
+    uint8_t *dst = &m_data[m_length + 2];
+    m_length += length + 2;
+    return dst;
+  }
+
+private:
+  std::array<uint8_t, N> m_data;
+  uint8_t m_length;
+};
+
+/**
+ * @brief Builder sized for legacy advertising and scan responses.
+ */
+using LegacyAdvertisementBuilder = AdvertisementBuilder<BLE_HS_ADV_MAX_SZ>;
+
+/**
+ * @brief Builder sized for the largest payload set with a single HCI command in extended advertising.
+ */
+using ExtAdvertisementBuilder = AdvertisementBuilder<255>;
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
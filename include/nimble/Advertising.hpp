@@ -20,6 +20,7 @@
 #include "host/ble_gap.h"
 
 #include "nimble/Address.hpp"
+#include "nimble/AdvertisementBuilder.hpp"
 #include "nimble/UUID.hpp"
 
 #include <vector>
@@ -69,12 +70,15 @@ public:
   void addTxPower();
   void setPreferredParams(uint16_t min, uint16_t max);
   std::string getPayload();// Retrieve the current advert payload.
+  [[nodiscard]] const uint8_t *getPayloadData() const;
+  [[nodiscard]] size_t getPayloadLength() const;
 
 private:
   void setServices(bool complete, uint8_t size, std::vector<UUID> const &v_uuid);
+  void logIfFull(bool added);
 
 private:
-  std::string m_payload;// The payload of the advertisement.
+  LegacyAdvertisementBuilder m_payload;// The payload of the advertisement.
 };// NimBLEAdvertisementData
 
 /**
@@ -105,8 +109,10 @@ public:
   void setMaxInterval(uint16_t maxinterval);
   void setMinInterval(uint16_t mininterval);
   void setAdvertisementData(AdvertisementData &advertisementData);
+  void setAdvertisementData(const LegacyAdvertisementBuilder &advertisementData);
   void setScanFilter(bool scanRequestWhitelistOnly, bool connectWhitelistOnly);
   void setScanResponseData(AdvertisementData &advertisementData);
+  void setScanResponseData(const LegacyAdvertisementBuilder &advertisementData);
   void setScanResponse(bool);
   void setMinPreferred(uint16_t);
   void setMaxPreferred(uint16_t);
@@ -114,10 +120,16 @@ public:
   void reset();
   void advCompleteCB();
   bool isAdvertising();
+  bool updateManufacturerData(const std::string &data);
+  bool updateManufacturerData(const std::vector<uint8_t> &data);
+  bool updateServiceData(const UUID &uuid, const std::string &data);
+  bool updateField(uint8_t type, const uint8_t *data, size_t length, bool scanResponse = false);
 
 private:
   void onHostSync();
   static int handleGapEvent(struct ble_gap_event *event, void *arg);
+  int patchField(bool scanResponse, uint8_t type, const uint8_t *data, size_t length, size_t keyLength, bool append);
+  bool patchServiceData(uint8_t type, const UUID &uuid, const std::string &data);
 
   ble_hs_adv_fields m_advData;
   ble_hs_adv_fields m_scanData;
@@ -136,6 +148,10 @@ private:
   std::vector<uint8_t> m_name;
   std::vector<uint8_t> m_mfgData;
   std::vector<uint8_t> m_uri;
+  uint8_t m_advPayload[BLE_HS_ADV_MAX_SZ];
+  uint8_t m_advPayloadLen;
+  uint8_t m_scanPayload[BLE_HS_ADV_MAX_SZ];
+  uint8_t m_scanPayloadLen;
 };
 
 }// namespace nimble
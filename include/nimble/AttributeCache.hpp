@@ -0,0 +1,76 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include <cstdint>
+#include <vector>
+
+#include <host/ble_gatt.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/Address.hpp"
+
+#ifndef CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+#define CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE 0
+#endif
+
+namespace nimble {
+
+class Client;
+
+/**
+ * @brief Persistent storage of the remote attribute database of bonded peers.
+ * @details The discovered services, characteristics and descriptors (handles, UUIDs and properties)
+ * are serialized to NVS keyed by the peer identity address, so reconnecting to a bonded peer
+ * with `Client::connect(..., false)` does not need to run discovery again.
+ * If the peer exposes a Database Hash characteristic its value is stored with the tree and
+ * compared on restore, the entry is also discarded when the peer indicates Service Changed.
+ */
+class AttributeCache {
+public:
+  static bool save(Client *pClient);
+  static bool restore(Client *pClient);
+  static void invalidate(Client *pClient);
+  static void erase(const Address &address);
+  static void eraseAll();
+
+private:
+  static constexpr uint8_t VERSION = 1;
+  static constexpr uint8_t HASH_SIZE = 16;
+
+  struct DatabaseHash {
+    uint8_t value[HASH_SIZE];
+    bool found;
+  };
+
+  static bool getPeerId(Client *pClient, Address *address);
+  static void makeKey(const Address &address, char *key);
+  static int readDatabaseHash(Client *pClient, DatabaseHash *hash);
+  static int onReadHashCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                          struct ble_gatt_attr *attr, void *arg);
+  static void serialize(Client *pClient, const DatabaseHash &hash, std::vector<uint8_t> &out);
+  static bool deserialize(Client *pClient, const std::vector<uint8_t> &in, DatabaseHash &hash);
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
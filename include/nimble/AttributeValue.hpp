@@ -24,8 +24,10 @@
 
 #include <host/ble_att.h>
 #include <nimble/nimble_npl.h>
+#include <os/os_mbuf.h>
 
 #include "nimble/Log.hpp"
+#include "nimble/Memory.hpp"
 
 #ifndef CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED
 #define CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED 0
@@ -43,6 +45,12 @@
 #error CONFIG_NIMBLE_CPP_ATT_VALUE_INIT_LENGTH cannot be less than 1; Range = 1 : 512
 #endif
 
+#if !defined(CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH)
+#define CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH 8
+#elif CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH > 64
+#error CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH cannot be larger than 64; Range = 0 : 64
+#endif
+
 /****  FIX COMPILATION ****/
 #undef min
 #undef max
@@ -57,27 +65,36 @@ struct Has_c_str_len : std::false_type {};
 template<typename T>
 struct Has_c_str_len<T, decltype(void(std::declval<T &>().c_str())), decltype(void(std::declval<T &>().length()))> : std::true_type {};
 
+class AttributeValueView;
+
 /**
  * @brief A specialized container class to hold BLE attribute values.
  * @details This class is designed to be more memory efficient than using\n
  * standard container types for value storage, while being convertible to\n
- * many different container classes.
+ * many different container classes.\n
+ * Values up to CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH bytes are stored inside the\n
+ * object, the heap is only used once a longer value is set.
  */
 class AttributeValue {
-  uint8_t *m_attr_value = nullptr;
+  uint8_t *m_attr_value = m_inline;
   uint16_t m_attr_max_len = 0;
   uint16_t m_attr_len = 0;
-  uint16_t m_capacity = 0;
+  uint16_t m_capacity = CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH;
 #if CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED
   time_t m_timestamp = 0;
 #endif
+  uint8_t m_inline[CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH + 1] = {};
+
   void deepCopy(const AttributeValue &source);
+  uint8_t *grow(uint16_t len, uint16_t keep);
 
 public:
   /**
      * @brief Default constructor.
-     * @param[in] init_len The initial size in bytes.
+     * @param[in] init_len The initial size in bytes, only allocated when CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH is 0.
      * @param[in] max_len The max size in bytes that the value can be.
+     * @details With inline storage the value starts inline whatever init_len is, and the heap
+     * is only used once a longer value is set, so an empty value never allocates.
      */
   explicit AttributeValue(uint16_t init_len = CONFIG_NIMBLE_CPP_ATT_VALUE_INIT_LENGTH, uint16_t max_len = BLE_ATT_ATTR_MAX_LEN);
 
@@ -138,9 +155,15 @@ public:
   /** @brief Returns the current size of the value in bytes */
   [[nodiscard]] uint16_t size() const { return m_attr_len; }
 
+  /** @brief Returns true if the value is stored inside the object rather than on the heap */
+  [[nodiscard]] bool isInline() const { return m_attr_value == m_inline; }
+
   /** @brief Returns a pointer to the internal buffer of the value */
   [[nodiscard]] const uint8_t *data() const { return m_attr_value; }
 
+  /** @brief Returns a view of the value that does not copy it */
+  [[nodiscard]] AttributeValueView view() const;
+
   /** @brief Returns a pointer to the internal buffer of the value as a const char* */
   [[nodiscard]] const char *c_str() const { return (const char *) m_attr_value; }
 
@@ -176,6 +199,24 @@ public:
      */
   bool setValue(const uint8_t *value, uint16_t len);
 
+  /**
+     * @brief Set the value from an mbuf chain, flattening it directly into the value buffer.
+     * @param[in] om A pointer to the first mbuf of the chain.
+     * @returns True if successful, false if the chain is longer than the max size.
+     */
+  bool setValue(const os_mbuf *om);
+
+  /**
+     * @brief Set the value from an mbuf chain, flattening it directly into the value buffer.
+     * @param[in] om A pointer to the first mbuf of the chain.
+     * @returns True if successful, false if the chain is longer than the max size.
+     * @details Needed so a non-const mbuf pointer does not bind to the setValue(const T &) template,
+     * which would store the pointer itself.
+     */
+  bool setValue(os_mbuf *om) {
+    return setValue(static_cast<const os_mbuf *>(om));
+  }
+
   /**
      * @brief Set value to the value of const char*.
      * @param [in] s A ponter to a const char value to set.
@@ -288,41 +329,148 @@ public:
   bool operator!=(const AttributeValue &source) { return !(*this == source); }
 };
 
+/**
+ * @brief A read only view of an attribute value that does not own or copy the data.
+ * @details The view is only valid until the value it was taken from is changed or destroyed,\n
+ * values of local attributes can be changed by peer writes and values of remote attributes by\n
+ * notifications, so a view should be used from the callbacks or while no update can happen.
+ */
+class AttributeValueView {
+  const uint8_t *m_data;
+  uint16_t m_len;
+  time_t m_timestamp;
+
+public:
+  /**
+     * @brief Construct a view of a buffer.
+     * @param[in] data A pointer to the value.
+     * @param[in] len The length of the value in bytes.
+     * @param[in] timestamp The time the value was last updated.
+     */
+  AttributeValueView(const uint8_t *data, uint16_t len, time_t timestamp = 0) : m_data(data), m_len(len), m_timestamp(timestamp) {}
+
+  /** @brief Construct a view of an attribute value */
+  AttributeValueView(const AttributeValue &value) : AttributeValueView(value.data(), value.size(), value.getTimeStamp()) {}
+
+  /** @brief Returns the length of the value in bytes */
+  [[nodiscard]] uint16_t length() const { return m_len; }
+
+  /** @brief Returns the size of the value in bytes */
+  [[nodiscard]] uint16_t size() const { return m_len; }
+
+  /** @brief Returns a pointer to the value */
+  [[nodiscard]] const uint8_t *data() const { return m_data; }
+
+  /** @brief Returns the value as a null terminated const char* */
+  [[nodiscard]] const char *c_str() const { return (const char *) m_data; }
+
+  /** @brief Iterator begin */
+  [[nodiscard]] const uint8_t *begin() const { return m_data; }
+
+  /** @brief Iterator end */
+  [[nodiscard]] const uint8_t *end() const { return m_data + m_len; }
+
+  /** @brief Returns the time the value was last updated */
+  [[nodiscard]] time_t getTimeStamp() const { return m_timestamp; }
+
+  /**
+     * @brief Template to return the value as a <type\>.
+     * @tparam T The type to convert the data to.
+     * @param [in] skipSizeCheck If true it will skip checking if the data size is less than\n
+     * <tt>sizeof(<type\>)</tt>.
+     * @return The data converted to <type\> or NULL if skipSizeCheck is false and the data is\n
+     * less than <tt>sizeof(<type\>)</tt>.
+     */
+  template<typename T>
+  T getValue(bool skipSizeCheck = false) const {
+    if (!skipSizeCheck && m_len < sizeof(T)) {
+      return T();
+    }
+    return *((T *) m_data);
+  }
+
+  /** @brief Subscript operator */
+  uint8_t operator[](int pos) const {
+    assert(pos < m_len && "out of range");
+    return m_data[pos];
+  }
+
+  /** @brief Operator; Get the value as a std::vector<uint8_t>. */
+  explicit operator std::vector<uint8_t>() const {
+    return {m_data, m_data + m_len};
+  }
+
+  /** @brief Operator; Get the value as a std::string. */
+  explicit operator std::string() const {
+    return std::string((char *) m_data, m_len);
+  }
+
+  /** @brief Equality operator */
+  bool operator==(const AttributeValueView &source) const {
+    return (m_len == source.size()) and memcmp(m_data, source.data(), m_len) == 0;
+  }
+
+  /** @brief Inequality operator */
+  bool operator!=(const AttributeValueView &source) const { return !(*this == source); }
+};
+
 inline AttributeValue::AttributeValue(uint16_t init_len, uint16_t max_len) {
   assert(init_len > 1);
   assert(init_len < BLE_ATT_ATTR_MAX_LEN);
 
-  m_attr_value = (uint8_t *) calloc(init_len + 1, 1);
-  assert(m_attr_value && "No Mem");
   m_attr_max_len = std::min(BLE_ATT_ATTR_MAX_LEN, (int) max_len);
   m_attr_len = 0;
-  m_capacity = init_len;
+#if CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH == 0
+  // Without inline storage every value needs a buffer, allocate the initial size up front.
+  m_attr_value = grow(init_len, 0);
+  m_attr_value[0] = '\0';
+#endif
   setTimeStamp(0);
 }
 
-inline AttributeValue::AttributeValue(const uint8_t *value, uint16_t len, uint16_t max_len)
-    : AttributeValue(len, max_len) {
+inline AttributeValue::AttributeValue(const uint8_t *value, uint16_t len, uint16_t max_len) {
+  m_attr_max_len = std::min(BLE_ATT_ATTR_MAX_LEN, (int) max_len);
+  m_attr_value = grow(len, 0);
   memcpy(m_attr_value, value, len);
   m_attr_value[len] = '\0';
   m_attr_len = len;
+  setTimeStamp(0);
 }
 
 inline AttributeValue::~AttributeValue() {
-  if (m_attr_value != nullptr) {
-    free(m_attr_value);
+  if (!isInline()) {
+    Memory::release(Memory::ATTRIBUTE_VALUE, m_attr_value, m_capacity + 1);
   }
 }
 
+inline AttributeValueView AttributeValue::view() const {
+  return AttributeValueView(*this);
+}
+
 inline AttributeValue &AttributeValue::operator=(AttributeValue &&source) {
   if (this != &source) {
-    free(m_attr_value);
+    if (!isInline()) {
+      Memory::release(Memory::ATTRIBUTE_VALUE, m_attr_value, m_capacity + 1);
+    }
 
-    m_attr_value = source.m_attr_value;
     m_attr_max_len = source.m_attr_max_len;
     m_attr_len = source.m_attr_len;
-    m_capacity = source.m_capacity;
     setTimeStamp(source.getTimeStamp());
-    source.m_attr_value = nullptr;
+
+    if (source.isInline()) {
+      m_attr_value = m_inline;
+      m_capacity = CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH;
+      memcpy(m_inline, source.m_inline, m_attr_len + 1);
+    } else {
+      // Take over the heap buffer and leave the source empty.
+      m_attr_value = source.m_attr_value;
+      m_capacity = source.m_capacity;
+      source.m_attr_value = source.m_inline;
+      source.m_capacity = CONFIG_NIMBLE_CPP_ATT_VALUE_INLINE_LENGTH;
+    }
+
+    source.m_attr_len = 0;
+    source.m_inline[0] = '\0';
   }
   return *this;
 }
@@ -334,15 +482,39 @@ inline AttributeValue &AttributeValue::operator=(const AttributeValue &source) {
   return *this;
 }
 
+/**
+ * @brief Get a buffer that can hold a value of the given length.
+ * @param[in] len The length of the value in bytes, not including the null terminator.
+ * @param[in] keep The number of bytes of the current value to keep when moving it to the heap.
+ * @returns The current buffer if large enough, otherwise a new one. The caller must publish it
+ * in m_attr_value.
+ */
+inline uint8_t *AttributeValue::grow(uint16_t len, uint16_t keep) {
+  if (len <= m_capacity) {
+    return m_attr_value;
+  }
+
+  uint8_t *res;
+  if (isInline()) {
+    res = (uint8_t *) Memory::allocate(Memory::ATTRIBUTE_VALUE, len + 1);
+    assert(res && "grow: malloc failed");
+    memcpy(res, m_inline, keep);
+  } else {
+    res = (uint8_t *) Memory::reallocate(Memory::ATTRIBUTE_VALUE, m_attr_value, m_capacity + 1, len + 1);
+    assert(res && "grow: realloc failed");
+  }
+
+  m_capacity = len;
+  return res;
+}
+
 inline void AttributeValue::deepCopy(const AttributeValue &source) {
-  uint8_t *res = (uint8_t *) realloc(m_attr_value, source.m_capacity + 1);
-  assert(res && "deepCopy: realloc failed");
+  uint8_t *res = grow(source.m_attr_len, 0);
 
   ble_npl_hw_enter_critical();
   m_attr_value = res;
   m_attr_max_len = source.m_attr_max_len;
   m_attr_len = source.m_attr_len;
-  m_capacity = source.m_capacity;
   setTimeStamp(source.getTimeStamp());
   memcpy(m_attr_value, source.m_attr_value, m_attr_len + 1);
   ble_npl_hw_exit_critical(0);
@@ -365,12 +537,7 @@ inline bool AttributeValue::setValue(const uint8_t *value, uint16_t len) {
     return false;
   }
 
-  uint8_t *res = m_attr_value;
-  if (len > m_capacity) {
-    res = (uint8_t *) realloc(m_attr_value, (len + 1));
-    m_capacity = len;
-  }
-  assert(res && "setValue: realloc failed");
+  uint8_t *res = grow(len, 0);
 
 #if CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED
   time_t t = time(nullptr);
@@ -388,6 +555,39 @@ inline bool AttributeValue::setValue(const uint8_t *value, uint16_t len) {
   return true;
 }
 
+inline bool AttributeValue::setValue(const os_mbuf *om) {
+  uint32_t len = 0;
+  for (const os_mbuf *next = om; next != nullptr; next = SLIST_NEXT(next, om_next)) {
+    len += next->om_len;
+  }
+
+  if (len > m_attr_max_len) {
+    NIMBLE_LOGE("NimBLEAttValue", "value exceeds max, len=%u, max=%u", len, m_attr_max_len);
+    return false;
+  }
+
+  uint8_t *res = grow(len, 0);
+
+#if CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED
+  time_t t = time(nullptr);
+#else
+  time_t t = 0;
+#endif
+
+  ble_npl_hw_enter_critical();
+  m_attr_value = res;
+  uint16_t offset = 0;
+  for (const os_mbuf *next = om; next != nullptr; next = SLIST_NEXT(next, om_next)) {
+    memcpy(m_attr_value + offset, next->om_data, next->om_len);
+    offset += next->om_len;
+  }
+  m_attr_value[len] = '\0';
+  m_attr_len = len;
+  setTimeStamp(t);
+  ble_npl_hw_exit_critical(0);
+  return true;
+}
+
 inline AttributeValue &AttributeValue::append(const uint8_t *value, uint16_t len) {
   if (len < 1) {
     return *this;
@@ -398,13 +598,8 @@ inline AttributeValue &AttributeValue::append(const uint8_t *value, uint16_t len
     return *this;
   }
 
-  uint8_t *res = m_attr_value;
   uint16_t new_len = m_attr_len + len;
-  if (new_len > m_capacity) {
-    res = (uint8_t *) realloc(m_attr_value, (new_len + 1));
-    m_capacity = new_len;
-  }
-  assert(res && "append: realloc failed");
+  uint8_t *res = grow(new_len, m_attr_len);
 
 #if CONFIG_NIMBLE_CPP_ATT_VALUE_TIMESTAMP_ENABLED
   time_t t = time(nullptr);
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include "nimble/AdvertisementBuilder.hpp"
 #include "nimble/UUID.hpp"
 
 /****  FIX COMPILATION ****/
@@ -54,6 +55,16 @@ public:
   void setManufacturerId(uint16_t manufacturerId);
   void setProximityUUID(const UUID &uuid);
   void setSignalPower(int8_t signalPower);
+
+  /**
+   * @brief Append the beacon as manufacturer data to an advertisement.
+   * @param [in] adv The advertisement to add the beacon to.
+   * @return True if the beacon fits in the remaining space.
+   */
+  template<size_t N>
+  bool encode(AdvertisementBuilder<N> &adv) const {
+    return adv.addField(BLE_HS_ADV_TYPE_MFG_DATA, m_beaconData);
+  }
 };// NimBLEBeacon
 
 }
@@ -0,0 +1,82 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include <cstddef>
+#include <cstdint>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+/**
+ * @brief The wire format shared by BulkTransferService and BulkTransferClient.
+ * @details The data is cut into blocks of up to MAX_CHUNKS chunks, each chunk sized to fit one
+ * write without response. The client writes the chunks of up to a window of blocks to the data
+ * characteristic, each followed by a BLOCK_END carrying the CRC-32 of the block, on the control
+ * characteristic. The server notifies an ACK for every block it received intact, or a NACK with
+ * the bitmap of the missing chunks, which the client sends again. Blocks are handed to the sink in
+ * order. All values are little endian.
+ *
+ * * Data: block (2), chunk (1), payload.
+ * * START: op, total length (4), chunk payload size (2), chunks per block (1), window (1).
+ * * BLOCK_END: op, block (2), CRC-32 (4).
+ * * FINISH, ABORT: op.
+ * * START_ACK, FINISH_ACK, ERROR: op, status (1).
+ * * BLOCK_ACK: op, block (2).
+ * * BLOCK_NACK: op, block (2), missing chunks bitmap (4).
+ */
+struct BulkTransfer {
+  static constexpr const char *SERVICE_UUID = "8a1c0000-5e3b-4c1f-9d5e-3a0b7f2c9e10";
+  static constexpr const char *DATA_UUID = "8a1c0001-5e3b-4c1f-9d5e-3a0b7f2c9e10";
+  static constexpr const char *CONTROL_UUID = "8a1c0002-5e3b-4c1f-9d5e-3a0b7f2c9e10";
+
+  static constexpr size_t DATA_HEADER_SIZE = 3;
+  static constexpr uint8_t MAX_CHUNKS = 32;
+  static constexpr uint8_t MAX_WINDOW = 16;
+
+  enum Op : uint8_t {
+    START = 0x01,
+    BLOCK_END = 0x02,
+    FINISH = 0x03,
+    ABORT = 0x04,
+    START_ACK = 0x81,
+    BLOCK_ACK = 0x82,
+    BLOCK_NACK = 0x83,
+    FINISH_ACK = 0x84,
+    ERROR = 0x85,
+  };
+
+  enum Status : uint8_t {
+    OK = 0,
+    REJECTED = 1,
+    NO_MEMORY = 2,
+    INVALID = 3,
+    SINK_ERROR = 4,
+    INCOMPLETE = 5,
+    TIMEOUT = 6,
+    DISCONNECTED = 7,
+  };
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
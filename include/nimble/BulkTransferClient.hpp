@@ -0,0 +1,101 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include "nimble/BulkTransfer.hpp"
+#include "nimble/UUID.hpp"
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+class Client;
+class RemoteCharacteristic;
+
+/**
+ * @brief The sending side of the bulk transfer protocol, see BulkTransfer.
+ * @details Keeps a window of blocks in flight with writes without response and sends again only the
+ * chunks the server reports missing. With a 247 byte MTU a block holds up to 7.7kB, so the default
+ * window of 4 blocks keeps the link busy while the server verifies and writes earlier blocks.
+ */
+class BulkTransferClient {
+public:
+  /**
+   * @brief The result of a transfer.
+   */
+  struct Result {
+    size_t bytesSent;        /// Number of bytes acknowledged by the server.
+    uint32_t blocks;         /// Number of blocks of the transfer.
+    uint32_t retransmits;    /// Number of blocks sent again in part or whole.
+    uint32_t elapsedMs;      /// Time taken by the transfer in milliseconds.
+    uint32_t bytesPerSecond; /// Achieved throughput.
+    BulkTransfer::Status status;/// OK or the reason the transfer stopped.
+  };
+
+  explicit BulkTransferClient(Client *pClient, const UUID &uuid = UUID(BulkTransfer::SERVICE_UUID));
+  ~BulkTransferClient();
+
+  bool begin();
+  bool send(const uint8_t *data, size_t length, Result *result = nullptr);
+  void setWindow(uint8_t blocks);
+  void setChunksPerBlock(uint8_t chunks);
+  void setTimeout(uint32_t timeoutMs);
+
+private:
+  struct Reply {
+    uint8_t op;
+    uint8_t status;
+    uint16_t block;
+    uint32_t missing;
+  };
+
+  void onNotify(const uint8_t *data, size_t length);
+  bool waitReply(Reply *reply, uint32_t timeoutMs);
+  bool waitStatus(BulkTransfer::Op op, BulkTransfer::Status *status);
+  bool request(const uint8_t *data, size_t length, BulkTransfer::Op op, BulkTransfer::Status *status);
+  bool sendControl(const uint8_t *data, size_t length);
+  bool sendBlock(const uint8_t *data, size_t length, uint16_t block, uint32_t chunks);
+  bool sendBlockEnd(const uint8_t *data, size_t length, uint16_t block);
+
+private:
+  Client *m_pClient;
+  UUID m_uuid;
+  RemoteCharacteristic *m_pData;
+  RemoteCharacteristic *m_pControl;
+  QueueHandle_t m_replies;
+  std::vector<uint8_t> m_packet;
+  uint32_t m_timeoutMs;
+  size_t m_blockSize;
+  uint16_t m_chunkSize;
+  uint8_t m_window;
+  uint8_t m_chunksPerBlock;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
@@ -0,0 +1,142 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <vector>
+
+#include "nimble/BulkTransfer.hpp"
+#include "nimble/Characteristic.hpp"
+#include "nimble/UUID.hpp"
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+class Server;
+class Service;
+class BulkTransferCallbacks;
+
+/**
+ * @brief The receiving side of the bulk transfer protocol, see BulkTransfer.
+ * @details Chunks are copied once, from the received mbufs into a window of block buffers, and every
+ * verified block is passed to the sink straight from that buffer, so an esp_ota_write() in
+ * BulkTransferCallbacks::onData() gets the data without further copies. One transfer runs at a
+ * time, a new START restarts it. The callbacks are called from the NimBLE host task.
+ */
+class BulkTransferService {
+public:
+  BulkTransferService(Server *pServer, BulkTransferCallbacks *pCallbacks, size_t maxBufferSize = 32768,
+                      const UUID &uuid = UUID(BulkTransfer::SERVICE_UUID));
+  ~BulkTransferService() = default;
+
+  bool start();
+  [[nodiscard]] Service *getService() const;
+  [[nodiscard]] bool isActive() const;
+  [[nodiscard]] size_t getReceived() const;
+
+private:
+  class DataCallbacks : public CharacteristicCallbacks {
+  public:
+    explicit DataCallbacks(BulkTransferService *pService) : m_pService(pService) {}
+    bool onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om, ConnectionInfo &connInfo) override;
+
+  private:
+    BulkTransferService *m_pService;
+  };
+
+  class ControlCallbacks : public CharacteristicCallbacks {
+  public:
+    explicit ControlCallbacks(BulkTransferService *pService) : m_pService(pService) {}
+    bool onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om, ConnectionInfo &connInfo) override;
+
+  private:
+    BulkTransferService *m_pService;
+  };
+
+  struct Slot {
+    uint16_t block;
+    uint32_t received;
+  };
+
+  void onData(const os_mbuf *om);
+  void onControl(const os_mbuf *om, ConnectionInfo &connInfo);
+  void onStart(const uint8_t *data, size_t length, ConnectionInfo &connInfo);
+  void onBlockEnd(uint16_t block, uint32_t crc);
+  void onFinish();
+  void finish(bool success);
+  [[nodiscard]] size_t getBlockLength(uint16_t block) const;
+  [[nodiscard]] uint32_t getBlockMask(uint16_t block) const;
+  void reply(BulkTransfer::Op op, BulkTransfer::Status status);
+  void replyBlock(BulkTransfer::Op op, uint16_t block, uint32_t missing = 0);
+
+private:
+  DataCallbacks m_dataCallbacks;
+  ControlCallbacks m_controlCallbacks;
+  BulkTransferCallbacks *m_pCallbacks;
+  Service *m_pService;
+  Characteristic *m_pControl;
+  size_t m_maxBufferSize;
+  std::vector<uint8_t> m_buffer;
+  std::vector<Slot> m_slots;
+  size_t m_totalLength;
+  size_t m_blockSize;
+  uint16_t m_chunkSize;
+  uint16_t m_blockCount;
+  uint16_t m_nextBlock;
+  uint16_t m_connHandle;
+  uint8_t m_chunksPerBlock;
+  bool m_active;
+};
+
+/**
+ * @brief Callbacks of a BulkTransferService, the sink of the received data.
+ */
+class BulkTransferCallbacks {
+public:
+  virtual ~BulkTransferCallbacks() = default;
+
+  /**
+   * @brief Called when a client starts a transfer, e.g. to call esp_ota_begin().
+   * @param [in] totalLength The length of the data.
+   * @param [in] connInfo The connection of the client.
+   * @return False to reject the transfer.
+   */
+  virtual bool onStart(size_t totalLength, ConnectionInfo &connInfo) { return true; };
+
+  /**
+   * @brief Called with every verified block, in order, e.g. to call esp_ota_write().
+   * @param [in] offset The offset of the block in the data.
+   * @param [in] data The block, only valid during the callback.
+   * @param [in] length The length of the block.
+   * @return False to abort the transfer.
+   */
+  virtual bool onData(size_t offset, const uint8_t *data, size_t length) { return true; };
+
+  /**
+   * @brief Called when the transfer ended, e.g. to call esp_ota_end().
+   * @param [in] success True if all the data was received and written to the sink.
+   */
+  virtual void onComplete(bool success) {};
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
@@ -0,0 +1,126 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <host/ble_gap.h>
+#include <os/os_mbuf.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS
+#define CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS 50
+#endif
+
+namespace nimble {
+
+class AdvertisedDevice;
+class ScanCallbacks;
+class Characteristic;
+class CharacteristicCallbacks;
+class Server;
+class ServerCallbacks;
+class RemoteCharacteristic;
+
+/**
+ * @brief Runs the application callbacks from worker tasks instead of the NimBLE host task.
+ * @details The host task copies the event data into a preallocated queue and returns, so slow
+ * callbacks no longer delay other connections. Dispatched callbacks are:
+ * * ScanCallbacks::onDiscovered() and onResult(), called with a copy of the advertised device
+ *   that is only valid during the callback.
+ * * CharacteristicCallbacks::onWrite(), getValue() returns the latest value written.
+ * * The notify_callback of RemoteCharacteristic::subscribe(), the notification mbuf is held
+ *   until the callback returns.
+ * * ServerCallbacks::onConnect() and onDisconnect().
+ *
+ * Events of a connection always run on the same worker, in the order they occurred. Each queue
+ * has its own depth, an event is dropped when its queue is full, or with the BLOCK policy after
+ * waiting for the workers to make room. The callback of a dropped event is not called, so the
+ * callbacks of a connection never run out of order, getDropped() counts them. Characteristics and services must not be deleted
+ * while events for them may still be queued.
+ */
+class CallbackDispatcher {
+public:
+  enum Queue : uint8_t {
+    SCAN,
+    GATT,
+    CONNECTION,
+    QUEUE_MAX,
+  };
+
+  enum OverflowPolicy : uint8_t {
+    DROP,
+    BLOCK,
+  };
+
+  static void setOverflowPolicy(Queue queue, OverflowPolicy policy, uint32_t timeoutMs = 0);
+  static uint32_t getDropped(Queue queue);
+
+private:
+  friend class Device;
+  friend class Scan;
+  friend class Characteristic;
+  friend class Server;
+  friend class Client;
+
+  enum EventType : uint8_t {
+    SCAN_DISCOVERED,
+    SCAN_RESULT,
+    CHR_WRITE,
+    NOTIFY_RX,
+    SERVER_CONNECT,
+    SERVER_DISCONNECT,
+    STOP,
+  };
+
+  struct Event {
+    EventType type;
+    Queue queue;
+    bool isNotify;
+    int reason;
+    void *pObject;
+    void *pCallbacks;
+    os_mbuf *om;
+    ble_gap_conn_desc desc;
+  };
+
+  static void start(BaseType_t core);
+  static void stop();
+  static bool dispatchScan(bool result, const AdvertisedDevice *pDevice, ScanCallbacks *pCallbacks);
+  static bool dispatchWrite(Characteristic *pChr, CharacteristicCallbacks *pCallbacks, const ble_gap_conn_desc &desc);
+  static bool dispatchNotify(RemoteCharacteristic *pChr, uint16_t connHandle, os_mbuf *om, bool isNotify);
+  static bool dispatchConnect(Server *pServer, ServerCallbacks *pCallbacks, const ble_gap_conn_desc &desc);
+  static bool dispatchDisconnect(Server *pServer, ServerCallbacks *pCallbacks, const ble_gap_conn_desc &desc, int reason);
+  static bool reserve(Queue queue);
+  static void release(Queue queue);
+  static void post(uint16_t connHandle, const Event &event);
+  static void run(Event &event);
+  static void finish(Event &event);
+  static void drain(QueueHandle_t queue);
+  static void task(void *arg);
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER */
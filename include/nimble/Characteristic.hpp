@@ -22,6 +22,7 @@
 #undef min
 #undef max
 /**************************/
+#include <bitset>
 #include <string>
 
 #include <vector>
@@ -31,6 +32,8 @@
 #include "nimble/Descriptor.hpp"
 
 
+#define NIMBLE_SUB_NOTIFY 0x0001
+#define NIMBLE_SUB_INDICATE 0x0002
 
 namespace nimble {
 
@@ -63,6 +66,10 @@ using Descriptors = std::vector<DescriptorPtr>;
  */
 class Characteristic {
   friend class Service;
+  friend class Server;
+  friend class GattTable;
+  friend class HIDReportSender;
+  friend class NotifyBatch;
 
 public:
   explicit Characteristic(const char *uuid, uint16_t properties = Property::READ | Property::WRITE, uint16_t maxLen = BLE_ATT_ATTR_MAX_LEN, Service *pService = nullptr);
@@ -90,6 +97,7 @@ public:
   Service *getService();
   uint16_t getProperties();
   AttributeValue getValue(time_t *timestamp = nullptr);
+  AttributeValueView getValueView() const;
   size_t getDataLength();
   void setValue(const uint8_t *data, size_t size);
   void setValue(const std::vector<uint8_t> &vec);
@@ -151,6 +159,8 @@ public:
 private:
   void setService(Service *pService);
   void setSubscribe(struct ble_gap_event *event);
+  [[nodiscard]] uint16_t getSubscribeValue(size_t peerIndex) const;
+  void clearSubscribe(size_t peerIndex);
   static int handleGapEvent(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 private:
@@ -163,7 +173,9 @@ private:
   std::vector<Descriptor *> m_dscVec;
   uint8_t m_removed;
 
-  std::vector<std::pair<uint16_t, uint16_t>> m_subscribedVec;
+  // Subscribed peers, indexed by their slot in the server peer state table.
+  std::bitset<CONFIG_BT_NIMBLE_MAX_CONNECTIONS> m_notifySubs;
+  std::bitset<CONFIG_BT_NIMBLE_MAX_CONNECTIONS> m_indicateSubs;
 };// NimBLECharacteristic
 
 using CharacteristicPtr = Characteristic *;
@@ -180,6 +192,7 @@ public:
   virtual ~CharacteristicCallbacks() = default;
   virtual void onRead(CharacteristicPtr characteristic, ConnectionInfo &connInfo);
   virtual void onWrite(CharacteristicPtr characteristic, ConnectionInfo &connInfo);
+  virtual bool onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om, ConnectionInfo &connInfo);
   virtual void onNotify(CharacteristicPtr characteristic);
   virtual void onStatus(CharacteristicPtr characteristic, int code);
   virtual void onSubscribe(CharacteristicPtr characteristic, ConnectionInfo &connInfo, uint16_t subValue);
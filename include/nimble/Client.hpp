@@ -19,15 +19,23 @@
 
 #include "nimble/Address.hpp"
 #include "nimble/AdvertisedDevice.hpp"
+#include "nimble/AttributeCache.hpp"
 #include "nimble/AttributeValue.hpp"
 #include "nimble/ConnectionInfo.hpp"
 #include "nimble/RemoteService.hpp"
+#include "nimble/Stats.hpp"
 #include "nimble/UUID.hpp"
 #include "nimble/Utils.hpp"
 
+#include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#ifndef BLE_GATT_READ_MAX_ATTRS
+#define BLE_GATT_READ_MAX_ATTRS 8
+#endif
+
 /****  FIX COMPILATION ****/
 #undef min
 #undef max
@@ -37,21 +45,47 @@ namespace nimble {
 
 class RemoteService;
 class RemoteCharacteristic;
+class RemoteDescriptor;
 class ClientCallbacks;
 class AdvertisedDevice;
+class Client;
+
+// Same as in RemoteCharacteristic.hpp, which includes this header before declaring it.
+typedef std::function<void(RemoteCharacteristic *pBLERemoteCharacteristic, uint8_t *pData, size_t length, bool isNotify)> notify_callback;
+
+/**
+ * @brief Completion callback of an asynchronous client operation, called from the NimBLE host task
+ * with 0 on success or a NimBLE error code.
+ */
+typedef std::function<void(Client *pClient, int rc)> client_complete_callback;
 
 /**
  * @brief A model of a %BLE client.
  */
 class Client {
   friend class Device;
+  friend class AttributeCache;
   friend class RemoteService;
   friend class ClientCallbacks;
+  friend class CallbackDispatcher;
 
 public:
+  /**
+   * @brief Statistics of the last attribute discovery.
+   */
+  struct DiscoveryStats {
+    uint32_t procedures;     /// Number of GATT discovery procedures issued.
+    uint32_t roundTrips;     /// Number of ATT request/response exchanges.
+    uint16_t services;       /// Number of services found.
+    uint16_t characteristics;/// Number of characteristics found.
+    uint16_t descriptors;    /// Number of descriptors found.
+    uint32_t elapsedMs;      /// Time taken by the discovery in milliseconds.
+  };
+
   bool connect(AdvertisedDevice *device, bool deleteAttributes = true);
   bool connect(const Address &address, bool deleteAttributes = true);
   bool connect(bool deleteAttributes = true);
+  bool connectAsync(const Address &address, client_complete_callback callback, bool deleteAttributes = true);
   int disconnect(uint8_t reason = BLE_ERR_REM_USER_CONN_TERM);
   Address getPeerAddress();
   void setPeerAddress(const Address &address);
@@ -67,6 +101,12 @@ public:
   bool setValue(const UUID &serviceUUID, const UUID &characteristicUUID,
                 const AttributeValue &value, bool response = false);
   RemoteCharacteristic *getCharacteristic(uint16_t handle);
+  bool readMultiple(const std::vector<RemoteCharacteristic *> &characteristics,
+                    const std::vector<uint16_t> &lengths = {});
+  bool subscribeAll(const std::vector<RemoteCharacteristic *> &characteristics,
+                    notify_callback notifyCallback = nullptr,
+                    bool notifications = true,
+                    bool response = true);
   bool isConnected();
   void setClientCallbacks(ClientCallbacks *pClientCallbacks, bool deleteCallbacks = true);
   std::string toString();
@@ -80,7 +120,12 @@ public:
   void updateConnParams(uint16_t minInterval, uint16_t maxInterval,
                         uint16_t latency, uint16_t timeout);
   void setDataLen(uint16_t tx_octets);
-  bool discoverAttributes();
+  void setConnectPhy(uint8_t mask);
+  bool setPhy(uint8_t txPhyMask, uint8_t rxPhyMask, uint16_t phyOptions = 0);
+  bool getPhy(uint8_t *txPhy, uint8_t *rxPhy);
+  bool discoverAttributes(bool singlePass = false);
+  bool discoverAttributesAsync(client_complete_callback callback);
+  DiscoveryStats getDiscoveryStats();
   ConnectionInfo getConnInfo();
   int getLastError();
 
@@ -95,7 +140,36 @@ private:
                                  const struct ble_gatt_svc *service,
                                  void *arg);
   static void dcTimerCb(ble_npl_event *event);
+  static int readMultipleCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                            struct ble_gatt_attr *attr, void *arg);
+  static int readMultipleVariableCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                                    struct ble_gatt_attr *attrs, uint8_t num_attrs, void *arg);
+  bool readMultipleFixed(const std::vector<RemoteCharacteristic *> &characteristics,
+                         const std::vector<uint16_t> &lengths);
+  bool readMultipleVariable(const std::vector<RemoteCharacteristic *> &characteristics);
+  int readChained(const std::vector<RemoteCharacteristic *> &characteristics, size_t *index);
+  int writeChained(const std::vector<std::pair<RemoteDescriptor *, uint16_t>> &writes, size_t *index);
   bool retrieveServices(const UUID *uuid_filter = nullptr);
+  struct DiscoveryContext;
+
+  bool discoverSinglePass();
+  void finishCharacteristicPass(DiscoveryContext &ctx);
+  void continueDiscovery(int rc);
+  void completeConnect(int rc);
+  int gapConnect(const ble_addr_t *peerAddr);
+  static int singlePassChrCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                             const struct ble_gatt_chr *chr, void *arg);
+  static int singlePassDscCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                             uint16_t chr_val_handle, const struct ble_gatt_dsc *dsc, void *arg);
+  void rebuildHandleTable();
+  RemoteCharacteristic *findHandle(uint16_t handle);
+  struct Retired;
+
+  void beginRead();
+  void endRead();
+  void release();
+  void retire(std::vector<RemoteService *> services, std::vector<RemoteCharacteristic *> characteristics);
+  static void reclaim(Retired *pList);
 
 private:
   Address m_peerAddress;
@@ -104,11 +178,43 @@ private:
   bool m_connEstablished;
   bool m_deleteCallbacks;
   int32_t m_connectTimeout;
+  uint8_t m_phyMask;
   ClientCallbacks *m_pClientCallbacks;
   ble_task_data_t *m_pTaskData;
   ble_npl_callout m_dcTimer;
 
   std::vector<RemoteService *> m_servicesVector;
+  DiscoveryStats m_discoveryStats;
+#if CONFIG_NIMBLE_CPP_STATS
+  uint32_t m_connectStartUs;
+#endif
+
+  // State of connectAsync() and discoverAttributesAsync(), these complete from the host task.
+  ble_task_data_t m_asyncTaskData;
+  client_complete_callback m_connectCallback;
+  bool m_asyncDeleteAttributes;
+  ble_task_data_t m_discoveryTaskData;
+  client_complete_callback m_discoveryCallback;
+  DiscoveryContext *m_pDiscoveryCtx;
+
+  /**
+   * @brief An entry of the characteristic value handle lookup table, a handle of 0 marks an empty slot.
+   */
+  struct HandleEntry {
+    uint16_t handle;
+    RemoteCharacteristic *pChr;
+  };
+
+  // Open addressing table of all discovered characteristics keyed by value handle, size is a power of 2.
+  std::vector<HandleEntry> m_handleTable;
+
+  // Attributes removed from the tree while a reader may still hold them, deleted when the last reader ends.
+  uint16_t m_readers;
+  Retired *m_pRetired;
+  bool m_deleteOnRelease;
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  uint16_t m_serviceChangedHandle;
+#endif
 
 private:
   ble_gap_conn_params m_pConnParams;
@@ -162,6 +268,14 @@ public:
      * @return True to accept the pin.
      */
   virtual bool onConfirmPIN(uint32_t pin);
+
+  /**
+     * @brief Called when the PHY of the connection changed or a PHY update request completed.
+     * @param [in] pClient A pointer to the calling client object.
+     * @param [in] txPhy The transmit PHY, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED.
+     * @param [in] rxPhy The receive PHY.
+     */
+  virtual void onPhyUpdate(Client *pClient, uint8_t txPhy, uint8_t rxPhy);
 };
 
 }// namespace nimble
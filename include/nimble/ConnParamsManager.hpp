@@ -0,0 +1,135 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include <cstddef>
+#include <cstdint>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+#define CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS 0
+#endif
+
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+
+#include <atomic>
+
+#include <nimble/nimble_npl.h>
+
+namespace nimble {
+
+class ConnectionInfo;
+class ConnParamsCallbacks;
+
+/**
+ * @brief Connection settings applied in one traffic mode.
+ */
+struct ConnParamsProfile {
+  uint16_t minInterval;/// Minimum connection interval in 1.25ms units.
+  uint16_t maxInterval;/// Maximum connection interval in 1.25ms units.
+  uint16_t latency;    /// Number of connection events the peripheral may skip.
+  uint16_t timeout;    /// Supervision timeout in 10ms units.
+  uint16_t txOctets;   /// Preferred data length (27 - 251), 0 to leave it unchanged.
+  uint8_t phyMask;     /// Preferred BLE_GAP_LE_PHY_*_MASK bits, 0 to leave the PHY unchanged.
+};
+
+/**
+ * @brief Switches every connection between an idle and a burst profile depending on its traffic.
+ * @details The bytes notified, indicated and written on each connection, in both roles, are counted
+ * and the rate is checked every window on the NimBLE host task. A connection switches to the burst
+ * profile as soon as a window reaches the burst threshold, and back to the idle profile once the
+ * rate stayed below the idle threshold for a number of windows. A switch waits for the
+ * BLE_GAP_EVENT_CONN_UPDATE of the previous one. New connections start in burst mode, they are
+ * moved to the idle profile when nothing is sent.
+ */
+class ConnParamsManager {
+public:
+  enum Mode : uint8_t {
+    IDLE,
+    BURST,
+  };
+
+  static void setProfile(Mode mode, const ConnParamsProfile &profile);
+  static void setThresholds(uint32_t burstBytesPerSec, uint32_t idleBytesPerSec, uint8_t idleWindows = 3);
+  static void setWindow(uint32_t windowMs);
+  static void setCallbacks(ConnParamsCallbacks *pCallbacks);
+  static bool start();
+  static void stop();
+  [[nodiscard]] static bool isRunning();
+  [[nodiscard]] static Mode getMode(uint16_t connHandle);
+  static void countBytes(uint16_t connHandle, size_t length);
+
+private:
+  friend class Server;
+  friend class Client;
+
+  struct Link {
+    std::atomic<uint32_t> bytes;
+    uint16_t connHandle;
+    bool active;
+    Mode mode;
+    Mode requested;
+    bool pending;
+    uint8_t quietWindows;
+    uint8_t pendingWindows;
+  };
+
+  static void onConnect(uint16_t connHandle);
+  static void onDisconnect(uint16_t connHandle);
+  static void onConnUpdate(uint16_t connHandle, int status);
+  static Link *findLink(uint16_t connHandle);
+  static void apply(Link &link, Mode mode);
+  static void evaluate();
+  static void timerCb(ble_npl_event *event);
+};
+
+/**
+ * @brief Callbacks of the ConnParamsManager, called from the NimBLE host task.
+ */
+class ConnParamsCallbacks {
+public:
+  virtual ~ConnParamsCallbacks() = default;
+
+  /**
+   * @brief Called when the peer accepted the parameters of a new mode.
+   * @param [in] connInfo The connection, with the updated parameters.
+   * @param [in] mode The mode now in use.
+   */
+  virtual void onModeChange(ConnectionInfo &connInfo, ConnParamsManager::Mode mode) {};
+
+  /**
+   * @brief Called when the parameters of a new mode were rejected, the switch is retried next window.
+   * @param [in] connHandle The connection handle.
+   * @param [in] mode The requested mode.
+   * @param [in] reason The status of the connection update.
+   */
+  virtual void onModeChangeFailed(uint16_t connHandle, ConnParamsManager::Mode mode, int reason) {};
+};
+
+}// namespace nimble
+
+#define NIMBLE_CONN_TRAFFIC(connHandle, length) nimble::ConnParamsManager::countBytes(connHandle, length)
+#else
+#define NIMBLE_CONN_TRAFFIC(connHandle, length) (void) 0
+#endif /* CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS */
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
@@ -33,6 +33,8 @@ class ConnectionInfo {
   friend class Client;
   friend class Characteristic;
   friend class Descriptor;
+  friend class CallbackDispatcher;
+  friend class ConnParamsManager;
 
   ble_gap_conn_desc m_desc{};
   ConnectionInfo() { m_desc = {}; }
@@ -60,6 +62,20 @@ public:
   /** @brief Gets the maximum transmission unit size for this connection (in bytes) */
   [[nodiscard]] uint16_t getMTU() const { return ble_att_mtu(m_desc.conn_handle); }
 
+  /** @brief Gets the transmit PHY of this connection, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED, 0 if unknown */
+  [[nodiscard]] uint8_t getTxPhy() const {
+    uint8_t txPhy = 0, rxPhy = 0;
+    ble_gap_read_le_phy(m_desc.conn_handle, &txPhy, &rxPhy);
+    return txPhy;
+  }
+
+  /** @brief Gets the receive PHY of this connection, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED, 0 if unknown */
+  [[nodiscard]] uint8_t getRxPhy() const {
+    uint8_t txPhy = 0, rxPhy = 0;
+    ble_gap_read_le_phy(m_desc.conn_handle, &txPhy, &rxPhy);
+    return rxPhy;
+  }
+
   /** @brief Check if we are in the master role in this connection */
   [[nodiscard]] bool isMaster() const { return (m_desc.role == BLE_GAP_ROLE_MASTER); }
 
@@ -0,0 +1,119 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include <vector>
+
+#include <nimble/nimble_npl.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/Address.hpp"
+
+namespace nimble {
+
+class Client;
+class ConnectionManagerCallbacks;
+
+/**
+ * @brief Brings up and keeps connections to a set of peripherals without blocking any task.
+ * @details Connection attempts are started back to back (the host allows one at a time) and
+ * attribute discovery runs on every established link concurrently, all driven from host events.
+ * Failed attempts are retried with an exponential backoff. Clients are taken from, and left in,
+ * the device client list. The state shared with the host task is only touched in critical sections,
+ * the targets can only be changed while the manager is stopped and no attempt is in progress.
+ */
+class ConnectionManager {
+public:
+  explicit ConnectionManager(ConnectionManagerCallbacks *pCallbacks = nullptr);
+  ~ConnectionManager();
+
+  bool addTarget(const Address &address);
+  bool removeTarget(const Address &address);
+  void setRetries(uint8_t maxRetries, uint32_t backoffMs = 250);
+  void setDiscoverAttributes(bool discover);
+  bool start();
+  void stop();
+  [[nodiscard]] bool isRunning() const;
+  [[nodiscard]] size_t getReadyCount() const;
+
+private:
+  enum State : uint8_t {
+    IDLE,
+    CONNECTING,
+    DISCOVERING,
+    READY,
+    FAILED,
+  };
+
+  struct Target {
+    Address address;
+    Client *pClient;
+    State state;
+    uint8_t attempts;
+    ble_npl_time_t retryAt;
+  };
+
+  static void timerCb(ble_npl_event *event);
+  void schedule();
+  void onConnect(Client *pClient, int rc);
+  void onDiscover(Client *pClient, int rc);
+  void retry(Target &target, int rc);
+  Target *findTarget(Client *pClient);
+  bool isBusy() const;
+
+private:
+  std::vector<Target> m_targets;
+  ConnectionManagerCallbacks *m_pCallbacks;
+  ble_npl_callout m_timer;
+  uint32_t m_backoffMs;
+  uint8_t m_maxRetries;
+  bool m_discover;
+  bool m_running;
+  bool m_restart;
+  bool m_scheduling;
+  bool m_connecting;
+};
+
+/**
+ * @brief Callbacks of a ConnectionManager, called from the NimBLE host task.
+ */
+class ConnectionManagerCallbacks {
+public:
+  virtual ~ConnectionManagerCallbacks() = default;
+
+  /**
+   * @brief Called when a target is connected and, if enabled, its attributes are discovered.
+   * @param [in] pClient The client connected to the target.
+   */
+  virtual void onReady(Client *pClient) {};
+
+  /**
+   * @brief Called when a target could not be brought up after all retries.
+   * @param [in] address The address of the target.
+   * @param [in] reason The error of the last attempt.
+   */
+  virtual void onFailed(const Address &address, int reason) {};
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
@@ -33,6 +33,8 @@ class DescriptorCallbacks;
  */
 class Descriptor {
   friend class Characteristic;
+  friend class GattTable;
+  friend class Service;
 
 public:
   Descriptor(const char *uuid, uint16_t properties, uint16_t max_len, Characteristic *pCharacteristic = nullptr);
@@ -50,6 +52,7 @@ public:
 
   size_t getLength();
   AttributeValue getValue(time_t *timestamp = nullptr);
+  AttributeValueView getValueView() const;
   std::string getStringValue();
 
   void setValue(const uint8_t *data, size_t size);
@@ -104,6 +107,7 @@ public:
   virtual ~DescriptorCallbacks() = default;
   virtual void onRead(Descriptor *pDescriptor, ConnectionInfo &connInfo);
   virtual void onWrite(Descriptor *pDescriptor, ConnectionInfo &connInfo);
+  virtual bool onWriteRaw(Descriptor *pDescriptor, const os_mbuf *om, ConnectionInfo &connInfo);
 };
 
 }// namespace nimble
@@ -22,6 +22,7 @@
 #include <string>
 
 #include <esp_bt.h>
+#include <freertos/FreeRTOS.h>
 
 /****  FIX COMPILATION ****/
 #undef min
@@ -30,31 +31,61 @@
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
 #include "nimble/Scan.hpp"
+#if CONFIG_BT_NIMBLE_EXT_ADV && CONFIG_BT_NIMBLE_ENABLE_PERIODIC_SYNC
+#include "nimble/PeriodicSync.hpp"
+#endif
 #endif
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
+#if CONFIG_BT_NIMBLE_EXT_ADV
+#include "nimble/ExtAdvertising.hpp"
+#else
 #include "nimble/Advertising.hpp"
 #endif
+#endif
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
 #include "nimble/Client.hpp"
+#include "nimble/ConnectionManager.hpp"
 #endif
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
 #include "nimble/Server.hpp"
 #endif
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+#include "nimble/L2CAPServer.hpp"
+#endif
+
 #include "nimble/Address.hpp"
+#include "nimble/AddressSet.hpp"
+#include "nimble/Memory.hpp"
+#include "nimble/Stats.hpp"
 #include "nimble/Utils.hpp"
 
 typedef int (*gap_event_handler)(ble_gap_event *event, void *arg);
 
 extern "C" void ble_store_config_init(void);
 
+#ifndef CONFIG_NIMBLE_CPP_HOST_TASK_CUSTOM
+#define CONFIG_NIMBLE_CPP_HOST_TASK_CUSTOM 0
+#endif
 
+#ifndef CONFIG_NIMBLE_CPP_TASK_CORE
+#define CONFIG_NIMBLE_CPP_TASK_CORE -2
+#endif
 
 namespace nimble {
 
+/**
+ * @brief Placement of the NimBLE host task.
+ */
+struct TaskConfig {
+  BaseType_t core;      /// Core to pin the task to, or tskNO_AFFINITY.
+  UBaseType_t priority; /// FreeRTOS priority of the task.
+  uint32_t stackSize;   /// Stack size in bytes.
+};
+
 /**
  * @brief A model of a %BLE Device from which all the BLE roles are created.
  */
@@ -74,11 +105,21 @@ class Device {
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
   friend class Advertising;
+  friend class ExtAdvertising;
+  friend class ExtAdvertisement;
 #endif
 
 public:
+  /**
+   * @brief Pin the library tasks to the core not running the host task, see init().
+   */
+  static constexpr BaseType_t TASK_CORE_OTHER = -2;
+
   static void init(std::string const &deviceName);
+  static void init(std::string const &deviceName, const TaskConfig &hostTask, BaseType_t taskCore = TASK_CORE_OTHER);
   static void deinit(bool clearAll = false);
+  static BaseType_t getHostTaskCore();
+  static BaseType_t getTaskCore();
   static void setDeviceName(std::string const &deviceName);
   static bool isInitialized();
   static Address getAddress();
@@ -100,6 +141,12 @@ public:
   static Server *getServer();
 #endif
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+public:
+  static L2CAPServer *createL2CAPServer();
+  static L2CAPServer *getL2CAPServer();
+#endif
+
 public:
   static void setPower(esp_power_level_t powerLevel, esp_ble_power_type_t powerType = ESP_BLE_PWR_TYPE_DEFAULT);
   static int8_t getPower(esp_ble_power_type_t powerType = ESP_BLE_PWR_TYPE_DEFAULT);
@@ -122,13 +169,23 @@ public:
   static bool isIgnored(const Address &address);
   static void addIgnored(const Address &address);
   static void removeIgnored(const Address &address);
+  static DeviceStats getStats();
+  static void resetStats();
+  static MemoryStats getMemoryStats();
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
 public:
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  static ExtAdvertising *getAdvertising();
+  static bool startAdvertising(uint8_t inst_id, int duration = 0, int max_events = 0);
+  static bool stopAdvertising(uint8_t inst_id);
+  static bool stopAdvertising();
+#else
   static Advertising *getAdvertising();
   static bool startAdvertising(uint32_t duration = 0);
   static bool stopAdvertising();
 #endif
+#endif
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
 public:
@@ -154,9 +211,13 @@ private:
   static void onReset(int reason);
   static void onSync();
   static void hostTask(void *param);
+  static BaseType_t validCore(BaseType_t core);
 
 private:
   static bool m_isInitialized;
+  static bool m_customHostTask;
+  static TaskConfig m_hostTaskConfig;
+  static BaseType_t m_taskCore;
   static bool m_isSynced;
   static std::string m_deviceName;
 
@@ -168,14 +229,22 @@ private:
   static Server *m_pServer;
 #endif
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+  static L2CAPServer *m_pL2CAPServer;
+#endif
+
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  static ExtAdvertising *m_bleAdvertising;
+#else
   static Advertising *m_bleAdvertising;
 #endif
+#endif
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
   static std::list<Client *> m_cList;
 #endif
-  static std::list<Address> m_ignoreList;
+  static AddressSet m_ignoreList;
   static uint32_t m_passkey;
   static ble_gap_event_listener m_listener;
   static gap_event_handler m_customGapHandler;
@@ -185,6 +254,7 @@ private:
   static uint8_t m_scanFilterMode;
 #endif
   static std::vector<Address> m_whiteList;
+  static AddressSet m_whiteListSet;
 };
 
 }// namespace nimble
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include "nimble/AdvertisementBuilder.hpp"
 #include "nimble/UUID.hpp"
 
 #include <string>
@@ -51,6 +52,16 @@ public:
   void setCount(uint32_t advCount);
   void setTime(uint32_t tmil);
 
+  /**
+   * @brief Append the TLM frame as service data to an advertisement.
+   * @param [in] adv The advertisement to add the frame to.
+   * @return True if the frame fits in the remaining space.
+   */
+  template<size_t N>
+  bool encode(AdvertisementBuilder<N> &adv) const {
+    return adv.setServiceData16(beaconUUID, m_eddystoneData);
+  }
+
 private:
   uint16_t beaconUUID;
   struct {
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include "nimble/AdvertisementBuilder.hpp"
 #include "nimble/UUID.hpp"
 
 #include <string>
@@ -45,6 +46,19 @@ public:
   void setPower(int8_t advertisedTxPower);
   void setURL(const std::string &url);
 
+  /**
+   * @brief Append the URL frame as service data to an advertisement.
+   * @param [in] adv The advertisement to add the frame to.
+   * @return True if the frame fits in the remaining space.
+   * @details Only the used part of the URL is encoded.
+   */
+  template<size_t N>
+  bool encode(AdvertisementBuilder<N> &adv) const {
+    static_assert(N >= 6, "Advertisement too small for an Eddystone URL frame");
+    return adv.setServiceData(UUID(beaconUUID), &m_eddystoneData,
+                              sizeof(m_eddystoneData) - sizeof(m_eddystoneData.url) + lengthURL);
+  }
+
 private:
   uint16_t beaconUUID;
   uint8_t lengthURL;
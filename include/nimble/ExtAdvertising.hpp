@@ -0,0 +1,178 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if (defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER) && CONFIG_BT_NIMBLE_EXT_ADV)
+
+#include "host/ble_gap.h"
+
+#include "nimble/Address.hpp"
+#include "nimble/UUID.hpp"
+
+#include <string>
+#include <vector>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+class ExtAdvertisingCallbacks;
+
+/**
+ * @brief The payload and parameters of one extended advertising instance.
+ * @details Unlike AdvertisementData the payload is not limited to 31 bytes, an instance using
+ * extended PDUs can carry up to BLE_EXT_ADV_MAX_SIZE (1650) bytes and advertise on the Coded
+ * or 2M PHY.
+ */
+class ExtAdvertisement {
+  friend class ExtAdvertising;
+
+public:
+  explicit ExtAdvertisement(uint8_t priPhy = BLE_HCI_LE_PHY_1M, uint8_t secPhy = BLE_HCI_LE_PHY_1M);
+
+  bool setAppearance(uint16_t appearance);
+  bool setCompleteServices(const UUID &uuid);
+  bool setCompleteServices16(const std::vector<UUID> &v_uuid);
+  bool setCompleteServices32(const std::vector<UUID> &v_uuid);
+  bool setFlags(uint8_t flag);
+  bool setManufacturerData(const std::string &data);
+  bool setManufacturerData(const std::vector<uint8_t> &data);
+  bool setURI(const std::string &uri);
+  bool setName(const std::string &name);
+  bool setPartialServices(const UUID &uuid);
+  bool setPartialServices16(const std::vector<UUID> &v_uuid);
+  bool setPartialServices32(const std::vector<UUID> &v_uuid);
+  bool setServiceData(const UUID &uuid, const std::string &data);
+  bool setShortName(const std::string &name);
+  bool setData(const uint8_t *data, size_t length);
+  bool addData(const std::string &data);
+  bool addData(const uint8_t *data, size_t length);
+  bool addTxPower();
+  bool setPreferredParams(uint16_t min, uint16_t max);
+  void clearData();
+  [[nodiscard]] size_t getDataSize() const;
+  [[nodiscard]] const std::vector<uint8_t> &getPayload() const;
+
+  void setLegacyAdvertising(bool val);
+  void setConnectable(bool val);
+  void setScannable(bool val);
+  void setMinInterval(uint32_t mininterval);
+  void setMaxInterval(uint32_t maxinterval);
+  void setPrimaryPhy(uint8_t phy);
+  void setSecondaryPhy(uint8_t phy);
+  void setScanFilter(bool scanRequestWhitelistOnly, bool connectWhitelistOnly);
+  void setDirectedPeer(const Address &addr);
+  void setDirected(bool val, bool high_duty = true);
+  void setAnonymous(bool val);
+  void setPrimaryChannels(bool ch37, bool ch38, bool ch39);
+  void setTxPower(int8_t dbm);
+  void setAddress(const Address &addr);
+  void enableScanRequestCallback(bool enable);
+
+private:
+  bool setServices(bool complete, uint8_t size, const std::vector<UUID> &v_uuid);
+
+private:
+  std::vector<uint8_t> m_payload;
+  ble_gap_ext_adv_params m_params;
+  ble_addr_t m_dirAddr;
+  ble_addr_t m_randAddr;
+  bool m_setRandAddr;
+};
+
+/**
+ * @brief Perform and manage extended %BLE advertising.
+ * @details Each instance (0 to CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES - 1) is an independent
+ * advertising set with its own payload, parameters and PHY, the controller interleaves all
+ * active sets. For example a Beacon, an EddystoneURL and an EddystoneTLM frame can be
+ * broadcast at the same time by giving each its own instance.
+ *
+ * A non-connectable, non-scannable extended instance can also carry periodic advertising: after
+ * setInstanceData(), call setPeriodicParams(), setPeriodicData() and startPeriodic(), then start().
+ * Listeners synchronize with a PeriodicSync and receive the periodic data at a fixed interval
+ * without scanning.
+ */
+class ExtAdvertising {
+  friend class Device;
+  friend class Server;
+
+public:
+  explicit ExtAdvertising();
+  ~ExtAdvertising();
+
+  bool start(uint8_t inst_id, int duration = 0, int max_events = 0);
+  bool setInstanceData(uint8_t inst_id, ExtAdvertisement &adv);
+  bool setScanResponseData(uint8_t inst_id, ExtAdvertisement &data);
+  bool removeInstance(uint8_t inst_id);
+  bool removeAll();
+  bool stop(uint8_t inst_id);
+  bool stop();
+  bool isActive(uint8_t inst_id);
+  bool isAdvertising();
+  void setCallbacks(ExtAdvertisingCallbacks *pCallbacks, bool deleteCallbacks = true);
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+  bool setPeriodicParams(uint8_t inst_id, uint16_t minInterval, uint16_t maxInterval, bool includeTxPower = false);
+  bool setPeriodicData(uint8_t inst_id, ExtAdvertisement &data);
+  bool startPeriodic(uint8_t inst_id);
+  bool stopPeriodic(uint8_t inst_id);
+  bool isPeriodicActive(uint8_t inst_id);
+#endif
+
+private:
+  void onHostSync();
+  bool setData(uint8_t inst_id, const std::vector<uint8_t> &payload, bool scanResponse);
+  static int handleGapEvent(struct ble_gap_event *event, void *arg);
+
+private:
+  bool m_deleteCallbacks;
+  ExtAdvertisingCallbacks *m_pCallbacks;
+  std::vector<bool> m_advStatus;
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+  std::vector<bool> m_periodicStatus;
+#endif
+};
+
+/**
+ * @brief Callbacks associated with ExtAdvertising class events, called from the NimBLE host task.
+ */
+class ExtAdvertisingCallbacks {
+public:
+  virtual ~ExtAdvertisingCallbacks() = default;
+
+  /**
+   * @brief Handle an advertising stop event.
+   * @param [in] pAdv A convenience pointer to the extended advertising interface.
+   * @param [in] reason The reason code for stopping the advertising.
+   * @param [in] inst_id The instance ID of the advertisement that was stopped.
+   */
+  virtual void onStopped(ExtAdvertising *pAdv, int reason, uint8_t inst_id) {};
+
+  /**
+   * @brief Handle a scan response request.
+   * This is called when a scanning device requests a scan response.
+   * @param [in] pAdv A convenience pointer to the extended advertising interface.
+   * @param [in] inst_id The instance ID of the advertisement that the scan response request was made.
+   * @param [in] addr The address of the device making the request.
+   */
+  virtual void onScanRequest(ExtAdvertising *pAdv, uint8_t inst_id, Address addr) {};
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_BROADCASTER && CONFIG_BT_NIMBLE_EXT_ADV */
@@ -0,0 +1,84 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <cstddef>
+#include <cstdint>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_GATT_ARENA
+#define CONFIG_NIMBLE_CPP_GATT_ARENA 0
+#endif
+
+namespace nimble {
+
+/**
+ * @brief A single block of memory the GATT server definition tables are carved from.
+ * @details The block is sized once for the whole attribute database and allocations are
+ * never freed individually, the whole block is released at once when the database is reset.
+ */
+class GattArena {
+public:
+  GattArena() = default;
+  ~GattArena();
+
+  GattArena(const GattArena &) = delete;
+  GattArena &operator=(const GattArena &) = delete;
+
+  bool reserve(size_t size);
+  void *allocate(size_t size, size_t align);
+  void release();
+  [[nodiscard]] bool owns(const void *ptr) const;
+  [[nodiscard]] size_t capacity() const;
+  [[nodiscard]] size_t used() const;
+
+  /**
+   * @brief Get the space taken by an array of objects, including the worst case alignment padding.
+   * @tparam T The type of the objects.
+   * @param [in] count The number of objects.
+   * @return The size in bytes.
+   */
+  template<typename T>
+  static constexpr size_t sizeOf(size_t count) {
+    return count * sizeof(T) + alignof(T) - 1;
+  }
+
+  /**
+   * @brief Allocate a zero initialized array of objects.
+   * @tparam T The type of the objects, must be trivially destructible.
+   * @param [in] count The number of objects.
+   * @return A pointer to the first object or nullptr if the arena is full.
+   */
+  template<typename T>
+  T *allocate(size_t count) {
+    return (T *) allocate(count * sizeof(T), alignof(T));
+  }
+
+private:
+  uint8_t *m_pBuf = nullptr;
+  size_t m_size = 0;
+  size_t m_used = 0;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
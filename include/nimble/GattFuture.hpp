@@ -0,0 +1,82 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include <functional>
+#include <memory>
+
+#include <freertos/FreeRTOS.h>
+#include <host/ble_gatt.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/AttributeValue.hpp"
+
+namespace nimble {
+
+/**
+ * @brief Completion callback of an asynchronous GATT client operation.
+ * @details Called from the NimBLE host task with the operation result code (0 on success)
+ * and, for reads, the value that was read.
+ */
+typedef std::function<void(int rc, const AttributeValue &value)> gatt_complete_callback;
+
+/**
+ * @brief A handle to the result of an asynchronous GATT client operation.
+ * @details Copies share the same result. The operation completes from the NimBLE host task
+ * whether or not any handle is still held, so the handle may be dropped if only the callback is of interest.
+ */
+class GattFuture {
+public:
+  GattFuture() = default;
+
+  [[nodiscard]] bool valid() const;
+  [[nodiscard]] bool isDone() const;
+  [[nodiscard]] int getRc() const;
+  [[nodiscard]] const AttributeValue &getValue() const;
+  bool wait(TickType_t timeout = portMAX_DELAY) const;
+
+private:
+  friend class RemoteCharacteristic;
+  friend class RemoteDescriptor;
+
+  struct State;
+
+  explicit GattFuture(std::shared_ptr<State> state);
+
+  static GattFuture failed(int rc, gatt_complete_callback callback);
+  static GattFuture read(uint16_t conn_handle, uint16_t attr_handle, gatt_complete_callback callback);
+  static GattFuture write(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *data, size_t length,
+                          bool response, gatt_complete_callback callback);
+
+  static void complete(State *state, int rc);
+  static int onReadCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                      struct ble_gatt_attr *attr, void *arg);
+  static int onWriteCB(uint16_t conn_handle, const struct ble_gatt_error *error,
+                       struct ble_gatt_attr *attr, void *arg);
+
+private:
+  std::shared_ptr<State> m_state;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
@@ -0,0 +1,226 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <cstddef>
+#include <cstdint>
+
+#include <host/ble_gatt.h>
+#include <host/ble_uuid.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/Characteristic.hpp"
+#include "nimble/Descriptor.hpp"
+
+namespace nimble {
+
+/**
+ * @brief Compile time definition of a fixed GATT server profile.
+ * @details The helpers build the NimBLE definition tables as constant expressions so the UUIDs,
+ * service and characteristic tables are placed in flash and nothing is allocated or converted
+ * at runtime. Each characteristic and descriptor entry is bound to a statically allocated
+ * Characteristic or Descriptor, which keeps its value and callbacks as usual. The table is
+ * registered with Server::addTable().
+ *
+ * @code
+ * static Characteristic batteryLevel((uint16_t) 0x2A19, Property::READ | Property::NOTIFY, 1);
+ *
+ * static constexpr ble_uuid16_t batteryServiceUuid = GattTable::uuid16(0x180F);
+ * static constexpr ble_uuid16_t batteryLevelUuid = GattTable::uuid16(0x2A19);
+ *
+ * static constexpr auto batteryChrs = GattTable::characteristics(
+ *     GattTable::characteristic(&batteryLevelUuid.u, Property::READ | Property::NOTIFY, batteryLevel));
+ *
+ * static constexpr auto profile = GattTable::services(
+ *     GattTable::primaryService(&batteryServiceUuid.u, batteryChrs.data()));
+ *
+ * Device::createServer()->addTable(profile.data());
+ * @endcode
+ */
+class GattTable {
+public:
+  /**
+   * @brief A table of definitions terminated by a zeroed entry, as NimBLE expects.
+   * @tparam T The definition type.
+   * @tparam N The number of definitions, not including the terminator.
+   */
+  template<typename T, size_t N>
+  struct Array {
+    T defs[N + 1];
+
+    /** @brief Returns a pointer to the first definition */
+    constexpr const T *data() const { return defs; }
+
+    /** @brief Returns a pointer to the first definition */
+    constexpr T *data() { return defs; }
+
+    /** @brief Returns the number of definitions, not including the terminator */
+    static constexpr size_t size() { return N; }
+  };
+
+  /**
+   * @brief Create a 16 bit UUID.
+   * @param [in] value The UUID value.
+   * @return The UUID, to be stored in a static constexpr variable.
+   */
+  static constexpr ble_uuid16_t uuid16(uint16_t value) {
+    ble_uuid16_t uuid{};
+    uuid.u.type = BLE_UUID_TYPE_16;
+    uuid.value = value;
+    return uuid;
+  }
+
+  /**
+   * @brief Create a 32 bit UUID.
+   * @param [in] value The UUID value.
+   * @return The UUID, to be stored in a static constexpr variable.
+   */
+  static constexpr ble_uuid32_t uuid32(uint32_t value) {
+    ble_uuid32_t uuid{};
+    uuid.u.type = BLE_UUID_TYPE_32;
+    uuid.value = value;
+    return uuid;
+  }
+
+  /**
+   * @brief Create a 128 bit UUID from its string form.
+   * @param [in] str The UUID in the form "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx".
+   * @return The UUID, to be stored in a static constexpr variable.
+   * @details Characters that are not hexadecimal digits are read as 0.
+   */
+  static constexpr ble_uuid128_t uuid128(const char (&str)[37]) {
+    ble_uuid128_t uuid{};
+    uuid.u.type = BLE_UUID_TYPE_128;
+
+    // The string is most significant byte first, NimBLE stores the value the other way around.
+    size_t pos = 0;
+    for (size_t i = 0; i < 16; i++) {
+      if (str[pos] == '-') {
+        pos++;
+      }
+      uuid.value[15 - i] = (uint8_t) ((hexDigit(str[pos]) << 4) | hexDigit(str[pos + 1]));
+      pos += 2;
+    }
+
+    return uuid;
+  }
+
+  /**
+   * @brief Create a characteristic definition bound to a Characteristic.
+   * @param [in] uuid The UUID of the characteristic, must have static storage.
+   * @param [in] properties The characteristic properties, see Property.
+   * @param [in] chr The Characteristic holding the value and callbacks, must have static storage.
+   * @param [in] descriptors The descriptor definitions or nullptr, see descriptors().
+   * @return The definition.
+   * @details The client characteristic configuration descriptor is added by NimBLE, it must not
+   * be listed in the descriptors.
+   */
+  static constexpr ble_gatt_chr_def characteristic(const ble_uuid_t *uuid, uint16_t properties, Characteristic &chr,
+                                                   ble_gatt_dsc_def *descriptors = nullptr) {
+    ble_gatt_chr_def def{};
+    def.uuid = uuid;
+    def.access_cb = Characteristic::handleGapEvent;
+    def.arg = &chr;
+    def.descriptors = descriptors;
+    def.flags = properties;
+    def.min_key_size = 0;
+    def.val_handle = &chr.m_handle;
+    return def;
+  }
+
+  /**
+   * @brief Create a descriptor definition bound to a Descriptor.
+   * @param [in] uuid The UUID of the descriptor, must have static storage.
+   * @param [in] properties The descriptor access flags, BLE_ATT_F_*.
+   * @param [in] dsc The Descriptor holding the value and callbacks, must have static storage.
+   * @return The definition.
+   */
+  static constexpr ble_gatt_dsc_def descriptor(const ble_uuid_t *uuid, uint8_t properties, Descriptor &dsc) {
+    ble_gatt_dsc_def def{};
+    def.uuid = uuid;
+    def.att_flags = properties;
+    def.min_key_size = 0;
+    def.access_cb = Descriptor::handleGapEvent;
+    def.arg = &dsc;
+    return def;
+  }
+
+  /**
+   * @brief Create a primary service definition.
+   * @param [in] uuid The UUID of the service, must have static storage.
+   * @param [in] chrs The characteristic definitions, see characteristics().
+   * @return The definition.
+   */
+  static constexpr ble_gatt_svc_def primaryService(const ble_uuid_t *uuid, const ble_gatt_chr_def *chrs) {
+    ble_gatt_svc_def def{};
+    def.type = BLE_GATT_SVC_TYPE_PRIMARY;
+    def.uuid = uuid;
+    def.includes = nullptr;
+    def.characteristics = chrs;
+    return def;
+  }
+
+  /**
+   * @brief Build a terminated table of characteristic definitions.
+   * @return The table, to be stored in a static constexpr variable.
+   */
+  template<typename... T>
+  static constexpr Array<ble_gatt_chr_def, sizeof...(T)> characteristics(T... defs) {
+    return {{defs..., ble_gatt_chr_def{}}};
+  }
+
+  /**
+   * @brief Build a terminated table of descriptor definitions.
+   * @return The table, to be stored in a static variable.
+   * @details NimBLE takes the descriptor tables as non const, so unlike the other tables this one
+   * can't be constexpr. It is still constant initialized and placed in initialized data.
+   */
+  template<typename... T>
+  static constexpr Array<ble_gatt_dsc_def, sizeof...(T)> descriptors(T... defs) {
+    return {{defs..., ble_gatt_dsc_def{}}};
+  }
+
+  /**
+   * @brief Build a terminated table of service definitions.
+   * @return The table, to be stored in a static constexpr variable and passed to Server::addTable().
+   */
+  template<typename... T>
+  static constexpr Array<ble_gatt_svc_def, sizeof...(T)> services(T... defs) {
+    return {{defs..., ble_gatt_svc_def{}}};
+  }
+
+private:
+  friend class Server;
+
+  static constexpr uint8_t hexDigit(char c) {
+    return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                                          : (c >= 'A' && c <= 'F')   ? c - 'A' + 10
+                                                                     : 0;
+  }
+
+  static void bind(const ble_gatt_svc_def *pSvcs);
+  static Characteristic *getCharacteristic(const ble_gatt_chr_def &def);
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
@@ -0,0 +1,127 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <host/ble_hs.h>
+#include <nimble/nimble_npl.h>
+
+#include "nimble/Characteristic.hpp"
+#include "nimble/HIDTypes.hpp"
+#include "nimble/Stats.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+/**
+ * @brief Sends the HID input reports of one connection with as little latency as the link allows.
+ * @details Each report ID is registered once with its characteristic and length, its buffers and a spare
+ * mbuf are allocated then, so sending a report copies it once into an mbuf taken from the spare and
+ * notifies it, without looking up the characteristic, the subscribers or the MTU.
+ *
+ * A report is sent at once unless its report ID is busy: a report is being handed to the host, one is
+ * waiting, the host is out of buffers, or one was sent less than a connection interval ago and only the
+ * relative fields changed. A busy report waits in its slot and the reports that follow are merged into
+ * it: the relative fields, e.g. the X/Y deltas of a mouse, are summed and the other bytes take the latest
+ * value. A report changing the other bytes, e.g. a button, is sent without waiting for the interval so no
+ * state is lost. The waiting report is sent from the NimBLE host task once the report ID is free.
+ *
+ * The latency recorded is the time from the oldest data of a report being passed to send() to the
+ * report being handed to the controller.
+ *
+ * The reports are registered before sending, and each report ID must be sent from a single task.
+ */
+class HIDReportSender {
+public:
+  /**
+   * @brief Counters of the sender.
+   */
+  struct ReportStats {
+    uint32_t sent;     /// Reports handed to the controller.
+    uint32_t coalesced;/// Reports merged into a waiting one.
+    uint32_t failed;   /// Reports dropped, e.g. not connected or not subscribed.
+    LatencyStats latency;/// Time from send() to the controller.
+  };
+
+  explicit HIDReportSender(uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE);
+  ~HIDReportSender();
+
+  bool addReport(uint8_t reportId, Characteristic *pCharacteristic, uint8_t length);
+  bool addRelativeField(uint8_t reportId, uint8_t offset, uint8_t size);
+  void setConnHandle(uint16_t connHandle);
+  [[nodiscard]] uint16_t getConnHandle() const;
+  bool send(uint8_t reportId, const uint8_t *data, size_t length);
+  bool requestLowLatency(uint16_t latency = 0, uint16_t timeout = 200);
+  [[nodiscard]] ReportStats getStats() const;
+  void resetStats();
+
+private:
+  /// The most relative fields of a report, e.g. X, Y, wheel and pan.
+  static constexpr uint8_t MAX_FIELDS = 4;
+
+  struct Field {
+    uint8_t offset;
+    uint8_t size;
+  };
+
+  struct Slot {
+    Characteristic *pChr;
+    os_mbuf *pSpare;
+    uint32_t sentAt;
+    uint32_t queuedAt;
+    uint8_t reportId;
+    uint8_t length;
+    uint8_t fieldCount;
+    uint64_t relativeBytes;
+    bool pending;
+    bool sending;
+    Field fields[MAX_FIELDS];
+    uint8_t pendingData[MAX_HID_REPORT_SIZE];
+    uint8_t sentData[MAX_HID_REPORT_SIZE];
+  };
+
+  Slot *findSlot(uint8_t reportId);
+  bool sameState(const Slot &slot, const uint8_t *a, const uint8_t *b) const;
+  void merge(const Slot &slot, uint8_t *dst, const uint8_t *src, bool srcIsNewer) const;
+  int transmit(Slot &slot, const uint8_t *data, uint32_t queuedAt);
+  void flush(Slot &slot);
+  void schedule(uint32_t delayUs);
+  [[nodiscard]] uint32_t getIntervalUs() const;
+  static void timerCb(ble_npl_event *event);
+
+private:
+  std::vector<Slot> m_slots;
+  ble_npl_callout m_timer;
+  uint16_t m_connHandle;
+  std::atomic<uint32_t> m_sent{0};
+  std::atomic<uint32_t> m_coalesced{0};
+  std::atomic<uint32_t> m_failed{0};
+  LatencyHistogram m_latency;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
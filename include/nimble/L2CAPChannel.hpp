@@ -0,0 +1,138 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <host/ble_l2cap.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS
+#define CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS 12
+#endif
+
+#ifndef CONFIG_NIMBLE_CPP_L2CAP_COC_BLOCK_SIZE
+#define CONFIG_NIMBLE_CPP_L2CAP_COC_BLOCK_SIZE 256
+#endif
+
+namespace nimble {
+
+class Client;
+class L2CAPChannelCallbacks;
+
+/**
+ * @brief An L2CAP connection oriented channel, a credit based stream of SDUs over a connection.
+ * @details Compared to GATT a channel has no per-packet ATT header and no notify or write response
+ * semantics, the peer grants credits for the packets it can buffer and SDUs up to the channel MTU
+ * are segmented and reassembled by the host. Incoming SDUs are reassembled into blocks of a pool
+ * shared by all channels, sized with CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS and _BLOCK_SIZE.
+ *
+ * Channels are opened by a Client with connect() or accepted by a service of the L2CAPServer.
+ * The callbacks are called from the NimBLE host task.
+ */
+class L2CAPChannel {
+  friend class L2CAPServer;
+
+public:
+  ~L2CAPChannel();
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+  static L2CAPChannel *connect(Client *pClient, uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks);
+#endif
+
+  bool write(const uint8_t *data, size_t length, uint32_t timeoutMs = 0);
+  bool write(const std::vector<uint8_t> &data, uint32_t timeoutMs = 0);
+  bool disconnect();
+  [[nodiscard]] bool isConnected() const;
+  [[nodiscard]] uint16_t getPSM() const;
+  [[nodiscard]] uint16_t getMTU() const;
+  [[nodiscard]] uint16_t getPeerMTU() const;
+  [[nodiscard]] uint16_t getConnHandle() const;
+
+private:
+  L2CAPChannel(uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks);
+
+  static int handleEvent(ble_l2cap_event *event, void *arg);
+  static os_mbuf *allocSdu();
+  bool waitUnstalled(uint32_t timeoutMs);
+  void wakeWriter();
+
+private:
+  uint16_t m_psm;
+  uint16_t m_mtu;
+  uint16_t m_peerMtu;
+  uint16_t m_connHandle;
+  ble_l2cap_chan *m_channel;
+  L2CAPChannelCallbacks *m_pCallbacks;
+  TaskHandle_t m_pWriter;
+  std::vector<uint8_t> m_rxBuffer;
+};
+
+/**
+ * @brief Callbacks of an L2CAPChannel.
+ */
+class L2CAPChannelCallbacks {
+public:
+  virtual ~L2CAPChannelCallbacks() = default;
+
+  /**
+   * @brief Called when a peer opens a channel to a service, return false to reject it.
+   * @param [in] pChannel The channel of the service.
+   * @param [in] peerMTU The largest SDU the peer accepts.
+   */
+  virtual bool shouldAccept(L2CAPChannel *pChannel, uint16_t peerMTU) { return true; };
+
+  /**
+   * @brief Called when the channel is connected.
+   * @param [in] pChannel The channel.
+   */
+  virtual void onConnect(L2CAPChannel *pChannel) {};
+
+  /**
+   * @brief Called when a channel opened with L2CAPChannel::connect() could not be established.
+   * @param [in] pChannel The channel, can be deleted from this callback.
+   * @param [in] reason The error.
+   */
+  virtual void onConnectFail(L2CAPChannel *pChannel, int reason) {};
+
+  /**
+   * @brief Called when a complete SDU was received.
+   * @param [in] pChannel The channel.
+   * @param [in] data The SDU, only valid during the callback.
+   * @param [in] length The length of the SDU.
+   */
+  virtual void onRead(L2CAPChannel *pChannel, const uint8_t *data, size_t length) {};
+
+  /**
+   * @brief Called when the channel is disconnected, a client channel can be deleted from this callback.
+   * @param [in] pChannel The channel.
+   */
+  virtual void onDisconnect(L2CAPChannel *pChannel) {};
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM */
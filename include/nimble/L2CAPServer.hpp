@@ -0,0 +1,54 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+
+#include <vector>
+
+#include "nimble/L2CAPChannel.hpp"
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+/**
+ * @brief The L2CAP services peers can open channels to, see Device::createL2CAPServer().
+ * @details Each service listens on one PSM and serves one channel at a time, on any connection.
+ * The host cannot unregister a PSM, services stay until Device::deinit().
+ */
+class L2CAPServer {
+  friend class Device;
+
+public:
+  L2CAPChannel *createService(uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks);
+  [[nodiscard]] L2CAPChannel *getService(uint16_t psm) const;
+  [[nodiscard]] size_t getServiceCount() const;
+
+private:
+  L2CAPServer() = default;
+  ~L2CAPServer();
+
+private:
+  std::vector<L2CAPChannel *> m_services;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM */
@@ -17,16 +17,50 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_NIMBLE_ENABLED)
 
+#include <esp_idf_version.h>
 #include <esp_log.h>
 #ifndef CONFIG_NIMBLE_CPP_LOG_LEVEL
 #define CONFIG_NIMBLE_CPP_LOG_LEVEL 0
 #endif
 
-#define NIMBLE_CPP_LOG_PRINT(level, tag, format, ...)         \
-  do {                                                        \
-    if (CONFIG_NIMBLE_CPP_LOG_LEVEL >= level)                 \
-      ESP_LOG_LEVEL_LOCAL(level, tag, format, ##__VA_ARGS__); \
+#ifndef CONFIG_NIMBLE_CPP_LOG_DEFERRED
+#define CONFIG_NIMBLE_CPP_LOG_DEFERRED 0
+#endif
+
+/*
+ * The arguments are only evaluated once both the compile time and the runtime level of the tag
+ * allow the message, so arguments such as toString() cost nothing when the message is not printed.
+ */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#define NIMBLE_CPP_LOG_ENABLED(level, tag) \
+  (CONFIG_NIMBLE_CPP_LOG_LEVEL >= level && LOG_LOCAL_LEVEL >= level && esp_log_level_get(tag) >= level)
+#else
+#define NIMBLE_CPP_LOG_ENABLED(level, tag) \
+  (CONFIG_NIMBLE_CPP_LOG_LEVEL >= level && LOG_LOCAL_LEVEL >= level)
+#endif
+
+#define NIMBLE_CPP_LOG_PRINT(level, tag, format, ...)   \
+  do {                                                  \
+    if (NIMBLE_CPP_LOG_ENABLED(level, tag))             \
+      ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__); \
+  } while (0)
+
+/*
+ * Deferred logs only copy the format and integer arguments into a ring buffer, a low priority
+ * task prints them later. Without CONFIG_NIMBLE_CPP_LOG_DEFERRED they are printed immediately.
+ */
+#if CONFIG_NIMBLE_CPP_LOG_DEFERRED
+#include "nimble/LogBuffer.hpp"
+
+#define NIMBLE_CPP_LOG_DEFER(level, tag, format, ...)                     \
+  do {                                                                    \
+    if (CONFIG_NIMBLE_CPP_LOG_LEVEL >= level)                             \
+      nimble::LogBuffer::write(level, tag, format, ##__VA_ARGS__);        \
   } while (0)
+#else
+#define NIMBLE_CPP_LOG_DEFER(level, tag, format, ...) \
+  NIMBLE_CPP_LOG_PRINT(level, tag, format, ##__VA_ARGS__)
+#endif
 
 #define NIMBLE_LOGD(tag, format, ...) \
   NIMBLE_CPP_LOG_PRINT(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
@@ -43,4 +77,19 @@
 #define NIMBLE_LOGC(tag, format, ...) \
   NIMBLE_CPP_LOG_PRINT(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
 
+/*
+ * Print a 6 byte little endian address, such as ble_addr_t::val, without formatting it to a string first.
+ */
+#define NIMBLE_ADDR_FMT "%02x:%02x:%02x:%02x:%02x:%02x"
+#define NIMBLE_ADDR_ARGS(val) (val)[5], (val)[4], (val)[3], (val)[2], (val)[1], (val)[0]
+
+#define NIMBLE_LOGD_DEFER(tag, format, ...) \
+  NIMBLE_CPP_LOG_DEFER(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+#define NIMBLE_LOGI_DEFER(tag, format, ...) \
+  NIMBLE_CPP_LOG_DEFER(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+
+#define NIMBLE_LOGW_DEFER(tag, format, ...) \
+  NIMBLE_CPP_LOG_DEFER(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+
 #endif /* CONFIG_BT_ENABLED */
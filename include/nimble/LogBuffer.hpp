@@ -0,0 +1,94 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_NIMBLE_CPP_LOG_DEFERRED
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+/**
+ * @brief A ring buffer of binary log records formatted later by a low priority task.
+ * @details Writing a record copies the level, tag, format pointer and up to MAX_ARGS integer
+ * arguments, nothing is formatted or printed by the caller. The tag and format must be string
+ * literals, the arguments integers of up to 32 bits, so `%s` cannot be used. Records written
+ * while the buffer is full are dropped and counted.
+ */
+class LogBuffer {
+public:
+  static constexpr size_t MAX_ARGS = 6;
+
+  /**
+   * @brief A log record as stored in the buffer.
+   */
+  struct Record {
+    uint32_t timestamp;
+    const char *tag;
+    const char *format;
+    uint32_t args[MAX_ARGS];
+    esp_log_level_t level;
+  };
+
+  static void start(BaseType_t core);
+  static void stop();
+
+  /**
+   * @brief Add a record to the buffer.
+   * @param [in] level The log level.
+   * @param [in] tag The log tag, a string literal.
+   * @param [in] format The printf format, a string literal.
+   * @param [in] args The integer arguments of the format.
+   */
+  template<typename... Args>
+  static void write(esp_log_level_t level, const char *tag, const char *format, Args... args) {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "Too many deferred log arguments");
+    static_assert(isArgTypeValid<Args...>(), "Deferred log arguments must be integers of up to 32 bits");
+
+    const uint32_t values[MAX_ARGS] = {static_cast<uint32_t>(args)...};
+    push(level, tag, format, values);
+  }
+
+private:
+  template<typename... Args>
+  static constexpr bool isArgTypeValid() {
+    bool valid = true;
+    for (bool it : {true, ((std::is_integral<Args>::value || std::is_enum<Args>::value) && sizeof(Args) <= 4)...}) {
+      valid = valid && it;
+    }
+    return valid;
+  }
+
+  static void push(esp_log_level_t level, const char *tag, const char *format, const uint32_t *args);
+  static bool pop(Record *record);
+  static void flush();
+  static void task(void *arg);
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_NIMBLE_CPP_LOG_DEFERRED */
@@ -0,0 +1,117 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_STATS
+#define CONFIG_NIMBLE_CPP_STATS 0
+#endif
+
+#ifndef CONFIG_NIMBLE_CPP_MEMORY_SPIRAM
+#define CONFIG_NIMBLE_CPP_MEMORY_SPIRAM 0
+#endif
+
+namespace nimble {
+
+/**
+ * @brief The heap usage of one subsystem of the library.
+ */
+struct MemoryUsage {
+  uint32_t bytes;    /// Bytes currently allocated.
+  uint32_t blocks;   /// Allocations currently live.
+  uint32_t peakBytes;/// Most bytes allocated at once since the last reset.
+  uint32_t failures; /// Allocations that failed.
+};
+
+/**
+ * @brief A snapshot of the heap usage of the library, see Device::getMemoryStats().
+ */
+struct MemoryStats {
+  MemoryUsage scan;             /// Advertised devices of the scan results and the device pool.
+  MemoryUsage attributeValues;  /// Heap buffers of local and remote attribute values.
+  MemoryUsage clientAttributes; /// Services, characteristics and descriptors discovered by the clients.
+  MemoryUsage serverDefinitions;/// GATT definition tables of the server services.
+  uint32_t totalBytes;          /// Bytes currently allocated by all the subsystems.
+  uint32_t freeInternal;        /// Free internal RAM of the system heap.
+  uint32_t freeSpiram;          /// Free PSRAM of the system heap, 0 without PSRAM.
+
+  [[nodiscard]] std::string toJson() const;
+};
+
+/**
+ * @brief The functions the library allocates the memory of its subsystems with, see Memory::setAllocator().
+ * @details caps holds the MALLOC_CAP_* heap capabilities chosen for the subsystem. release() is only
+ * passed memory returned by allocate() or reallocate().
+ */
+struct MemoryAllocator {
+  void *(*allocate)(size_t size, uint32_t caps);
+  void *(*reallocate)(void *ptr, size_t size, uint32_t caps);
+  void (*release)(void *ptr);
+};
+
+/**
+ * @brief Allocates and accounts the heap memory of the library subsystems.
+ * @details Each subsystem allocates from the heap capabilities set for it, by default internal RAM for the
+ * attribute values and server tables used on every operation and, with CONFIG_NIMBLE_CPP_MEMORY_SPIRAM,
+ * PSRAM for the scan results and discovered attributes that are only read occasionally. A PSRAM
+ * allocation that fails is retried from any heap.
+ *
+ * The bytes and blocks of each subsystem are counted when CONFIG_NIMBLE_CPP_STATS is enabled.
+ */
+class Memory {
+public:
+  enum Subsystem : uint8_t {
+    SCAN,
+    ATTRIBUTE_VALUE,
+    CLIENT,
+    SERVER,
+    SUBSYSTEM_MAX,
+  };
+
+  static void setAllocator(const MemoryAllocator *pAllocator);
+  static void setCaps(Subsystem subsystem, uint32_t caps);
+  [[nodiscard]] static uint32_t getCaps(Subsystem subsystem);
+  static void *allocate(Subsystem subsystem, size_t size);
+  static void *reallocate(Subsystem subsystem, void *ptr, size_t oldSize, size_t size);
+  static void release(Subsystem subsystem, void *ptr, size_t size);
+  static void *allocateObject(Subsystem subsystem, size_t size);
+  static MemoryStats snapshot();
+  static void reset();
+};
+
+}// namespace nimble
+
+/**
+ * @brief Declare class allocation functions that allocate the instances of a class from a subsystem.
+ * @details Used inside the class definition, e.g. NIMBLE_MEMORY_SUBSYSTEM(CLIENT).
+ */
+#define NIMBLE_MEMORY_SUBSYSTEM(subsystem)                                                                            \
+  static void *operator new(size_t size) { return nimble::Memory::allocateObject(nimble::Memory::subsystem, size); }   \
+  static void *operator new[](size_t size) { return nimble::Memory::allocateObject(nimble::Memory::subsystem, size); } \
+  static void operator delete(void *ptr, size_t size) { nimble::Memory::release(nimble::Memory::subsystem, ptr, size); } \
+  static void operator delete[](void *ptr, size_t size) { nimble::Memory::release(nimble::Memory::subsystem, ptr, size); }
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
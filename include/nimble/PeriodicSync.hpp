@@ -0,0 +1,113 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER) && CONFIG_BT_NIMBLE_EXT_ADV && CONFIG_BT_NIMBLE_ENABLE_PERIODIC_SYNC
+
+#include "host/ble_gap.h"
+
+#include "nimble/Address.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+class AdvertisedDevice;
+class PeriodicSyncCallbacks;
+
+/**
+ * @brief A synchronization with the periodic advertising of a remote device.
+ * @details Once synchronized the controller wakes up only at the periodic interval of the
+ * advertiser to receive its data, so a listener can stop scanning and still receive every update.
+ * The sync is established from extended advertising reports, so a scan must be running until
+ * PeriodicSyncCallbacks::onSync() is called. The controller can only establish one sync at a time.
+ *
+ * The callbacks are called from the NimBLE host task.
+ */
+class PeriodicSync {
+public:
+  explicit PeriodicSync(PeriodicSyncCallbacks *pCallbacks = nullptr);
+  ~PeriodicSync();
+
+  bool create(const Address &address, uint8_t sid, uint16_t skip = 0, uint32_t timeoutMs = 10000);
+  bool create(AdvertisedDevice *pDevice, uint16_t skip = 0, uint32_t timeoutMs = 10000);
+  bool cancel();
+  bool terminate();
+  void setCallbacks(PeriodicSyncCallbacks *pCallbacks);
+  [[nodiscard]] bool isSynced() const;
+  [[nodiscard]] bool isPending() const;
+  [[nodiscard]] uint16_t getHandle() const;
+  [[nodiscard]] Address getAddress() const;
+  [[nodiscard]] uint8_t getSetId() const;
+  [[nodiscard]] uint16_t getInterval() const;
+  [[nodiscard]] uint8_t getPhy() const;
+
+private:
+  static int handleGapEvent(ble_gap_event *event, void *arg);
+  void onReport(const ble_gap_event &event);
+
+private:
+  PeriodicSyncCallbacks *m_pCallbacks;
+  Address m_address;
+  uint16_t m_handle;
+  uint16_t m_interval;
+  uint8_t m_sid;
+  uint8_t m_phy;
+  bool m_synced;
+  std::vector<uint8_t> m_report;
+};
+
+/**
+ * @brief Callbacks of a PeriodicSync.
+ */
+class PeriodicSyncCallbacks {
+public:
+  virtual ~PeriodicSyncCallbacks() = default;
+
+  /**
+   * @brief Called when the sync is established or could not be established.
+   * @param [in] pSync The sync.
+   * @param [in] status 0 on success, otherwise the HCI error, e.g. after cancel().
+   */
+  virtual void onSync(PeriodicSync *pSync, int status) {};
+
+  /**
+   * @brief Called with the periodic advertising data, reassembled if it spans several PDUs.
+   * @param [in] pSync The sync.
+   * @param [in] data The advertising data, only valid during the callback.
+   * @param [in] length The length of the data.
+   * @param [in] rssi The RSSI of the last PDU.
+   * @param [in] txPower The Tx power of the advertiser, 127 if not available.
+   */
+  virtual void onReport(PeriodicSync *pSync, const uint8_t *data, size_t length, int8_t rssi, int8_t txPower) {};
+
+  /**
+   * @brief Called when the sync is lost, e.g. the advertiser stopped or went out of range.
+   * @param [in] pSync The sync, a new one can be created from this callback.
+   * @param [in] reason The reason the sync was lost.
+   */
+  virtual void onLost(PeriodicSync *pSync, int reason) {};
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_OBSERVER && CONFIG_BT_NIMBLE_EXT_ADV && CONFIG_BT_NIMBLE_ENABLE_PERIODIC_SYNC */
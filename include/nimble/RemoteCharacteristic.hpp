@@ -26,9 +26,12 @@
 #undef max
 /**************************/
 
+#include "nimble/GattFuture.hpp"
 #include "nimble/RemoteDescriptor.hpp"
 #include "nimble/RemoteService.hpp"
 #include "nimble/Log.hpp"
+#include "nimble/Memory.hpp"
+#include "nimble/Stats.hpp"
 
 namespace nimble {
 
@@ -47,6 +50,20 @@ typedef struct {
  */
 class RemoteCharacteristic {
 public:
+  NIMBLE_MEMORY_SUBSYSTEM(CLIENT)
+
+  /**
+   * @brief Statistics of a streamed write.
+   */
+  struct StreamStats {
+    size_t bytesWritten;    /// Number of bytes queued for transmission.
+    uint32_t packets;       /// Number of write without response packets sent.
+    uint32_t stalls;        /// Number of times the writer waited for buffers.
+    uint32_t elapsedMs;     /// Time taken by the write in milliseconds.
+    uint32_t bytesPerSecond;/// Achieved throughput.
+    int rc;                 /// 0 on success or the error code that stopped the write.
+  };
+
   ~RemoteCharacteristic();
 
   // Public member functions
@@ -66,9 +83,11 @@ public:
   uint16_t getDefHandle();
   UUID getUUID();
   AttributeValue readValue(time_t *timestamp = nullptr);
+  GattFuture readValueAsync(gatt_complete_callback callback = nullptr);
   std::string toString();
   RemoteService *getRemoteService();
   AttributeValue getValue(time_t *timestamp = nullptr);
+  AttributeValueView getValueView() const;
   bool subscribe(bool notifications = true,
                  notify_callback notifyCallback = nullptr,
                  bool response = true);
@@ -78,6 +97,15 @@ public:
                   bool response = false);
   bool writeValue(const std::vector<uint8_t> &v, bool response = false);
   bool writeValue(const char *s, bool response = false);
+  bool writeStream(const uint8_t *data,
+                   size_t length,
+                   StreamStats *stats = nullptr,
+                   uint32_t stallTimeoutMs = 1000);
+  GattFuture writeValueAsync(const uint8_t *data,
+                             size_t length,
+                             gatt_complete_callback callback = nullptr,
+                             bool response = true);
+  LatencyStats getLatencyStats() const;
 
   /*********************** Template Functions ************************/
 
@@ -142,8 +170,10 @@ private:
   RemoteCharacteristic(RemoteService *pRemoteservice, const struct ble_gatt_chr *chr);
 
   friend class Client;
+  friend class AttributeCache;
   friend class RemoteService;
   friend class RemoteDescriptor;
+  friend class CallbackDispatcher;
 
   // Private member functions
   bool setNotify(uint16_t val, notify_callback notifyCallback = nullptr, bool response = true);
@@ -157,6 +187,9 @@ private:
                               void *arg);
   static int nextCharCB(uint16_t conn_handle, const struct ble_gatt_error *error,
                         const struct ble_gatt_chr *chr, void *arg);
+#if CONFIG_NIMBLE_CPP_STATS
+  void recordLatency(Stats::Latency latency, uint32_t start);
+#endif
 
   // Private properties
   UUID m_uuid;
@@ -170,6 +203,9 @@ private:
 
   // We maintain a vector of descriptors owned by this characteristic.
   std::vector<RemoteDescriptor *> m_descriptorVector;
+#if CONFIG_NIMBLE_CPP_STATS
+  LatencyHistogram m_latency;
+#endif
 };// NimBLERemoteCharacteristic
 
 }
@@ -18,6 +18,8 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
 
 #include "nimble/AttributeValue.hpp"
+#include "nimble/GattFuture.hpp"
+#include "nimble/Memory.hpp"
 #include "nimble/RemoteCharacteristic.hpp"
 #include "nimble/UUID.hpp"
 
@@ -28,17 +30,24 @@ class RemoteCharacteristic;
  * @brief A model of remote %BLE descriptor.
  */
 class RemoteDescriptor {
+  friend class AttributeCache;
+  friend class Client;
   friend class RemoteCharacteristic;
 
 public:
+  NIMBLE_MEMORY_SUBSYSTEM(CLIENT)
+
   uint16_t getHandle();
   RemoteCharacteristic *getRemoteCharacteristic();
   UUID getUUID();
   AttributeValue readValue();
+  GattFuture readValueAsync(gatt_complete_callback callback = nullptr);
   std::string toString();
   bool writeValue(const uint8_t *data, size_t length, bool response = false);
   bool writeValue(const std::vector<uint8_t> &v, bool response = false);
   bool writeValue(const char *s, bool response = false);
+  GattFuture writeValueAsync(const uint8_t *data, size_t length,
+                             gatt_complete_callback callback = nullptr, bool response = true);
 
   /*********************** Template Functions ************************/
 
@@ -18,6 +18,7 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
 
 #include "nimble/Client.hpp"
+#include "nimble/Memory.hpp"
 #include "nimble/RemoteCharacteristic.hpp"
 #include "nimble/UUID.hpp"
 
@@ -38,6 +39,8 @@ class RemoteCharacteristic;
  */
 class RemoteService {
 public:
+  NIMBLE_MEMORY_SUBSYSTEM(CLIENT)
+
   virtual ~RemoteService();
 
   // Public methods
@@ -62,6 +65,7 @@ private:
 
   // Friends
   friend class Client;
+  friend class AttributeCache;
   friend class RemoteCharacteristic;
 
   // Private methods
@@ -18,10 +18,14 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
 
 #include "nimble/AdvertisedDevice.hpp"
+#include "nimble/ScanFilter.hpp"
 #include "nimble/Utils.hpp"
 
 #include "host/ble_gap.h"
+#include <nimble/nimble_npl.h>
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
 /****  FIX COMPILATION ****/
@@ -29,6 +33,14 @@
 #undef max
 /**************************/
 
+#ifndef CONFIG_NIMBLE_CPP_SCAN_RESULTS_MAX
+#define CONFIG_NIMBLE_CPP_SCAN_RESULTS_MAX 0
+#endif
+
+#ifndef CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE
+#define CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE 0
+#endif
+
 namespace nimble {
 
 class Device;
@@ -43,20 +55,83 @@ class Address;
  * by a NimBLEAdvertisedDevice object.  The number of items in the set is given by
  * getCount().  We can retrieve a device by calling getDevice() passing in the
  * index (starting at 0) of the desired device.
+ *
+ * Devices are kept in the order they were first seen until one is removed, the last device then
+ * takes its place.
+ * A copy holds the same device pointers, not copies of the devices.
  */
 class ScanResults {
   friend class Scan;
 
 public:
-  void dump();
-  std::size_t getCount();
-  AdvertisedDevice getDevice(uint32_t i);
-  std::vector<AdvertisedDevice *>::iterator begin();
-  std::vector<AdvertisedDevice *>::iterator end();
-  AdvertisedDevice *getDevice(const Address &address);
+  ScanResults() = default;
+  ScanResults(const ScanResults &other);
+  ScanResults &operator=(const ScanResults &other);
+  ~ScanResults();
+
+  void dump() const;
+  std::size_t getCount() const;
+  AdvertisedDevice getDevice(uint32_t i) const;
+  std::vector<AdvertisedDevice *>::const_iterator begin() const;
+  std::vector<AdvertisedDevice *>::const_iterator end() const;
+  AdvertisedDevice *getDevice(const Address &address) const;
+
+private:
+  AdvertisedDevice *find(const Address &address) const;
+  bool isFull() const;
+  bool insert(AdvertisedDevice *advertisedDevice);
+  AdvertisedDevice *remove(const Address &address);
+  void clear();
+  void touch(AdvertisedDevice *advertisedDevice);
+  void link(AdvertisedDevice *advertisedDevice);
+  void unlink(AdvertisedDevice *advertisedDevice);
+
+private:
+  static std::size_t hash(const Address &address);
+  std::size_t findSlot(const Address &address) const;
+  bool growIndex();
+  void releaseIndex();
 
 private:
+  /**
+   * @brief Open addressing index into m_advertisedDevicesVector, keyed on the address and type.
+   * @details Each slot holds the vector position + 1, 0 marks an empty slot. The table is allocated
+   * on the first insert and doubled to stay at most half full, so probe sequences stay short.
+   */
+  static constexpr std::size_t MIN_INDEX_SIZE = 16;
+  static constexpr std::size_t MAX_DEVICES = UINT16_MAX - 1;
+  static constexpr uint16_t INDEX_EMPTY = 0;
+
   std::vector<AdvertisedDevice *> m_advertisedDevicesVector;
+  uint16_t *m_index = nullptr;
+  std::size_t m_indexSize = 0;// 0 or a power of 2.
+
+  // The devices ordered by the time they were last seen, linked through the devices.
+  AdvertisedDevice *m_pOldest = nullptr;
+  AdvertisedDevice *m_pNewest = nullptr;
+};
+
+/**
+ * @brief How a scan shares the radio with the connections, see Scan::setSchedule().
+ */
+struct ScanSchedule {
+  uint16_t burstMs;       /// The length of a scan burst, 0 to scan continuously with the set interval and window.
+  uint16_t restMs;        /// The radio time left to the connections after a burst, per connection.
+  uint8_t maxDutyPercent; /// The share of the scan interval used for scanning, divided among the connections.
+};
+
+/**
+ * @brief Scan statistics, see Scan::getStats().
+ */
+struct ScanStats {
+  uint32_t reports;         /// Advertising reports received.
+  uint32_t filtered;        /// Reports rejected by the filters.
+  uint32_t evicted;         /// Devices removed from the results after their TTL or to make room.
+  uint32_t dropped;         /// New devices not stored, the results were full or out of memory.
+  uint32_t bursts;          /// Scan bursts started.
+  uint32_t pauses;          /// Times the scan was paused for a connection or discovery.
+  uint32_t scanTimeMs;      /// Time spent scanning, excluding pauses and rests.
+  uint32_t reportsPerSecond;/// The hit rate, reports per second of scanning.
 };
 
 /**
@@ -66,6 +141,7 @@ private:
  */
 class Scan {
   friend class Device;
+  friend class Client;
 
 public:
   bool start(uint32_t duration, bool is_continue = false);
@@ -80,10 +156,20 @@ public:
   void clearDuplicateCache();
   bool stop();
   void clearResults();
-  ScanResults getResults();
-  ScanResults getResults(uint32_t duration, bool is_continue = false);
+  const ScanResults &getResults();
+  const ScanResults &getResults(uint32_t duration, bool is_continue = false);
   void setMaxResults(uint8_t maxResults);
+  void setRawReports(bool enabled);
+  void setFilters(const ScanFilter &filter);
+  void setReportOnChange(uint8_t rssiDelta, uint32_t refreshMs = 0);
+  void setResultTTL(uint32_t ttlMs);
   void erase(const Address &address);
+  void setSchedule(const ScanSchedule &schedule);
+  void pause();
+  void resume();
+  [[nodiscard]] bool isPaused() const;
+  ScanStats getStats() const;
+  void resetStats();
 
 private:
   Scan();
@@ -91,8 +177,18 @@ private:
 
 private:
   static int handleGapEvent(ble_gap_event *event, void *arg);
+  static void scheduleTimerCb(ble_npl_event *event);
   void onHostReset();
   void onHostSync();
+  AdvertisedDevice *allocDevice();
+  void freeDevice(AdvertisedDevice *advertisedDevice);
+  int startBurst();
+  void endBurst();
+  bool nextBurst();
+  int32_t getRemaining() const;
+  void finish(int reason);
+  bool evictOldest();
+  void evictExpired(int64_t now);
 
 private:
   ScanCallbacks *m_pScanCallbacks;
@@ -102,6 +198,47 @@ private:
   uint32_t m_duration;
   ble_task_data_t *m_pTaskData;
   uint8_t m_maxResults;
+  bool m_rawReports;
+  ScanFilter m_filter;
+  uint8_t m_changeRSSI;
+  uint32_t m_changeRefreshMs;
+  uint32_t m_ttlMs;
+  ScanSchedule m_schedule;
+  ScanStats m_stats;
+  ble_npl_callout m_scheduleTimer;
+  ble_npl_time_t m_endAt;
+  ble_npl_time_t m_burstStart;
+  std::atomic<uint8_t> m_pauseCount;
+  bool m_scheduled;
+  bool m_bursting;
+#if CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE > 0
+  AdvertisedDevice *m_devicePool;
+  std::vector<AdvertisedDevice *> m_freeDevices;
+#endif
+};
+
+/**
+ * @brief Pauses a scheduled scan for the lifetime of the object, see Scan::pause().
+ */
+class ScanPause {
+public:
+  explicit ScanPause(Scan *pScan) : m_pScan(pScan) {
+    if (m_pScan != nullptr) {
+      m_pScan->pause();
+    }
+  }
+
+  ~ScanPause() {
+    if (m_pScan != nullptr) {
+      m_pScan->resume();
+    }
+  }
+
+  ScanPause(const ScanPause &) = delete;
+  ScanPause &operator=(const ScanPause &) = delete;
+
+private:
+  Scan *m_pScan;
 };
 
 /**
@@ -123,6 +260,19 @@ public:
      */
   virtual void onResult(AdvertisedDevice *advertisedDevice) {};
 
+  /**
+     * @brief Called for every advertisement report when raw reports are enabled with Scan::setRawReports().
+     * @param [in] disc The report as received from the stack, only valid for the duration of the call.
+     * @details The report is not stored in the scan results and no other result callbacks are invoked.
+     * The AD structures in <tt>disc.data</tt> can be parsed in place, e.g. with ble_hs_adv_parse().
+     * With extended advertising enabled the report is a <tt>ble_gap_ext_disc_desc</tt>.
+     */
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  virtual void onRawReport(const ble_gap_ext_disc_desc &disc) {};
+#else
+  virtual void onRawReport(const ble_gap_disc_desc &disc) {};
+#endif
+
   /**
      * @brief Called when a scan operation ends.
      * @param [in] scanResults The results of the scan that ended.
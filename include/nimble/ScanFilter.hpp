@@ -0,0 +1,103 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+
+#include "nimble/ble.h"
+
+#include "nimble/Address.hpp"
+#include "nimble/UUID.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+namespace nimble {
+
+/**
+ * @brief A set of rules applied to the raw advertising reports before anything is stored, see Scan::setFilters().
+ * @details The rules are compiled when added: each content rule becomes a fixed size pattern and the
+ * advertising data types they look at are collected in a bitmask. A report is then matched by walking
+ * its data in place, skipping every field whose type no rule is interested in, so a rejected report
+ * costs neither an allocation nor a copy.
+ *
+ * A report passes when its RSSI is at least the floor, its address starts with the address prefix and,
+ * if any content rule was added, at least one content rule matches. The content rules are:
+ * - a service UUID listed in the complete or incomplete UUID lists,
+ * - service data for a UUID,
+ * - manufacturer data starting with a company ID,
+ * - a shortened or complete name starting with a prefix.
+ *
+ * Scan responses are not filtered, only the advertisement they answer is, so data carried only in the
+ * scan response, often the name, cannot make a device pass.
+ */
+class ScanFilter {
+public:
+  ScanFilter();
+
+  ScanFilter &addServiceUUID(const UUID &uuid);
+  ScanFilter &addServiceData(const UUID &uuid);
+  ScanFilter &addManufacturerId(uint16_t companyId);
+  ScanFilter &addNamePrefix(const std::string &prefix);
+  ScanFilter &setMinRSSI(int8_t rssi);
+  ScanFilter &setAddressPrefix(const Address &address, uint8_t length);
+  void clear();
+  [[nodiscard]] bool isEmpty() const;
+  [[nodiscard]] bool matches(const ble_addr_t &addr, int8_t rssi, const uint8_t *data, size_t length) const;
+
+private:
+  enum Kind : uint8_t {
+    SERVICE_UUID,
+    SERVICE_DATA,
+    MANUFACTURER_ID,
+    NAME_PREFIX,
+  };
+
+  /// The longest value a rule can match, as much as a legacy advertisement can carry.
+  static constexpr uint8_t MAX_PATTERN_LENGTH = 29;
+
+  struct Pattern {
+    Kind kind;
+    uint8_t length;
+    uint8_t value[MAX_PATTERN_LENGTH];
+  };
+
+  void addPattern(Kind kind, const uint8_t *value, uint8_t length);
+  void addUUID(Kind kind, const UUID &uuid);
+  bool matchField(uint8_t type, const uint8_t *value, uint8_t length) const;
+
+  [[nodiscard]] bool wants(uint8_t type) const {
+    return (m_types[type >> 5] >> (type & 31)) & 1;
+  }
+
+private:
+  std::vector<Pattern> m_patterns;
+  uint32_t m_types[8];
+  uint8_t m_addrPrefix[6];
+  uint8_t m_addrPrefixLength;
+  int8_t m_minRSSI;
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_OBSERVER */
@@ -22,9 +22,16 @@
 
 #include "nimble/Address.hpp"
 #include "nimble/Utils.hpp"
+#if CONFIG_BT_NIMBLE_EXT_ADV
+#include "nimble/ExtAdvertising.hpp"
+#else
 #include "nimble/Advertising.hpp"
+#endif
 #include "nimble/ConnectionInfo.hpp"
+#include "nimble/GattArena.hpp"
+#include "nimble/GattTable.hpp"
 #include "nimble/Service.hpp"
+#include "nimble/Stats.hpp"
 #include "nimble/UUID.hpp"
 
 /****  FIX COMPILATION ****/
@@ -32,6 +39,14 @@
 #undef max
 /**************************/
 
+#ifndef CONFIG_NIMBLE_CPP_INDICATION_COALESCE
+#define CONFIG_NIMBLE_CPP_INDICATION_COALESCE 1
+#endif
+
+#ifndef CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH
+#define CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH 4
+#endif
+
 namespace nimble {
 
 class Device;
@@ -39,6 +54,29 @@ class Service;
 class Characteristic;
 class ServerCallbacks;
 
+/**
+ * @brief A set of characteristic values to be notified together with Server::notifyBatch().
+ * @details The values are not copied, they must remain valid until the batch has been sent.
+ */
+class NotifyBatch {
+  friend class Server;
+
+public:
+  void add(Characteristic *pCharacteristic, const uint8_t *value, size_t length);
+  void add(Characteristic *pCharacteristic);
+  void clear();
+  [[nodiscard]] size_t size() const;
+
+private:
+  struct Entry {
+    Characteristic *pCharacteristic;
+    const uint8_t *value;
+    size_t length;
+  };
+
+  std::vector<Entry> m_entries;
+};
+
 /**
  * @brief The model of a %BLE server.
  */
@@ -48,6 +86,9 @@ class Server {
   friend class Service;
   friend class Device;
   friend class Advertising;
+  friend class ExtAdvertising;
+  friend class HIDReportSender;
+  friend class ServerSnapshot;
 
 public:
   size_t getConnectedCount();
@@ -57,11 +98,18 @@ public:
   void addService(Service *service);
   void setCallbacks(ServerCallbacks *pCallbacks, bool deleteCallbacks = true);
 
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  ExtAdvertising *getAdvertising();
+  bool startAdvertising(uint8_t inst_id, int duration = 0, int max_events = 0);
+  bool stopAdvertising(uint8_t inst_id);
+#else
   Advertising *getAdvertising();
   bool startAdvertising(uint32_t duration = 0);
+#endif
   bool stopAdvertising();
 
   void start();
+  bool addTable(const ble_gatt_svc_def *pSvcs);
 
   Service *getServiceByUUID(const char *uuid, uint16_t instanceId = 0);
   Service *getServiceByUUID(const UUID &uuid, uint16_t instanceId = 0);
@@ -69,7 +117,10 @@ public:
   int disconnect(uint16_t connID, uint8_t reason = BLE_ERR_REM_USER_CONN_TERM);
   void updateConnParams(uint16_t conn_handle, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
   void setDataLen(uint16_t conn_handle, uint16_t tx_octets);
+  bool setPhy(uint16_t conn_handle, uint8_t txPhyMask, uint8_t rxPhyMask, uint16_t phyOptions = 0);
+  bool getPhy(uint16_t conn_handle, uint8_t *txPhy, uint8_t *rxPhy);
   uint16_t getPeerMTU(uint16_t conn_id);
+  void notifyBatch(const NotifyBatch &batch, uint16_t conn_handle = BLE_HCI_LE_CONN_HANDLE_MAX + 1);
   std::vector<uint16_t> getPeerDevices();
   ConnectionInfo getPeerInfo(size_t index);
   ConnectionInfo getPeerInfo(const Address &address);
@@ -86,19 +137,57 @@ private:
   bool m_svcChanged;
   ServerCallbacks *m_pServerCallbacks;
   bool m_deleteCallbacks;
-  uint16_t m_indWait[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
   std::vector<uint16_t> m_connectedPeersVec;
 
+  /**
+   * @brief Indications of a peer waiting for the confirmation of the one in flight, oldest first.
+   */
+  struct IndicationQueue {
+    struct Entry {
+      Characteristic *pChr;
+      os_mbuf *om;
+    };
+
+    Entry entries[CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH];
+    uint8_t head;
+    uint8_t count;
+    bool inFlight;
+#if CONFIG_NIMBLE_CPP_STATS
+    uint32_t sentAt;
+#endif
+  };
+
+  /**
+   * @brief Cached state of a connected peer, kept up to date from the GAP events.
+   * @details A free entry has a connection handle of BLE_HS_CONN_HANDLE_NONE.
+   */
+  struct PeerState {
+    ble_gap_conn_desc desc;
+    uint16_t mtu;
+    IndicationQueue indications;
+  };
+  PeerState m_peerStates[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+
   //    uint16_t               m_svcChgChrHdl; // Future use
 
   std::vector<Service *> m_svcVec;
   std::vector<Characteristic *> m_notifyChrVec;
+  std::vector<Characteristic *> m_notifyChrByHandle;
+  std::vector<const ble_gatt_svc_def *> m_tables;
+  GattArena m_gattArena;
 
   static int handleGapEvent(struct ble_gap_event *event, void *arg);
   void serviceChanged();
   void resetGATT();
-  bool setIndicateWait(uint16_t conn_handle);
-  void clearIndicateWait(uint16_t conn_handle);
+  GattArena *getGattArena();
+  int queueIndication(uint16_t conn_handle, Characteristic *pChr, os_mbuf *om);
+  void sendNextIndication(uint16_t conn_handle);
+  void purgeIndications(uint16_t conn_handle, Characteristic *pChr = nullptr);
+  PeerState *getPeerState(uint16_t conn_handle);
+  PeerState *updatePeerState(uint16_t conn_handle);
+  void removePeerState(uint16_t conn_handle);
+  [[nodiscard]] size_t getPeerIndex(const PeerState *pState) const;
+  Characteristic *getNotifyCharacteristic(uint16_t handle);
 };// NimBLEServer
 
 /**
@@ -154,6 +243,15 @@ public:
      * @return True to accept the pin.
      */
   virtual bool onConfirmPIN(uint32_t pin);
+
+  /**
+     * @brief Called when the PHY of a connection changed or a PHY update request completed.
+     * @param [in] connInfo A reference to a NimBLEConnInfo instance with information
+     * about the peer connection parameters.
+     * @param [in] txPhy The transmit PHY, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED.
+     * @param [in] rxPhy The receive PHY.
+     */
+  virtual void onPhyUpdate(ConnectionInfo &connInfo, uint8_t txPhy, uint8_t rxPhy);
 };// NimBLEServerCallbacks
 
 }// namespace nimble
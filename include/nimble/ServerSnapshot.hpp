@@ -0,0 +1,75 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <cstdint>
+
+#include <host/ble_hs.h>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#include "nimble/Address.hpp"
+
+#ifndef CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+#define CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT 0
+#endif
+
+#ifndef CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_PEERS
+#define CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_PEERS 4
+#endif
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+
+namespace nimble {
+
+class Server;
+
+/**
+ * @brief Snapshot of the server state of bonded peers, kept across deep sleep and reboots.
+ * @details For each bonded peer the last negotiated MTU and the connection parameters in use are
+ * recorded, keyed by the peer identity address, in RTC memory or, with CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_NVS,
+ * in NVS. When the peer connects again and the link is encrypted with its bond, the MTU exchange is
+ * started and the previous connection parameters are requested.
+ *
+ * The CCCD subscriptions are restored by the NimBLE store of the bond at the same point, reported
+ * through onSubscribe(), so they are not part of the snapshot.
+ */
+class ServerSnapshot {
+public:
+  static void save();
+  static void erase(const Address &address);
+  static void eraseAll();
+
+private:
+  friend class Server;
+
+  static void onStart();
+  static void onEncrypted(uint16_t connHandle, int status);
+  static void onUpdate(uint16_t connHandle);
+  static void onDisconnect(uint16_t connHandle);
+  static void restore(uint16_t connHandle);
+  static void persist(bool commit);
+};
+
+}// namespace nimble
+
+#endif /* CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT */
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
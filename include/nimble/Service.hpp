@@ -72,6 +72,12 @@ public:
   Characteristics getCharacteristics(const char *uuid);
   Characteristics getCharacteristics(const UUID &uuid);
 
+private:
+  friend class Server;
+
+  size_t getDefinitionSize();
+  void freeDefinition();
+
 private:
   uint16_t m_handle;
   UUID m_uuid;
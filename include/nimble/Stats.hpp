@@ -0,0 +1,143 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/****  FIX COMPILATION ****/
+#undef min
+#undef max
+/**************************/
+
+#ifndef CONFIG_NIMBLE_CPP_STATS
+#define CONFIG_NIMBLE_CPP_STATS 0
+#endif
+
+namespace nimble {
+
+/**
+ * @brief A snapshot of a latency histogram.
+ * @details Bucket i counts the samples below getBucketLimitUs(i), the last bucket counts the rest.
+ */
+struct LatencyStats {
+  static constexpr size_t BUCKETS = 14;
+
+  uint32_t buckets[BUCKETS];/// Number of samples in each bucket.
+  uint32_t count;           /// Total number of samples.
+  uint32_t maxUs;           /// Largest sample in microseconds.
+
+  [[nodiscard]] static uint32_t getBucketLimitUs(size_t bucket);
+  [[nodiscard]] uint32_t getPercentileUs(uint8_t percentile) const;
+};
+
+/**
+ * @brief A fixed bucket latency histogram that can be updated from any task or core without locking.
+ */
+class LatencyHistogram {
+public:
+  void record(uint32_t us);
+  void reset();
+  [[nodiscard]] LatencyStats snapshot() const;
+
+private:
+  std::atomic<uint32_t> m_buckets[LatencyStats::BUCKETS]{};
+  std::atomic<uint32_t> m_count{0};
+  std::atomic<uint32_t> m_maxUs{0};
+};
+
+/**
+ * @brief A snapshot of the statistics of the device, see Device::getStats().
+ */
+struct DeviceStats {
+  uint32_t scanReports;   /// Advertising reports received.
+  uint32_t scanDropped;   /// Reports dropped, ignored addresses, full results or empty device pool.
+  uint32_t scanDeduped;   /// Reports of known devices not passed to the callbacks again.
+  uint32_t scanFiltered;  /// Reports rejected by the scan filters.
+  uint32_t notifySent;    /// Notifications handed to the host.
+  uint32_t notifyFailed;  /// Notifications the host refused.
+  uint32_t notifyNoMem;   /// Notifications dropped for lack of mbufs.
+  uint32_t indicateSent;  /// Indications sent or queued.
+  uint32_t indicateFailed;/// Indications dropped or not confirmed.
+  LatencyStats indicationRtt;/// Time from sending an indication to its confirmation.
+  LatencyStats gattRead;     /// Round trip of GATT client reads.
+  LatencyStats gattWrite;    /// Round trip of GATT client writes with response.
+  LatencyStats connect;      /// Time from starting a connection to the connect event.
+  LatencyStats discovery;    /// Duration of the attribute discoveries.
+
+  [[nodiscard]] std::string toJson() const;
+};
+
+/**
+ * @brief Global event counters and latency histograms.
+ * @details Counters are kept per core so the cores never write the same cache line, a snapshot sums them.
+ * The NIMBLE_STAT_* macros compile to nothing unless CONFIG_NIMBLE_CPP_STATS is enabled.
+ */
+class Stats {
+public:
+  enum Counter : uint8_t {
+    SCAN_REPORTS,
+    SCAN_DROPPED,
+    SCAN_DEDUPED,
+    SCAN_FILTERED,
+    NOTIFY_SENT,
+    NOTIFY_FAILED,
+    NOTIFY_ENOMEM,
+    INDICATE_SENT,
+    INDICATE_FAILED,
+    COUNTER_MAX,
+  };
+
+  enum Latency : uint8_t {
+    INDICATION_RTT,
+    GATT_READ,
+    GATT_WRITE,
+    CONNECT,
+    DISCOVERY,
+    LATENCY_MAX,
+  };
+
+  static void increment(Counter counter);
+  static void countNotify(int rc);
+  static void record(Latency latency, uint32_t us);
+  static uint32_t now();
+  static DeviceStats snapshot();
+  static void reset();
+};
+
+}// namespace nimble
+
+#if CONFIG_NIMBLE_CPP_STATS
+#define NIMBLE_STAT_INC(counter) nimble::Stats::increment(nimble::Stats::counter)
+#define NIMBLE_STAT_NOTIFY(rc) nimble::Stats::countNotify(rc)
+#define NIMBLE_STAT_START(var) uint32_t var = nimble::Stats::now()
+#define NIMBLE_STAT_NOW() nimble::Stats::now()
+#define NIMBLE_STAT_LATENCY(latency, start) nimble::Stats::record(nimble::Stats::latency, nimble::Stats::now() - (start))
+#define NIMBLE_STAT_RECORD(latency, us) nimble::Stats::record(nimble::Stats::latency, us)
+#else
+#define NIMBLE_STAT_INC(counter) (void) 0
+#define NIMBLE_STAT_NOTIFY(rc) (void) 0
+#define NIMBLE_STAT_START(var)
+#define NIMBLE_STAT_NOW() 0
+#define NIMBLE_STAT_LATENCY(latency, start) (void) 0
+#define NIMBLE_STAT_RECORD(latency, us) (void) 0
+#endif
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
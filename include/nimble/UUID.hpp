@@ -17,7 +17,10 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_NIMBLE_ENABLED)
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <host/ble_uuid.h>
 
 /****  FIX COMPILATION ****/
@@ -27,12 +30,74 @@
 
 namespace nimble {
 
+/**
+ * @brief A UUID parsed at compile time, see operator""_uuid().
+ * @details Converts implicitly to a UUID, which then only copies the bytes.
+ */
+struct UUIDLiteral {
+  uint8_t size;      /// The size of the UUID in bytes, 2, 4 or 16, 0 if the string is not a UUID.
+  uint8_t value[16]; /// The UUID, least significant byte first like the native UUID.
+
+  /**
+   * @brief Parse a UUID string.
+   * @param [in] str The UUID as "xxxx", "xxxxxxxx" or "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx", optionally prefixed by "0x".
+   * @param [in] length The length of the string.
+   * @return The UUID, with a size of 0 if the string is not a UUID.
+   */
+  static constexpr UUIDLiteral parse(const char *str, size_t length) {
+    if (length > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+      str += 2;
+      length -= 2;
+    }
+
+    if (length != 4 && length != 8 && length != 36) {
+      return {};
+    }
+
+    // The string is most significant byte first.
+    UUIDLiteral uuid{};
+    const uint8_t size = length == 36 ? 16 : length / 2;
+    size_t pos = 0;
+    for (uint8_t i = 0; i < size; i++) {
+      if (length == 36 && (pos == 8 || pos == 13 || pos == 18 || pos == 23)) {
+        if (str[pos] != '-') {
+          return {};
+        }
+        pos++;
+      }
+
+      const int high = hexDigit(str[pos]);
+      const int low = hexDigit(str[pos + 1]);
+      if (high < 0 || low < 0) {
+        return {};
+      }
+
+      uuid.value[size - 1 - i] = (uint8_t) ((high << 4) | low);
+      pos += 2;
+    }
+
+    uuid.size = size;
+    return uuid;
+  }
+
+private:
+  static constexpr int hexDigit(char c) {
+    return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+  }
+};
+
 /**
  * @brief A model of a %BLE UUID.
+ * @details A 16 or 32 bit UUID is equal to its 128 bit form built on the %BLE base UUID,
+ * and hashes the same so either can be used as a key.
  */
 class UUID {
 public:
-  explicit UUID(const std::string &uuid);
+  /// The buffer size toChars() needs, a 128 bit UUID and the terminator.
+  static constexpr size_t STR_LEN = 37;
+
+  UUID(const UUIDLiteral &uuid);
+  explicit UUID(std::string_view uuid);
   explicit UUID(uint16_t uuid);
   explicit UUID(uint32_t uuid);
   explicit UUID(const ble_uuid128_t *uuid);
@@ -44,21 +109,56 @@ public:
   [[nodiscard]] uint8_t bitSize() const;
   [[nodiscard]] bool equals(const UUID &uuid) const;
   [[nodiscard]] const ble_uuid_any_t *getNative() const;
+  [[nodiscard]] std::size_t hash() const;
   const UUID &to128();
   const UUID &to16();
   [[nodiscard]] std::string toString() const;
-  static UUID fromString(const std::string &uuid);
+  size_t toChars(char *buf, size_t size) const;
+  static UUID fromString(std::string_view uuid);
 
 public:
   bool operator==(const UUID &rhs) const;
   bool operator!=(const UUID &rhs) const;
   explicit operator std::string() const;
 
+private:
+  bool getShortValue(uint32_t *value) const;
+
 private:
   ble_uuid_any_t m_uuid {};
   bool m_valueSet = false;
 };
 
+inline namespace literals {
+
+/**
+ * @brief Parse a UUID literal at compile time.
+ * @details <b>Use:</b> <tt>static constexpr UUIDLiteral HEART_RATE = "180d"_uuid;</tt> or directly
+ * as an argument, e.g. <tt>pClient->getService("180d"_uuid)</tt>, instead of a string parsed on every call.
+ * @param [in] str The UUID in any of the forms accepted by UUIDLiteral::parse().
+ * @param [in] length The length of the string.
+ * @return The parsed UUID.
+ */
+constexpr UUIDLiteral operator""_uuid(const char *str, size_t length) {
+  return UUIDLiteral::parse(str, length);
+}
+
+}// namespace literals
+
 }
 
+namespace std {
+
+/**
+ * @brief Hash support, to use UUIDs as keys of unordered containers.
+ */
+template<>
+struct hash<nimble::UUID> {
+  size_t operator()(const nimble::UUID &uuid) const noexcept {
+    return uuid.hash();
+  }
+};
+
+}// namespace std
+
 #endif
@@ -43,6 +43,7 @@ public:
   static void dumpGapEvent(ble_gap_event *event, void *arg);
   static const char *gapEventToString(uint8_t eventType);
   static char *buildHexData(uint8_t *target, const uint8_t *source, uint8_t length);
+  static size_t toHex(char *buf, size_t size, const uint8_t *data, size_t length);
   static const char *advTypeToString(uint8_t advType);
   static const char *returnCodeToString(int rc);
   static int checkConnParams(ble_gap_conn_params *params);
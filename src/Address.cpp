@@ -16,6 +16,7 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED)
 
 #include <algorithm>
+#include <cstring>
 
 #include "nimble/Address.hpp"
 #include "nimble/Log.hpp"
@@ -25,6 +26,24 @@ namespace nimble {
 
 static const char *LOG_TAG = "NimBLEAddress";
 
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/**
+ * @brief Get the value of a hexadecimal digit.
+ * @param [in] c The character.
+ * @return The value, or -1 if not a hexadecimal digit.
+ */
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}// hexValue
+
 /*************************************************
  * NOTE: NimBLE address bytes are in INVERSE ORDER!
  * We will accomodate that fact in these methods.
@@ -53,12 +72,12 @@ Address::Address() {
  * ```
  * 00:00:00:00:00:00
  * ```
- * which is 17 characters in length.
+ * which is 17 characters in length. The string is parsed in place, nothing is allocated.
  *
  * @param [in] stringAddress The hex string representation of the address.
  * @param [in] type The type of the address.
  */
-Address::Address(const std::string &stringAddress, uint8_t type) {
+Address::Address(std::string_view stringAddress, uint8_t type) {
   m_addrType = type;
 
   if (stringAddress.length() == 0) {
@@ -71,20 +90,23 @@ Address::Address(const std::string &stringAddress, uint8_t type) {
     return;
   }
 
-  if (stringAddress.length() != 17) {
-    memset(m_address, 0, sizeof m_address);// "00:00:00:00:00:00" represents an invalid address
-    NIMBLE_LOGD(LOG_TAG, "Invalid address '%s'", stringAddress.c_str());
-    return;
-  }
+  if (stringAddress.length() == 17) {
+    bool valid = true;
+    for (size_t index = 0; index < sizeof m_address && valid; index++) {
+      const size_t pos = index * 3;
+      const int high = hexValue(stringAddress[pos]);
+      const int low = hexValue(stringAddress[pos + 1]);
+      valid = high >= 0 && low >= 0 && (index == 5 || stringAddress[pos + 2] == ':');
+      m_address[5 - index] = (high << 4) | low;
+    }
 
-  int data[6];
-  if (sscanf(stringAddress.c_str(), "%x:%x:%x:%x:%x:%x", &data[5], &data[4], &data[3], &data[2], &data[1], &data[0]) != 6) {
-    memset(m_address, 0, sizeof m_address);// "00:00:00:00:00:00" represents an invalid address
-    NIMBLE_LOGD(LOG_TAG, "Invalid address '%s'", stringAddress.c_str());
-  }
-  for (size_t index = 0; index < sizeof m_address; index++) {
-    m_address[index] = data[index];
+    if (valid) {
+      return;
+    }
   }
+
+  memset(m_address, 0, sizeof m_address);// "00:00:00:00:00:00" represents an invalid address
+  NIMBLE_LOGD(LOG_TAG, "Invalid address '%.*s'", (int) stringAddress.length(), stringAddress.data());
 }// NimBLEAddress
 
 /**
@@ -149,6 +171,31 @@ std::string Address::toString() const {
   return std::string(*this);
 }// toString
 
+/**
+ * @brief Format the address into a buffer, without allocating.
+ * @param [out] buf The buffer, STR_LEN bytes fit any address.
+ * @param [in] size The size of the buffer.
+ * @return The length of the string written, 0 if the buffer is too small.
+ */
+size_t Address::toChars(char *buf, size_t size) const {
+  if (size < STR_LEN) {
+    if (size > 0) {
+      buf[0] = '\0';
+    }
+    return 0;
+  }
+
+  for (size_t index = 0; index < sizeof m_address; index++) {
+    const uint8_t byte = m_address[5 - index];
+    buf[index * 3] = HEX_DIGITS[byte >> 4];
+    buf[index * 3 + 1] = HEX_DIGITS[byte & 0x0f];
+    buf[index * 3 + 2] = ':';
+  }
+  buf[STR_LEN - 1] = '\0';
+
+  return STR_LEN - 1;
+}// toChars
+
 /**
  * @brief Convenience operator to check if this address is equal to another.
  */
@@ -169,11 +216,8 @@ bool Address::operator!=(const Address &rhs) const {
  * that accept std::string and/or or it's methods as a parameter.
  */
 Address::operator std::string() const {
-  char buffer[18];
-  snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",
-           m_address[5], m_address[4], m_address[3],
-           m_address[2], m_address[1], m_address[0]);
-  return std::string(buffer);
+  char buffer[STR_LEN];
+  return std::string(buffer, toChars(buffer, sizeof(buffer)));
 }// operator std::string
 
 /**
@@ -185,6 +229,32 @@ Address::operator uint64_t() const {
   return address;
 }// operator uint64_t
 
+/**
+ * @brief Create a key from an address and its type.
+ * @param [in] address The address.
+ */
+AddressKey::AddressKey(const Address &address) {
+  m_value = (uint64_t) address | ((uint64_t) address.getType() << 48);
+}// AddressKey
+
+/**
+ * @brief Create a key from the native NimBLE address.
+ * @param [in] address The native address.
+ */
+AddressKey::AddressKey(const ble_addr_t &address) {
+  m_value = 0;
+  memcpy(&m_value, address.val, 6);
+  m_value |= (uint64_t) address.type << 48;
+}// AddressKey
+
+/**
+ * @brief Get the address of the key.
+ * @return The address with its type.
+ */
+Address AddressKey::toAddress() const {
+  return Address(m_value & 0xffffffffffffULL, (uint8_t) (m_value >> 48));
+}// toAddress
+
 }
 
 #endif
@@ -0,0 +1,250 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include "nimble/AddressSet.hpp"
+
+#include <cstring>
+
+namespace nimble {
+
+/**
+ * @brief Marks a slot as used, the packed address only uses the lower 48 bits.
+ */
+static constexpr uint64_t SLOT_USED = 1ULL << 48;
+static constexpr std::size_t MIN_CAPACITY = 16;
+
+/**
+ * @brief Check if an address is in the set.
+ * @param [in] address The address to look for, its type is not compared.
+ * @return True if the address is in the set.
+ */
+bool AddressSet::contains(const Address &address) const {
+  if (m_count == 0) {
+    return false;
+  }
+
+  const uint64_t key = pack(address);
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  if (!bloomTest(hash(key))) {
+    return false;
+  }
+#endif
+
+  return m_slots[findSlot(key)] == key;
+}// contains
+
+/**
+ * @brief Add an address to the set.
+ * @param [in] address The address to add.
+ * @return True if the address was added, false if it was already in the set.
+ */
+bool AddressSet::insert(const Address &address) {
+  if ((m_count + 1) * 2 > m_slots.size()) {
+    rehash(m_slots.empty() ? MIN_CAPACITY : m_slots.size() * 2);
+  }
+
+  const uint64_t key = pack(address);
+  const std::size_t slot = findSlot(key);
+
+  if (m_slots[slot] == key) {
+    return false;
+  }
+
+  m_slots[slot] = key;
+  m_count++;
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  bloomAdd(hash(key));
+#endif
+
+  return true;
+}// insert
+
+/**
+ * @brief Remove an address from the set.
+ * @param [in] address The address to remove.
+ * @return True if the address was removed, false if it was not in the set.
+ */
+bool AddressSet::erase(const Address &address) {
+  if (m_count == 0) {
+    return false;
+  }
+
+  const uint64_t key = pack(address);
+  std::size_t slot = findSlot(key);
+
+  if (m_slots[slot] != key) {
+    return false;
+  }
+
+  // Backward shift deletion, move up any entry whose probe sequence passes through the freed slot.
+  const std::size_t mask = m_slots.size() - 1;
+  std::size_t next = (slot + 1) & mask;
+
+  while (m_slots[next] != 0) {
+    const std::size_t home = hash(m_slots[next]) & mask;
+    const bool inPlace = (slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next);
+
+    if (!inPlace) {
+      m_slots[slot] = m_slots[next];
+      slot = next;
+    }
+
+    next = (next + 1) & mask;
+  }
+
+  m_slots[slot] = 0;
+  m_count--;
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  // Bits can't be removed from a Bloom filter, rebuild it from the remaining entries.
+  bloomRebuild();
+#endif
+
+  return true;
+}// erase
+
+/**
+ * @brief Remove all addresses from the set and release the table.
+ */
+void AddressSet::clear() {
+  std::vector<uint64_t>().swap(m_slots);
+  m_count = 0;
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+  memset(m_bloom, 0, sizeof m_bloom);
+#endif
+}// clear
+
+/**
+ * @brief Get the number of addresses in the set.
+ * @return The number of addresses.
+ */
+std::size_t AddressSet::size() const {
+  return m_count;
+}// size
+
+/**
+ * @brief Check if the set is empty.
+ * @return True if there are no addresses in the set.
+ */
+bool AddressSet::empty() const {
+  return m_count == 0;
+}// empty
+
+/**
+ * @brief Pack the 6 bytes of an address into a table key.
+ * @param [in] address The address to pack.
+ * @return The key, never 0 so that 0 can mark an empty slot.
+ * @details The type is left out, like Address::operator==() an address matches whatever its type.
+ */
+/*STATIC*/
+uint64_t AddressSet::pack(const Address &address) {
+  const uint8_t *value = address.getNative();
+  uint64_t key = SLOT_USED;
+
+  for (int i = 0; i < 6; i++) {
+    key |= (uint64_t) value[i] << (i * 8);
+  }
+
+  return key;
+}// pack
+
+/**
+ * @brief Hash a packed address key.
+ * @param [in] key The packed key.
+ * @return A 32 bit hash of the key.
+ */
+/*STATIC*/
+uint32_t AddressSet::hash(uint64_t key) {
+  return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}// hash
+
+/**
+ * @brief Find the slot holding a key.
+ * @param [in] key The packed key to look for.
+ * @return The slot holding the key, or the empty slot where it would be inserted.
+ */
+std::size_t AddressSet::findSlot(uint64_t key) const {
+  const std::size_t mask = m_slots.size() - 1;
+  std::size_t slot = hash(key) & mask;
+
+  while (m_slots[slot] != 0 && m_slots[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}// findSlot
+
+/**
+ * @brief Resize the table and re-insert all keys.
+ * @param [in] capacity The new number of slots, must be a power of 2.
+ */
+void AddressSet::rehash(std::size_t capacity) {
+  std::vector<uint64_t> oldSlots(capacity, 0);
+  oldSlots.swap(m_slots);
+
+  for (uint64_t key : oldSlots) {
+    if (key != 0) {
+      m_slots[findSlot(key)] = key;
+    }
+  }
+}// rehash
+
+#if CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS > 0
+/**
+ * @brief Set the two filter bits of a key hash.
+ * @param [in] hash The hash of the key.
+ */
+void AddressSet::bloomAdd(uint32_t hash) {
+  const uint32_t bit1 = hash % CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS;
+  const uint32_t bit2 = ((hash >> 16) | (hash << 16)) % CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS;
+
+  m_bloom[bit1 / 32] |= 1UL << (bit1 % 32);
+  m_bloom[bit2 / 32] |= 1UL << (bit2 % 32);
+}// bloomAdd
+
+/**
+ * @brief Test the two filter bits of a key hash.
+ * @param [in] hash The hash of the key.
+ * @return False if the key is definitely not in the set.
+ */
+bool AddressSet::bloomTest(uint32_t hash) const {
+  const uint32_t bit1 = hash % CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS;
+  const uint32_t bit2 = ((hash >> 16) | (hash << 16)) % CONFIG_NIMBLE_CPP_ADDRESS_SET_BLOOM_BITS;
+
+  return (m_bloom[bit1 / 32] & (1UL << (bit1 % 32))) && (m_bloom[bit2 / 32] & (1UL << (bit2 % 32)));
+}// bloomTest
+
+/**
+ * @brief Rebuild the filter from the keys in the table.
+ */
+void AddressSet::bloomRebuild() {
+  memset(m_bloom, 0, sizeof m_bloom);
+
+  for (uint64_t key : m_slots) {
+    if (key != 0) {
+      bloomAdd(hash(key));
+    }
+  }
+}// bloomRebuild
+#endif
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
@@ -20,7 +20,9 @@
 #include "nimble/Log.hpp"
 #include "nimble/Utils.hpp"
 
+#include <algorithm>
 #include <climits>
+#include <cstring>
 
 static const char* LOG_TAG = "NimBLEAdvertisedDevice";
 
@@ -29,12 +31,33 @@ namespace nimble {
 /**
  * @brief Constructor
  */
-AdvertisedDevice::AdvertisedDevice() : m_payload(62, 0) {
+AdvertisedDevice::AdvertisedDevice() : m_payload{} {
   m_advType = 0;
+  m_payloadLength = 0;
+  m_fieldCount = 0;
+  m_typeMask = 0;
   m_rssi = -9999;
   m_callbackSent = 0;
   m_timestamp = 0;
   m_advLength = 0;
+  m_firstSeen = 0;
+  m_lastSeen = 0;
+  m_reportedAt = 0;
+  m_sightings = 0;
+  m_advInterval = 0;
+  m_rssiAverage = 0;
+  memset(m_rssiHistory, 0, sizeof(m_rssiHistory));
+  m_rssiIndex = 0;
+  m_reportedRSSI = 0;
+  m_pOlder = nullptr;
+  m_pNewer = nullptr;
+#if CONFIG_BT_NIMBLE_EXT_ADV
+  m_isLegacyAdv = true;
+  m_sid = 0;
+  m_primPhy = BLE_HCI_LE_PHY_1M;
+  m_secPhy = BLE_HCI_LE_PHY_1M;
+  m_periodicItvl = 0;
+#endif
 }// NimBLEAdvertisedDevice
 
 /**
@@ -155,19 +178,18 @@ uint16_t AdvertisedDevice::getMaxInterval() {
  * @return The manufacturer data.
  */
 std::string AdvertisedDevice::getManufacturerData(uint8_t index) {
-  size_t data_loc = 0;
-  index++;
-
-  if (findAdvField(BLE_HS_ADV_TYPE_MFG_DATA, index, &data_loc) > 0) {
-    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[data_loc];
-    if (field->length > 1) {
-      return std::string((char *) field->value, field->length - 1);
-    }
-  }
-
-  return "";
+  return std::string(getManufacturerDataView(index));
 }// getManufacturerData
 
+/**
+ * @brief Get a view of the manufacturer data without copying it.
+ * @param [in] index The index of the of the manufacturer data set to get.
+ * @return A view of the manufacturer data in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getManufacturerDataView(uint8_t index) {
+  return getFieldView(BLE_HS_ADV_TYPE_MFG_DATA, index);
+}// getManufacturerDataView
+
 /**
  * @brief Get the count of manufacturer data sets.
  * @return The number of manufacturer data sets.
@@ -181,52 +203,54 @@ uint8_t AdvertisedDevice::getManufacturerDataCount() {
  * @return The URI data.
  */
 std::string AdvertisedDevice::getURI() {
-  size_t data_loc = 0;
-
-  if (findAdvField(BLE_HS_ADV_TYPE_URI, 0, &data_loc) > 0) {
-    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[data_loc];
-    if (field->length > 1) {
-      return std::string((char *) field->value, field->length - 1);
-    }
-  }
-
-  return "";
+  return std::string(getURIView());
 }// getURI
 
+/**
+ * @brief Get a view of the URI without copying it.
+ * @return A view of the URI data in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getURIView() {
+  return getFieldView(BLE_HS_ADV_TYPE_URI);
+}// getURIView
+
 /**
  * @brief Get the data from any type available in the advertisement
  * @param [in] type The advertised data type BLE_HS_ADV_TYPE
  * @return The data available under the type `type`
 */
 std::string AdvertisedDevice::getPayloadByType(uint16_t type) {
-  size_t data_loc = 0;
-
-  if (findAdvField(type, 0, &data_loc) > 0) {
-    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[data_loc];
-    if (field->length > 1) {
-      return std::string((char *) field->value, field->length - 1);
-    }
-  }
-
-  return "";
+  return std::string(getPayloadByTypeView(type));
 }// getPayloadByType
 
+/**
+ * @brief Get a view of the data of any type available in the advertisement without copying it.
+ * @param [in] type The advertised data type BLE_HS_ADV_TYPE
+ * @return A view of the data in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getPayloadByTypeView(uint16_t type) {
+  return getFieldView(type);
+}// getPayloadByTypeView
+
 /**
  * @brief Get the advertised name.
  * @return The name of the advertised device.
  */
 std::string AdvertisedDevice::getName() {
-  size_t data_loc = 0;
+  return std::string(getNameView());
+}// getName
 
-  if (findAdvField(BLE_HS_ADV_TYPE_COMP_NAME, 0, &data_loc) > 0 || findAdvField(BLE_HS_ADV_TYPE_INCOMP_NAME, 0, &data_loc) > 0) {
-    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[data_loc];
-    if (field->length > 1) {
-      return std::string((char *) field->value, field->length - 1);
-    }
+/**
+ * @brief Get a view of the advertised name without copying it.
+ * @return A view of the name in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getNameView() {
+  if (hasType(BLE_HS_ADV_TYPE_COMP_NAME)) {
+    return getFieldView(BLE_HS_ADV_TYPE_COMP_NAME);
   }
 
-  return "";
-}// getName
+  return getFieldView(BLE_HS_ADV_TYPE_INCOMP_NAME);
+}// getNameView
 
 /**
  * @brief Get the RSSI.
@@ -236,6 +260,71 @@ int AdvertisedDevice::getRSSI() {
   return m_rssi;
 }// getRSSI
 
+/**
+ * @brief Get the smoothed RSSI.
+ * @details An exponentially weighted moving average of the advertisements received, each new
+ * report weighs 1/4, which follows a moving device within a few reports.
+ * @return The average RSSI, 0 if no advertisement was received.
+ */
+int AdvertisedDevice::getRSSIAverage() {
+  // Round to the nearest dBm, the average is negative.
+  return (m_rssiAverage - 8) / 16;
+}// getRSSIAverage
+
+/**
+ * @brief Get the median RSSI of the last advertisements.
+ * @details Unlike the average a median ignores single reflections and collisions entirely,
+ * it is the better input for presence thresholds.
+ * @return The median of the last 5 RSSI values, of fewer until 5 advertisements were received.
+ */
+int AdvertisedDevice::getRSSIMedian() {
+  const uint8_t count = std::min<uint32_t>(m_sightings, RSSI_HISTORY);
+  if (count == 0) {
+    return 0;
+  }
+
+  int8_t values[RSSI_HISTORY];
+  memcpy(values, m_rssiHistory, count);
+  std::sort(values, values + count);
+  return values[count / 2];
+}// getRSSIMedian
+
+/**
+ * @brief Get the number of advertisements received from the device.
+ * @return The number of sightings, scan responses are not counted.
+ * @note Every advertisement is only reported when duplicates are wanted, see Scan::setScanCallbacks().
+ */
+uint32_t AdvertisedDevice::getSightings() {
+  return m_sightings;
+}// getSightings
+
+/**
+ * @brief Get the time the device was first seen.
+ * @return The time in microseconds since boot, as returned by esp_timer_get_time().
+ */
+int64_t AdvertisedDevice::getFirstSeen() {
+  return m_firstSeen;
+}// getFirstSeen
+
+/**
+ * @brief Get the time the device was last seen.
+ * @return The time in microseconds since boot, as returned by esp_timer_get_time().
+ */
+int64_t AdvertisedDevice::getLastSeen() {
+  return m_lastSeen;
+}// getLastSeen
+
+/**
+ * @brief Get the measured advertising interval.
+ * @details A moving average of the time between the advertisements received. Gaps longer than the
+ * longest advertising interval, e.g. while the scan was paused, are not counted, while lost
+ * advertisements make the interval appear longer than it is.
+ * @return The interval in microseconds, 0 until two advertisements were received.
+ */
+uint32_t AdvertisedDevice::getAdvertisingInterval() {
+  return m_advInterval;
+}// getAdvertisingInterval
+
 /**
  * @brief Get the scan object that created this advertised device.
  * @return The scan object.
@@ -294,6 +383,15 @@ Address AdvertisedDevice::getTargetAddress(uint8_t index) {
  * @return The advertised service data or empty string if no data.
  */
 std::string AdvertisedDevice::getServiceData(uint8_t index) {
+  return std::string(getServiceDataView(index));
+}//getServiceData
+
+/**
+ * @brief Get a view of the service data without copying it.
+ * @param [in] index The index of the service data requested.
+ * @return A view of the service data in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getServiceDataView(uint8_t index) {
   ble_hs_adv_field *field = nullptr;
   uint8_t bytes;
   size_t data_loc = findServiceData(index, &bytes);
@@ -301,12 +399,12 @@ std::string AdvertisedDevice::getServiceData(uint8_t index) {
   if (data_loc != ULONG_MAX) {
     field = (ble_hs_adv_field *) &m_payload[data_loc];
     if (field->length > bytes) {
-      return std::string((char *) (field->value + bytes), field->length - bytes - 1);
+      return std::string_view((char *) (field->value + bytes), field->length - bytes - 1);
     }
   }
 
-  return "";
-}//getServiceData
+  return {};
+}// getServiceDataView
 
 /**
  * @brief Get the service data.
@@ -314,26 +412,41 @@ std::string AdvertisedDevice::getServiceData(uint8_t index) {
  * @return The advertised service data or empty string if no data.
  */
 std::string AdvertisedDevice::getServiceData(const UUID &uuid) {
-  ble_hs_adv_field *field = nullptr;
-  uint8_t bytes;
-  uint8_t index = 0;
-  size_t data_loc = findServiceData(index, &bytes);
-  size_t plSize = m_payload.size() - 2;
-  uint8_t uuidBytes = uuid.bitSize() / 8;
+  return std::string(getServiceDataView(uuid));
+}//getServiceData
 
-  while (data_loc < plSize) {
-    field = (ble_hs_adv_field *) &m_payload[data_loc];
-    if (bytes == uuidBytes && UUID(field->value, bytes, false) == uuid) {
-      return std::string((char *) (field->value + bytes), field->length - bytes - 1);
-    }
+/**
+ * @brief Get a view of the service data without copying it.
+ * @param [in] uuid The uuid of the service data requested.
+ * @return A view of the service data in the payload, valid until the payload is updated.
+ */
+std::string_view AdvertisedDevice::getServiceDataView(const UUID &uuid) {
+  uint8_t type;
+  const uint8_t uuidBytes = uuid.bitSize() / 8;
+
+  switch (uuidBytes) {
+  case 2:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID16;
+    break;
+  case 4:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID32;
+    break;
+  default:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID128;
+    break;
+  }
 
-    index++;
-    data_loc = findServiceData(index, &bytes);
+  // Only the fields of the matching UUID size need to be checked.
+  for (uint16_t i = 0; i < m_fieldCount; i++) {
+    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[m_fieldOffset[i]];
+    if (field->type == type && field->length > uuidBytes && UUID(field->value, uuidBytes, false) == uuid) {
+      return std::string_view((char *) (field->value + uuidBytes), field->length - uuidBytes - 1);
+    }
   }
 
   NIMBLE_LOGI(LOG_TAG, "No service data found");
-  return "";
-}//getServiceData
+  return {};
+}// getServiceDataView
 
 /**
  * @brief Get the UUID of the service data at the index.
@@ -604,7 +717,7 @@ bool AdvertisedDevice::haveTXPower() {
  * @brief Get the set ID of the extended advertisement.
  * @return The set ID.
  */
-uint8_t NimBLEAdvertisedDevice::getSetId() {
+uint8_t AdvertisedDevice::getSetId() {
   return m_sid;
 }// getSetId
 
@@ -614,7 +727,7 @@ uint8_t NimBLEAdvertisedDevice::getSetId() {
  *  * BLE_HCI_LE_PHY_1M
  *  * BLE_HCI_LE_PHY_CODED
  */
-uint8_t NimBLEAdvertisedDevice::getPrimaryPhy() {
+uint8_t AdvertisedDevice::getPrimaryPhy() {
   return m_primPhy;
 }// getPrimaryPhy
 
@@ -625,7 +738,7 @@ uint8_t NimBLEAdvertisedDevice::getPrimaryPhy() {
  *  * BLE_HCI_LE_PHY_2M
  *  * BLE_HCI_LE_PHY_CODED
  */
-uint8_t NimBLEAdvertisedDevice::getSecondaryPhy() {
+uint8_t AdvertisedDevice::getSecondaryPhy() {
   return m_secPhy;
 }// getSecondaryPhy
 
@@ -633,27 +746,27 @@ uint8_t NimBLEAdvertisedDevice::getSecondaryPhy() {
  * @brief Get the periodic interval of the advertisement.
  * @return The periodic advertising interval, 0 if not periodic advertising.
  */
-uint16_t NimBLEAdvertisedDevice::getPeriodicInterval() {
+uint16_t AdvertisedDevice::getPeriodicInterval() {
   return m_periodicItvl;
 }// getPeriodicInterval
 #endif
 
+/**
+ * @brief Find an AD structure of the given type using the field index built by setPayload.
+ * @param [in] type The AD type to look for.
+ * @param [in] index The 1 based index of the entry to find, 0 to find the first field.
+ * @param [out] data_loc If not nullptr, set to the offset of the field in the payload.
+ * @return The number of entries of the type counted up to the field found.
+ */
 uint8_t AdvertisedDevice::findAdvField(uint8_t type, uint8_t index, size_t *data_loc) {
-  ble_hs_adv_field *field = nullptr;
-  size_t length = m_payload.size();
-  size_t data = 0;
   uint8_t count = 0;
 
-  if (length < 3) {
+  if (!hasType(type)) {
     return count;
   }
 
-  while (length > 2) {
-    field = (ble_hs_adv_field *) &m_payload[data];
-
-    if (field->length >= length) {
-      return count;
-    }
+  for (uint16_t i = 0; i < m_fieldCount; i++) {
+    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[m_fieldOffset[i]];
 
     if (field->type == type) {
       switch (type) {
@@ -683,22 +796,77 @@ uint8_t AdvertisedDevice::findAdvField(uint8_t type, uint8_t index, size_t *data
       }
 
       if (data_loc != nullptr) {
+        *data_loc = m_fieldOffset[i];
         if (index == 0 || count >= index) {
           break;
         }
       }
     }
+  }
+
+  return count;
+}
 
-    length -= 1 + field->length;
-    data += 1 + field->length;
+/**
+ * @brief Check the AD type bitmap for a type.
+ * @param [in] type The AD type to check.
+ * @return False if the type is definitely not in the payload.
+ * @details Types outside of the bitmap range are always reported as possibly present.
+ */
+bool AdvertisedDevice::hasType(uint8_t type) const {
+  if (type >= 64) {
+    return true;
   }
 
-  if (data_loc != nullptr && field != nullptr) {
-    *data_loc = data;
+  return (m_typeMask & (1ULL << type)) != 0;
+}// hasType
+
+/**
+ * @brief Get a view of the data of the first AD structure of the type.
+ * @param [in] type The AD type to look for.
+ * @param [in] index The index of the structure of that type.
+ * @return A view of the field data without the type byte, or an empty view if not found.
+ */
+std::string_view AdvertisedDevice::getFieldView(uint8_t type, uint8_t index) {
+  size_t data_loc = 0;
+
+  if (findAdvField(type, index + 1, &data_loc) > index) {
+    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[data_loc];
+    if (field->length > 1) {
+      return std::string_view((char *) field->value, field->length - 1);
+    }
   }
 
-  return count;
-}
+  return {};
+}// getFieldView
+
+/**
+ * @brief Index the AD structures of the payload starting at an offset.
+ * @param [in] offset The offset in the payload of the first structure to index.
+ */
+void AdvertisedDevice::indexPayload(size_t offset) {
+  while (offset + 1 < m_payloadLength && m_fieldCount < NIMBLE_CPP_ADV_FIELDS_MAX) {
+    ble_hs_adv_field *field = (ble_hs_adv_field *) &m_payload[offset];
+
+    // A zero length is padding at the end of the significant data.
+    if (field->length == 0) {
+      offset++;
+      continue;
+    }
+
+    // Stop at a truncated structure.
+    if (offset + 1 + field->length > m_payloadLength) {
+      break;
+    }
+
+    m_fieldOffset[m_fieldCount++] = offset;
+    if (field->type < 64) {
+      m_typeMask |= 1ULL << field->type;
+    }
+
+    offset += 1 + field->length;
+  }
+}// indexPayload
 
 /**
  * @brief Set the address of the advertised device.
@@ -729,6 +897,33 @@ void AdvertisedDevice::setRSSI(int rssi) {
   m_rssi = rssi;
 }// setRSSI
 
+/**
+ * @brief Account an advertisement in the sighting aggregates.
+ * @param [in] rssi The RSSI of the advertisement.
+ * @param [in] now The time of the advertisement in microseconds.
+ */
+void AdvertisedDevice::addSighting(int8_t rssi, int64_t now) {
+  // The longest advertising interval allowed, 10.24s, plus the maximum random delay.
+  static constexpr int64_t MAX_INTERVAL_US = 10250000;
+
+  if (m_sightings == 0) {
+    m_firstSeen = now;
+    m_rssiAverage = rssi * 16;
+  } else {
+    m_rssiAverage += (rssi * 16 - m_rssiAverage) / 4;
+
+    const int64_t interval = now - m_lastSeen;
+    if (interval > 0 && interval <= MAX_INTERVAL_US) {
+      m_advInterval = m_advInterval == 0 ? interval : m_advInterval + (interval - (int64_t) m_advInterval) / 8;
+    }
+  }
+
+  m_rssiHistory[m_rssiIndex] = rssi;
+  m_rssiIndex = (m_rssiIndex + 1) % RSSI_HISTORY;
+  m_lastSeen = now;
+  m_sightings++;
+}// addSighting
+
 /**
  * @brief Create a string representation of this device.
  * @return A string representation of this device.
@@ -783,17 +978,32 @@ uint8_t *AdvertisedDevice::getPayload() {
 }// getPayload
 
 /**
- * @brief Stores the payload of the advertised device in a vector.
+ * @brief Stores the payload of the advertised device in the inline payload buffer.
  * @param [in] payload The advertisement payload.
  * @param [in] length The length of the payload in bytes.
  * @param [in] append Indicates if the the data should be appended (scan response).
+ * @details Data that does not fit in the buffer is dropped, no heap allocation is made.
  */
 void AdvertisedDevice::setPayload(const uint8_t *payload, uint8_t length, bool append) {
+  if (!append) {
+    m_payloadLength = 0;
+    m_fieldCount = 0;
+    m_typeMask = 0;
+  }
+
+  const size_t offset = m_payloadLength;
+
+  if (m_payloadLength + length > sizeof m_payload) {
+    NIMBLE_LOGW(LOG_TAG, "Payload too large, truncated to %d bytes", sizeof m_payload);
+    length = sizeof m_payload - m_payloadLength;
+  }
+
+  memcpy(m_payload + m_payloadLength, payload, length);
+  m_payloadLength += length;
+  indexPayload(offset);
+
   if (!append) {
     m_advLength = length;
-    m_payload.assign(payload, payload + length);
-  } else {
-    m_payload.insert(m_payload.end(), payload, payload + length);
   }
 }
 
@@ -830,7 +1040,7 @@ time_t AdvertisedDevice::getTimestamp() {
  * @return The size of the payload in bytes.
  */
 size_t AdvertisedDevice::getPayloadLength() {
-  return m_payload.size();
+  return m_payloadLength;
 }// getPayloadLength
 
 /**
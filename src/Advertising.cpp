@@ -65,6 +65,8 @@ void Advertising::reset() {
   m_customScanResponseData = false;
   m_scanResp = true;
   m_advDataSet = false;
+  m_advPayloadLen = 0;
+  m_scanPayloadLen = 0;
   // Set this to non-zero to prevent auto start if host reset before started by app.
   m_duration = BLE_HS_FOREVER;
   m_advCompCB = nullptr;
@@ -128,7 +130,7 @@ void Advertising::addTxPower() {
  */
 void Advertising::setName(const std::string &name) {
   m_name.assign(name.begin(), name.end());
-  m_advData.name = &m_name[0];
+  m_advData.name = m_name.data();
   m_advData.name_len = m_name.size();
   m_advDataSet = false;
 }// setName
@@ -139,7 +141,7 @@ void Advertising::setName(const std::string &name) {
  */
 void Advertising::setManufacturerData(const std::string &data) {
   m_mfgData.assign(data.begin(), data.end());
-  m_advData.mfg_data = &m_mfgData[0];
+  m_advData.mfg_data = m_mfgData.data();
   m_advData.mfg_data_len = m_mfgData.size();
   m_advDataSet = false;
 }// setManufacturerData
@@ -150,7 +152,7 @@ void Advertising::setManufacturerData(const std::string &data) {
  */
 void Advertising::setManufacturerData(const std::vector<uint8_t> &data) {
   m_mfgData = data;
-  m_advData.mfg_data = &m_mfgData[0];
+  m_advData.mfg_data = m_mfgData.data();
   m_advData.mfg_data_len = m_mfgData.size();
   m_advDataSet = false;
 }// setManufacturerData
@@ -161,7 +163,7 @@ void Advertising::setManufacturerData(const std::vector<uint8_t> &data) {
  */
 void Advertising::setURI(const std::string &uri) {
   m_uri.assign(uri.begin(), uri.end());
-  m_advData.uri = &m_uri[0];
+  m_advData.uri = m_uri.data();
   m_advData.uri_len = m_uri.size();
   m_advDataSet = false;
 }// setURI
@@ -177,7 +179,7 @@ void Advertising::setServiceData(const UUID &uuid, const std::string &data) {
   case 16: {
     m_svcData16.assign((uint8_t *) &uuid.getNative()->u16.value, (uint8_t *) &uuid.getNative()->u16.value + 2);
     m_svcData16.insert(m_svcData16.end(), data.begin(), data.end());
-    m_advData.svc_data_uuid16 = (uint8_t *) &m_svcData16[0];
+    m_advData.svc_data_uuid16 = m_svcData16.data();
     m_advData.svc_data_uuid16_len = (!data.empty()) ? m_svcData16.size() : 0;
     break;
   }
@@ -185,7 +187,7 @@ void Advertising::setServiceData(const UUID &uuid, const std::string &data) {
   case 32: {
     m_svcData32.assign((uint8_t *) &uuid.getNative()->u32.value, (uint8_t *) &uuid.getNative()->u32.value + 4);
     m_svcData32.insert(m_svcData32.end(), data.begin(), data.end());
-    m_advData.svc_data_uuid32 = (uint8_t *) &m_svcData32[0];
+    m_advData.svc_data_uuid32 = m_svcData32.data();
     m_advData.svc_data_uuid32_len = (!data.empty()) ? m_svcData32.size() : 0;
     break;
   }
@@ -193,7 +195,7 @@ void Advertising::setServiceData(const UUID &uuid, const std::string &data) {
   case 128: {
     m_svcData128.assign(uuid.getNative()->u128.value, uuid.getNative()->u128.value + 16);
     m_svcData128.insert(m_svcData128.end(), data.begin(), data.end());
-    m_advData.svc_data_uuid128 = (uint8_t *) &m_svcData128[0];
+    m_advData.svc_data_uuid128 = m_svcData128.data();
     m_advData.svc_data_uuid128_len = (!data.empty()) ? m_svcData128.size() : 0;
     break;
   }
@@ -340,10 +342,18 @@ void Advertising::setScanFilter(bool scanRequestWhitelistOnly, bool connectWhite
  */
 
 void Advertising::setAdvertisementData(AdvertisementData &advertisementData) {
+  setAdvertisementData(advertisementData.m_payload);
+}// setAdvertisementData
+
+/**
+ * @brief Set the advertisement data that is to be published in a regular advertisement.
+ * @param [in] advertisementData The encoded data to be advertised.
+ */
+void Advertising::setAdvertisementData(const LegacyAdvertisementBuilder &advertisementData) {
   NIMBLE_LOGD(LOG_TAG, ">> setAdvertisementData");
-  int rc = ble_gap_adv_set_data(
-      (uint8_t *) advertisementData.getPayload().data(),
-      advertisementData.getPayload().length());
+  m_advPayloadLen = advertisementData.size();
+  memcpy(m_advPayload, advertisementData.data(), m_advPayloadLen);
+  int rc = ble_gap_adv_set_data(m_advPayload, m_advPayloadLen);
   if (rc != 0) {
     NIMBLE_LOGE(LOG_TAG, "ble_gap_adv_set_data: %d %s",
                 rc, Utils::returnCodeToString(rc));
@@ -359,10 +369,18 @@ void Advertising::setAdvertisementData(AdvertisementData &advertisementData) {
  * When using custom scan response data you must also use custom advertisement data.
  */
 void Advertising::setScanResponseData(AdvertisementData &advertisementData) {
+  setScanResponseData(advertisementData.m_payload);
+}// setScanResponseData
+
+/**
+ * @brief Set the advertisement data that is to be published in a scan response.
+ * @param [in] advertisementData The encoded data to be advertised.
+ */
+void Advertising::setScanResponseData(const LegacyAdvertisementBuilder &advertisementData) {
   NIMBLE_LOGD(LOG_TAG, ">> setScanResponseData");
-  int rc = ble_gap_adv_rsp_set_data(
-      (uint8_t *) advertisementData.getPayload().data(),
-      advertisementData.getPayload().length());
+  m_scanPayloadLen = advertisementData.size();
+  memcpy(m_scanPayload, advertisementData.data(), m_scanPayloadLen);
+  int rc = ble_gap_adv_rsp_set_data(m_scanPayload, m_scanPayloadLen);
   if (rc != 0) {
     NIMBLE_LOGE(LOG_TAG, "ble_gap_adv_rsp_set_data: %d %s",
                 rc, Utils::returnCodeToString(rc));
@@ -536,8 +554,12 @@ bool Advertising::start(uint32_t duration, void (*advCompleteCB)(Advertising *pA
       }
     }
 
+    // Keep the encoded payloads so single fields can be updated later without re-encoding.
     if (m_scanResp && !m_customScanResponseData) {
-      rc = ble_gap_adv_rsp_set_fields(&m_scanData);
+      rc = ble_hs_adv_set_fields(&m_scanData, m_scanPayload, &m_scanPayloadLen, BLE_HS_ADV_MAX_SZ);
+      if (rc == 0) {
+        rc = ble_gap_adv_rsp_set_data(m_scanPayload, m_scanPayloadLen);
+      }
       switch (rc) {
       case 0:
         break;
@@ -558,7 +580,10 @@ bool Advertising::start(uint32_t duration, void (*advCompleteCB)(Advertising *pA
     }
 
     if (rc == 0) {
-      rc = ble_gap_adv_set_fields(&m_advData);
+      rc = ble_hs_adv_set_fields(&m_advData, m_advPayload, &m_advPayloadLen, BLE_HS_ADV_MAX_SZ);
+      if (rc == 0) {
+        rc = ble_gap_adv_set_data(m_advPayload, m_advPayloadLen);
+      }
       switch (rc) {
       case 0:
         break;
@@ -617,11 +642,11 @@ bool Advertising::start(uint32_t duration, void (*advCompleteCB)(Advertising *pA
                          (pServer != nullptr) ? Server::handleGapEvent : Advertising::handleGapEvent,
                          (void *) this);
 #else
-  rc = ble_gap_adv_start(NimBLEDevice::m_own_addr_type,
+  rc = ble_gap_adv_start(Device::m_own_addr_type,
                          (dirAddr != nullptr) ? &peerAddr : NULL,
                          duration,
                          &m_advParams,
-                         NimBLEAdvertising::handleGapEvent,
+                         Advertising::handleGapEvent,
                          (void *) this);
 #endif
   switch (rc) {
@@ -692,6 +717,210 @@ bool Advertising::isAdvertising() {
   return ble_gap_adv_active();
 }// isAdvertising
 
+/**
+ * @brief Update the advertised manufacturer data without stopping advertising.
+ * @param [in] data The data to advertise.
+ * @return True if the data was updated.
+ * @details Only the manufacturer data field of the already encoded payload is rewritten and sent to the
+ * controller, advertising keeps running. If the payload has not been set yet the data is used by the
+ * next call to start().
+ */
+bool Advertising::updateManufacturerData(const std::string &data) {
+  return updateManufacturerData(std::vector<uint8_t>(data.begin(), data.end()));
+}// updateManufacturerData
+
+/**
+ * @brief Update the advertised manufacturer data without stopping advertising.
+ * @param [in] data The data to advertise.
+ * @return True if the data was updated.
+ */
+bool Advertising::updateManufacturerData(const std::vector<uint8_t> &data) {
+  if (m_customAdvData || m_advDataSet) {
+    int rc = patchField(false, BLE_HS_ADV_TYPE_MFG_DATA, data.data(), data.size(), 0, false);
+    if (rc == BLE_HS_ENOENT) {
+      rc = patchField(true, BLE_HS_ADV_TYPE_MFG_DATA, data.data(), data.size(), 0, false);
+    }
+    if (rc == BLE_HS_ENOENT) {
+      rc = patchField(false, BLE_HS_ADV_TYPE_MFG_DATA, data.data(), data.size(), 0, true);
+    }
+    if (rc != 0) {
+      return false;
+    }
+  }
+
+  if (!m_customAdvData) {
+    // Keep the fields in sync so the payload is the same if it is encoded again after a host reset.
+    m_mfgData = data;
+    m_advData.mfg_data = m_mfgData.data();
+    m_advData.mfg_data_len = m_mfgData.size();
+  }
+
+  return true;
+}// updateManufacturerData
+
+/**
+ * @brief Update the service data advertised for the UUID without stopping advertising.
+ * @param [in] uuid The UUID the service data belongs to.
+ * @param [in] data The data to advertise.
+ * @return True if the data was updated.
+ * @details Only the service data field of this UUID is rewritten in the encoded payload and sent to the
+ * controller, advertising keeps running.
+ */
+bool Advertising::updateServiceData(const UUID &uuid, const std::string &data) {
+  uint8_t type;
+  switch (uuid.bitSize()) {
+  case 16:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID16;
+    break;
+  case 32:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID32;
+    break;
+  case 128:
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID128;
+    break;
+  default:
+    return false;
+  }
+
+  bool encoded = m_advDataSet;
+  if (m_customAdvData || encoded) {
+    if (!patchServiceData(type, uuid, data)) {
+      return false;
+    }
+  }
+
+  if (!m_customAdvData) {
+    // Keep the fields in sync, setServiceData() flags the payload for encoding which is not needed here.
+    setServiceData(uuid, data);
+    m_advDataSet = encoded;
+  }
+
+  return true;
+}// updateServiceData
+
+/**
+ * @brief Rewrite the service data field of the UUID in the encoded payload.
+ * @param [in] type The AD type of the field, BLE_HS_ADV_TYPE_SVC_DATA_UUID*.
+ * @param [in] uuid The UUID the service data belongs to.
+ * @param [in] data The data to advertise.
+ * @return True if the payload was updated and sent to the controller.
+ */
+bool Advertising::patchServiceData(uint8_t type, const UUID &uuid, const std::string &data) {
+  std::vector<uint8_t> field;
+  switch (uuid.bitSize()) {
+  case 16:
+    field.assign((uint8_t *) &uuid.getNative()->u16.value, (uint8_t *) &uuid.getNative()->u16.value + 2);
+    break;
+  case 32:
+    field.assign((uint8_t *) &uuid.getNative()->u32.value, (uint8_t *) &uuid.getNative()->u32.value + 4);
+    break;
+  default:
+    field.assign(uuid.getNative()->u128.value, uuid.getNative()->u128.value + 16);
+    break;
+  }
+  size_t keyLength = field.size();
+  field.insert(field.end(), data.begin(), data.end());
+
+  int rc = patchField(false, type, field.data(), field.size(), keyLength, false);
+  if (rc == BLE_HS_ENOENT) {
+    rc = patchField(true, type, field.data(), field.size(), keyLength, false);
+  }
+  if (rc == BLE_HS_ENOENT) {
+    rc = patchField(false, type, field.data(), field.size(), keyLength, true);
+  }
+
+  return rc == 0;
+}// patchServiceData
+
+/**
+ * @brief Replace one AD structure of the encoded payload without stopping advertising.
+ * @param [in] type The AD type of the field, BLE_HS_ADV_TYPE_*.
+ * @param [in] data The content of the field, without the length and type bytes.
+ * @param [in] length The length of the data.
+ * @param [in] scanResponse True to update the scan response rather than the advertisement.
+ * @return True if the data was updated.
+ * @details The first field of this type is replaced, or the field is appended if there is none.
+ * The payload must have been set by start(), setAdvertisementData() or setScanResponseData().
+ * @note Fields written this way are lost if the payload is encoded again, after changing it with
+ * the other setters or after a host reset.
+ */
+bool Advertising::updateField(uint8_t type, const uint8_t *data, size_t length, bool scanResponse) {
+  return patchField(scanResponse, type, data, length, 0, true) == 0;
+}// updateField
+
+/**
+ * @brief Rewrite one AD structure in a cached payload and send the payload to the controller.
+ * @param [in] scanResponse True to patch the scan response payload.
+ * @param [in] type The AD type to look for.
+ * @param [in] data The new content of the field.
+ * @param [in] length The length of the new content.
+ * @param [in] keyLength The number of leading bytes that must match too, e.g. the service data UUID.
+ * @param [in] append If true the field is appended when not found.
+ * @return 0 on success, BLE_HS_ENOENT if the field was not found or a NimBLE error code.
+ */
+int Advertising::patchField(bool scanResponse, uint8_t type, const uint8_t *data, size_t length,
+                            size_t keyLength, bool append) {
+  bool valid = scanResponse ? (m_customScanResponseData || (m_scanResp && m_advDataSet))
+                            : (m_customAdvData || m_advDataSet);
+  if (!valid) {
+    NIMBLE_LOGE(LOG_TAG, "Advertising data not set, start advertising first");
+    return BLE_HS_EINVAL;
+  }
+
+  uint8_t *payload = scanResponse ? m_scanPayload : m_advPayload;
+  uint8_t &payloadLen = scanResponse ? m_scanPayloadLen : m_advPayloadLen;
+
+  // Find the field, AD structures are [length][type][data] with length covering type and data.
+  size_t offset = 0;
+  size_t fieldLen = 0;
+  bool found = false;
+  while (offset + 1 < payloadLen) {
+    fieldLen = payload[offset] + 1;
+    if (payload[offset] == 0 || offset + fieldLen > payloadLen) {
+      break;
+    }
+    if (payload[offset + 1] == type && fieldLen - 2 >= keyLength &&
+        memcmp(&payload[offset + 2], data, keyLength) == 0) {
+      found = true;
+      break;
+    }
+    offset += fieldLen;
+  }
+
+  if (!found) {
+    if (!append) {
+      return BLE_HS_ENOENT;
+    }
+    offset = payloadLen;
+    fieldLen = 0;
+  }
+
+  size_t newLen = payloadLen - fieldLen + length + 2;
+  if (newLen > BLE_HS_ADV_MAX_SZ) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return BLE_HS_EMSGSIZE;
+  }
+
+  // Build the new payload aside, the cached one is only replaced once the controller accepted it.
+  uint8_t patched[BLE_HS_ADV_MAX_SZ];
+  memcpy(patched, payload, offset);
+  patched[offset] = length + 1;
+  patched[offset + 1] = type;
+  memcpy(&patched[offset + 2], data, length);
+  memcpy(&patched[offset + length + 2], &payload[offset + fieldLen], payloadLen - offset - fieldLen);
+
+  int rc = scanResponse ? ble_gap_adv_rsp_set_data(patched, newLen) : ble_gap_adv_set_data(patched, newLen);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Error updating advertisement data; rc=%d, %s",
+                rc, Utils::returnCodeToString(rc));
+    return rc;
+  }
+
+  memcpy(payload, patched, newLen);
+  payloadLen = newLen;
+  return 0;
+}// patchField
+
 /*
  * Host reset seems to clear advertising data,
  * we need clear the flag so it reloads it.
@@ -737,16 +966,22 @@ int Advertising::handleGapEvent(struct ble_gap_event *event, void *arg) {
   return 0;
 }
 
+/**
+ * @brief Log a field that did not fit in the payload.
+ * @param [in] added The result of adding the field.
+ */
+void AdvertisementData::logIfFull(bool added) {
+  if (!added) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+  }
+}// logIfFull
+
 /**
  * @brief Add data to the payload to be advertised.
  * @param [in] data The data to be added to the payload.
  */
 void AdvertisementData::addData(const std::string &data) {
-  if ((m_payload.length() + data.length()) > BLE_HS_ADV_MAX_SZ) {
-    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
-    return;
-  }
-  m_payload.append(data);
+  logIfFull(m_payload.addData(data.data(), data.length()));
 }// addData
 
 /**
@@ -755,7 +990,7 @@ void AdvertisementData::addData(const std::string &data) {
  * @param [in] length The size of data to be added to the payload.
  */
 void AdvertisementData::addData(char *data, size_t length) {
-  addData(std::string(data, length));
+  logIfFull(m_payload.addData(data, length));
 }// addData
 
 /**
@@ -766,10 +1001,7 @@ void AdvertisementData::addData(char *data, size_t length) {
  * https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.characteristic.gap.appearance.xml
  */
 void AdvertisementData::setAppearance(uint16_t appearance) {
-  char cdata[2];
-  cdata[0] = 3;
-  cdata[1] = BLE_HS_ADV_TYPE_APPEARANCE;// 0x19
-  addData(std::string(cdata, 2) + std::string((char *) &appearance, 2));
+  logIfFull(m_payload.setAppearance(appearance));
 }// setAppearance
 
 /**
@@ -780,11 +1012,7 @@ void AdvertisementData::setAppearance(uint16_t appearance) {
  * * BLE_HS_ADV_F_BREDR_UNSUP - must always use with NimBLE
  */
 void AdvertisementData::setFlags(uint8_t flag) {
-  char cdata[3];
-  cdata[0] = 2;
-  cdata[1] = BLE_HS_ADV_TYPE_FLAGS;// 0x01
-  cdata[2] = flag | BLE_HS_ADV_F_BREDR_UNSUP;
-  addData(std::string(cdata, 3));
+  logIfFull(m_payload.setFlags(flag));
 }// setFlag
 
 /**
@@ -792,10 +1020,7 @@ void AdvertisementData::setFlags(uint8_t flag) {
  * @param [in] data The manufacturer data to advertise.
  */
 void AdvertisementData::setManufacturerData(const std::string &data) {
-  char cdata[2];
-  cdata[0] = data.length() + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_MFG_DATA;// 0xff
-  addData(std::string(cdata, 2) + data);
+  logIfFull(m_payload.setManufacturerData(data.data(), data.length()));
 }// setManufacturerData
 
 /**
@@ -803,10 +1028,7 @@ void AdvertisementData::setManufacturerData(const std::string &data) {
  * @param [in] data The manufacturer data to advertise.
  */
 void AdvertisementData::setManufacturerData(const std::vector<uint8_t> &data) {
-  char cdata[2];
-  cdata[0] = data.size() + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_MFG_DATA;// 0xff
-  addData(std::string(cdata, 2) + std::string((char *) &data[0], data.size()));
+  logIfFull(m_payload.setManufacturerData(data.data(), data.size()));
 }// setManufacturerData
 
 /**
@@ -814,10 +1036,7 @@ void AdvertisementData::setManufacturerData(const std::vector<uint8_t> &data) {
  * @param [in] uri The uri to advertise.
  */
 void AdvertisementData::setURI(const std::string &uri) {
-  char cdata[2];
-  cdata[0] = uri.length() + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_URI;
-  addData(std::string(cdata, 2) + uri);
+  logIfFull(m_payload.setURI(uri));
 }// setURI
 
 /**
@@ -825,10 +1044,7 @@ void AdvertisementData::setURI(const std::string &uri) {
  * @param [in] name The name to advertise.
  */
 void AdvertisementData::setName(const std::string &name) {
-  char cdata[2];
-  cdata[0] = name.length() + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_COMP_NAME;// 0x09
-  addData(std::string(cdata, 2) + name);
+  logIfFull(m_payload.setName(name));
 }// setName
 
 /**
@@ -887,46 +1103,50 @@ void AdvertisementData::setPartialServices32(const std::vector<UUID> &v_uuid) {
  */
 void AdvertisementData::setServices(const bool complete, const uint8_t size,
                                           const std::vector<UUID> &v_uuid) {
-  char cdata[2];
-  cdata[0] = (size / 8) * v_uuid.size() + 1;
+  uint8_t type;
   switch (size) {
   case 16:
-    cdata[1] = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS16 : BLE_HS_ADV_TYPE_INCOMP_UUIDS16;
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS16 : BLE_HS_ADV_TYPE_INCOMP_UUIDS16;
     break;
   case 32:
-    cdata[1] = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS32 : BLE_HS_ADV_TYPE_INCOMP_UUIDS32;
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS32 : BLE_HS_ADV_TYPE_INCOMP_UUIDS32;
     break;
   case 128:
-    cdata[1] = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS128 : BLE_HS_ADV_TYPE_INCOMP_UUIDS128;
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS128 : BLE_HS_ADV_TYPE_INCOMP_UUIDS128;
     break;
   default:
     return;
   }
 
-  std::string uuids;
+  uint8_t uuids[BLE_HS_ADV_MAX_SZ];
+  size_t length = 0;
 
   for (auto &it : v_uuid) {
     if (it.bitSize() != size) {
       NIMBLE_LOGE(LOG_TAG, "Service UUID(%d) invalid", size);
       return;
-    } else {
-      switch (size) {
-      case 16:
-        uuids += std::string((char *) &it.getNative()->u16.value, 2);
-        break;
-      case 32:
-        uuids += std::string((char *) &it.getNative()->u32.value, 4);
-        break;
-      case 128:
-        uuids += std::string((char *) &it.getNative()->u128.value, 16);
-        break;
-      default:
-        return;
-      }
     }
+
+    if (length + size / 8 > sizeof(uuids)) {
+      logIfFull(false);
+      return;
+    }
+
+    switch (size) {
+    case 16:
+      memcpy(&uuids[length], &it.getNative()->u16.value, 2);
+      break;
+    case 32:
+      memcpy(&uuids[length], &it.getNative()->u32.value, 4);
+      break;
+    default:
+      memcpy(&uuids[length], it.getNative()->u128.value, 16);
+      break;
+    }
+    length += size / 8;
   }
 
-  addData(std::string(cdata, 2) + uuids);
+  logIfFull(m_payload.addField(type, uuids, length));
 }// setServices
 
 /**
@@ -935,35 +1155,7 @@ void AdvertisementData::setServices(const bool complete, const uint8_t size,
  * @param [in] data The data to be associated with the service data advertised.
  */
 void AdvertisementData::setServiceData(const UUID &uuid, const std::string &data) {
-  char cdata[2];
-  switch (uuid.bitSize()) {
-  case 16: {
-    // [Len] [0x16] [UUID16] data
-    cdata[0] = data.length() + 3;
-    cdata[1] = BLE_HS_ADV_TYPE_SVC_DATA_UUID16;// 0x16
-    addData(std::string(cdata, 2) + std::string((char *) &uuid.getNative()->u16.value, 2) + data);
-    break;
-  }
-
-  case 32: {
-    // [Len] [0x20] [UUID32] data
-    cdata[0] = data.length() + 5;
-    cdata[1] = BLE_HS_ADV_TYPE_SVC_DATA_UUID32;// 0x20
-    addData(std::string(cdata, 2) + std::string((char *) &uuid.getNative()->u32.value, 4) + data);
-    break;
-  }
-
-  case 128: {
-    // [Len] [0x21] [UUID128] data
-    cdata[0] = data.length() + 17;
-    cdata[1] = BLE_HS_ADV_TYPE_SVC_DATA_UUID128;// 0x21
-    addData(std::string(cdata, 2) + std::string((char *) &uuid.getNative()->u128.value, 16) + data);
-    break;
-  }
-
-  default:
-    return;
-  }
+  logIfFull(m_payload.setServiceData(uuid, data.data(), data.length()));
 }// setServiceData
 
 /**
@@ -971,21 +1163,14 @@ void AdvertisementData::setServiceData(const UUID &uuid, const std::string &data
  * @param [in] name The short name of the device.
  */
 void AdvertisementData::setShortName(const std::string &name) {
-  char cdata[2];
-  cdata[0] = name.length() + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_INCOMP_NAME;// 0x08
-  addData(std::string(cdata, 2) + name);
+  logIfFull(m_payload.setName(name, false));
 }// setShortName
 
 /**
  * @brief Adds Tx power level to the advertisement data.
  */
 void AdvertisementData::addTxPower() {
-  char cdata[3];
-  cdata[0] = BLE_HS_ADV_TX_PWR_LVL_LEN + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_TX_PWR_LVL;
-  cdata[2] = Device::getPower();
-  addData(cdata, 3);
+  logIfFull(m_payload.addTxPower(Device::getPower()));
 }// addTxPower
 
 /**
@@ -994,24 +1179,34 @@ void AdvertisementData::addTxPower() {
  * @param [in] max The maximum interval desired.
  */
 void AdvertisementData::setPreferredParams(uint16_t min, uint16_t max) {
-  char cdata[6];
-  cdata[0] = BLE_HS_ADV_SLAVE_ITVL_RANGE_LEN + 1;
-  cdata[1] = BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE;
-  cdata[2] = min;
-  cdata[3] = min >> 8;
-  cdata[4] = max;
-  cdata[5] = max >> 8;
-  addData(cdata, 6);
+  logIfFull(m_payload.setPreferredParams(min, max));
 }// setPreferredParams
 
 /**
  * @brief Retrieve the payload that is to be advertised.
- * @return The payload that is to be advertised.
+ * @return A copy of the payload that is to be advertised.
+ * @note Use getPayloadData() and getPayloadLength() to access the payload without a copy.
  */
 std::string AdvertisementData::getPayload() {
-  return m_payload;
+  return std::string((const char *) m_payload.data(), m_payload.size());
 }// getPayload
 
+/**
+ * @brief Get a pointer to the encoded payload.
+ * @return A pointer to getPayloadLength() bytes, valid until the data is modified.
+ */
+const uint8_t *AdvertisementData::getPayloadData() const {
+  return m_payload.data();
+}// getPayloadData
+
+/**
+ * @brief Get the length of the encoded payload.
+ * @return The length in bytes, at most BLE_HS_ADV_MAX_SZ.
+ */
+size_t AdvertisementData::getPayloadLength() const {
+  return m_payload.size();
+}// getPayloadLength
+
 }
 
 #endif /* CONFIG_BT_ENABLED && CONFIG_BT_NIMBLE_ROLE_BROADCASTER  && !CONFIG_BT_NIMBLE_EXT_ADV */
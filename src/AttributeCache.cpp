@@ -0,0 +1,483 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include "nimble/AttributeCache.hpp"
+
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <host/ble_hs.h>
+#include <nvs.h>
+
+#include "nimble/Client.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/RemoteCharacteristic.hpp"
+#include "nimble/RemoteDescriptor.hpp"
+#include "nimble/RemoteService.hpp"
+#include "nimble/Utils.hpp"
+
+static const char *LOG_TAG = "NimBLEAttributeCache";
+static const char *NVS_NAMESPACE = "nimble_gatt";
+static constexpr uint16_t DATABASE_HASH_UUID = 0x2B2A;
+
+namespace nimble {
+
+/**
+ * @brief Helpers to write the little endian cache format.
+ */
+static void putU8(std::vector<uint8_t> &out, uint8_t value) {
+  out.push_back(value);
+}// putU8
+
+static void putU16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}// putU16
+
+static void putUUID(std::vector<uint8_t> &out, const UUID &uuid) {
+  const ble_uuid_any_t *native = uuid.getNative();
+  putU8(out, native->u.type);
+
+  switch (native->u.type) {
+  case BLE_UUID_TYPE_16:
+    putU16(out, native->u16.value);
+    break;
+  case BLE_UUID_TYPE_32:
+    putU16(out, native->u32.value & 0xFFFF);
+    putU16(out, native->u32.value >> 16);
+    break;
+  case BLE_UUID_TYPE_128:
+    out.insert(out.end(), native->u128.value, native->u128.value + 16);
+    break;
+  default:
+    break;
+  }
+}// putUUID
+
+/**
+ * @brief Bounds checked reader of the cache format, any read past the end marks the reader as failed.
+ */
+struct CacheReader {
+  const std::vector<uint8_t> &in;
+  size_t pos;
+  bool ok;
+
+  uint8_t getU8() {
+    if (pos + 1 > in.size()) {
+      ok = false;
+      return 0;
+    }
+    return in[pos++];
+  }
+
+  uint16_t getU16() {
+    uint16_t low = getU8();
+    return low | (getU8() << 8);
+  }
+
+  void getUUID(ble_uuid_any_t *uuid) {
+    memset(uuid, 0, sizeof(*uuid));
+    uuid->u.type = getU8();
+
+    switch (uuid->u.type) {
+    case BLE_UUID_TYPE_16:
+      uuid->u16.value = getU16();
+      break;
+    case BLE_UUID_TYPE_32: {
+      uint32_t low = getU16();
+      uuid->u32.value = low | ((uint32_t) getU16() << 16);
+      break;
+    }
+    case BLE_UUID_TYPE_128:
+      for (int i = 0; i < 16; i++) {
+        uuid->u128.value[i] = getU8();
+      }
+      break;
+    default:
+      ok = false;
+      break;
+    }
+  }
+};
+
+/**
+ * @brief Save the discovered attributes of a connected and bonded peer.
+ * @param [in] pClient The client connected to the peer.
+ * @return True if the attributes were stored.
+ */
+/*STATIC*/
+bool AttributeCache::save(Client *pClient) {
+  Address peerId;
+  if (!getPeerId(pClient, &peerId) || pClient->m_servicesVector.empty()) {
+    return false;
+  }
+
+  if (!Device::isBonded(peerId)) {
+    NIMBLE_LOGD(LOG_TAG, "Peer not bonded, not caching attributes");
+    return false;
+  }
+
+  DatabaseHash hash{};
+  int rc = readDatabaseHash(pClient, &hash);
+  if (rc != 0) {
+    return false;
+  }
+
+  std::vector<uint8_t> blob;
+  serialize(pClient, hash, blob);
+
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err != ESP_OK) {
+    NIMBLE_LOGE(LOG_TAG, "nvs_open failed; err=%d", err);
+    return false;
+  }
+
+  char key[16];
+  makeKey(peerId, key);
+  err = nvs_set_blob(handle, key, blob.data(), blob.size());
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+
+  if (err != ESP_OK) {
+    NIMBLE_LOGE(LOG_TAG, "Failed to store attributes; err=%d", err);
+    return false;
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Cached %d bytes of attributes for %s", blob.size(), peerId.toString().c_str());
+  return true;
+}// save
+
+/**
+ * @brief Restore the attributes of a connected and bonded peer.
+ * @param [in] pClient The client connected to the peer, the client must not hold any services.
+ * @return True if the attributes were restored.
+ * @details If the peer has a Database Hash characteristic it is read and compared with the stored
+ * value, the cache entry is erased on mismatch or if it can't be parsed.
+ */
+/*STATIC*/
+bool AttributeCache::restore(Client *pClient) {
+  Address peerId;
+  if (!getPeerId(pClient, &peerId) || !Device::isBonded(peerId)) {
+    return false;
+  }
+
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+
+  char key[16];
+  makeKey(peerId, key);
+
+  size_t length = 0;
+  std::vector<uint8_t> blob;
+  esp_err_t err = nvs_get_blob(handle, key, nullptr, &length);
+  if (err == ESP_OK) {
+    blob.resize(length);
+    err = nvs_get_blob(handle, key, blob.data(), &length);
+  }
+  nvs_close(handle);
+
+  if (err != ESP_OK) {
+    NIMBLE_LOGD(LOG_TAG, "No cached attributes for %s", peerId.toString().c_str());
+    return false;
+  }
+
+  DatabaseHash stored{};
+  if (!deserialize(pClient, blob, stored)) {
+    NIMBLE_LOGW(LOG_TAG, "Invalid attribute cache for %s", peerId.toString().c_str());
+    pClient->deleteServices();
+    erase(peerId);
+    return false;
+  }
+
+  DatabaseHash current{};
+  if (readDatabaseHash(pClient, &current) != 0) {
+    pClient->deleteServices();
+    return false;
+  }
+
+  if (current.found != stored.found || memcmp(current.value, stored.value, HASH_SIZE) != 0) {
+    NIMBLE_LOGI(LOG_TAG, "Database hash changed for %s", peerId.toString().c_str());
+    pClient->deleteServices();
+    erase(peerId);
+    return false;
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Restored %d services for %s", pClient->m_servicesVector.size(), peerId.toString().c_str());
+  return true;
+}// restore
+
+/**
+ * @brief Erase the cached attributes of the peer a client is connected to.
+ * @param [in] pClient The client connected to the peer.
+ */
+/*STATIC*/
+void AttributeCache::invalidate(Client *pClient) {
+  Address peerId;
+  if (getPeerId(pClient, &peerId)) {
+    erase(peerId);
+  }
+}// invalidate
+
+/**
+ * @brief Erase the cached attributes of a peer.
+ * @param [in] address The identity address of the peer.
+ */
+/*STATIC*/
+void AttributeCache::erase(const Address &address) {
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return;
+  }
+
+  char key[16];
+  makeKey(address, key);
+  if (nvs_erase_key(handle, key) == ESP_OK) {
+    nvs_commit(handle);
+    NIMBLE_LOGD(LOG_TAG, "Erased cached attributes for %s", address.toString().c_str());
+  }
+  nvs_close(handle);
+}// erase
+
+/**
+ * @brief Erase the cached attributes of all peers.
+ */
+/*STATIC*/
+void AttributeCache::eraseAll() {
+  nvs_handle_t handle;
+  if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return;
+  }
+
+  if (nvs_erase_all(handle) == ESP_OK) {
+    nvs_commit(handle);
+  }
+  nvs_close(handle);
+}// eraseAll
+
+/**
+ * @brief Get the identity address of the peer a client is connected to.
+ * @param [in] pClient The client connected to the peer.
+ * @param [out] address The identity address of the peer.
+ * @return True if the client is connected.
+ */
+/*STATIC*/
+bool AttributeCache::getPeerId(Client *pClient, Address *address) {
+  ble_gap_conn_desc desc;
+  if (ble_gap_conn_find(pClient->getConnId(), &desc) != 0) {
+    return false;
+  }
+
+  *address = Address(desc.peer_id_addr);
+  return true;
+}// getPeerId
+
+/**
+ * @brief Make the NVS key of a peer, 6 address bytes in hex followed by the address type.
+ * @param [in] address The identity address of the peer.
+ * @param [out] key A buffer of at least 14 bytes.
+ */
+/*STATIC*/
+void AttributeCache::makeKey(const Address &address, char *key) {
+  const uint8_t *val = address.getNative();
+  snprintf(key, 16, "%02x%02x%02x%02x%02x%02x%u",
+           val[5], val[4], val[3], val[2], val[1], val[0], address.getType());
+}// makeKey
+
+/**
+ * @brief Read the Database Hash characteristic of the peer.
+ * @param [in] pClient The client connected to the peer.
+ * @param [out] hash The hash, found is false if the peer does not have one.
+ * @return 0 on success, including when the peer has no Database Hash, otherwise an error code.
+ */
+/*STATIC*/
+int AttributeCache::readDatabaseHash(Client *pClient, DatabaseHash *hash) {
+  UUID uuid(DATABASE_HASH_UUID);
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  ble_task_data_t taskData = {pClient, cur_task, 0, hash};
+
+  hash->found = false;
+  int rc = ble_gattc_read_by_uuid(pClient->getConnId(), 1, 0xFFFF, &uuid.getNative()->u,
+                                  AttributeCache::onReadHashCB, &taskData);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Failed to read database hash; rc=%d, %s", rc, Utils::returnCodeToString(rc));
+    return rc;
+  }
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  switch (taskData.rc) {
+  case 0:
+  case BLE_HS_EDONE:
+  // No Database Hash characteristic, the cache can only be invalidated by Service Changed.
+  case BLE_HS_ATT_ERR(BLE_ATT_ERR_ATTR_NOT_FOUND):
+    return 0;
+  default:
+    NIMBLE_LOGE(LOG_TAG, "Failed to read database hash; rc=%d, %s",
+                taskData.rc, Utils::returnCodeToString(taskData.rc));
+    return taskData.rc;
+  }
+}// readDatabaseHash
+
+/**
+ * @brief Callback for the Database Hash read.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int AttributeCache::onReadHashCB(uint16_t conn_handle,
+                                 const struct ble_gatt_error *error,
+                                 struct ble_gatt_attr *attr, void *arg) {
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *pClient = (Client *) pTaskData->pATT;
+
+  if (pClient->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  if (error->status == 0 && attr != nullptr) {
+    DatabaseHash *hash = (DatabaseHash *) pTaskData->buf;
+    if (OS_MBUF_PKTLEN(attr->om) == HASH_SIZE) {
+      os_mbuf_copydata(attr->om, 0, HASH_SIZE, hash->value);
+      hash->found = true;
+    }
+    return 0;
+  }
+
+  pTaskData->rc = error->status;
+  xTaskNotifyGive(pTaskData->task);
+
+  return 0;
+}// onReadHashCB
+
+/**
+ * @brief Serialize the attribute tree of a client.
+ * @param [in] pClient The client holding the discovered attributes.
+ * @param [in] hash The Database Hash of the peer.
+ * @param [out] out The buffer to write to.
+ */
+/*STATIC*/
+void AttributeCache::serialize(Client *pClient, const DatabaseHash &hash, std::vector<uint8_t> &out) {
+  putU8(out, VERSION);
+  putU8(out, hash.found);
+  out.insert(out.end(), hash.value, hash.value + HASH_SIZE);
+  putU16(out, pClient->m_servicesVector.size());
+
+  for (auto &svc : pClient->m_servicesVector) {
+    putUUID(out, svc->m_uuid);
+    putU16(out, svc->m_startHandle);
+    putU16(out, svc->m_endHandle);
+    putU16(out, svc->m_characteristicVector.size());
+
+    for (auto &chr : svc->m_characteristicVector) {
+      putUUID(out, chr->m_uuid);
+      putU16(out, chr->m_defHandle);
+      putU16(out, chr->m_handle);
+      putU16(out, chr->m_endHandle);
+      putU8(out, chr->m_charProp);
+      putU16(out, chr->m_descriptorVector.size());
+
+      for (auto &dsc : chr->m_descriptorVector) {
+        putUUID(out, dsc->m_uuid);
+        putU16(out, dsc->m_handle);
+      }
+    }
+  }
+}// serialize
+
+/**
+ * @brief Rebuild the attribute tree of a client from a serialized buffer.
+ * @param [in] pClient The client to add the attributes to.
+ * @param [in] in The serialized attributes.
+ * @param [out] hash The Database Hash stored with the attributes.
+ * @return True if the buffer was parsed completely, on failure the added attributes are left for the caller to delete.
+ */
+/*STATIC*/
+bool AttributeCache::deserialize(Client *pClient, const std::vector<uint8_t> &in, DatabaseHash &hash) {
+  CacheReader reader{in, 0, true};
+
+  if (reader.getU8() != VERSION) {
+    return false;
+  }
+
+  hash.found = reader.getU8();
+  for (int i = 0; i < HASH_SIZE; i++) {
+    hash.value[i] = reader.getU8();
+  }
+
+  uint16_t svcCount = reader.getU16();
+  for (uint16_t s = 0; s < svcCount && reader.ok; s++) {
+    ble_gatt_svc svc;
+    reader.getUUID(&svc.uuid);
+    svc.start_handle = reader.getU16();
+    svc.end_handle = reader.getU16();
+    if (!reader.ok) {
+      break;
+    }
+
+    RemoteService *pService = new RemoteService(pClient, &svc);
+    pClient->m_servicesVector.push_back(pService);
+
+    uint16_t chrCount = reader.getU16();
+    for (uint16_t c = 0; c < chrCount && reader.ok; c++) {
+      ble_gatt_chr chr;
+      reader.getUUID(&chr.uuid);
+      chr.def_handle = reader.getU16();
+      chr.val_handle = reader.getU16();
+      uint16_t endHandle = reader.getU16();
+      chr.properties = reader.getU8();
+      if (!reader.ok) {
+        break;
+      }
+
+      RemoteCharacteristic *pChr = new RemoteCharacteristic(pService, &chr);
+      pChr->m_endHandle = endHandle;
+      pService->m_characteristicVector.push_back(pChr);
+
+      uint16_t dscCount = reader.getU16();
+      for (uint16_t d = 0; d < dscCount && reader.ok; d++) {
+        ble_gatt_dsc dsc;
+        reader.getUUID(&dsc.uuid);
+        dsc.handle = reader.getU16();
+        if (!reader.ok) {
+          break;
+        }
+
+        pChr->m_descriptorVector.push_back(new RemoteDescriptor(pChr, &dsc));
+      }
+    }
+  }
+
+  pClient->rebuildHandleTable();
+  return reader.ok && reader.pos == in.size();
+}// deserialize
+
+}// namespace nimble
+
+#endif /* CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE */
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
@@ -0,0 +1,398 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include "nimble/BulkTransferClient.hpp"
+
+#include <cstring>
+
+#include <esp_rom_crc.h>
+#include <nimble/nimble_npl.h>
+
+#include "nimble/Client.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/RemoteCharacteristic.hpp"
+#include "nimble/RemoteService.hpp"
+
+static const char *LOG_TAG = "NimBLEBulkTransferClient";
+
+namespace nimble {
+
+/**
+ * @brief Number of consecutive reply timeouts before the transfer is abandoned.
+ */
+static constexpr uint8_t MAX_TIMEOUTS = 5;
+
+/**
+ * @brief Depth of the reply queue, the server sends at most one reply per block in flight and request.
+ */
+static constexpr uint8_t REPLY_QUEUE_DEPTH = 2 * BulkTransfer::MAX_WINDOW + 4;
+
+/**
+ * @brief Constructor.
+ * @param [in] pClient The client connected to the server.
+ * @param [in] uuid The UUID of the service.
+ */
+BulkTransferClient::BulkTransferClient(Client *pClient, const UUID &uuid) : m_uuid(uuid) {
+  m_pClient = pClient;
+  m_pData = nullptr;
+  m_pControl = nullptr;
+  m_replies = xQueueCreate(REPLY_QUEUE_DEPTH, sizeof(Reply));
+  m_timeoutMs = 1000;
+  m_blockSize = 0;
+  m_chunkSize = 0;
+  m_window = 4;
+  m_chunksPerBlock = BulkTransfer::MAX_CHUNKS;
+}// BulkTransferClient
+
+/**
+ * @brief Destructor, unsubscribes from the replies of the server.
+ */
+BulkTransferClient::~BulkTransferClient() {
+  if (m_pControl != nullptr && m_pClient->isConnected()) {
+    m_pControl->unsubscribe();
+  }
+
+  vQueueDelete(m_replies);
+}// ~BulkTransferClient
+
+/**
+ * @brief Find the service of the server and subscribe to its replies.
+ * @return True if the server has the service.
+ * @details Called by send() if needed, must be called again after reconnecting.
+ */
+bool BulkTransferClient::begin() {
+  m_pData = nullptr;
+  m_pControl = nullptr;
+
+  RemoteService *pService = m_pClient->getService(m_uuid);
+  if (pService == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Bulk transfer service not found");
+    return false;
+  }
+
+  RemoteCharacteristic *pData = pService->getCharacteristic(UUID(BulkTransfer::DATA_UUID));
+  RemoteCharacteristic *pControl = pService->getCharacteristic(UUID(BulkTransfer::CONTROL_UUID));
+  if (pData == nullptr || pControl == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Bulk transfer characteristics not found");
+    return false;
+  }
+
+  if (!pControl->subscribe(true, [this](RemoteCharacteristic *pChr, uint8_t *pData, size_t length, bool isNotify) {
+        onNotify(pData, length);
+      })) {
+    NIMBLE_LOGE(LOG_TAG, "Could not subscribe to the control characteristic");
+    return false;
+  }
+
+  m_pData = pData;
+  m_pControl = pControl;
+  return true;
+}// begin
+
+/**
+ * @brief Send data to the server, blocking until the server acknowledged all of it.
+ * @param [in] data The data.
+ * @param [in] length The length of the data.
+ * @param [out] result If not nullptr, filled with the statistics of the transfer.
+ * @return True if the server received and stored all the data.
+ * @details Must not be called from the NimBLE host task.
+ */
+bool BulkTransferClient::send(const uint8_t *data, size_t length, Result *result) {
+  Result res{};
+  res.status = BulkTransfer::OK;
+  ble_npl_time_t start = ble_npl_time_get();
+
+  if ((m_pData == nullptr && !begin()) || !m_pClient->isConnected()) {
+    res.status = BulkTransfer::DISCONNECTED;
+    if (result != nullptr) {
+      *result = res;
+    }
+    return false;
+  }
+
+  m_chunkSize = m_pClient->getMTU() - 3 - BulkTransfer::DATA_HEADER_SIZE;
+  m_blockSize = (size_t) m_chunkSize * m_chunksPerBlock;
+  m_packet.resize(m_chunkSize + BulkTransfer::DATA_HEADER_SIZE);
+  size_t blocks = (length + m_blockSize - 1) / m_blockSize;
+  res.blocks = blocks;
+  xQueueReset(m_replies);
+
+  uint8_t startMsg[9] = {BulkTransfer::START,
+                         (uint8_t) length, (uint8_t) (length >> 8), (uint8_t) (length >> 16), (uint8_t) (length >> 24),
+                         (uint8_t) m_chunkSize, (uint8_t) (m_chunkSize >> 8), m_chunksPerBlock, m_window};
+
+  if (length == 0 || blocks > UINT16_MAX) {
+    res.status = BulkTransfer::INVALID;
+  } else if (!request(startMsg, sizeof(startMsg), BulkTransfer::START_ACK, &res.status)) {
+    res.status = m_pClient->isConnected() ? BulkTransfer::TIMEOUT : BulkTransfer::DISCONNECTED;
+  }
+
+  std::vector<bool> acked(blocks, false);
+  uint16_t base = 0;
+  uint16_t next = 0;
+  uint8_t timeouts = 0;
+
+  while (res.status == BulkTransfer::OK && base < blocks) {
+    // Keep the window full.
+    while (next < blocks && next < base + m_window) {
+      if (!sendBlock(data, length, next, UINT32_MAX) || !sendBlockEnd(data, length, next)) {
+        res.status = BulkTransfer::DISCONNECTED;
+        break;
+      }
+      next++;
+    }
+
+    Reply reply;
+    if (res.status != BulkTransfer::OK) {
+      break;
+    }
+
+    if (!waitReply(&reply, m_timeoutMs)) {
+      if (!m_pClient->isConnected()) {
+        res.status = BulkTransfer::DISCONNECTED;
+      } else if (++timeouts > MAX_TIMEOUTS) {
+        res.status = BulkTransfer::TIMEOUT;
+      } else {
+        // Ask again for the state of the blocks in flight, each is answered with an ACK or a NACK.
+        for (uint16_t block = base; block < next; block++) {
+          if (!acked[block]) {
+            sendBlockEnd(data, length, block);
+          }
+        }
+      }
+      continue;
+    }
+
+    timeouts = 0;
+    switch (reply.op) {
+    case BulkTransfer::BLOCK_ACK:
+      if (reply.block >= base && reply.block < next) {
+        acked[reply.block] = true;
+      }
+      while (base < next && acked[base]) {
+        base++;
+      }
+      break;
+
+    case BulkTransfer::BLOCK_NACK:
+      if (reply.block >= base && reply.block < next && !acked[reply.block]) {
+        res.retransmits++;
+        if (!sendBlock(data, length, reply.block, reply.missing) || !sendBlockEnd(data, length, reply.block)) {
+          res.status = BulkTransfer::DISCONNECTED;
+        }
+      }
+      break;
+
+    case BulkTransfer::ERROR:
+      res.status = (BulkTransfer::Status) reply.status;
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  if (res.status == BulkTransfer::OK) {
+    uint8_t finishMsg = BulkTransfer::FINISH;
+    if (!request(&finishMsg, 1, BulkTransfer::FINISH_ACK, &res.status)) {
+      res.status = m_pClient->isConnected() ? BulkTransfer::TIMEOUT : BulkTransfer::DISCONNECTED;
+    }
+  } else if (m_pClient->isConnected()) {
+    uint8_t abortMsg = BulkTransfer::ABORT;
+    sendControl(&abortMsg, 1);
+  }
+
+  size_t sent = (size_t) base * m_blockSize;
+  res.bytesSent = sent < length ? sent : length;
+  res.elapsedMs = ble_npl_time_ticks_to_ms32(ble_npl_time_get() - start);
+  res.bytesPerSecond = res.elapsedMs ? (uint32_t) ((uint64_t) res.bytesSent * 1000 / res.elapsedMs) : res.bytesSent;
+
+  if (result != nullptr) {
+    *result = res;
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Sent %d bytes in %lu ms, %lu B/s, %lu retransmits, status: %d",
+              res.bytesSent, res.elapsedMs, res.bytesPerSecond, res.retransmits, res.status);
+  return res.status == BulkTransfer::OK;
+}// send
+
+/**
+ * @brief Set the number of blocks sent before waiting for an acknowledgement.
+ * @param [in] blocks The window, 1 to BulkTransfer::MAX_WINDOW.
+ * @details The server needs a buffer of a block per window slot.
+ */
+void BulkTransferClient::setWindow(uint8_t blocks) {
+  m_window = blocks == 0 ? 1 : blocks > BulkTransfer::MAX_WINDOW ? BulkTransfer::MAX_WINDOW
+                                                                 : blocks;
+}// setWindow
+
+/**
+ * @brief Set the number of chunks in a block, each block is verified by its own CRC.
+ * @param [in] chunks The chunks per block, 1 to BulkTransfer::MAX_CHUNKS.
+ */
+void BulkTransferClient::setChunksPerBlock(uint8_t chunks) {
+  m_chunksPerBlock = chunks == 0 ? 1 : chunks > BulkTransfer::MAX_CHUNKS ? BulkTransfer::MAX_CHUNKS
+                                                                         : chunks;
+}// setChunksPerBlock
+
+/**
+ * @brief Set how long to wait for a reply before asking the server again.
+ * @param [in] timeoutMs The timeout in milliseconds.
+ */
+void BulkTransferClient::setTimeout(uint32_t timeoutMs) {
+  m_timeoutMs = timeoutMs;
+}// setTimeout
+
+/**
+ * @brief Queue a reply of the server, called from the NimBLE host task.
+ * @param [in] data The notification.
+ * @param [in] length The length of the notification.
+ */
+void BulkTransferClient::onNotify(const uint8_t *data, size_t length) {
+  if (length < 2) {
+    return;
+  }
+
+  Reply reply{};
+  reply.op = data[0];
+  reply.status = data[1];
+  if (length >= 3) {
+    reply.block = data[1] | (data[2] << 8);
+  }
+  if (length >= 7) {
+    reply.missing = data[3] | (data[4] << 8) | (data[5] << 16) | ((uint32_t) data[6] << 24);
+  }
+
+  // A lost reply is recovered by the timeout.
+  xQueueSend(m_replies, &reply, 0);
+}// onNotify
+
+/**
+ * @brief Wait for the next reply of the server.
+ * @param [out] reply The reply.
+ * @param [in] timeoutMs The longest time to wait.
+ * @return True if a reply was received.
+ */
+bool BulkTransferClient::waitReply(Reply *reply, uint32_t timeoutMs) {
+  return xQueueReceive(m_replies, reply, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}// waitReply
+
+/**
+ * @brief Send a control message and wait for its reply, sending it again on timeout.
+ * @param [in] data The message.
+ * @param [in] length The length of the message.
+ * @param [in] op The reply to wait for.
+ * @param [out] status The status of the reply.
+ * @return True if the reply was received.
+ */
+bool BulkTransferClient::request(const uint8_t *data, size_t length, BulkTransfer::Op op, BulkTransfer::Status *status) {
+  for (uint8_t attempt = 0; attempt <= MAX_TIMEOUTS && m_pClient->isConnected(); attempt++) {
+    if (!sendControl(data, length)) {
+      return false;
+    }
+
+    if (waitStatus(op, status)) {
+      return true;
+    }
+  }
+
+  return false;
+}// request
+
+/**
+ * @brief Wait for a status reply, skipping late block replies.
+ * @param [in] op The reply to wait for.
+ * @param [out] status The status of the reply.
+ * @return True if the reply was received before the timeout.
+ */
+bool BulkTransferClient::waitStatus(BulkTransfer::Op op, BulkTransfer::Status *status) {
+  Reply reply;
+  while (waitReply(&reply, m_timeoutMs)) {
+    if (reply.op == op || reply.op == BulkTransfer::ERROR) {
+      *status = (BulkTransfer::Status) reply.status;
+      return true;
+    }
+  }
+
+  return false;
+}// waitStatus
+
+/**
+ * @brief Write a control message without response.
+ * @param [in] data The message.
+ * @param [in] length The length of the message.
+ * @return True if the message was queued.
+ */
+bool BulkTransferClient::sendControl(const uint8_t *data, size_t length) {
+  return m_pControl->writeStream(data, length);
+}// sendControl
+
+/**
+ * @brief Write chunks of a block.
+ * @param [in] data The data of the transfer.
+ * @param [in] length The length of the data.
+ * @param [in] block The block index.
+ * @param [in] chunks The bitmap of the chunks to send.
+ * @return True if the chunks were queued.
+ */
+bool BulkTransferClient::sendBlock(const uint8_t *data, size_t length, uint16_t block, uint32_t chunks) {
+  m_packet[0] = block;
+  m_packet[1] = block >> 8;
+
+  for (uint8_t chunk = 0; chunk < m_chunksPerBlock; chunk++) {
+    size_t offset = (size_t) block * m_blockSize + (size_t) chunk * m_chunkSize;
+    if (offset >= length) {
+      break;
+    }
+
+    if (!(chunks & (1UL << chunk))) {
+      continue;
+    }
+
+    size_t payload = length - offset < m_chunkSize ? length - offset : m_chunkSize;
+    m_packet[2] = chunk;
+    memcpy(&m_packet[BulkTransfer::DATA_HEADER_SIZE], data + offset, payload);
+
+    // The packet fits the MTU, the stream is a single write that waits for buffers when the host is out of them.
+    if (!m_pData->writeStream(m_packet.data(), payload + BulkTransfer::DATA_HEADER_SIZE)) {
+      return false;
+    }
+  }
+
+  return true;
+}// sendBlock
+
+/**
+ * @brief Write the end of a block with its CRC, the server answers with an ACK or a NACK.
+ * @param [in] data The data of the transfer.
+ * @param [in] length The length of the data.
+ * @param [in] block The block index.
+ * @return True if the message was queued.
+ */
+bool BulkTransferClient::sendBlockEnd(const uint8_t *data, size_t length, uint16_t block) {
+  size_t offset = (size_t) block * m_blockSize;
+  size_t blockLength = length - offset < m_blockSize ? length - offset : m_blockSize;
+  uint32_t crc = esp_rom_crc32_le(0, data + offset, blockLength);
+
+  uint8_t msg[7] = {BulkTransfer::BLOCK_END, (uint8_t) block, (uint8_t) (block >> 8),
+                    (uint8_t) crc, (uint8_t) (crc >> 8), (uint8_t) (crc >> 16), (uint8_t) (crc >> 24)};
+  return sendControl(msg, sizeof(msg));
+}// sendBlockEnd
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
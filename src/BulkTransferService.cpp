@@ -0,0 +1,391 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "nimble/BulkTransferService.hpp"
+
+#include <esp_rom_crc.h>
+#include <os/os_mbuf.h>
+
+#include "nimble/Log.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Service.hpp"
+
+static const char *LOG_TAG = "NimBLEBulkTransferService";
+
+namespace nimble {
+
+static BulkTransferCallbacks defaultCallbacks;
+
+/**
+ * @brief Size of the largest control message, START.
+ */
+static constexpr size_t MAX_CONTROL_SIZE = 9;
+
+static uint16_t getLE16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t getLE32(const uint8_t *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/**
+ * @brief Constructor, creates the service and its characteristics, start() must be called before the server.
+ * @param [in] pServer The server.
+ * @param [in] pCallbacks The sink of the received data, may be nullptr.
+ * @param [in] maxBufferSize The largest window of blocks accepted, in bytes.
+ * @param [in] uuid The UUID of the service.
+ */
+BulkTransferService::BulkTransferService(Server *pServer, BulkTransferCallbacks *pCallbacks, size_t maxBufferSize,
+                                         const UUID &uuid) : m_dataCallbacks(this), m_controlCallbacks(this) {
+  m_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+  m_maxBufferSize = maxBufferSize;
+  m_totalLength = 0;
+  m_blockSize = 0;
+  m_chunkSize = 0;
+  m_blockCount = 0;
+  m_nextBlock = 0;
+  m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+  m_chunksPerBlock = 0;
+  m_active = false;
+
+  m_pService = pServer->createService(uuid);
+  Characteristic *pData = m_pService->createCharacteristic(UUID(BulkTransfer::DATA_UUID), Property::WRITE_NR);
+  pData->setCallbacks(&m_dataCallbacks);
+  m_pControl = m_pService->createCharacteristic(UUID(BulkTransfer::CONTROL_UUID),
+                                                Property::WRITE | Property::WRITE_NR | Property::NOTIFY);
+  m_pControl->setCallbacks(&m_controlCallbacks);
+}// BulkTransferService
+
+/**
+ * @brief Start the service.
+ * @return True if the service was started.
+ */
+bool BulkTransferService::start() {
+  return m_pService->start();
+}// start
+
+/**
+ * @brief Get the GATT service.
+ * @return The service.
+ */
+Service *BulkTransferService::getService() const {
+  return m_pService;
+}// getService
+
+/**
+ * @brief Check if a transfer is in progress.
+ * @return True between START and FINISH or an error.
+ */
+bool BulkTransferService::isActive() const {
+  return m_active;
+}// isActive
+
+/**
+ * @brief Get the number of bytes written to the sink by the current or last transfer.
+ * @return The number of bytes.
+ */
+size_t BulkTransferService::getReceived() const {
+  size_t received = (size_t) m_nextBlock * m_blockSize;
+  return received < m_totalLength ? received : m_totalLength;
+}// getReceived
+
+/**
+ * @brief Copy a chunk into the buffer of its block.
+ * @param [in] om The written data.
+ */
+void BulkTransferService::onData(const os_mbuf *om) {
+  uint16_t length = OS_MBUF_PKTLEN(om);
+  if (!m_active || length <= BulkTransfer::DATA_HEADER_SIZE) {
+    return;
+  }
+
+  uint8_t header[BulkTransfer::DATA_HEADER_SIZE];
+  os_mbuf_copydata(om, 0, sizeof(header), header);
+  uint16_t block = getLE16(header);
+  uint8_t chunk = header[2];
+
+  // Chunks of blocks already written or beyond the window are stale or invalid.
+  if (block < m_nextBlock || block >= m_nextBlock + m_slots.size() || block >= m_blockCount) {
+    return;
+  }
+
+  size_t offset = (size_t) chunk * m_chunkSize;
+  size_t payload = length - BulkTransfer::DATA_HEADER_SIZE;
+  if (chunk >= m_chunksPerBlock || payload > m_chunkSize || offset + payload > getBlockLength(block)) {
+    NIMBLE_LOGW(LOG_TAG, "Invalid chunk %d of block %d", chunk, block);
+    return;
+  }
+
+  size_t index = block % m_slots.size();
+  Slot &slot = m_slots[index];
+  if (slot.block != block) {
+    slot.block = block;
+    slot.received = 0;
+  }
+
+  os_mbuf_copydata(om, BulkTransfer::DATA_HEADER_SIZE, payload, &m_buffer[index * m_blockSize + offset]);
+  slot.received |= 1UL << chunk;
+}// onData
+
+/**
+ * @brief Handle a control message.
+ * @param [in] om The written data.
+ * @param [in] connInfo The connection of the client.
+ */
+void BulkTransferService::onControl(const os_mbuf *om, ConnectionInfo &connInfo) {
+  uint8_t data[MAX_CONTROL_SIZE] = {};
+  uint16_t length = OS_MBUF_PKTLEN(om);
+  if (length == 0) {
+    return;
+  }
+
+  os_mbuf_copydata(om, 0, length < sizeof(data) ? length : sizeof(data), data);
+
+  switch (data[0]) {
+  case BulkTransfer::START:
+    onStart(data, length, connInfo);
+    break;
+  case BulkTransfer::BLOCK_END:
+    if (m_active && length >= 7) {
+      onBlockEnd(getLE16(&data[1]), getLE32(&data[3]));
+    }
+    break;
+  case BulkTransfer::FINISH:
+    onFinish();
+    break;
+  case BulkTransfer::ABORT:
+    if (m_active) {
+      NIMBLE_LOGI(LOG_TAG, "Transfer aborted by the client");
+      finish(false);
+    }
+    break;
+  default:
+    break;
+  }
+}// onControl
+
+/**
+ * @brief Start a transfer, replacing the current one.
+ * @param [in] data The START message.
+ * @param [in] length The length of the message.
+ * @param [in] connInfo The connection of the client.
+ */
+void BulkTransferService::onStart(const uint8_t *data, size_t length, ConnectionInfo &connInfo) {
+  if (m_active) {
+    finish(false);
+  }
+
+  m_connHandle = connInfo.getConnHandle();
+  m_blockCount = 0;
+  if (length < MAX_CONTROL_SIZE) {
+    reply(BulkTransfer::START_ACK, BulkTransfer::INVALID);
+    return;
+  }
+
+  m_totalLength = getLE32(&data[1]);
+  m_chunkSize = getLE16(&data[5]);
+  m_chunksPerBlock = data[7];
+  uint8_t window = data[8];
+
+  if (m_totalLength == 0 || m_chunkSize == 0 || m_chunksPerBlock == 0 || m_chunksPerBlock > BulkTransfer::MAX_CHUNKS ||
+      window == 0 || window > BulkTransfer::MAX_WINDOW) {
+    reply(BulkTransfer::START_ACK, BulkTransfer::INVALID);
+    return;
+  }
+
+  m_blockSize = (size_t) m_chunkSize * m_chunksPerBlock;
+  size_t blockCount = (m_totalLength + m_blockSize - 1) / m_blockSize;
+  if (blockCount > UINT16_MAX) {
+    reply(BulkTransfer::START_ACK, BulkTransfer::INVALID);
+    return;
+  }
+
+  if (m_blockSize * window > m_maxBufferSize) {
+    NIMBLE_LOGW(LOG_TAG, "Window of %d bytes exceeds the buffer limit", m_blockSize * window);
+    reply(BulkTransfer::START_ACK, BulkTransfer::NO_MEMORY);
+    return;
+  }
+
+  if (!m_pCallbacks->onStart(m_totalLength, connInfo)) {
+    reply(BulkTransfer::START_ACK, BulkTransfer::REJECTED);
+    return;
+  }
+
+  m_buffer.resize(m_blockSize * window);
+  m_slots.assign(window, Slot{UINT16_MAX, 0});
+  m_blockCount = blockCount;
+  m_nextBlock = 0;
+  m_active = true;
+
+  NIMBLE_LOGI(LOG_TAG, "Transfer of %d bytes in %d blocks started", m_totalLength, m_blockCount);
+  reply(BulkTransfer::START_ACK, BulkTransfer::OK);
+}// onStart
+
+/**
+ * @brief Verify a block, acknowledge it and write the blocks completed in order to the sink.
+ * @param [in] block The block index.
+ * @param [in] crc The CRC-32 of the block computed by the client.
+ */
+void BulkTransferService::onBlockEnd(uint16_t block, uint32_t crc) {
+  // Written already, the acknowledgement was lost.
+  if (block < m_nextBlock) {
+    replyBlock(BulkTransfer::BLOCK_ACK, block);
+    return;
+  }
+
+  if (block >= m_nextBlock + m_slots.size() || block >= m_blockCount) {
+    return;
+  }
+
+  size_t index = block % m_slots.size();
+  Slot &slot = m_slots[index];
+  uint32_t expected = getBlockMask(block);
+  if (slot.block != block) {
+    replyBlock(BulkTransfer::BLOCK_NACK, block, expected);
+    return;
+  }
+
+  uint32_t missing = expected & ~slot.received;
+  if (missing != 0) {
+    replyBlock(BulkTransfer::BLOCK_NACK, block, missing);
+    return;
+  }
+
+  if (esp_rom_crc32_le(0, &m_buffer[index * m_blockSize], getBlockLength(block)) != crc) {
+    NIMBLE_LOGW(LOG_TAG, "CRC mismatch in block %d", block);
+    slot.received = 0;
+    replyBlock(BulkTransfer::BLOCK_NACK, block, expected);
+    return;
+  }
+
+  replyBlock(BulkTransfer::BLOCK_ACK, block);
+
+  // The slot of a block is reused only once every earlier block was acknowledged, so the blocks
+  // completed in order are written and their slots freed here.
+  while (m_nextBlock < m_blockCount) {
+    index = m_nextBlock % m_slots.size();
+    Slot &next = m_slots[index];
+    if (next.block != m_nextBlock || (getBlockMask(m_nextBlock) & ~next.received) != 0) {
+      break;
+    }
+
+    if (!m_pCallbacks->onData((size_t) m_nextBlock * m_blockSize, &m_buffer[index * m_blockSize],
+                              getBlockLength(m_nextBlock))) {
+      NIMBLE_LOGE(LOG_TAG, "Sink failed at block %d", m_nextBlock);
+      reply(BulkTransfer::ERROR, BulkTransfer::SINK_ERROR);
+      finish(false);
+      return;
+    }
+
+    next.block = UINT16_MAX;
+    m_nextBlock++;
+  }
+}// onBlockEnd
+
+/**
+ * @brief Complete the transfer if every block was written.
+ */
+void BulkTransferService::onFinish() {
+  if (!m_active) {
+    // A FINISH sent again because the FINISH_ACK was lost.
+    bool complete = m_blockCount != 0 && m_nextBlock == m_blockCount;
+    reply(BulkTransfer::FINISH_ACK, complete ? BulkTransfer::OK : BulkTransfer::INVALID);
+    return;
+  }
+
+  bool complete = m_nextBlock == m_blockCount;
+  reply(BulkTransfer::FINISH_ACK, complete ? BulkTransfer::OK : BulkTransfer::INCOMPLETE);
+  finish(complete);
+}// onFinish
+
+/**
+ * @brief End the transfer and release the buffers.
+ * @param [in] success True if all the data was written to the sink.
+ */
+void BulkTransferService::finish(bool success) {
+  m_active = false;
+  m_buffer.clear();
+  m_buffer.shrink_to_fit();
+  m_slots.clear();
+  NIMBLE_LOGI(LOG_TAG, "Transfer %s, %d bytes written", success ? "complete" : "failed", getReceived());
+  m_pCallbacks->onComplete(success);
+}// finish
+
+/**
+ * @brief Get the length of a block, the last one can be shorter.
+ * @param [in] block The block index.
+ * @return The length in bytes.
+ */
+size_t BulkTransferService::getBlockLength(uint16_t block) const {
+  size_t offset = (size_t) block * m_blockSize;
+  return m_totalLength - offset < m_blockSize ? m_totalLength - offset : m_blockSize;
+}// getBlockLength
+
+/**
+ * @brief Get the bitmap of the chunks of a block.
+ * @param [in] block The block index.
+ * @return A bit set for every chunk.
+ */
+uint32_t BulkTransferService::getBlockMask(uint16_t block) const {
+  size_t chunks = (getBlockLength(block) + m_chunkSize - 1) / m_chunkSize;
+  return chunks >= 32 ? UINT32_MAX : (1UL << chunks) - 1;
+}// getBlockMask
+
+/**
+ * @brief Notify a status to the client.
+ * @param [in] op The reply.
+ * @param [in] status The status.
+ */
+void BulkTransferService::reply(BulkTransfer::Op op, BulkTransfer::Status status) {
+  uint8_t data[2] = {op, status};
+  m_pControl->notify(data, sizeof(data), true, m_connHandle);
+}// reply
+
+/**
+ * @brief Notify the state of a block to the client.
+ * @param [in] op BLOCK_ACK or BLOCK_NACK.
+ * @param [in] block The block index.
+ * @param [in] missing With BLOCK_NACK, the bitmap of the chunks to send again.
+ */
+void BulkTransferService::replyBlock(BulkTransfer::Op op, uint16_t block, uint32_t missing) {
+  uint8_t data[7] = {op, (uint8_t) block, (uint8_t) (block >> 8),
+                     (uint8_t) missing, (uint8_t) (missing >> 8), (uint8_t) (missing >> 16), (uint8_t) (missing >> 24)};
+  m_pControl->notify(data, op == BulkTransfer::BLOCK_NACK ? 7 : 3, true, m_connHandle);
+}// replyBlock
+
+/**
+ * @brief Take the written chunk straight from the mbuf, the value of the characteristic is not updated.
+ */
+bool BulkTransferService::DataCallbacks::onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om,
+                                                    ConnectionInfo &connInfo) {
+  m_pService->onData(om);
+  return true;
+}// onWriteRaw
+
+/**
+ * @brief Take the control message straight from the mbuf.
+ */
+bool BulkTransferService::ControlCallbacks::onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om,
+                                                       ConnectionInfo &connInfo) {
+  m_pService->onControl(om, connInfo);
+  return true;
+}// onWriteRaw
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
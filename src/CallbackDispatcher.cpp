@@ -0,0 +1,462 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+
+#include "nimble/CallbackDispatcher.hpp"
+#include "nimble/ConnectionInfo.hpp"
+#include "nimble/Log.hpp"
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+#include "nimble/Scan.hpp"
+#endif
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+#include "nimble/Characteristic.hpp"
+#include "nimble/Server.hpp"
+#endif
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+#include "nimble/RemoteCharacteristic.hpp"
+#endif
+
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <nimble/nimble_npl.h>
+
+namespace nimble {
+
+static const char *LOG_TAG = "NimBLECallbackDispatcher";
+
+static constexpr uint16_t QUEUE_DEPTH[CallbackDispatcher::QUEUE_MAX] = {
+    CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH,
+    CONFIG_NIMBLE_CPP_DISPATCH_GATT_QUEUE_DEPTH,
+    CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_QUEUE_DEPTH,
+};
+
+// Every worker can hold all events of all queues and its stop event, so posting a reserved event never blocks.
+static constexpr uint16_t WORKER_QUEUE_LENGTH = CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH +
+                                                CONFIG_NIMBLE_CPP_DISPATCH_GATT_QUEUE_DEPTH +
+                                                CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_QUEUE_DEPTH + 1;
+
+static QueueHandle_t s_workers[CONFIG_NIMBLE_CPP_DISPATCH_WORKERS];
+static SemaphoreHandle_t s_slots[CallbackDispatcher::QUEUE_MAX];
+// Connection events wait a little for room, never forever, the host task must keep running.
+static CallbackDispatcher::OverflowPolicy s_policy[CallbackDispatcher::QUEUE_MAX] = {
+    CallbackDispatcher::DROP,
+    CallbackDispatcher::DROP,
+    CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS > 0 ? CallbackDispatcher::BLOCK : CallbackDispatcher::DROP,
+};
+static TickType_t s_timeout[CallbackDispatcher::QUEUE_MAX] = {0, 0, pdMS_TO_TICKS(CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS)};
+static std::atomic<uint32_t> s_dropped[CallbackDispatcher::QUEUE_MAX];
+static bool s_running = false;
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+// Copies of the advertised devices handed to the scan callbacks, one per queued scan event.
+static AdvertisedDevice s_scanDevices[CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH];
+static AdvertisedDevice *s_freeScanDevices[CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH];
+static uint16_t s_freeScanDeviceCount = 0;
+#endif
+
+/**
+ * @brief Set what happens to events posted while their queue is full.
+ * @param [in] queue The queue.
+ * @param [in] policy DROP to discard the event, BLOCK to wait for room in the queue.
+ * @param [in] timeoutMs With BLOCK, the time to wait before dropping the event, 0 to wait forever.
+ * @details Blocking stalls the NimBLE host task, a timeout of 0 can stall it for good if a callback never returns.
+ * By default scan and GATT events are dropped, connection events wait CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS.
+ * The callback of a dropped event is not called, running it on the host task could put it ahead
+ * of the events of its connection still queued.
+ */
+/*STATIC*/
+void CallbackDispatcher::setOverflowPolicy(Queue queue, OverflowPolicy policy, uint32_t timeoutMs) {
+  s_policy[queue] = policy;
+  s_timeout[queue] = policy == DROP ? 0 : timeoutMs == 0 ? portMAX_DELAY
+                                                         : pdMS_TO_TICKS(timeoutMs);
+}// setOverflowPolicy
+
+/**
+ * @brief Get the number of events dropped because a queue was full.
+ * @param [in] queue The queue.
+ * @return The number of callbacks not called.
+ */
+/*STATIC*/
+uint32_t CallbackDispatcher::getDropped(Queue queue) {
+  return s_dropped[queue].load(std::memory_order_relaxed);
+}// getDropped
+
+/**
+ * @brief Create the queues and start the workers, called by Device::init().
+ * @param [in] core The core to pin the workers to, or tskNO_AFFINITY.
+ */
+/*STATIC*/
+void CallbackDispatcher::start(BaseType_t core) {
+  if (s_running) {
+    return;
+  }
+
+  for (size_t i = 0; i < QUEUE_MAX; i++) {
+    if (s_slots[i] == nullptr) {
+      s_slots[i] = xSemaphoreCreateCounting(QUEUE_DEPTH[i], QUEUE_DEPTH[i]);
+    }
+  }
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  for (size_t i = 0; i < CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH; i++) {
+    s_freeScanDevices[i] = &s_scanDevices[i];
+  }
+  s_freeScanDeviceCount = CONFIG_NIMBLE_CPP_DISPATCH_SCAN_QUEUE_DEPTH;
+#endif
+
+  for (size_t i = 0; i < CONFIG_NIMBLE_CPP_DISPATCH_WORKERS; i++) {
+    if (s_workers[i] == nullptr) {
+      s_workers[i] = xQueueCreate(WORKER_QUEUE_LENGTH, sizeof(Event));
+    } else {
+      // Events posted while the previous workers were stopping, their callbacks are not called.
+      drain(s_workers[i]);
+    }
+
+    xTaskCreatePinnedToCore(CallbackDispatcher::task, "nimble_cb", CONFIG_NIMBLE_CPP_DISPATCH_TASK_STACK_SIZE,
+                            s_workers[i], CONFIG_NIMBLE_CPP_DISPATCH_TASK_PRIORITY, nullptr, core);
+  }
+
+  s_running = true;
+}// start
+
+/**
+ * @brief Stop the workers once they have run the queued callbacks, called by Device::deinit().
+ */
+/*STATIC*/
+void CallbackDispatcher::stop() {
+  if (!s_running) {
+    return;
+  }
+
+  // No new reservation from here, so nothing is posted behind the stop events.
+  s_running = false;
+
+  Event event{};
+  event.type = STOP;
+  for (auto &it : s_workers) {
+    xQueueSend(it, &event, portMAX_DELAY);
+  }
+}// stop
+
+/**
+ * @brief Take a place in a queue, waiting according to its overflow policy.
+ * @param [in] queue The queue.
+ * @return True if the event can be posted, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::reserve(Queue queue) {
+  if (s_running && xSemaphoreTake(s_slots[queue], s_timeout[queue]) == pdTRUE) {
+    return true;
+  }
+
+  s_dropped[queue].fetch_add(1, std::memory_order_relaxed);
+  NIMBLE_LOGW_DEFER(LOG_TAG, "Callback queue %d full, event dropped", queue);
+  return false;
+}// reserve
+
+/**
+ * @brief Give back the place of a completed event.
+ * @param [in] queue The queue of the event.
+ */
+/*STATIC*/
+void CallbackDispatcher::release(Queue queue) {
+  xSemaphoreGive(s_slots[queue]);
+}// release
+
+/**
+ * @brief Hand a reserved event to the worker of its connection.
+ * @param [in] connHandle The connection of the event, so its events stay in order.
+ * @param [in] event The event, copied.
+ */
+/*STATIC*/
+void CallbackDispatcher::post(uint16_t connHandle, const Event &event) {
+  if (xQueueSend(s_workers[connHandle % CONFIG_NIMBLE_CPP_DISPATCH_WORKERS], &event, portMAX_DELAY) != pdTRUE) {
+    Event dropped = event;
+    finish(dropped);
+  }
+}// post
+
+/**
+ * @brief Queue a scan callback.
+ * @param [in] result True for onResult(), false for onDiscovered().
+ * @param [in] pDevice The advertised device, copied.
+ * @param [in] pCallbacks The callbacks to call.
+ * @return True if the callback was queued, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::dispatchScan(bool result, const AdvertisedDevice *pDevice, ScanCallbacks *pCallbacks) {
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  if (!reserve(SCAN)) {
+    return false;
+  }
+
+  // A place in the scan queue guarantees a free device copy.
+  ble_npl_hw_enter_critical();
+  AdvertisedDevice *pCopy = s_freeScanDevices[--s_freeScanDeviceCount];
+  ble_npl_hw_exit_critical(0);
+  *pCopy = *pDevice;
+
+  Event event{};
+  event.type = result ? SCAN_RESULT : SCAN_DISCOVERED;
+  event.queue = SCAN;
+  event.pObject = pCopy;
+  event.pCallbacks = pCallbacks;
+  post(0, event);
+  return true;
+#else
+  return false;
+#endif
+}// dispatchScan
+
+/**
+ * @brief Queue CharacteristicCallbacks::onWrite().
+ * @param [in] pChr The characteristic written.
+ * @param [in] pCallbacks The callbacks of the characteristic.
+ * @param [in] desc The connection of the writer.
+ * @return True if the callback was queued, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::dispatchWrite(Characteristic *pChr, CharacteristicCallbacks *pCallbacks,
+                                       const ble_gap_conn_desc &desc) {
+  if (!reserve(GATT)) {
+    return false;
+  }
+
+  Event event{};
+  event.type = CHR_WRITE;
+  event.queue = GATT;
+  event.pObject = pChr;
+  event.pCallbacks = pCallbacks;
+  event.desc = desc;
+  post(desc.conn_handle, event);
+  return true;
+}// dispatchWrite
+
+/**
+ * @brief Queue the notify callback of a remote characteristic.
+ * @param [in] pChr The remote characteristic notified.
+ * @param [in] connHandle The connection of the peer.
+ * @param [in] om The notification data, owned by the dispatcher if queued.
+ * @param [in] isNotify True for a notification, false for an indication.
+ * @return True if the callback was queued and took the mbuf, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::dispatchNotify(RemoteCharacteristic *pChr, uint16_t connHandle, os_mbuf *om, bool isNotify) {
+  if (!reserve(GATT)) {
+    return false;
+  }
+
+  // Keeps the characteristic alive until the worker ran its callback, even if it is deleted meanwhile.
+  pChr->getRemoteService()->getClient()->beginRead();
+
+  Event event{};
+  event.type = NOTIFY_RX;
+  event.queue = GATT;
+  event.isNotify = isNotify;
+  event.pObject = pChr;
+  event.om = om;
+  event.desc.conn_handle = connHandle;
+  post(connHandle, event);
+  return true;
+}// dispatchNotify
+
+/**
+ * @brief Queue ServerCallbacks::onConnect().
+ * @param [in] pServer The server.
+ * @param [in] pCallbacks The callbacks of the server.
+ * @param [in] desc The new connection.
+ * @return True if the callback was queued, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::dispatchConnect(Server *pServer, ServerCallbacks *pCallbacks, const ble_gap_conn_desc &desc) {
+  if (!reserve(CONNECTION)) {
+    return false;
+  }
+
+  Event event{};
+  event.type = SERVER_CONNECT;
+  event.queue = CONNECTION;
+  event.pObject = pServer;
+  event.pCallbacks = pCallbacks;
+  event.desc = desc;
+  post(desc.conn_handle, event);
+  return true;
+}// dispatchConnect
+
+/**
+ * @brief Queue ServerCallbacks::onDisconnect().
+ * @param [in] pServer The server.
+ * @param [in] pCallbacks The callbacks of the server.
+ * @param [in] desc The closed connection.
+ * @param [in] reason The reason of the disconnection.
+ * @return True if the callback was queued, false if it was dropped.
+ */
+/*STATIC*/
+bool CallbackDispatcher::dispatchDisconnect(Server *pServer, ServerCallbacks *pCallbacks,
+                                            const ble_gap_conn_desc &desc, int reason) {
+  if (!reserve(CONNECTION)) {
+    return false;
+  }
+
+  Event event{};
+  event.type = SERVER_DISCONNECT;
+  event.queue = CONNECTION;
+  event.reason = reason;
+  event.pObject = pServer;
+  event.pCallbacks = pCallbacks;
+  event.desc = desc;
+  post(desc.conn_handle, event);
+  return true;
+}// dispatchDisconnect
+
+/**
+ * @brief Call the callback of an event and release its resources.
+ * @param [in] event The event.
+ */
+/*STATIC*/
+void CallbackDispatcher::run(Event &event) {
+  ConnectionInfo connInfo(event.desc);
+
+  switch (event.type) {
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  case SCAN_DISCOVERED:
+  case SCAN_RESULT: {
+    auto *pDevice = static_cast<AdvertisedDevice *>(event.pObject);
+    auto *pCallbacks = static_cast<ScanCallbacks *>(event.pCallbacks);
+    if (event.type == SCAN_RESULT) {
+      pCallbacks->onResult(pDevice);
+    } else {
+      pCallbacks->onDiscovered(pDevice);
+    }
+    break;
+  }
+#endif
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+  case CHR_WRITE:
+    static_cast<CharacteristicCallbacks *>(event.pCallbacks)->onWrite(static_cast<Characteristic *>(event.pObject), connInfo);
+    break;
+
+  case SERVER_CONNECT:
+    static_cast<ServerCallbacks *>(event.pCallbacks)->onConnect(static_cast<Server *>(event.pObject), connInfo);
+    break;
+
+  case SERVER_DISCONNECT:
+    static_cast<ServerCallbacks *>(event.pCallbacks)->onDisconnect(static_cast<Server *>(event.pObject), connInfo, event.reason);
+    break;
+#endif
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+  case NOTIFY_RX: {
+    auto *pChr = static_cast<RemoteCharacteristic *>(event.pObject);
+    if (pChr->m_notifyCallback != nullptr) {
+      pChr->m_notifyCallback(pChr, event.om->om_data, OS_MBUF_PKTLEN(event.om), event.isNotify);
+    }
+    break;
+  }
+#endif
+
+  default:
+    break;
+  }
+
+  finish(event);
+}// run
+
+/**
+ * @brief Release what a posted event holds, after its callback ran or when it is discarded.
+ * @param [in] event The event.
+ * @details Every posted event must end here exactly once: it frees the scan device copy, the mbuf,
+ * the reader section of the client and the place in the queue.
+ */
+/*STATIC*/
+void CallbackDispatcher::finish(Event &event) {
+  switch (event.type) {
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  case SCAN_DISCOVERED:
+  case SCAN_RESULT:
+    ble_npl_hw_enter_critical();
+    s_freeScanDevices[s_freeScanDeviceCount++] = static_cast<AdvertisedDevice *>(event.pObject);
+    ble_npl_hw_exit_critical(0);
+    break;
+#endif
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+  case NOTIFY_RX:
+    // May delete the client if Device::deleteClient() was called meanwhile.
+    static_cast<RemoteCharacteristic *>(event.pObject)->getRemoteService()->getClient()->endRead();
+    break;
+#endif
+
+  default:
+    break;
+  }
+
+  if (event.om != nullptr) {
+    os_mbuf_free_chain(event.om);
+    event.om = nullptr;
+  }
+
+  release(event.queue);
+}// finish
+
+/**
+ * @brief Discard the events left in a worker queue without calling their callbacks.
+ * @param [in] queue The queue of a worker.
+ */
+/*STATIC*/
+void CallbackDispatcher::drain(QueueHandle_t queue) {
+  Event event;
+  while (xQueueReceive(queue, &event, 0) == pdTRUE) {
+    if (event.type != STOP) {
+      finish(event);
+    }
+  }
+}// drain
+
+/**
+ * @brief A worker task running the callbacks of its queue in order.
+ * @param [in] arg The queue of the worker.
+ */
+/*STATIC*/
+void CallbackDispatcher::task(void *arg) {
+  QueueHandle_t queue = static_cast<QueueHandle_t>(arg);
+  Event event;
+
+  for (;;) {
+    if (xQueueReceive(queue, &event, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    if (event.type == STOP) {
+      drain(queue);
+      vTaskDelete(nullptr);
+    }
+
+    run(event);
+  }
+}// task
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER */
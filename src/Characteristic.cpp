@@ -15,16 +15,17 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
 
+#include "nimble/CallbackDispatcher.hpp"
 #include "nimble/Characteristic.hpp"
+#include "nimble/ConnParamsManager.hpp"
 #include "nimble/Descriptor2904.hpp"
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
+#include "nimble/Stats.hpp"
 
 namespace nimble {
 
 #define NULL_HANDLE (0xffff)
-#define NIMBLE_SUB_NOTIFY 0x0001
-#define NIMBLE_SUB_INDICATE 0x0002
 
 static CharacteristicCallbacks defaultCallback;
 static const char *LOG_TAG = "NimBLECharacteristic";
@@ -238,6 +239,14 @@ AttributeValue Characteristic::getValue(time_t *timestamp) {
   return m_value;
 }// getValue
 
+/**
+ * @brief Get a view of the current value that does not copy it.
+ * @return A view of the value, valid until the value is next changed.
+ */
+AttributeValueView Characteristic::getValueView() const {
+  return m_value.view();
+}// getValueView
+
 /**
  * @brief Retrieve the the current data length of the characteristic.
  * @return The length of the current characteristic data.
@@ -269,12 +278,12 @@ int Characteristic::handleGapEvent(uint16_t conn_handle, uint16_t attr_handle,
   if (ble_uuid_cmp(uuid, &pCharacteristic->getUUID().getNative()->u) == 0) {
     switch (ctxt->op) {
     case BLE_GATT_ACCESS_OP_READ_CHR: {
-      rc = ble_gap_conn_find(conn_handle, &peerInfo.m_desc);
-      assert(rc == 0);
+      Server *pServer = Device::getServer();
+      peerInfo = pServer->getPeerIDInfo(conn_handle);
 
       // If the packet header is only 8 bytes this is a follow up of a long read
       // so we don't want to call the onRead() callback again.
-      if (ctxt->om->om_pkthdr_len > 8 || pCharacteristic->m_value.size() <= (ble_att_mtu(peerInfo.m_desc.conn_handle) - 3)) {
+      if (ctxt->om->om_pkthdr_len > 8 || pCharacteristic->m_value.size() <= (pServer->getPeerMTU(conn_handle) - 3)) {
         pCharacteristic->m_pCallbacks->onRead(pCharacteristic, peerInfo);
       }
 
@@ -285,30 +294,25 @@ int Characteristic::handleGapEvent(uint16_t conn_handle, uint16_t attr_handle,
     }
 
     case BLE_GATT_ACCESS_OP_WRITE_CHR: {
-      uint16_t att_max_len = pCharacteristic->m_value.max_size();
+      NIMBLE_CONN_TRAFFIC(conn_handle, OS_MBUF_PKTLEN(ctxt->om));
+      peerInfo = Device::getServer()->getPeerIDInfo(conn_handle);
 
-      if (ctxt->om->om_len > att_max_len) {
-        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+      // Let the application consume the data directly from the mbuf chain if it wants to.
+      if (pCharacteristic->m_pCallbacks->onWriteRaw(pCharacteristic, ctxt->om, peerInfo)) {
+        return 0;
       }
 
-      uint8_t buf[att_max_len];
-      size_t len = ctxt->om->om_len;
-      memcpy(buf, ctxt->om->om_data, len);
-
-      os_mbuf *next;
-      next = SLIST_NEXT(ctxt->om, om_next);
-      while (next != NULL) {
-        if ((len + next->om_len) > att_max_len) {
-          return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-        }
-        memcpy(&buf[len], next->om_data, next->om_len);
-        len += next->om_len;
-        next = SLIST_NEXT(next, om_next);
+      if (!pCharacteristic->m_value.setValue(ctxt->om)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
       }
-      rc = ble_gap_conn_find(conn_handle, &peerInfo.m_desc);
-      assert(rc == 0);
-      pCharacteristic->setValue(buf, len);
+
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+      // With its queue full the write callback is dropped, running it here would put it ahead of
+      // the callbacks of this connection still queued.
+      CallbackDispatcher::dispatchWrite(pCharacteristic, pCharacteristic->m_pCallbacks, peerInfo.m_desc);
+#else
       pCharacteristic->m_pCallbacks->onWrite(pCharacteristic, peerInfo);
+#endif
       return 0;
     }
     default:
@@ -324,19 +328,46 @@ int Characteristic::handleGapEvent(uint16_t conn_handle, uint16_t attr_handle,
  * @returns Number of clients subscribed to notifications / indications.
  */
 size_t Characteristic::getSubscribedCount() const {
-  return m_subscribedVec.size();
+  return (m_notifySubs | m_indicateSubs).count();
 }
 
+/**
+ * @brief Get the subscription of a peer.
+ * @param [in] peerIndex The slot of the peer in the server peer state table.
+ * @return A combination of NIMBLE_SUB_NOTIFY and NIMBLE_SUB_INDICATE, 0 if not subscribed.
+ */
+uint16_t Characteristic::getSubscribeValue(size_t peerIndex) const {
+  return (m_notifySubs[peerIndex] ? NIMBLE_SUB_NOTIFY : 0) | (m_indicateSubs[peerIndex] ? NIMBLE_SUB_INDICATE : 0);
+}// getSubscribeValue
+
+/**
+ * @brief Remove the subscription of a peer.
+ * @param [in] peerIndex The slot of the peer in the server peer state table.
+ */
+void Characteristic::clearSubscribe(size_t peerIndex) {
+  m_notifySubs.reset(peerIndex);
+  m_indicateSubs.reset(peerIndex);
+}// clearSubscribe
+
 /**
  * @brief Set the subscribe status for this characteristic.\n
- * This will maintain a vector of subscribed clients and their indicate/notify status.
+ * This will maintain the set of subscribed clients and their indicate/notify status.
+ * @details A peer the server has no cached state for, such as a connection made as a client,
+ * is added to the peer state table from the stack so its subscription is kept and notified.
  */
 void Characteristic::setSubscribe(struct ble_gap_event *event) {
-  ConnectionInfo peerInfo;
-  if (ble_gap_conn_find(event->subscribe.conn_handle, &peerInfo.m_desc) != 0) {
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer->getPeerState(event->subscribe.conn_handle);
+  if (pState == nullptr) {
+    pState = pServer->updatePeerState(event->subscribe.conn_handle);
+  }
+  if (pState == nullptr) {
+    NIMBLE_LOGW(LOG_TAG, "Subscribe dropped, no peer state for conn: %d", event->subscribe.conn_handle);
     return;
   }
 
+  ConnectionInfo peerInfo(pState->desc);
+
   uint16_t subVal = 0;
   if (event->subscribe.cur_notify > 0 && (m_properties & Property ::NOTIFY)) {
     subVal |= NIMBLE_SUB_NOTIFY;
@@ -348,25 +379,12 @@ void Characteristic::setSubscribe(struct ble_gap_event *event) {
   NIMBLE_LOGI(LOG_TAG, "New subscribe value for conn: %d val: %d", event->subscribe.conn_handle, subVal);
 
   if (!event->subscribe.cur_indicate && event->subscribe.prev_indicate) {
-    Device::getServer()->clearIndicateWait(event->subscribe.conn_handle);
-  }
-
-  auto it = m_subscribedVec.begin();
-  for (; it != m_subscribedVec.end(); ++it) {
-    if ((*it).first == event->subscribe.conn_handle) {
-      break;
-    }
+    pServer->purgeIndications(event->subscribe.conn_handle, this);
   }
 
-  if (subVal > 0) {
-    if (it == m_subscribedVec.end()) {
-      m_subscribedVec.emplace_back(event->subscribe.conn_handle, subVal);
-    } else {
-      (*it).second = subVal;
-    }
-  } else if (it != m_subscribedVec.end()) {
-    m_subscribedVec.erase(it);
-  }
+  size_t peerIndex = pServer->getPeerIndex(pState);
+  m_notifySubs[peerIndex] = (subVal & NIMBLE_SUB_NOTIFY) != 0;
+  m_indicateSubs[peerIndex] = (subVal & NIMBLE_SUB_INDICATE) != 0;
 
   m_pCallbacks->onSubscribe(this, peerInfo, subVal);
 }
@@ -422,7 +440,7 @@ void Characteristic::notify(const std::vector<uint8_t> &value, bool is_notificat
  * @param[in] conn_handle Connection handle to send individual notification, or BLE_HCI_LE_CONN_HANDLE_MAX + 1 to send notification to all subscribed clients.
  */
 void Characteristic::notify(const uint8_t *value, size_t length, bool is_notification, uint16_t conn_handle) {
-  NIMBLE_LOGD(LOG_TAG, ">> notify: length: %d", length);
+  NIMBLE_LOGD_DEFER(LOG_TAG, ">> notify: length: %d", length);
 
   if (!(m_properties & Property ::NOTIFY) && !(m_properties & Property::INDICATE)) {
     NIMBLE_LOGE(LOG_TAG,
@@ -430,8 +448,8 @@ void Characteristic::notify(const uint8_t *value, size_t length, bool is_notific
                 std::string(getUUID()).c_str());
   }
 
-  if (m_subscribedVec.empty()) {
-    NIMBLE_LOGD(LOG_TAG, "<< notify: No clients subscribed.");
+  if (m_notifySubs.none() && m_indicateSubs.none()) {
+    NIMBLE_LOGD_DEFER(LOG_TAG, "<< notify: No clients subscribed.");
     return;
   }
 
@@ -439,40 +457,44 @@ void Characteristic::notify(const uint8_t *value, size_t length, bool is_notific
 
   bool reqSec = (m_properties & BLE_GATT_CHR_F_READ_AUTHEN) || (m_properties & BLE_GATT_CHR_F_READ_AUTHOR) || (m_properties & BLE_GATT_CHR_F_READ_ENC);
   int rc = 0;
+  Server *pServer = Device::getServer();
 
-  for (auto &it : m_subscribedVec) {
-    // check if need a specific client
-    if ((conn_handle <= BLE_HCI_LE_CONN_HANDLE_MAX) && (it.first != conn_handle)) {
+  for (size_t i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
+    uint16_t subVal = getSubscribeValue(i);
+    if (subVal == 0) {
       continue;
     }
 
-    uint16_t _mtu = getService()->getServer()->getPeerMTU(it.first) - 3;
+    const Server::PeerState &state = pServer->m_peerStates[i];
+    uint16_t peer = state.desc.conn_handle;
+
+    // check if need a specific client
+    if ((conn_handle <= BLE_HCI_LE_CONN_HANDLE_MAX) && (peer != conn_handle)) {
+      continue;
+    }
 
-    // check if connected and subscribed
-    if (_mtu == 0 || it.second == 0) {
+    // check if connected
+    if (peer == BLE_HS_CONN_HANDLE_NONE || state.mtu <= 3) {
       continue;
     }
+    uint16_t _mtu = state.mtu - 3;
 
     // check if security requirements are satisfied
-    if (reqSec) {
-      struct ble_gap_conn_desc desc;
-      rc = ble_gap_conn_find(it.first, &desc);
-      if (rc != 0 || !desc.sec_state.encrypted) {
-        continue;
-      }
+    if (reqSec && !state.desc.sec_state.encrypted) {
+      continue;
     }
 
     if (length > _mtu) {
-      NIMBLE_LOGW(LOG_TAG, "- Truncating to %d bytes (maximum notify size)", _mtu);
+      NIMBLE_LOGW_DEFER(LOG_TAG, "- Truncating to %d bytes (maximum notify size)", _mtu);
     }
 
-    if (is_notification && (!(it.second & NIMBLE_SUB_NOTIFY))) {
+    if (is_notification && (!(subVal & NIMBLE_SUB_NOTIFY))) {
       NIMBLE_LOGW(LOG_TAG,
                   "Sending notification to client subscribed to indications, sending indication instead");
       is_notification = false;
     }
 
-    if (!is_notification && (!(it.second & NIMBLE_SUB_INDICATE))) {
+    if (!is_notification && (!(subVal & NIMBLE_SUB_INDICATE))) {
       NIMBLE_LOGW(LOG_TAG,
                   "Sending indication to client subscribed to notification, sending notification instead");
       is_notification = true;
@@ -482,24 +504,20 @@ void Characteristic::notify(const uint8_t *value, size_t length, bool is_notific
     // we could be allocating a buffer that doesn't get released.
     // We also must create it in each loop iteration because it is consumed with each host call.
     os_mbuf *om = ble_hs_mbuf_from_flat(value, length);
+    NIMBLE_CONN_TRAFFIC(peer, length);
 
     if (!is_notification && (m_properties & Property::INDICATE)) {
-      if (!Device::getServer()->setIndicateWait(it.first)) {
-        NIMBLE_LOGE(LOG_TAG, "prior Indication in progress");
-        os_mbuf_free_chain(om);
-        return;
-      }
-
-      rc = ble_gattc_indicate_custom(it.first, m_handle, om);
+      rc = pServer->queueIndication(peer, this, om);
       if (rc != 0) {
-        Device::getServer()->clearIndicateWait(it.first);
+        NIMBLE_LOGE(LOG_TAG, "Indication not sent; rc=%d %s", rc, Utils::returnCodeToString(rc));
       }
     } else {
-      ble_gattc_notify_custom(it.first, m_handle, om);
+      rc = ble_gattc_notify_custom(peer, m_handle, om);
+      NIMBLE_STAT_NOTIFY(rc);
     }
   }
 
-  NIMBLE_LOGD(LOG_TAG, "<< notify");
+  NIMBLE_LOGD_DEFER(LOG_TAG, "<< notify");
 }// Notify
 
 /**
@@ -529,10 +547,13 @@ CharacteristicCallbacks *Characteristic::getCallbacks() {
  */
 void Characteristic::setValue(const uint8_t *data, size_t length) {
 #if CONFIG_NIMBLE_CPP_LOG_LEVEL >= 4
-  char *pHex = NimBLEUtils::buildHexData(nullptr, data, length);
-  NIMBLE_LOGD(LOG_TAG, ">> setValue: length=%d, data=%s, characteristic UUID=%s",
-              length, pHex, getUUID().toString().c_str());
-  free(pHex);
+  if (NIMBLE_CPP_LOG_ENABLED(ESP_LOG_DEBUG, LOG_TAG)) {
+    char hex[65];
+    char uuid[UUID::STR_LEN];
+    Utils::toHex(hex, sizeof(hex), data, length);
+    m_uuid.toChars(uuid, sizeof(uuid));
+    NIMBLE_LOGD(LOG_TAG, ">> setValue: length=%d, data=%s, characteristic UUID=%s", length, hex, uuid);
+  }
 #endif
 
   m_value.setValue(data, length);
@@ -592,6 +613,18 @@ void CharacteristicCallbacks::onWrite(Characteristic *pCharacteristic, Connectio
   NIMBLE_LOGD("NimBLECharacteristicCallbacks", "onWrite: default");
 }// onWrite
 
+/**
+ * @brief Callback function to consume a write request directly from the received mbuf chain.
+ * @param [in] pCharacteristic The characteristic that is the source of the event.
+ * @param [in] om The mbuf chain holding the written data, only valid for the duration of the call.
+ * @param [in] connInfo A reference to a NimBLEConnInfo instance containing the peer info.
+ * @return True if the data was consumed, the characteristic value is then not updated
+ * and onWrite() is not called. The default returns false.
+ */
+bool CharacteristicCallbacks::onWriteRaw(Characteristic *pCharacteristic, const os_mbuf *om, ConnectionInfo &connInfo) {
+  return false;
+}// onWriteRaw
+
 /**
  * @brief Callback function to support a Notify request.
  * @param [in] pCharacteristic The characteristic that is the source of the event.
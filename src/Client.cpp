@@ -18,9 +18,12 @@
 #include <string>
 #include <unordered_set>
 #include <climits>
+#include <esp_idf_version.h>
 #include <nimble/nimble_port.h>
 
+#include "nimble/CallbackDispatcher.hpp"
 #include "nimble/Client.hpp"
+#include "nimble/ConnParamsManager.hpp"
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
 
@@ -47,9 +50,72 @@
 
 namespace nimble {
 
+// The Read Multiple Variable Length request is available from the NimBLE host of ESP-IDF 5.2.
+#if defined(ESP_IDF_VERSION) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define NIMBLE_CPP_READ_MULT_VAR 1
+#else
+#define NIMBLE_CPP_READ_MULT_VAR 0
+#endif
+
 static const char* LOG_TAG = "NimBLEClient";
 static ClientCallbacks defaultCallbacks;
 
+/**
+ * @brief Estimates the number of ATT responses needed to return a list of entries.
+ * @details NimBLE reports discovered attributes one at a time, not the response they came in.
+ * Servers pack consecutive entries of the same length into a response up to the MTU, so the
+ * responses can be counted from the entry lengths, plus the final Attribute Not Found exchange.
+ */
+struct PduCounter {
+  uint16_t perPdu;
+  uint16_t lastLen;
+  uint16_t used;
+  uint32_t pdus;
+
+  explicit PduCounter(uint16_t mtu) : perPdu(mtu - 2), lastLen(0), used(0), pdus(0) {}
+
+  void add(uint16_t len) {
+    if (len != lastLen || used + len > perPdu) {
+      pdus++;
+      used = 0;
+      lastLen = len;
+    }
+    used += len;
+  }
+
+  uint32_t finish() const { return pdus + 1; }
+};
+
+/**
+ * @brief Length of a UUID on the air, 32 bit UUIDs are sent as 128 bit.
+ */
+static uint16_t uuidLen(const UUID &uuid) {
+  return uuid.bitSize() == BLE_UUID_TYPE_16 ? 2 : 16;
+}// uuidLen
+
+/**
+ * @brief Context of a single pass discovery shared by the discovery callbacks.
+ */
+struct Client::DiscoveryContext {
+  enum Stage : uint8_t { SERVICES, CHARACTERISTICS, DESCRIPTORS };
+
+  std::vector<RemoteCharacteristic *> chrs;
+  size_t cursor;
+  PduCounter pdus;
+  uint16_t descriptors;
+  Stage stage;
+  ble_npl_time_t start;
+};
+
+/**
+ * @brief Attributes removed from the tree, deleted once no reader may still hold them.
+ */
+struct Client::Retired {
+  Retired *pNext;
+  std::vector<RemoteService *> services;
+  std::vector<RemoteCharacteristic *> characteristics;
+};
+
 /**
  * @brief Constructor, private - only callable by NimBLEDevice::createClient
  * to ensure proper handling of the list of client objects.
@@ -58,10 +124,22 @@ Client::Client(const Address &peerAddress) : m_peerAddress(peerAddress) {
   m_pClientCallbacks = &defaultCallbacks;
   m_conn_id = BLE_HS_CONN_HANDLE_NONE;
   m_connectTimeout = 30000;
+  m_phyMask = BLE_GAP_LE_PHY_1M_MASK;
   m_deleteCallbacks = false;
   m_pTaskData = nullptr;
   m_connEstablished = false;
   m_lastErr = 0;
+  m_discoveryStats = DiscoveryStats{};
+  m_asyncTaskData = {this, nullptr, 0, nullptr};
+  m_asyncDeleteAttributes = true;
+  m_discoveryTaskData = {this, nullptr, 0, nullptr};
+  m_pDiscoveryCtx = nullptr;
+  m_readers = 0;
+  m_pRetired = nullptr;
+  m_deleteOnRelease = false;
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  m_serviceChangedHandle = 0;
+#endif
 
   m_pConnParams.scan_itvl = 16;                                           // Scan interval in 0.625ms units (NimBLE Default)
   m_pConnParams.scan_window = 16;                                         // Scan window in 0.625ms units (NimBLE Default)
@@ -85,6 +163,18 @@ Client::~Client() {
   // Before we are finished with the client, we must release resources.
   deleteServices();
 
+  // Device::deleteClient() defers the delete to the last endRead() while notification callbacks run.
+  assert(m_readers == 0);
+  Retired *pList = m_pRetired;
+  m_pRetired = nullptr;
+  reclaim(pList);
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  if (m_pDiscoveryCtx != nullptr && Device::m_pScan != nullptr) {
+    Device::m_pScan->resume();
+  }
+#endif
+  delete m_pDiscoveryCtx;
+
   if (m_deleteCallbacks && m_pClientCallbacks != &defaultCallbacks) {
     delete m_pClientCallbacks;
   }
@@ -111,11 +201,13 @@ void Client::dcTimerCb(ble_npl_event *event) {
  */
 void Client::deleteServices() {
   NIMBLE_LOGD(LOG_TAG, ">> deleteServices");
-  // Delete all the services.
-  for (auto &it : m_servicesVector) {
-    delete it;
-  }
-  m_servicesVector.clear();
+  // Take the services out of the vector first so the handle table is never rebuilt from deleted services.
+  std::vector<RemoteService *> services;
+  services.swap(m_servicesVector);
+  rebuildHandleTable();
+
+  // Delete all the services once the notifications being dispatched are done with them.
+  retire(std::move(services), {});
 
   NIMBLE_LOGD(LOG_TAG, "<< deleteServices");
 }// deleteServices
@@ -130,8 +222,10 @@ size_t Client::deleteService(const UUID &uuid) {
   // Delete the requested service.
   for (auto it = m_servicesVector.begin(); it != m_servicesVector.end(); ++it) {
     if ((*it)->getUUID() == uuid) {
-      delete *it;
+      RemoteService *pService = *it;
       m_servicesVector.erase(it);
+      rebuildHandleTable();
+      retire({pService}, {});
       break;
     }
   }
@@ -203,14 +297,19 @@ bool Client::connect(const Address &address, bool deleteAttributes) {
   m_pTaskData = &taskData;
   int rc = 0;
 
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  ScanPause scanPause(Device::m_pScan);
+#endif
+
   /* Try to connect the the advertiser.  Allow 30 seconds (30000 ms) for
      *  timeout (default value of m_connectTimeout).
      *  Loop on BLE_HS_EBUSY if the scan hasn't stopped yet.
      */
   do {
-    rc = ble_gap_connect(Device::m_own_addr_type, &peerAddr_t,
-                         m_connectTimeout, &m_pConnParams,
-                         Client::handleGapEvent, this);
+#if CONFIG_NIMBLE_CPP_STATS
+    m_connectStartUs = Stats::now();
+#endif
+    rc = gapConnect(&peerAddr_t);
     switch (rc) {
     case 0:
       break;
@@ -290,6 +389,11 @@ bool Client::connect(const Address &address, bool deleteAttributes) {
   if (deleteAttributes) {
     deleteServices();
   }
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  else if (m_servicesVector.empty()) {
+    AttributeCache::restore(this);
+  }
+#endif
 
   m_connEstablished = true;
   m_pClientCallbacks->onConnect(this);
@@ -299,6 +403,107 @@ bool Client::connect(const Address &address, bool deleteAttributes) {
   return isConnected();
 }// connect
 
+/**
+ * @brief Connect to a BLE Server without blocking.
+ * @param [in] address The address of the server.
+ * @param [in] callback Called from the NimBLE host task when the connection is established or fails.
+ * @param [in] deleteAttributes If true this will delete any attribute objects this client may already\n
+ * have created and clears the vectors after successful connection.
+ * @return True if the connection attempt was started.
+ * @details Only one connection attempt can be in progress in the host at a time, further attempts
+ * fail with BLE_HS_EALREADY until the current one completes. Unlike connect() an active scan is
+ * not stopped, the attempt fails with BLE_HS_EBUSY instead.
+ */
+bool Client::connectAsync(const Address &address, client_complete_callback callback, bool deleteAttributes) {
+  NIMBLE_LOGD(LOG_TAG, ">> connectAsync(%s)", address.toString().c_str());
+
+  if (not Device::m_isSynced) {
+    NIMBLE_LOGC(LOG_TAG, "Host reset, wait for sync.");
+    return false;
+  }
+
+  if (isConnected() || m_connEstablished || m_pTaskData != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Client busy, connected to %s, id=%d", std::string(m_peerAddress).c_str(), getConnId());
+    return false;
+  }
+
+  ble_addr_t peerAddr_t;
+  memcpy(&peerAddr_t.val, address.getNative(), 6);
+  peerAddr_t.type = address.getType();
+  if (ble_gap_conn_find_by_addr(&peerAddr_t, nullptr) == 0) {
+    NIMBLE_LOGE(LOG_TAG, "A connection to %s already exists", address.toString().c_str());
+    return false;
+  }
+
+  m_peerAddress = address;
+  m_connectCallback = std::move(callback);
+  m_asyncDeleteAttributes = deleteAttributes;
+  m_asyncTaskData = {this, nullptr, 0, nullptr};
+  m_pTaskData = &m_asyncTaskData;
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  // Resumed in completeConnect().
+  if (Device::m_pScan != nullptr) {
+    Device::m_pScan->pause();
+  }
+#endif
+
+#if CONFIG_NIMBLE_CPP_STATS
+  m_connectStartUs = Stats::now();
+#endif
+  int rc = gapConnect(&peerAddr_t);
+  m_lastErr = rc;
+
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Failed to connect to %s, rc=%d; %s",
+                address.toString().c_str(), rc, Utils::returnCodeToString(rc));
+    m_pTaskData = nullptr;
+    m_connectCallback = nullptr;
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+    if (Device::m_pScan != nullptr) {
+      Device::m_pScan->resume();
+    }
+#endif
+    return false;
+  }
+
+  return true;
+}// connectAsync
+
+/**
+ * @brief Complete a connectAsync() attempt, called from the host task.
+ * @param [in] rc The result of the connection attempt.
+ */
+void Client::completeConnect(int rc) {
+  m_lastErr = rc;
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  if (Device::m_pScan != nullptr) {
+    Device::m_pScan->resume();
+  }
+#endif
+
+  if (rc == 0) {
+    NIMBLE_LOGI(LOG_TAG, "Connection established");
+    if (m_asyncDeleteAttributes) {
+      deleteServices();
+    }
+    m_connEstablished = true;
+    m_pClientCallbacks->onConnect(this);
+  } else {
+    NIMBLE_LOGE(LOG_TAG, "Connection failed; status=%d %s", rc, Utils::returnCodeToString(rc));
+    if (isConnected()) {
+      disconnect();
+    }
+  }
+
+  client_complete_callback callback = std::move(m_connectCallback);
+  m_connectCallback = nullptr;
+  if (callback) {
+    callback(this, rc);
+  }
+}// completeConnect
+
 /**
  * @brief Initiate a secure connection (pair/bond) with the server.\n
  * Called automatically when a characteristic or descriptor requires encryption or authentication to access it.
@@ -385,19 +590,78 @@ int Client::disconnect(uint8_t reason) {
   return rc;
 }// disconnect
 
+/**
+ * @brief Start the GAP connection procedure to a peer with the configured parameters.
+ * @param [in] peerAddr The address of the peer.
+ * @return 0 on success, otherwise the NimBLE error code.
+ */
+int Client::gapConnect(const ble_addr_t *peerAddr) {
 #if CONFIG_BT_NIMBLE_EXT_ADV
+  // The same parameters are used on every PHY the connection is initiated on.
+  return ble_gap_ext_connect(Device::m_own_addr_type, peerAddr, m_connectTimeout, m_phyMask,
+                             &m_pConnParams, &m_pConnParams, &m_pConnParams,
+                             Client::handleGapEvent, this);
+#else
+  return ble_gap_connect(Device::m_own_addr_type, peerAddr,
+                         m_connectTimeout, &m_pConnParams,
+                         Client::handleGapEvent, this);
+#endif
+}// gapConnect
+
 /**
  * @brief Set the PHY types to use when connecting to a server.
+ * @details The PHYs are requested for the connection as soon as it is established. With extended
+ * advertising enabled they are also the PHYs the connection is initiated on, so a peer advertising
+ * on the Coded PHY only can be reached; initiating on 2M also requires the 1M bit.
  * @param [in] mask A bitmask indicating what PHYS to connect with.\n
  * The available bits are:
  * * 0x01 BLE_GAP_LE_PHY_1M_MASK
  * * 0x02 BLE_GAP_LE_PHY_2M_MASK
  * * 0x04 BLE_GAP_LE_PHY_CODED_MASK
  */
-void NimBLEClient::setConnectPhy(uint8_t mask) {
+void Client::setConnectPhy(uint8_t mask) {
   m_phyMask = mask;
-}
-#endif
+}// setConnectPhy
+
+/**
+ * @brief Request a change of the PHY of the connection.
+ * * Can only be used after a connection has been established.
+ * @details The controller negotiates the PHYs with the server, the result is passed to
+ * ClientCallbacks::onPhyUpdate().
+ * @param [in] txPhyMask The preferred transmit PHYs, a bitmask of BLE_GAP_LE_PHY_1M_MASK,
+ * BLE_GAP_LE_PHY_2M_MASK and BLE_GAP_LE_PHY_CODED_MASK.
+ * @param [in] rxPhyMask The preferred receive PHYs, same bitmask.
+ * @param [in] phyOptions The coding of the Coded PHY:
+ * * 0x00 BLE_GAP_LE_PHY_CODED_ANY
+ * * 0x01 BLE_GAP_LE_PHY_CODED_S2
+ * * 0x02 BLE_GAP_LE_PHY_CODED_S8
+ * @return True if the request was sent.
+ */
+bool Client::setPhy(uint8_t txPhyMask, uint8_t rxPhyMask, uint16_t phyOptions) {
+  int rc = ble_gap_set_prefered_le_phy(m_conn_id, txPhyMask, rxPhyMask, phyOptions);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Set PHY error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// setPhy
+
+/**
+ * @brief Read the current PHY of the connection.
+ * @param [out] txPhy The transmit PHY, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED.
+ * @param [out] rxPhy The receive PHY.
+ * @return True if successful.
+ */
+bool Client::getPhy(uint8_t *txPhy, uint8_t *rxPhy) {
+  int rc = ble_gap_read_le_phy(m_conn_id, txPhy, rxPhy);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Read PHY error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// getPhy
 
 /**
  * @brief Set the connection parameters to use when connecting to a server.
@@ -652,64 +916,134 @@ std::vector<RemoteService *> *Client::getServices(bool refresh) {
 
 /**
  * @brief Retrieves the full database of attributes that the peripheral has available.
+ * @param [in] singlePass If true the characteristics of all services are found with one Read By Type procedure
+ * and the descriptors of all characteristics with one Find Information procedure over the whole handle range,
+ * instead of one procedure per service and per characteristic.
  * @return True if successful.
+ * @details The procedures, round trips and time taken are available from getDiscoveryStats() afterwards.
  */
-bool Client::discoverAttributes() {
+bool Client::discoverAttributes(bool singlePass) {
+  m_discoveryStats = DiscoveryStats{};
+  ble_npl_time_t start = ble_npl_time_get();
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  ScanPause scanPause(Device::m_pScan);
+#endif
+
   deleteServices();
 
   if (!retrieveServices()) {
     return false;
   }
 
+  const uint16_t mtu = getMTU();
+  PduCounter svcPdus(mtu);
   for (auto svc : m_servicesVector) {
-    if (!svc->retrieveCharacteristics()) {
+    svcPdus.add(4 + uuidLen(svc->m_uuid));
+  }
+  m_discoveryStats.procedures = 1;
+  m_discoveryStats.roundTrips = svcPdus.finish();
+
+  if (singlePass) {
+    if (!discoverSinglePass()) {
       return false;
     }
-
-    for (auto chr : svc->m_characteristicVector) {
-      if (!chr->retrieveDescriptors()) {
+  } else {
+    for (auto svc : m_servicesVector) {
+      if (!svc->retrieveCharacteristics()) {
         return false;
       }
+
+      PduCounter chrPdus(mtu);
+      for (auto chr : svc->m_characteristicVector) {
+        chrPdus.add(5 + uuidLen(chr->m_uuid));
+      }
+      m_discoveryStats.procedures++;
+      m_discoveryStats.roundTrips += chrPdus.finish();
+
+      for (auto chr : svc->m_characteristicVector) {
+        if (!chr->retrieveDescriptors()) {
+          return false;
+        }
+
+        if (chr->m_handle != chr->m_endHandle) {
+          PduCounter dscPdus(mtu);
+          for (auto dsc : chr->m_descriptorVector) {
+            dscPdus.add(2 + uuidLen(dsc->m_uuid));
+          }
+          m_discoveryStats.procedures++;
+          m_discoveryStats.roundTrips += dscPdus.finish();
+          m_discoveryStats.descriptors += chr->m_descriptorVector.size();
+        }
+      }
     }
   }
 
+  m_discoveryStats.services = m_servicesVector.size();
+  for (auto svc : m_servicesVector) {
+    m_discoveryStats.characteristics += svc->m_characteristicVector.size();
+  }
+  m_discoveryStats.elapsedMs = ble_npl_time_ticks_to_ms32(ble_npl_time_get() - start);
+  NIMBLE_STAT_RECORD(DISCOVERY, m_discoveryStats.elapsedMs * 1000);
+
+  NIMBLE_LOGI(LOG_TAG, "Discovered %d services, %d characteristics, %d descriptors; %lu procedures, %lu round trips, %lu ms",
+              m_discoveryStats.services, m_discoveryStats.characteristics, m_discoveryStats.descriptors,
+              m_discoveryStats.procedures, m_discoveryStats.roundTrips, m_discoveryStats.elapsedMs);
+
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  AttributeCache::save(this);
+#endif
+
   return true;
 }// discoverAttributes
 
 /**
- * @brief Ask the remote %BLE server for its services.\n
- * Here we ask the server for its set of services and wait until we have received them all.
- * @return true on success otherwise false if an error occurred
+ * @brief Get the statistics of the last call to discoverAttributes().
+ * @return The discovery statistics.
  */
-bool Client::retrieveServices(const UUID *uuid_filter) {
-  /**
- * Design
- * ------
- * We invoke ble_gattc_disc_all_svcs.  This will request a list of the services exposed by the
- * peer BLE partner to be returned in the callback function provided.
+Client::DiscoveryStats Client::getDiscoveryStats() {
+  return m_discoveryStats;
+}// getDiscoveryStats
+
+/**
+ * @brief Find all characteristics and descriptors of the discovered services in two procedures.
+ * @return True if successful.
  */
+bool Client::discoverSinglePass() {
+  int rc = 0;
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  DiscoveryContext ctx{{}, 0, PduCounter(getMTU()), 0, DiscoveryContext::CHARACTERISTICS, 0};
+  ble_task_data_t taskData = {this, cur_task, 0, &ctx};
 
-  NIMBLE_LOGD(LOG_TAG, ">> retrieveServices");
+  rc = ble_gattc_disc_all_chrs(m_conn_id, 1, 0xFFFF, Client::singlePassChrCB, &taskData);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_disc_all_chrs: rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
 
-  if (!isConnected()) {
-    NIMBLE_LOGE(LOG_TAG, "Disconnected, could not retrieve services -aborting");
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (taskData.rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Could not retrieve characteristics");
     return false;
   }
 
-  int rc = 0;
-  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
-  ble_task_data_t taskData = {this, cur_task, 0, nullptr};
+  finishCharacteristicPass(ctx);
 
-  if (uuid_filter == nullptr) {
-    rc = ble_gattc_disc_all_svcs(m_conn_id, Client::serviceDiscoveredCB, &taskData);
-  } else {
-    rc = ble_gattc_disc_svc_by_uuid(m_conn_id, &uuid_filter->getNative()->u,
-                                    Client::serviceDiscoveredCB, &taskData);
+  if (ctx.chrs.empty()) {
+    return true;
   }
 
+  taskData.rc = 0;
+
+  rc = ble_gattc_disc_all_dscs(m_conn_id, ctx.chrs.front()->m_handle, 0xFFFF,
+                               Client::singlePassDscCB, &taskData);
   if (rc != 0) {
-    NIMBLE_LOGE(LOG_TAG, "ble_gattc_disc_all_svcs: rc=%d %s", rc, Utils::returnCodeToString(rc));
-    m_lastErr = rc;
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_disc_all_dscs: rc=%d %s", rc, Utils::returnCodeToString(rc));
     return false;
   }
 
@@ -717,80 +1051,385 @@ bool Client::retrieveServices(const UUID *uuid_filter) {
   // Clear the task notification value to ensure we block
   ulTaskNotifyValueClear(cur_task, ULONG_MAX);
 #endif
-
-  // wait until we have all the services
   ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-  m_lastErr = taskData.rc;
 
-  if (taskData.rc == 0) {
-    NIMBLE_LOGD(LOG_TAG, "<< retrieveServices");
-    return true;
-  } else {
-    NIMBLE_LOGE(LOG_TAG, "Could not retrieve services");
+  if (taskData.rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Could not retrieve descriptors");
     return false;
   }
-}// getServices
+
+  m_discoveryStats.procedures++;
+  m_discoveryStats.roundTrips += ctx.pdus.finish();
+  m_discoveryStats.descriptors = ctx.descriptors;
+
+  return true;
+}// discoverSinglePass
 
 /**
- * @brief STATIC Callback for the service discovery API function.\n
- * When a service is found or there is none left or there was an error
- * the API will call this and report findings.
+ * @brief Complete the characteristic pass of a single pass discovery and prepare the descriptor pass.
+ * @param [in] ctx The discovery context.
  */
-int Client::serviceDiscoveredCB(
-    uint16_t conn_handle,
-    const struct ble_gatt_error *error,
-    const struct ble_gatt_svc *service, void *arg) {
-  NIMBLE_LOGD(LOG_TAG, "Service Discovered >> status: %d handle: %d",
-              error->status, (error->status == 0) ? service->start_handle : -1);
+void Client::finishCharacteristicPass(DiscoveryContext &ctx) {
+  m_discoveryStats.procedures++;
+  m_discoveryStats.roundTrips += ctx.pdus.finish();
 
-  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
-  Client *client = (Client *) pTaskData->pATT;
+  // Set the end handles as retrieveCharacteristics() does, each characteristic ends before the next one.
+  for (auto svc : m_servicesVector) {
+    auto &chrs = svc->m_characteristicVector;
+    for (size_t i = 0; i < chrs.size(); i++) {
+      chrs[i]->m_endHandle = (i + 1 < chrs.size()) ? chrs[i + 1]->m_defHandle - 1 : svc->getEndHandle();
+      ctx.chrs.push_back(chrs[i]);
+    }
+  }
 
-  // Make sure the service discovery is for this device
-  if (client->getConnId() != conn_handle) {
-    return 0;
+  rebuildHandleTable();
+
+  ctx.pdus = PduCounter(getMTU());
+  ctx.cursor = 0;
+  ctx.stage = DiscoveryContext::DESCRIPTORS;
+}// finishCharacteristicPass
+
+/**
+ * @brief Retrieve the full database of attributes without blocking.
+ * @param [in] callback Called from the NimBLE host task when the discovery completes.
+ * @return True if the discovery was started.
+ * @details Performs the same procedures as discoverAttributes(true), each one is started from
+ * the completion of the previous one, so discoveries on several clients run at the same time.
+ * The attributes are not saved to the attribute cache as that requires blocking reads.
+ */
+bool Client::discoverAttributesAsync(client_complete_callback callback) {
+  if (!isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected, could not retrieve services -aborting");
+    return false;
   }
 
-  if (error->status == 0) {
-    // Found a service - add it to the vector
-    RemoteService *pRemoteService = new RemoteService(client, service);
-    client->m_servicesVector.push_back(pRemoteService);
-    return 0;
+  if (m_pDiscoveryCtx != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Discovery already in progress");
+    return false;
   }
 
-  if (error->status == BLE_HS_EDONE) {
-    pTaskData->rc = 0;
-  } else {
-    NIMBLE_LOGE(LOG_TAG, "serviceDiscoveredCB() rc=%d %s",error->status, Utils::returnCodeToString(error->status));
-    pTaskData->rc = error->status;
+  deleteServices();
+  m_discoveryStats = DiscoveryStats{};
+  m_pDiscoveryCtx = new DiscoveryContext{{}, 0, PduCounter(getMTU()), 0, DiscoveryContext::SERVICES, ble_npl_time_get()};
+  m_discoveryCallback = std::move(callback);
+  m_discoveryTaskData = {this, nullptr, 0, m_pDiscoveryCtx};
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  // Resumed in continueDiscovery() when the discovery completes.
+  if (Device::m_pScan != nullptr) {
+    Device::m_pScan->pause();
   }
+#endif
 
-  xTaskNotifyGive(pTaskData->task);
+  int rc = ble_gattc_disc_all_svcs(m_conn_id, Client::serviceDiscoveredCB, &m_discoveryTaskData);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_disc_all_svcs: rc=%d %s", rc, Utils::returnCodeToString(rc));
+    m_lastErr = rc;
+    delete m_pDiscoveryCtx;
+    m_pDiscoveryCtx = nullptr;
+    m_discoveryCallback = nullptr;
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+    if (Device::m_pScan != nullptr) {
+      Device::m_pScan->resume();
+    }
+#endif
+    return false;
+  }
 
-  NIMBLE_LOGD(LOG_TAG, "<< Service Discovered");
-  return error->status;
-}
+  return true;
+}// discoverAttributesAsync
 
 /**
- * @brief Get the value of a specific characteristic associated with a specific service.
- * @param [in] serviceUUID The service that owns the characteristic.
- * @param [in] characteristicUUID The characteristic whose value we wish to read.
- * @returns characteristic value or an empty string if not found
+ * @brief Start the next step of an asynchronous discovery, called from the host task when a procedure completes.
+ * @param [in] rc The result of the procedure that completed.
  */
-AttributeValue Client::getValue(const UUID &serviceUUID, const UUID &characteristicUUID) {
-  NIMBLE_LOGD(LOG_TAG, ">> getValue: serviceUUID: %s, characteristicUUID: %s", serviceUUID.toString().c_str(), characteristicUUID.toString().c_str());
-
-  AttributeValue ret;
-  RemoteService *pService = getService(serviceUUID);
+void Client::continueDiscovery(int rc) {
+  DiscoveryContext *ctx = m_pDiscoveryCtx;
+
+  if (rc == 0) {
+    switch (ctx->stage) {
+    case DiscoveryContext::SERVICES: {
+      PduCounter svcPdus(getMTU());
+      for (auto svc : m_servicesVector) {
+        svcPdus.add(4 + uuidLen(svc->m_uuid));
+      }
+      m_discoveryStats.procedures = 1;
+      m_discoveryStats.roundTrips = svcPdus.finish();
 
-  if (pService != nullptr) {
-    RemoteCharacteristic *pChar = pService->getCharacteristic(characteristicUUID);
-    if (pChar != nullptr) {
-      ret = pChar->readValue();
+      ctx->stage = DiscoveryContext::CHARACTERISTICS;
+      rc = ble_gattc_disc_all_chrs(m_conn_id, 1, 0xFFFF, Client::singlePassChrCB, &m_discoveryTaskData);
+      if (rc == 0) {
+        return;
+      }
+      break;
     }
-  }
 
-  NIMBLE_LOGD(LOG_TAG, "<< getValue");
+    case DiscoveryContext::CHARACTERISTICS:
+      finishCharacteristicPass(*ctx);
+      if (ctx->chrs.empty()) {
+        break;
+      }
+
+      rc = ble_gattc_disc_all_dscs(m_conn_id, ctx->chrs.front()->m_handle, 0xFFFF,
+                                   Client::singlePassDscCB, &m_discoveryTaskData);
+      if (rc == 0) {
+        return;
+      }
+      break;
+
+    case DiscoveryContext::DESCRIPTORS:
+      m_discoveryStats.procedures++;
+      m_discoveryStats.roundTrips += ctx->pdus.finish();
+      m_discoveryStats.descriptors = ctx->descriptors;
+      break;
+    }
+  }
+
+  m_lastErr = rc;
+  m_discoveryStats.services = m_servicesVector.size();
+  for (auto svc : m_servicesVector) {
+    m_discoveryStats.characteristics += svc->m_characteristicVector.size();
+  }
+  m_discoveryStats.elapsedMs = ble_npl_time_ticks_to_ms32(ble_npl_time_get() - ctx->start);
+  NIMBLE_STAT_RECORD(DISCOVERY, m_discoveryStats.elapsedMs * 1000);
+
+  NIMBLE_LOGI(LOG_TAG, "Async discovery done rc=%d; %d services, %d characteristics, %d descriptors in %lu ms",
+              rc, m_discoveryStats.services, m_discoveryStats.characteristics,
+              m_discoveryStats.descriptors, m_discoveryStats.elapsedMs);
+
+  m_pDiscoveryCtx = nullptr;
+  delete ctx;
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+  if (Device::m_pScan != nullptr) {
+    Device::m_pScan->resume();
+  }
+#endif
+
+  client_complete_callback callback = std::move(m_discoveryCallback);
+  m_discoveryCallback = nullptr;
+  if (callback) {
+    callback(this, rc);
+  }
+}// continueDiscovery
+
+/**
+ * @brief Callback for the single pass characteristic discovery, adds each characteristic to the service that contains it.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int Client::singlePassChrCB(uint16_t conn_handle,
+                            const struct ble_gatt_error *error,
+                            const struct ble_gatt_chr *chr, void *arg) {
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *client = (Client *) pTaskData->pATT;
+  DiscoveryContext *ctx = (DiscoveryContext *) pTaskData->buf;
+
+  if (client->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  if (error->status == 0) {
+    ctx->pdus.add(chr->uuid.u.type == BLE_UUID_TYPE_16 ? 7 : 21);
+
+    // Services and characteristics are both reported in handle order.
+    auto &services = client->m_servicesVector;
+    while (ctx->cursor < services.size() && services[ctx->cursor]->getEndHandle() < chr->def_handle) {
+      ctx->cursor++;
+    }
+
+    if (ctx->cursor < services.size() && services[ctx->cursor]->getStartHandle() <= chr->def_handle) {
+      RemoteService *pService = services[ctx->cursor];
+      pService->m_characteristicVector.push_back(new RemoteCharacteristic(pService, chr));
+    }
+    return 0;
+  }
+
+  pTaskData->rc = (error->status == BLE_HS_EDONE) ? 0 : error->status;
+  if (pTaskData->task != nullptr) {
+    xTaskNotifyGive(pTaskData->task);
+  } else {
+    client->continueDiscovery(pTaskData->rc);
+  }
+  return error->status;
+}// singlePassChrCB
+
+/**
+ * @brief Callback for the single pass descriptor discovery.
+ * @details Find Information returns every attribute in the range, the service, include and
+ * characteristic declarations and the characteristic values are skipped, any other attribute
+ * is a descriptor of the characteristic whose range contains it.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int Client::singlePassDscCB(uint16_t conn_handle,
+                            const struct ble_gatt_error *error,
+                            uint16_t chr_val_handle,
+                            const struct ble_gatt_dsc *dsc, void *arg) {
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *client = (Client *) pTaskData->pATT;
+  DiscoveryContext *ctx = (DiscoveryContext *) pTaskData->buf;
+
+  if (client->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  if (error->status == 0) {
+    ctx->pdus.add(dsc->uuid.u.type == BLE_UUID_TYPE_16 ? 4 : 18);
+
+    if (dsc->uuid.u.type == BLE_UUID_TYPE_16) {
+      switch (dsc->uuid.u16.value) {
+      case 0x2800:// Primary service
+      case 0x2801:// Secondary service
+      case 0x2802:// Include
+      case 0x2803:// Characteristic
+        return 0;
+      default:
+        break;
+      }
+    }
+
+    auto &chrs = ctx->chrs;
+    while (ctx->cursor < chrs.size() && chrs[ctx->cursor]->m_endHandle < dsc->handle) {
+      ctx->cursor++;
+    }
+
+    if (ctx->cursor < chrs.size() && chrs[ctx->cursor]->m_handle < dsc->handle) {
+      RemoteCharacteristic *pChr = chrs[ctx->cursor];
+      pChr->m_descriptorVector.push_back(new RemoteDescriptor(pChr, dsc));
+      ctx->descriptors++;
+    }
+    return 0;
+  }
+
+  pTaskData->rc = (error->status == BLE_HS_EDONE) ? 0 : error->status;
+  if (pTaskData->task != nullptr) {
+    xTaskNotifyGive(pTaskData->task);
+  } else {
+    client->continueDiscovery(pTaskData->rc);
+  }
+  return error->status;
+}// singlePassDscCB
+
+/**
+ * @brief Ask the remote %BLE server for its services.\n
+ * Here we ask the server for its set of services and wait until we have received them all.
+ * @return true on success otherwise false if an error occurred
+ */
+bool Client::retrieveServices(const UUID *uuid_filter) {
+  /**
+ * Design
+ * ------
+ * We invoke ble_gattc_disc_all_svcs.  This will request a list of the services exposed by the
+ * peer BLE partner to be returned in the callback function provided.
+ */
+
+  NIMBLE_LOGD(LOG_TAG, ">> retrieveServices");
+
+  if (!isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected, could not retrieve services -aborting");
+    return false;
+  }
+
+  int rc = 0;
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  ble_task_data_t taskData = {this, cur_task, 0, nullptr};
+
+  if (uuid_filter == nullptr) {
+    rc = ble_gattc_disc_all_svcs(m_conn_id, Client::serviceDiscoveredCB, &taskData);
+  } else {
+    rc = ble_gattc_disc_svc_by_uuid(m_conn_id, &uuid_filter->getNative()->u,
+                                    Client::serviceDiscoveredCB, &taskData);
+  }
+
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_disc_all_svcs: rc=%d %s", rc, Utils::returnCodeToString(rc));
+    m_lastErr = rc;
+    return false;
+  }
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+
+  // wait until we have all the services
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  m_lastErr = taskData.rc;
+
+  if (taskData.rc == 0) {
+    NIMBLE_LOGD(LOG_TAG, "<< retrieveServices");
+    return true;
+  } else {
+    NIMBLE_LOGE(LOG_TAG, "Could not retrieve services");
+    return false;
+  }
+}// getServices
+
+/**
+ * @brief STATIC Callback for the service discovery API function.\n
+ * When a service is found or there is none left or there was an error
+ * the API will call this and report findings.
+ */
+int Client::serviceDiscoveredCB(
+    uint16_t conn_handle,
+    const struct ble_gatt_error *error,
+    const struct ble_gatt_svc *service, void *arg) {
+  NIMBLE_LOGD(LOG_TAG, "Service Discovered >> status: %d handle: %d",
+              error->status, (error->status == 0) ? service->start_handle : -1);
+
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *client = (Client *) pTaskData->pATT;
+
+  // Make sure the service discovery is for this device
+  if (client->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  if (error->status == 0) {
+    // Found a service - add it to the vector
+    RemoteService *pRemoteService = new RemoteService(client, service);
+    client->m_servicesVector.push_back(pRemoteService);
+    return 0;
+  }
+
+  if (error->status == BLE_HS_EDONE) {
+    pTaskData->rc = 0;
+  } else {
+    NIMBLE_LOGE(LOG_TAG, "serviceDiscoveredCB() rc=%d %s",error->status, Utils::returnCodeToString(error->status));
+    pTaskData->rc = error->status;
+  }
+
+  if (pTaskData->task != nullptr) {
+    xTaskNotifyGive(pTaskData->task);
+  } else {
+    client->continueDiscovery(pTaskData->rc);
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "<< Service Discovered");
+  return error->status;
+}
+
+/**
+ * @brief Get the value of a specific characteristic associated with a specific service.
+ * @param [in] serviceUUID The service that owns the characteristic.
+ * @param [in] characteristicUUID The characteristic whose value we wish to read.
+ * @returns characteristic value or an empty string if not found
+ */
+AttributeValue Client::getValue(const UUID &serviceUUID, const UUID &characteristicUUID) {
+  NIMBLE_LOGD(LOG_TAG, ">> getValue: serviceUUID: %s, characteristicUUID: %s", serviceUUID.toString().c_str(), characteristicUUID.toString().c_str());
+
+  AttributeValue ret;
+  RemoteService *pService = getService(serviceUUID);
+
+  if (pService != nullptr) {
+    RemoteCharacteristic *pChar = pService->getCharacteristic(characteristicUUID);
+    if (pChar != nullptr) {
+      ret = pChar->readValue();
+    }
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "<< getValue");
   return ret;
 }// getValue
 
@@ -826,24 +1465,536 @@ bool Client::setValue(const UUID &serviceUUID, const UUID &characteristicUUID,
  * @returns The matching remote characteristic, nullptr otherwise.
  */
 RemoteCharacteristic *Client::getCharacteristic(const uint16_t handle) {
-  RemoteService *pService = nullptr;
-  for (auto & it : m_servicesVector) {
-    if (it->getStartHandle() <= handle && handle <= it->getEndHandle()) {
-      pService = it;
+  return findHandle(handle);
+}// getCharacteristic
+
+/**
+ * @brief Read the values of several characteristics of the peer in as few exchanges as possible.
+ * @param [in] characteristics The characteristics to read, the values are stored in each characteristic.
+ * @param [in] lengths The fixed length of each value, in the order of the characteristics, or empty if not known.
+ * @return True if all the values were read.
+ * @details With the lengths given and all the values fitting in one response, a single ATT Read Multiple
+ * request is used. Without them the ATT Read Multiple Variable Length request is used if the NimBLE host
+ * and the peer support it. Otherwise the characteristics are read one after the other, each read is
+ * started from the host task as soon as the previous one completes so the calling task is only woken up once.
+ */
+bool Client::readMultiple(const std::vector<RemoteCharacteristic *> &characteristics,
+                          const std::vector<uint16_t> &lengths) {
+  NIMBLE_LOGD(LOG_TAG, ">> readMultiple(): %d characteristics", characteristics.size());
+
+  if (!isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return false;
+  }
+
+  if (characteristics.empty()) {
+    return true;
+  }
+
+  if (!lengths.empty() && lengths.size() != characteristics.size()) {
+    NIMBLE_LOGE(LOG_TAG, "<< readMultiple(): %d lengths for %d characteristics", lengths.size(), characteristics.size());
+    return false;
+  }
+
+  if (lengths.empty() ? readMultipleVariable(characteristics) : readMultipleFixed(characteristics, lengths)) {
+    NIMBLE_LOGD(LOG_TAG, "<< readMultiple(): read in one request");
+    return true;
+  }
+
+  int rc = 0;
+  int retryCount = 1;
+  size_t index = 0;
+
+  do {
+    rc = readChained(characteristics, &index);
+
+    switch (rc) {
+    case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_AUTHEN):
+    case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_AUTHOR):
+    case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_ENC):
+      if (retryCount && secureConnection()) {
+        break;
+      }
+    /* Else falls through. */
+    default:
+      retryCount = 0;
       break;
     }
+  } while (rc != 0 && retryCount--);
+
+  m_lastErr = rc;
+  NIMBLE_LOGD(LOG_TAG, "<< readMultiple(): rc=%d", rc);
+  return rc == 0;
+}// readMultiple
+
+/**
+ * @brief Read fixed length values with one ATT Read Multiple request.
+ * @param [in] characteristics The characteristics to read.
+ * @param [in] lengths The length of each value.
+ * @return True if all the values were read, false if the request can't be used or failed.
+ * @details Read Multiple responses are the values concatenated without lengths, so this is only
+ * used when the caller gives each value length and the response length matches their sum.
+ */
+bool Client::readMultipleFixed(const std::vector<RemoteCharacteristic *> &characteristics,
+                               const std::vector<uint16_t> &lengths) {
+  if (characteristics.size() < 2 || characteristics.size() > BLE_GATT_READ_MAX_ATTRS) {
+    return false;
   }
 
-  if (pService != nullptr) {
-    for (auto & it : *pService) {
-      if (it->getHandle() == handle) {
-        return it;
+  uint16_t handles[BLE_GATT_READ_MAX_ATTRS];
+  size_t total = 0;
+
+  for (size_t i = 0; i < characteristics.size(); i++) {
+    handles[i] = characteristics[i]->m_handle;
+    total += lengths[i];
+  }
+
+  // The response holds at most MTU - 1 bytes of values.
+  if (total > (size_t) (getMTU() - 1)) {
+    return false;
+  }
+
+  AttributeValue value;
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  ble_task_data_t taskData = {this, cur_task, 0, &value};
+
+  int rc = ble_gattc_read_mult(m_conn_id, handles, characteristics.size(), Client::readMultipleCB, &taskData);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_read_mult: rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (taskData.rc != 0 || value.size() != total) {
+    NIMBLE_LOGD(LOG_TAG, "Read multiple not usable; rc=%d, length %d expected %d", taskData.rc, value.size(), total);
+    return false;
+  }
+
+  const uint8_t *data = value.data();
+  for (size_t i = 0; i < characteristics.size(); i++) {
+    characteristics[i]->m_value.setValue(data, lengths[i]);
+    data += lengths[i];
+  }
+
+  return true;
+}// readMultipleFixed
+
+/**
+ * @brief Read values of any length with one ATT Read Multiple Variable Length request.
+ * @param [in] characteristics The characteristics to read.
+ * @return True if all the values were read, false if the request can't be used or failed.
+ * @details The response holds the length of each value, the values are only stored if the response
+ * holds all of them so a truncated response falls back to reading them one after the other.
+ */
+bool Client::readMultipleVariable(const std::vector<RemoteCharacteristic *> &characteristics) {
+#if NIMBLE_CPP_READ_MULT_VAR
+  if (characteristics.size() < 2 || characteristics.size() > BLE_GATT_READ_MAX_ATTRS) {
+    return false;
+  }
+
+  uint16_t handles[BLE_GATT_READ_MAX_ATTRS];
+  for (size_t i = 0; i < characteristics.size(); i++) {
+    handles[i] = characteristics[i]->m_handle;
+  }
+
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  ble_task_data_t taskData = {this, cur_task, 0, (void *) &characteristics};
+
+  int rc = ble_gattc_read_mult_var(m_conn_id, handles, characteristics.size(), Client::readMultipleVariableCB, &taskData);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gattc_read_mult_var: rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (taskData.rc != 0) {
+    NIMBLE_LOGD(LOG_TAG, "Read multiple variable not usable; rc=%d", taskData.rc);
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}// readMultipleVariable
+
+/**
+ * @brief Read characteristics one after the other, starting each read from the completion of the previous one.
+ * @param [in] characteristics The characteristics to read.
+ * @param [in,out] index The first characteristic to read, on return the one that failed.
+ * @return 0 on success or the error of the read that failed.
+ */
+int Client::readChained(const std::vector<RemoteCharacteristic *> &characteristics, size_t *index) {
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  int result = 0;
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+
+  // The calling task blocks until the chain completes, so the chain can refer to locals.
+  gatt_complete_callback next;
+  next = [&](int rc, const AttributeValue &value) {
+    if (rc == 0 && ++(*index) < characteristics.size()) {
+      characteristics[*index]->readValueAsync(next);
+      return;
+    }
+
+    result = rc;
+    xTaskNotifyGive(cur_task);
+  };
+
+  characteristics[*index]->readValueAsync(next);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  return result;
+}// readChained
+
+/**
+ * @brief Subscribe to several characteristics of the peer, writing their CCCDs back to back.
+ * @param [in] characteristics The characteristics to subscribe to.
+ * @param [in] notifyCallback The callback for the notifications and indications of all the characteristics.
+ * @param [in] notifications If true, subscribe for notifications where the characteristic supports them,
+ * otherwise for indications where it supports them.
+ * @param [in] response If true, write the CCCDs with write requests, otherwise with write commands, which
+ * are faster but must be accepted by the peer.
+ * @return True if all the CCCDs were written.
+ * @details The CCCDs are looked up in the attributes already discovered or restored from the attribute cache,
+ * descriptors are only discovered for characteristics without a known CCCD, before any write is sent.
+ * Write requests are sent one after the other, each from the host task as soon as the previous one
+ * completes, so the calling task is only woken up once. Write commands are all queued at once.
+ * Characteristics without a CCCD only get the callback, as with RemoteCharacteristic::subscribe().
+ */
+bool Client::subscribeAll(const std::vector<RemoteCharacteristic *> &characteristics,
+                          notify_callback notifyCallback, bool notifications, bool response) {
+  NIMBLE_LOGD(LOG_TAG, ">> subscribeAll(): %d characteristics", characteristics.size());
+
+  if (!isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return false;
+  }
+
+  std::vector<std::pair<RemoteDescriptor *, uint16_t>> writes;
+  writes.reserve(characteristics.size());
+
+  for (auto &chr : characteristics) {
+    chr->m_notifyCallback = notifyCallback;
+
+    RemoteDescriptor *pDsc = chr->getDescriptor(UUID((uint16_t) 0x2902));
+    if (pDsc == nullptr) {
+      NIMBLE_LOGW(LOG_TAG, "Callback set, CCCD not found; handle=%d", chr->getHandle());
+      continue;
+    }
+
+    bool notify = notifications ? (chr->canNotify() || !chr->canIndicate()) : (!chr->canIndicate() && chr->canNotify());
+    writes.emplace_back(pDsc, notify ? 0x01 : 0x02);
+  }
+
+  int rc = 0;
+
+  if (!response) {
+    for (auto &write : writes) {
+      rc = write.first->writeValueAsync((const uint8_t *) &write.second, 2, nullptr, false).getRc();
+      if (rc != 0) {
+        break;
       }
     }
+  } else if (!writes.empty()) {
+    int retryCount = 1;
+    size_t index = 0;
+
+    do {
+      rc = writeChained(writes, &index);
+
+      switch (rc) {
+      case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_AUTHEN):
+      case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_AUTHOR):
+      case BLE_HS_ATT_ERR(BLE_ATT_ERR_INSUFFICIENT_ENC):
+        if (retryCount && secureConnection()) {
+          break;
+        }
+      /* Else falls through. */
+      default:
+        retryCount = 0;
+        break;
+      }
+    } while (rc != 0 && retryCount--);
   }
 
-  return nullptr;
-}
+  m_lastErr = rc;
+  NIMBLE_LOGD(LOG_TAG, "<< subscribeAll(): %d CCCDs written, rc=%d", writes.size(), rc);
+  return rc == 0;
+}// subscribeAll
+
+/**
+ * @brief Write descriptors one after the other, starting each write from the completion of the previous one.
+ * @param [in] writes The descriptors and the 16 bit values to write to them.
+ * @param [in,out] index The first write to send, on return the one that failed.
+ * @return 0 on success or the error of the write that failed.
+ */
+int Client::writeChained(const std::vector<std::pair<RemoteDescriptor *, uint16_t>> &writes, size_t *index) {
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+  int result = 0;
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+
+  // The calling task blocks until the chain completes, so the chain can refer to locals.
+  gatt_complete_callback next;
+  next = [&](int rc, const AttributeValue &value) {
+    if (rc == 0 && ++(*index) < writes.size()) {
+      writes[*index].first->writeValueAsync((const uint8_t *) &writes[*index].second, 2, next, true);
+      return;
+    }
+
+    result = rc;
+    xTaskNotifyGive(cur_task);
+  };
+
+  writes[*index].first->writeValueAsync((const uint8_t *) &writes[*index].second, 2, next, true);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  return result;
+}// writeChained
+
+/**
+ * @brief Callback for the Read Multiple request.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int Client::readMultipleCB(uint16_t conn_handle,
+                           const struct ble_gatt_error *error,
+                           struct ble_gatt_attr *attr, void *arg) {
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *client = (Client *) pTaskData->pATT;
+
+  if (client->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  int rc = error->status;
+  if (rc == 0 && attr != nullptr) {
+    AttributeValue *value = (AttributeValue *) pTaskData->buf;
+    value->setValue(attr->om);
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "Read multiple complete; status=%d conn_handle=%d", rc, conn_handle);
+
+  pTaskData->rc = rc;
+  xTaskNotifyGive(pTaskData->task);
+  return 0;
+}// readMultipleCB
+
+/**
+ * @brief Callback for the Read Multiple Variable Length request.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int Client::readMultipleVariableCB(uint16_t conn_handle,
+                                   const struct ble_gatt_error *error,
+                                   struct ble_gatt_attr *attrs, uint8_t num_attrs, void *arg) {
+  ble_task_data_t *pTaskData = (ble_task_data_t *) arg;
+  Client *client = (Client *) pTaskData->pATT;
+
+  if (client->getConnId() != conn_handle) {
+    return 0;
+  }
+
+  auto &characteristics = *(const std::vector<RemoteCharacteristic *> *) pTaskData->buf;
+  int rc = error->status;
+  if (rc == 0 && (attrs == nullptr || num_attrs != characteristics.size())) {
+    rc = BLE_HS_EBADDATA;
+  }
+
+  for (size_t i = 0; rc == 0 && i < num_attrs; i++) {
+    if (!characteristics[i]->m_value.setValue(attrs[i].om)) {
+      rc = BLE_HS_EMSGSIZE;
+    }
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "Read multiple variable complete; status=%d conn_handle=%d", rc, conn_handle);
+
+  pTaskData->rc = rc;
+  xTaskNotifyGive(pTaskData->task);
+  return 0;
+}// readMultipleVariableCB
+
+/**
+ * @brief Rebuild the characteristic value handle lookup table from the discovered attributes.
+ * @details Called whenever characteristics are discovered or deleted so that lookups by handle,
+ * including every received notification, never need to walk the service and characteristic vectors.
+ */
+void Client::rebuildHandleTable() {
+  size_t count = 0;
+  for (auto &svc : m_servicesVector) {
+    count += svc->m_characteristicVector.size();
+  }
+
+  std::vector<HandleEntry> table;
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  m_serviceChangedHandle = 0;
+#endif
+  if (count > 0) {
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+      capacity <<= 1;
+    }
+    table.resize(capacity, HandleEntry{0, nullptr});
+
+    const size_t mask = capacity - 1;
+    for (auto &svc : m_servicesVector) {
+      for (auto &chr : svc->m_characteristicVector) {
+        size_t slot = chr->m_handle & mask;
+        while (table[slot].handle != 0 && table[slot].handle != chr->m_handle) {
+          slot = (slot + 1) & mask;
+        }
+        table[slot] = HandleEntry{chr->m_handle, chr};
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+        if (chr->m_uuid == UUID((uint16_t) 0x2A05)) {
+          m_serviceChangedHandle = chr->m_handle;
+        }
+#endif
+      }
+    }
+  }
+
+  // The host task reads the table when notifications arrive, swap it in atomically.
+  ble_npl_hw_enter_critical();
+  m_handleTable.swap(table);
+  ble_npl_hw_exit_critical(0);
+}// rebuildHandleTable
+
+/**
+ * @brief Find a discovered characteristic by value handle.
+ * @param [in] handle The value handle of the characteristic.
+ * @return The characteristic or nullptr if it has not been discovered.
+ */
+RemoteCharacteristic *Client::findHandle(uint16_t handle) {
+  RemoteCharacteristic *pChr = nullptr;
+
+  ble_npl_hw_enter_critical();
+  if (handle != 0 && !m_handleTable.empty()) {
+    const size_t mask = m_handleTable.size() - 1;
+    size_t slot = handle & mask;
+    while (m_handleTable[slot].handle != 0) {
+      if (m_handleTable[slot].handle == handle) {
+        pChr = m_handleTable[slot].pChr;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+  ble_npl_hw_exit_critical(0);
+
+  return pChr;
+}// findHandle
+
+/**
+ * @brief Start using attributes found in the tree from a task that does not own it.
+ * @details Attributes removed from the tree meanwhile are only deleted after the matching endRead(),
+ * reads may be nested and never wait for the task changing the tree.
+ */
+void Client::beginRead() {
+  ble_npl_hw_enter_critical();
+  m_readers++;
+  ble_npl_hw_exit_critical(0);
+}// beginRead
+
+/**
+ * @brief Stop using the attributes, the last reader deletes the attributes removed meanwhile.
+ * @details If Device::deleteClient() was called during the read, the last reader also deletes the client.
+ */
+void Client::endRead() {
+  Retired *pList = nullptr;
+  bool deleteClient = false;
+
+  ble_npl_hw_enter_critical();
+  if (--m_readers == 0) {
+    pList = m_pRetired;
+    m_pRetired = nullptr;
+    deleteClient = m_deleteOnRelease;
+  }
+  ble_npl_hw_exit_critical(0);
+
+  reclaim(pList);
+  if (deleteClient) {
+    delete this;
+  }
+}// endRead
+
+/**
+ * @brief Delete the client now if there is no reader, otherwise when the last one ends.
+ * @details Called by Device::deleteClient() once the client is disconnected and out of the client list,
+ * so no new reader can start. Never waits, a notification callback may delete its own client.
+ */
+void Client::release() {
+  ble_npl_hw_enter_critical();
+  bool deferred = m_readers != 0;
+  m_deleteOnRelease = deferred;
+  ble_npl_hw_exit_critical(0);
+
+  if (!deferred) {
+    delete this;
+  }
+}// release
+
+/**
+ * @brief Delete attributes removed from the tree, now if there is no reader, otherwise when the last one ends.
+ * @param [in] services The services to delete.
+ * @param [in] characteristics The characteristics to delete.
+ * @details The attributes must already be unreachable, out of their vectors and the handle table.
+ */
+void Client::retire(std::vector<RemoteService *> services, std::vector<RemoteCharacteristic *> characteristics) {
+  if (services.empty() && characteristics.empty()) {
+    return;
+  }
+
+  auto pRetired = new Retired{nullptr, std::move(services), std::move(characteristics)};
+  Retired *pList = nullptr;
+
+  ble_npl_hw_enter_critical();
+  pRetired->pNext = m_pRetired;
+  m_pRetired = pRetired;
+  if (m_readers == 0) {
+    pList = m_pRetired;
+    m_pRetired = nullptr;
+  }
+  ble_npl_hw_exit_critical(0);
+
+  reclaim(pList);
+}// retire
+
+/**
+ * @brief Delete a list of retired attributes.
+ * @param [in] pList The first entry of the list, may be nullptr.
+ */
+/*STATIC*/
+void Client::reclaim(Retired *pList) {
+  while (pList != nullptr) {
+    Retired *pNext = pList->pNext;
+    for (auto &it : pList->services) {
+      delete it;
+    }
+    for (auto &it : pList->characteristics) {
+      delete it;
+    }
+    delete pList;
+    pList = pNext;
+  }
+}// reclaim
 
 /**
  * @brief Get the current mtu of this connection.
@@ -890,6 +2041,10 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
     // Stop the disconnect timer since we are now disconnected.
     ble_npl_callout_stop(&pClient->m_dcTimer);
 
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+    ConnParamsManager::onDisconnect(event->disconnect.conn.conn_handle);
+#endif
+
     // Remove the device from ignore list so we will scan it again
     Device::removeIgnored(pClient->m_peerAddress);
 
@@ -922,8 +2077,16 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
     rc = event->connect.status;
     if (rc == 0) {
       NIMBLE_LOGI(LOG_TAG, "Connected event");
+      NIMBLE_STAT_LATENCY(CONNECT, pClient->m_connectStartUs);
 
       pClient->m_conn_id = event->connect.conn_handle;
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+      ConnParamsManager::onConnect(pClient->m_conn_id);
+#endif
+
+      if (pClient->m_phyMask != BLE_GAP_LE_PHY_1M_MASK) {
+        pClient->setPhy(pClient->m_phyMask, pClient->m_phyMask);
+      }
 
       rc = ble_gattc_exchange_mtu(pClient->m_conn_id, nullptr, nullptr);
       if (rc != 0) {
@@ -947,48 +2110,46 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
     if (pClient->m_conn_id != event->notify_rx.conn_handle)
       return 0;
 
-    // If a notification comes before this flag is set we might
-    // access a vector while it is being cleared in connect()
+    // Notifications received before the connection is set up are for attributes not discovered yet.
     if (!pClient->m_connEstablished) {
       return 0;
     }
 
-    NIMBLE_LOGD(LOG_TAG, "Notify Received for handle: %d",
-                event->notify_rx.attr_handle);
-
-    for (auto &it : pClient->m_servicesVector) {
-      // Dont waste cycles searching services without this handle in its range
-      if (it->getEndHandle() < event->notify_rx.attr_handle) {
-        continue;
-      }
-
-      auto cVector = &it->m_characteristicVector;
-      NIMBLE_LOGD(LOG_TAG, "checking service %s for handle: %d",
-                  it->getUUID().toString().c_str(),
-                  event->notify_rx.attr_handle);
-
-      auto characteristic = cVector->cbegin();
-      for (; characteristic != cVector->cend(); ++characteristic) {
-        if ((*characteristic)->m_handle == event->notify_rx.attr_handle)
-          break;
-      }
-
-      if (characteristic != cVector->cend()) {
-        NIMBLE_LOGD(LOG_TAG, "Got Notification for characteristic %s",
-                    (*characteristic)->toString().c_str());
+    NIMBLE_CONN_TRAFFIC(event->notify_rx.conn_handle, OS_MBUF_PKTLEN(event->notify_rx.om));
+    NIMBLE_LOGD_DEFER(LOG_TAG, "Notify Received for handle: %d",
+                      event->notify_rx.attr_handle);
 
-        uint32_t data_len = OS_MBUF_PKTLEN(event->notify_rx.om);
-        (*characteristic)->m_value.setValue(event->notify_rx.om->om_data, data_len);
+#if CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+    // The peer database changed, the cached attributes are no longer valid.
+    if (event->notify_rx.attr_handle == pClient->m_serviceChangedHandle) {
+      NIMBLE_LOGI(LOG_TAG, "Service changed, invalidating attribute cache");
+      AttributeCache::invalidate(pClient);
+    }
+#endif
 
-        if ((*characteristic)->m_notifyCallback != nullptr) {
-          NIMBLE_LOGD(LOG_TAG, "Invoking callback for notification on characteristic %s",
-                      (*characteristic)->toString().c_str());
-          (*characteristic)->m_notifyCallback(*characteristic, event->notify_rx.om->om_data, data_len, !event->notify_rx.indication);
+    // The characteristic may be removed from the tree meanwhile, the read keeps it until the callback returns.
+    pClient->beginRead();
+    RemoteCharacteristic *characteristic = pClient->findHandle(event->notify_rx.attr_handle);
+    if (characteristic != nullptr) {
+      uint32_t data_len = OS_MBUF_PKTLEN(event->notify_rx.om);
+      characteristic->m_value.setValue(event->notify_rx.om->om_data, data_len);
+
+      if (characteristic->m_notifyCallback != nullptr) {
+        NIMBLE_LOGD_DEFER(LOG_TAG, "Invoking callback for notification on handle: %d",
+                          event->notify_rx.attr_handle);
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+        // The dispatcher takes the mbuf so the host does not free it before the callback runs.
+        if (CallbackDispatcher::dispatchNotify(characteristic, event->notify_rx.conn_handle,
+                                               event->notify_rx.om, !event->notify_rx.indication)) {
+          event->notify_rx.om = nullptr;
         }
-        break;
+#else
+        characteristic->m_notifyCallback(characteristic, event->notify_rx.om->om_data, data_len, !event->notify_rx.indication);
+#endif
       }
     }
 
+    pClient->endRead();
     return 0;
   }// BLE_GAP_EVENT_NOTIFY_RX
 
@@ -1029,6 +2190,9 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
     } else {
       NIMBLE_LOGE(LOG_TAG, "Update connection parameters failed.");
     }
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+    ConnParamsManager::onConnUpdate(event->conn_update.conn_handle, event->conn_update.status);
+#endif
     return 0;
   }// BLE_GAP_EVENT_CONN_UPDATE
 
@@ -1065,6 +2229,21 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
     break;
   }// BLE_GAP_EVENT_MTU
 
+  case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE: {
+    if (pClient->m_conn_id != event->phy_updated.conn_handle) {
+      return 0;
+    }
+
+    if (event->phy_updated.status != 0) {
+      NIMBLE_LOGW(LOG_TAG, "PHY update failed; status=%d", event->phy_updated.status);
+      return 0;
+    }
+
+    NIMBLE_LOGI(LOG_TAG, "PHY update; tx=%d rx=%d", event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+    pClient->m_pClientCallbacks->onPhyUpdate(pClient, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+    return 0;
+  }// BLE_GAP_EVENT_PHY_UPDATE_COMPLETE
+
   case BLE_GAP_EVENT_PASSKEY_ACTION: {
     struct ble_sm_io pkey = {0, {0}};
     (void) pkey;//warning: variable 'pkey' set but not used [-Wunused-but-set-variable]
@@ -1117,11 +2296,14 @@ int Client::handleGapEvent(struct ble_gap_event *event, void *arg) {
   }// Switch
 
   if (pClient->m_pTaskData != nullptr) {
-    pClient->m_pTaskData->rc = rc;
-    if (pClient->m_pTaskData->task) {
-      xTaskNotifyGive(pClient->m_pTaskData->task);
-    }
+    ble_task_data_t *pTaskData = pClient->m_pTaskData;
+    pTaskData->rc = rc;
     pClient->m_pTaskData = nullptr;
+    if (pTaskData->task) {
+      xTaskNotifyGive(pTaskData->task);
+    } else if (pTaskData == &pClient->m_asyncTaskData) {
+      pClient->completeConnect(rc);
+    }
   }
 
   return 0;
@@ -1198,6 +2380,10 @@ bool ClientCallbacks::onConfirmPIN(uint32_t pin) {
   return true;
 }
 
+void ClientCallbacks::onPhyUpdate(Client *pClient, uint8_t txPhy, uint8_t rxPhy) {
+  NIMBLE_LOGD("NimBLEClientCallbacks", "onPhyUpdate: default");
+}
+
 }
 
 #endif /* CONFIG_BT_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
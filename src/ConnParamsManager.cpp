@@ -0,0 +1,367 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include "nimble/ConnParamsManager.hpp"
+
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+
+#include <cstring>
+
+#include <host/ble_gap.h>
+#include <host/ble_hs.h>
+#include <nimble/nimble_port.h>
+
+#include "nimble/ConnectionInfo.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Utils.hpp"
+
+static const char *LOG_TAG = "NimBLEConnParamsManager";
+
+namespace nimble {
+
+static ConnParamsCallbacks defaultCallbacks;
+
+/**
+ * @brief Number of windows to wait for a connection update event before requesting again.
+ */
+static constexpr uint8_t MAX_PENDING_WINDOWS = 5;
+
+static ConnParamsManager::Link s_links[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+static ConnParamsProfile s_profiles[2] = {
+    {320, 400, 2, 600, 0, 0},                   // IDLE: 400 - 500ms
+    {6, 12, 0, 400, 251, BLE_GAP_LE_PHY_2M_MASK},// BURST: 7.5 - 15ms
+};
+static ConnParamsCallbacks *s_pCallbacks = &defaultCallbacks;
+static ble_npl_callout s_timer;
+static uint32_t s_windowMs = 1000;
+static uint32_t s_burstBytesPerSec = 2000;
+static uint32_t s_idleBytesPerSec = 200;
+static uint8_t s_idleWindows = 3;
+static bool s_timerInitialized = false;
+static bool s_running = false;
+
+/**
+ * @brief Set the connection settings used in a mode.
+ * @param [in] mode The mode.
+ * @param [in] profile The settings, the intervals must pass Utils::checkConnParams().
+ * @details Connections already in the mode keep their settings until they switch again.
+ */
+/*STATIC*/
+void ConnParamsManager::setProfile(Mode mode, const ConnParamsProfile &profile) {
+  s_profiles[mode] = profile;
+}// setProfile
+
+/**
+ * @brief Set the traffic rates switching between the modes.
+ * @param [in] burstBytesPerSec A window at or above this rate switches to the burst mode.
+ * @param [in] idleBytesPerSec Windows below this rate count towards switching back to the idle mode.
+ * @param [in] idleWindows The number of consecutive quiet windows before switching to the idle mode.
+ * @details The gap between the two rates and the quiet windows keep a connection from switching
+ * back and forth when its traffic is close to a threshold.
+ */
+/*STATIC*/
+void ConnParamsManager::setThresholds(uint32_t burstBytesPerSec, uint32_t idleBytesPerSec, uint8_t idleWindows) {
+  s_burstBytesPerSec = burstBytesPerSec;
+  s_idleBytesPerSec = idleBytesPerSec < burstBytesPerSec ? idleBytesPerSec : burstBytesPerSec;
+  s_idleWindows = idleWindows > 0 ? idleWindows : 1;
+}// setThresholds
+
+/**
+ * @brief Set how often the traffic of the connections is checked.
+ * @param [in] windowMs The length of a measurement window in milliseconds.
+ */
+/*STATIC*/
+void ConnParamsManager::setWindow(uint32_t windowMs) {
+  s_windowMs = windowMs > 0 ? windowMs : 1;
+}// setWindow
+
+/**
+ * @brief Set the callbacks called when a connection changes mode.
+ * @param [in] pCallbacks The callbacks, nullptr for none.
+ */
+/*STATIC*/
+void ConnParamsManager::setCallbacks(ConnParamsCallbacks *pCallbacks) {
+  s_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+}// setCallbacks
+
+/**
+ * @brief Start checking the traffic of the connections.
+ * @return True if started, false if already running or the device is not initialized.
+ * @details Connections established before Device::init() are unknown to the manager, connections
+ * made while it is stopped are tracked and switched once it runs.
+ */
+/*STATIC*/
+bool ConnParamsManager::start() {
+  if (s_running || !Device::isInitialized()) {
+    return false;
+  }
+
+  if (!s_timerInitialized) {
+    memset(&s_timer, 0, sizeof(s_timer));
+    ble_npl_callout_init(&s_timer, nimble_port_get_dflt_eventq(), ConnParamsManager::timerCb, nullptr);
+    s_timerInitialized = true;
+  }
+
+  for (auto &it : s_links) {
+    it.bytes.store(0, std::memory_order_relaxed);
+    it.quietWindows = 0;
+  }
+
+  s_running = true;
+  ble_npl_time_t ticks;
+  ble_npl_time_ms_to_ticks(s_windowMs, &ticks);
+  ble_npl_callout_reset(&s_timer, ticks);
+  return true;
+}// start
+
+/**
+ * @brief Stop switching modes, the connections keep their current settings.
+ */
+/*STATIC*/
+void ConnParamsManager::stop() {
+  s_running = false;
+  if (s_timerInitialized) {
+    ble_npl_callout_stop(&s_timer);
+  }
+}// stop
+
+/**
+ * @brief Check if the manager is running.
+ * @return True if started and not stopped.
+ */
+/*STATIC*/
+bool ConnParamsManager::isRunning() {
+  return s_running;
+}// isRunning
+
+/**
+ * @brief Get the mode of a connection.
+ * @param [in] connHandle The connection handle.
+ * @return The mode last accepted by the peer, IDLE for unknown connections.
+ */
+/*STATIC*/
+ConnParamsManager::Mode ConnParamsManager::getMode(uint16_t connHandle) {
+  Link *pLink = findLink(connHandle);
+  return pLink != nullptr ? pLink->mode : IDLE;
+}// getMode
+
+/**
+ * @brief Add bytes sent or received on a connection to its traffic.
+ * @param [in] connHandle The connection handle.
+ * @param [in] length The number of bytes.
+ * @details Called by the library for notifications, indications and writes, can be called by the
+ * application for other traffic such as L2CAP channels. Safe to call from any task.
+ */
+/*STATIC*/
+void ConnParamsManager::countBytes(uint16_t connHandle, size_t length) {
+  Link *pLink = findLink(connHandle);
+  if (pLink != nullptr) {
+    pLink->bytes.fetch_add(length, std::memory_order_relaxed);
+  }
+}// countBytes
+
+/**
+ * @brief Start tracking a new connection, called from the connect events.
+ * @param [in] connHandle The connection handle.
+ */
+/*STATIC*/
+void ConnParamsManager::onConnect(uint16_t connHandle) {
+  if (findLink(connHandle) != nullptr) {
+    return;
+  }
+
+  for (auto &it : s_links) {
+    if (!it.active) {
+      it.bytes.store(0, std::memory_order_relaxed);
+      it.connHandle = connHandle;
+      it.mode = BURST;
+      it.requested = BURST;
+      it.pending = false;
+      it.quietWindows = 0;
+      it.pendingWindows = 0;
+      it.active = true;
+      return;
+    }
+  }
+}// onConnect
+
+/**
+ * @brief Stop tracking a connection, called from the disconnect events.
+ * @param [in] connHandle The connection handle.
+ */
+/*STATIC*/
+void ConnParamsManager::onDisconnect(uint16_t connHandle) {
+  Link *pLink = findLink(connHandle);
+  if (pLink != nullptr) {
+    pLink->active = false;
+  }
+}// onDisconnect
+
+/**
+ * @brief Complete a mode switch, called from the BLE_GAP_EVENT_CONN_UPDATE events.
+ * @param [in] connHandle The connection handle.
+ * @param [in] status The status of the update.
+ */
+/*STATIC*/
+void ConnParamsManager::onConnUpdate(uint16_t connHandle, int status) {
+  Link *pLink = findLink(connHandle);
+  if (pLink == nullptr || !pLink->pending) {
+    return;
+  }
+
+  pLink->pending = false;
+  if (status != 0) {
+    NIMBLE_LOGW(LOG_TAG, "Mode %d rejected on conn %d; rc=%d %s",
+                pLink->requested, connHandle, status, Utils::returnCodeToString(status));
+    s_pCallbacks->onModeChangeFailed(connHandle, pLink->requested, status);
+    return;
+  }
+
+  pLink->mode = pLink->requested;
+  pLink->quietWindows = 0;
+
+  ConnectionInfo connInfo;
+  if (ble_gap_conn_find(connHandle, &connInfo.m_desc) == 0) {
+    NIMBLE_LOGD(LOG_TAG, "Conn %d in mode %d, interval %d", connHandle, pLink->mode, connInfo.getConnInterval());
+    s_pCallbacks->onModeChange(connInfo, pLink->mode);
+  }
+}// onConnUpdate
+
+/**
+ * @brief Find the tracked state of a connection.
+ * @param [in] connHandle The connection handle.
+ * @return The state, or nullptr if the connection is not tracked.
+ */
+/*STATIC*/
+ConnParamsManager::Link *ConnParamsManager::findLink(uint16_t connHandle) {
+  for (auto &it : s_links) {
+    if (it.active && it.connHandle == connHandle) {
+      return &it;
+    }
+  }
+
+  return nullptr;
+}// findLink
+
+/**
+ * @brief Request the settings of a mode on a connection.
+ * @param [in] link The connection.
+ * @param [in] mode The mode to switch to.
+ */
+/*STATIC*/
+void ConnParamsManager::apply(Link &link, Mode mode) {
+  const ConnParamsProfile &profile = s_profiles[mode];
+
+  // Raise the PHY and data length first so a burst can use them as soon as the interval drops.
+  if (profile.phyMask != 0) {
+    int rc = ble_gap_set_prefered_le_phy(link.connHandle, profile.phyMask, profile.phyMask, BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+      NIMBLE_LOGD(LOG_TAG, "Set PHY error: %d, %s", rc, Utils::returnCodeToString(rc));
+    }
+  }
+
+#if !(defined(CONFIG_NIMBLE_CPP_IDF) && !defined(ESP_IDF_VERSION) || (ESP_IDF_VERSION_MAJOR * 100 + ESP_IDF_VERSION_MINOR * 10 + ESP_IDF_VERSION_PATCH) < 432)
+  if (profile.txOctets != 0) {
+    int rc = ble_gap_set_data_len(link.connHandle, profile.txOctets, (profile.txOctets + 14) * 8);
+    if (rc != 0) {
+      NIMBLE_LOGD(LOG_TAG, "Set data length error: %d, %s", rc, Utils::returnCodeToString(rc));
+    }
+  }
+#endif
+
+  ble_gap_upd_params params;
+  params.itvl_min = profile.minInterval;
+  params.itvl_max = profile.maxInterval;
+  params.latency = profile.latency;
+  params.supervision_timeout = profile.timeout;
+  params.min_ce_len = BLE_GAP_INITIAL_CONN_MIN_CE_LEN;
+  params.max_ce_len = BLE_GAP_INITIAL_CONN_MAX_CE_LEN;
+
+  link.requested = mode;
+  link.pendingWindows = 0;
+
+  int rc = ble_gap_update_params(link.connHandle, &params);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Update params error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return;
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "Conn %d switching to mode %d", link.connHandle, mode);
+  link.pending = true;
+}// apply
+
+/**
+ * @brief Measure the traffic of the last window and switch the connections that crossed a threshold.
+ */
+/*STATIC*/
+void ConnParamsManager::evaluate() {
+  for (auto &link : s_links) {
+    if (!link.active) {
+      continue;
+    }
+
+    uint32_t bytes = link.bytes.exchange(0, std::memory_order_relaxed);
+    uint32_t rate = (uint64_t) bytes * 1000 / s_windowMs;
+
+    // Wait for the peer to answer the last request, the host reports it with a connection update.
+    if (link.pending) {
+      if (++link.pendingWindows < MAX_PENDING_WINDOWS) {
+        continue;
+      }
+      link.pending = false;
+    }
+
+    if (rate >= s_burstBytesPerSec) {
+      link.quietWindows = 0;
+      if (link.mode != BURST) {
+        apply(link, BURST);
+      }
+      continue;
+    }
+
+    if (link.mode == IDLE) {
+      continue;
+    }
+
+    link.quietWindows = rate < s_idleBytesPerSec ? link.quietWindows + 1 : 0;
+    if (link.quietWindows >= s_idleWindows) {
+      apply(link, IDLE);
+    }
+  }
+}// evaluate
+
+/**
+ * @brief Timer callback, checks the connections on the host task and re-arms the timer.
+ */
+/*STATIC*/
+void ConnParamsManager::timerCb(ble_npl_event *event) {
+  if (!s_running) {
+    return;
+  }
+
+  evaluate();
+
+  ble_npl_time_t ticks;
+  ble_npl_time_ms_to_ticks(s_windowMs, &ticks);
+  ble_npl_callout_reset(&s_timer, ticks);
+}// timerCb
+
+}// namespace nimble
+
+#endif /* CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS */
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
@@ -0,0 +1,421 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include "nimble/ConnectionManager.hpp"
+
+#include <cstring>
+
+#include <nimble/nimble_port.h>
+
+#include "nimble/Client.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Log.hpp"
+
+static const char *LOG_TAG = "NimBLEConnectionManager";
+
+namespace nimble {
+
+static ConnectionManagerCallbacks defaultCallbacks;
+
+/**
+ * @brief How often established links are checked so that dropped ones are reconnected.
+ */
+static constexpr uint32_t POLL_INTERVAL_MS = 1000;
+
+/**
+ * @brief Upper bound of the retry backoff, as a multiple of the initial backoff.
+ */
+static constexpr uint8_t MAX_BACKOFF_SHIFT = 5;
+
+/**
+ * @brief Constructor.
+ * @param [in] pCallbacks The callbacks to invoke when targets are ready or fail, may be nullptr.
+ */
+ConnectionManager::ConnectionManager(ConnectionManagerCallbacks *pCallbacks) {
+  m_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+  m_backoffMs = 250;
+  m_maxRetries = 3;
+  m_discover = true;
+  m_running = false;
+  m_restart = false;
+  m_scheduling = false;
+  m_connecting = false;
+
+  memset(&m_timer, 0, sizeof(m_timer));
+  ble_npl_callout_init(&m_timer, nimble_port_get_dflt_eventq(), ConnectionManager::timerCb, this);
+}// ConnectionManager
+
+/**
+ * @brief Destructor, stops the manager. The clients are left connected.
+ */
+ConnectionManager::~ConnectionManager() {
+  stop();
+  ble_npl_callout_deinit(&m_timer);
+}// ~ConnectionManager
+
+/**
+ * @brief Add a peripheral to bring up.
+ * @param [in] address The address of the peripheral.
+ * @return True if the peripheral is a target, false if the manager is running or an attempt is in progress.
+ */
+bool ConnectionManager::addTarget(const Address &address) {
+  if (isBusy()) {
+    NIMBLE_LOGE(LOG_TAG, "Targets can only be changed while stopped and idle");
+    return false;
+  }
+
+  for (auto &it : m_targets) {
+    if (it.address == address) {
+      return true;
+    }
+  }
+
+  m_targets.push_back(Target{address, nullptr, IDLE, 0, 0});
+  return true;
+}// addTarget
+
+/**
+ * @brief Remove a peripheral, the client is left connected.
+ * @param [in] address The address of the peripheral.
+ * @return True if the peripheral was a target, false if not or if the manager is running or an attempt is in progress.
+ */
+bool ConnectionManager::removeTarget(const Address &address) {
+  if (isBusy()) {
+    NIMBLE_LOGE(LOG_TAG, "Targets can only be changed while stopped and idle");
+    return false;
+  }
+
+  for (auto it = m_targets.begin(); it != m_targets.end(); ++it) {
+    if (it->address == address) {
+      m_targets.erase(it);
+      return true;
+    }
+  }
+
+  return false;
+}// removeTarget
+
+/**
+ * @brief Set how failed connections are retried.
+ * @param [in] maxRetries The number of retries after the first failed attempt.
+ * @param [in] backoffMs The delay before the first retry, doubled for every further retry.
+ */
+void ConnectionManager::setRetries(uint8_t maxRetries, uint32_t backoffMs) {
+  ble_npl_hw_enter_critical();
+  m_maxRetries = maxRetries;
+  m_backoffMs = backoffMs;
+  ble_npl_hw_exit_critical(0);
+}// setRetries
+
+/**
+ * @brief Set whether the attributes of each target are discovered once connected.
+ * @param [in] discover If true, Client::discoverAttributesAsync() is run on every new link.
+ */
+void ConnectionManager::setDiscoverAttributes(bool discover) {
+  ble_npl_hw_enter_critical();
+  m_discover = discover;
+  ble_npl_hw_exit_critical(0);
+}// setDiscoverAttributes
+
+/**
+ * @brief Start bringing up the targets.
+ * @return True if the manager was started.
+ * @details The rest of the work is done on the NimBLE host task, this returns immediately.
+ * The targets are reset by the host task too, attempts of a previous run may still be completing.
+ * The manager must not be destroyed while operations it started are in progress.
+ */
+bool ConnectionManager::start() {
+  ble_npl_hw_enter_critical();
+  if (m_running) {
+    ble_npl_hw_exit_critical(0);
+    return false;
+  }
+  m_running = true;
+  m_restart = true;
+  ble_npl_hw_exit_critical(0);
+
+  ble_npl_callout_reset(&m_timer, 0);
+  return true;
+}// start
+
+/**
+ * @brief Stop starting new connections, attempts in progress complete normally.
+ */
+void ConnectionManager::stop() {
+  ble_npl_hw_enter_critical();
+  m_running = false;
+  ble_npl_hw_exit_critical(0);
+  ble_npl_callout_stop(&m_timer);
+}// stop
+
+/**
+ * @brief Check if the manager is running.
+ * @return True if started and not stopped.
+ */
+bool ConnectionManager::isRunning() const {
+  ble_npl_hw_enter_critical();
+  bool running = m_running;
+  ble_npl_hw_exit_critical(0);
+  return running;
+}// isRunning
+
+/**
+ * @brief Get the number of targets that are connected and discovered.
+ * @return The number of ready targets.
+ */
+size_t ConnectionManager::getReadyCount() const {
+  size_t count = 0;
+  ble_npl_hw_enter_critical();
+  for (auto &it : m_targets) {
+    if (it.state == READY) {
+      count++;
+    }
+  }
+  ble_npl_hw_exit_critical(0);
+
+  return count;
+}// getReadyCount
+
+/**
+ * @brief Check if the host task may be using the targets.
+ * @return True if running, scheduling or waiting for a connection or a discovery to complete.
+ * @details Once stopped and idle the host task has nothing left to do for this manager, so the
+ * targets can be changed from the application task.
+ */
+bool ConnectionManager::isBusy() const {
+  ble_npl_hw_enter_critical();
+  bool busy = m_running || m_restart || m_scheduling || m_connecting;
+  for (auto &it : m_targets) {
+    busy = busy || it.state == CONNECTING || it.state == DISCOVERING;
+  }
+  ble_npl_hw_exit_critical(0);
+
+  return busy;
+}// isBusy
+
+/**
+ * @brief Timer callback, runs the scheduler on the host task.
+ */
+/*STATIC*/
+void ConnectionManager::timerCb(ble_npl_event *event) {
+  auto *pManager = (ConnectionManager *) ble_npl_event_get_arg(event);
+  pManager->schedule();
+}// timerCb
+
+/**
+ * @brief Start the next due connection attempt and re-arm the timer for the next retry or link check.
+ */
+void ConnectionManager::schedule() {
+  ble_npl_time_t now = ble_npl_time_get();
+
+  ble_npl_hw_enter_critical();
+  if (!m_running || m_scheduling) {
+    ble_npl_hw_exit_critical(0);
+    return;
+  }
+  // Reset the targets here rather than in start(), a stopped run may still be completing its attempts.
+  if (m_restart) {
+    m_restart = false;
+    for (auto &it : m_targets) {
+      if (it.state == FAILED) {
+        it.state = IDLE;
+      }
+      if (it.state == IDLE || it.state == READY) {
+        it.attempts = 0;
+        it.retryAt = now;
+      }
+    }
+  }
+  m_scheduling = true;
+  ble_npl_hw_exit_critical(0);
+
+  ble_npl_time_t wait;
+  ble_npl_time_ms_to_ticks(POLL_INTERVAL_MS, &wait);
+
+  for (auto &target : m_targets) {
+    // Reconnect links that dropped since they were brought up.
+    if (target.state == READY && !target.pClient->isConnected()) {
+      NIMBLE_LOGI(LOG_TAG, "Lost %s, reconnecting", target.address.toString().c_str());
+      target.state = IDLE;
+      target.attempts = 0;
+      target.retryAt = now;
+    }
+
+    if (target.state != IDLE) {
+      continue;
+    }
+
+    int32_t due = (int32_t) (target.retryAt - now);
+    if (due > 0) {
+      if ((ble_npl_time_t) due < wait) {
+        wait = due;
+      }
+      continue;
+    }
+
+    // The host allows a single connection attempt at a time.
+    if (m_connecting) {
+      continue;
+    }
+
+    if (target.pClient == nullptr) {
+      target.pClient = Device::getClientByPeerAddress(target.address);
+    }
+    if (target.pClient == nullptr) {
+      if (Device::getClientListSize() >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+        retry(target, BLE_HS_ENOMEM);
+        continue;
+      }
+      target.pClient = Device::createClient(target.address);
+    }
+
+    ble_npl_hw_enter_critical();
+    target.state = CONNECTING;
+    target.attempts++;
+    m_connecting = true;
+    ble_npl_hw_exit_critical(0);
+
+    NIMBLE_LOGD(LOG_TAG, "Connecting to %s, attempt %d", target.address.toString().c_str(), target.attempts);
+    if (!target.pClient->connectAsync(target.address, [this](Client *pClient, int rc) { onConnect(pClient, rc); })) {
+      ble_npl_hw_enter_critical();
+      m_connecting = false;
+      ble_npl_hw_exit_critical(0);
+      int rc = target.pClient->getLastError();
+      retry(target, rc != 0 ? rc : BLE_HS_EUNKNOWN);
+    }
+  }
+
+  ble_npl_hw_enter_critical();
+  m_scheduling = false;
+  bool running = m_running;
+  ble_npl_hw_exit_critical(0);
+
+  if (running) {
+    ble_npl_callout_reset(&m_timer, wait);
+  }
+}// schedule
+
+/**
+ * @brief Completion of a connection attempt.
+ * @param [in] pClient The client that connected.
+ * @param [in] rc The result of the attempt.
+ */
+void ConnectionManager::onConnect(Client *pClient, int rc) {
+  Target *target = findTarget(pClient);
+  ble_npl_hw_enter_critical();
+  bool discover = m_discover;
+  if (target != nullptr && rc == 0) {
+    target->state = discover ? DISCOVERING : READY;
+  }
+  m_connecting = false;
+  ble_npl_hw_exit_critical(0);
+
+  if (target != nullptr) {
+    if (rc != 0) {
+      retry(*target, rc);
+    } else if (!discover) {
+      m_pCallbacks->onReady(pClient);
+    } else if (!pClient->discoverAttributesAsync([this](Client *pClient, int rc) { onDiscover(pClient, rc); })) {
+      pClient->disconnect();
+      retry(*target, pClient->getLastError());
+    }
+  }
+
+  // Start the next connection right away rather than waiting for the timer.
+  schedule();
+}// onConnect
+
+/**
+ * @brief Completion of an attribute discovery.
+ * @param [in] pClient The client whose attributes were discovered.
+ * @param [in] rc The result of the discovery.
+ */
+void ConnectionManager::onDiscover(Client *pClient, int rc) {
+  Target *target = findTarget(pClient);
+  if (target == nullptr) {
+    return;
+  }
+
+  if (rc == 0) {
+    ble_npl_hw_enter_critical();
+    target->state = READY;
+    ble_npl_hw_exit_critical(0);
+    m_pCallbacks->onReady(pClient);
+    return;
+  }
+
+  NIMBLE_LOGW(LOG_TAG, "Discovery of %s failed; rc=%d", target->address.toString().c_str(), rc);
+  if (pClient->isConnected()) {
+    pClient->disconnect();
+  }
+  retry(*target, rc);
+}// onDiscover
+
+/**
+ * @brief Schedule a retry of a target, or give up once the retries are exhausted.
+ * @param [in] target The target that failed.
+ * @param [in] rc The error of the failed attempt.
+ */
+void ConnectionManager::retry(Target &target, int rc) {
+  ble_npl_hw_enter_critical();
+  uint8_t maxRetries = m_maxRetries;
+  uint32_t backoffMs = m_backoffMs;
+  ble_npl_hw_exit_critical(0);
+
+  if (target.attempts > maxRetries) {
+    NIMBLE_LOGE(LOG_TAG, "Giving up on %s; rc=%d", target.address.toString().c_str(), rc);
+    ble_npl_hw_enter_critical();
+    target.state = FAILED;
+    ble_npl_hw_exit_critical(0);
+    m_pCallbacks->onFailed(target.address, rc);
+    return;
+  }
+
+  uint8_t shift = target.attempts > 0 ? target.attempts - 1 : 0;
+  if (shift > MAX_BACKOFF_SHIFT) {
+    shift = MAX_BACKOFF_SHIFT;
+  }
+
+  ble_npl_time_t ticks;
+  ble_npl_time_ms_to_ticks(backoffMs << shift, &ticks);
+  ble_npl_time_t retryAt = ble_npl_time_get() + ticks;
+  ble_npl_hw_enter_critical();
+  target.state = IDLE;
+  target.retryAt = retryAt;
+  ble_npl_hw_exit_critical(0);
+
+  NIMBLE_LOGD(LOG_TAG, "Retrying %s in %lu ms; rc=%d", target.address.toString().c_str(), backoffMs << shift, rc);
+}// retry
+
+/**
+ * @brief Find the target a client belongs to.
+ * @param [in] pClient The client.
+ * @return The target or nullptr if the client is not used by this manager.
+ */
+ConnectionManager::Target *ConnectionManager::findTarget(Client *pClient) {
+  for (auto &it : m_targets) {
+    if (it.pClient == pClient) {
+      return &it;
+    }
+  }
+
+  return nullptr;
+}// findTarget
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
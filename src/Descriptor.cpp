@@ -16,6 +16,7 @@
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
 
 #include "nimble/Descriptor.hpp"
+#include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
 #include "nimble/Service.hpp"
 
@@ -125,6 +126,14 @@ AttributeValue Descriptor::getValue(time_t *timestamp) {
   return m_value;
 }// getValue
 
+/**
+ * @brief Get a view of the current value that does not copy it.
+ * @return A view of the value, valid until the value is next changed.
+ */
+AttributeValueView Descriptor::getValueView() const {
+  return m_value.view();
+}// getValueView
+
 /**
  * @brief Get the value of this descriptor as a string.
  * @return A std::string instance containing a copy of the descriptor's value.
@@ -158,12 +167,12 @@ int Descriptor::handleGapEvent(uint16_t conn_handle, uint16_t attr_handle,
   if (ble_uuid_cmp(uuid, &pDescriptor->getUUID().getNative()->u) == 0) {
     switch (ctxt->op) {
     case BLE_GATT_ACCESS_OP_READ_DSC: {
-      rc = ble_gap_conn_find(conn_handle, &peerInfo.m_desc);
-      assert(rc == 0);
+      Server *pServer = Device::getServer();
+      peerInfo = pServer->getPeerIDInfo(conn_handle);
 
       // If the packet header is only 8 bytes this is a follow up of a long read
       // so we don't want to call the onRead() callback again.
-      if (ctxt->om->om_pkthdr_len > 8 || pDescriptor->m_value.size() <= (ble_att_mtu(peerInfo.getConnHandle()) - 3)) {
+      if (ctxt->om->om_pkthdr_len > 8 || pDescriptor->m_value.size() <= (pServer->getPeerMTU(conn_handle) - 3)) {
         pDescriptor->m_pCallbacks->onRead(pDescriptor, peerInfo);
       }
 
@@ -174,30 +183,17 @@ int Descriptor::handleGapEvent(uint16_t conn_handle, uint16_t attr_handle,
     }
 
     case BLE_GATT_ACCESS_OP_WRITE_DSC: {
-      rc = ble_gap_conn_find(conn_handle, &peerInfo.m_desc);
-      assert(rc == 0);
+      peerInfo = Device::getServer()->getPeerIDInfo(conn_handle);
 
-      uint16_t att_max_len = pDescriptor->m_value.max_size();
-
-      if (ctxt->om->om_len > att_max_len) {
-        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+      // Let the application consume the data directly from the mbuf chain if it wants to.
+      if (pDescriptor->m_pCallbacks->onWriteRaw(pDescriptor, ctxt->om, peerInfo)) {
+        return 0;
       }
 
-      uint8_t buf[att_max_len];
-      size_t len = ctxt->om->om_len;
-      memcpy(buf, ctxt->om->om_data, len);
-      os_mbuf *next;
-      next = SLIST_NEXT(ctxt->om, om_next);
-      while (next != NULL) {
-        if ((len + next->om_len) > att_max_len) {
-          return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
-        }
-        memcpy(&buf[len], next->om_data, next->om_len);
-        len += next->om_len;
-        next = SLIST_NEXT(next, om_next);
+      if (!pDescriptor->m_value.setValue(ctxt->om)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
       }
 
-      pDescriptor->setValue(buf, len);
       pDescriptor->m_pCallbacks->onWrite(pDescriptor, peerInfo);
       return 0;
     }
@@ -289,6 +285,19 @@ void DescriptorCallbacks::onWrite(Descriptor *pDescriptor, ConnectionInfo &connI
   NIMBLE_LOGD("NimBLEDescriptorCallbacks", "onWrite: default");
 }// onWrite
 
+/**
+ * @brief Callback function to consume a write request directly from the received mbuf chain.
+ * @param [in] pDescriptor The descriptor that is the source of the event.
+ * @param [in] om The mbuf chain holding the written data, only valid for the duration of the call.
+ * @param [in] connInfo A reference to a NimBLEConnInfo instance containing the peer info.
+ * @return True if the data was consumed, the descriptor value is then not updated
+ * and onWrite() is not called. The default returns false.
+ */
+bool DescriptorCallbacks::onWriteRaw(Descriptor *pDescriptor, const os_mbuf *om, ConnectionInfo &connInfo) {
+  (void) pDescriptor;
+  return false;
+}// onWriteRaw
+
 }
 
 #endif /* CONFIG_BT_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
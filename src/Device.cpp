@@ -17,6 +17,7 @@
 
 #include <esp_bt.h>
 #include <esp_err.h>
+#include <freertos/task.h>
 #include <host/ble_hs.h>
 #include <host/ble_hs_pvcy.h>
 #include <host/util/util.h>
@@ -26,6 +27,7 @@
 #include <services/gap/ble_svc_gap.h>
 #include <services/gatt/ble_svc_gatt.h>
 
+#include "nimble/CallbackDispatcher.hpp"
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
 #include "nimble/Scan.hpp"
@@ -37,6 +39,15 @@ static const char *LOG_TAG = "Device";
 
 bool Device::m_isInitialized = false;
 bool Device::m_isSynced = false;
+bool Device::m_customHostTask = CONFIG_NIMBLE_CPP_HOST_TASK_CUSTOM;
+#if CONFIG_NIMBLE_CPP_HOST_TASK_CUSTOM
+TaskConfig Device::m_hostTaskConfig = {CONFIG_NIMBLE_CPP_HOST_TASK_CORE,
+                                       CONFIG_NIMBLE_CPP_HOST_TASK_PRIORITY,
+                                       CONFIG_NIMBLE_CPP_HOST_TASK_STACK_SIZE};
+#else
+TaskConfig Device::m_hostTaskConfig = {};
+#endif
+BaseType_t Device::m_taskCore = CONFIG_NIMBLE_CPP_TASK_CORE;
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
 Scan *Device::m_pScan = nullptr;
@@ -46,11 +57,19 @@ Scan *Device::m_pScan = nullptr;
 Server *Device::m_pServer = nullptr;
 #endif
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+L2CAPServer *Device::m_pL2CAPServer = nullptr;
+#endif
+
 uint32_t Device::m_passkey = 123456;
 
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
+#if CONFIG_BT_NIMBLE_EXT_ADV
+ExtAdvertising *Device::m_bleAdvertising = nullptr;
+#else
 Advertising *Device::m_bleAdvertising = nullptr;
 #endif
+#endif
 
 gap_event_handler Device::m_customGapHandler = nullptr;
 
@@ -60,8 +79,9 @@ ble_gap_event_listener Device::m_listener;
 std::list<Client *> Device::m_cList;
 #endif
 
-std::list<Address> Device::m_ignoreList;
+AddressSet Device::m_ignoreList;
 std::vector<Address> Device::m_whiteList;
+AddressSet Device::m_whiteListSet;
 
 uint8_t Device::m_own_addr_type = BLE_OWN_ADDR_PUBLIC;
 
@@ -95,7 +115,69 @@ uint8_t Device::m_scanFilterMode = CONFIG_BTDM_SCAN_DUPL_TYPE;
 }// getServer
 #endif// #if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+/**
+ * @brief Create the instance of the L2CAP server.
+ * @return The L2CAP server, services are added with L2CAPServer::createService().
+ */
+/* STATIC */ L2CAPServer *Device::createL2CAPServer() {
+  if (Device::m_pL2CAPServer == nullptr) {
+    Device::m_pL2CAPServer = new L2CAPServer();
+  }
+
+  return m_pL2CAPServer;
+}// createL2CAPServer
+
+/**
+ * @brief Get the instance of the L2CAP server.
+ * @return A pointer to the L2CAP server, nullptr if not created.
+ */
+/* STATIC */ L2CAPServer *Device::getL2CAPServer() {
+  return m_pL2CAPServer;
+}// getL2CAPServer
+#endif// #if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
+#if CONFIG_BT_NIMBLE_EXT_ADV
+/**
+ * @brief Get the instance of the extended advertising object.
+ * @return A pointer to the extended advertising object.
+ */
+ExtAdvertising *Device::getAdvertising() {
+  if (m_bleAdvertising == nullptr) {
+    m_bleAdvertising = new ExtAdvertising();
+  }
+  return m_bleAdvertising;
+}
+
+/**
+ * @brief Convenience function to begin advertising an instance.
+ * @param [in] inst_id The extended advertisement instance ID to start.
+ * @param [in] duration How long to advertise for in milliseconds, 0 = forever (default).
+ * @param [in] max_events Maximum number of advertisement events to send, 0 = no limit (default).
+ * @return True if advertising started successfully.
+ */
+bool Device::startAdvertising(uint8_t inst_id, int duration, int max_events) {
+  return getAdvertising()->start(inst_id, duration, max_events);
+}// startAdvertising
+
+/**
+ * @brief Convenience function to stop advertising an instance.
+ * @param [in] inst_id The extended advertisement instance ID to stop.
+ * @return True if advertising stopped successfully.
+ */
+bool Device::stopAdvertising(uint8_t inst_id) {
+  return getAdvertising()->stop(inst_id);
+}// stopAdvertising
+
+/**
+ * @brief Convenience function to stop all advertising instances.
+ * @return True if advertising stopped successfully.
+ */
+bool Device::stopAdvertising() {
+  return getAdvertising()->stop();
+}// stopAdvertising
+#else
 /**
  * @brief Get the instance of the advertising object.
  * @return A pointer to the advertising object.
@@ -123,6 +205,7 @@ bool Device::startAdvertising(uint32_t duration) {
 bool Device::stopAdvertising() {
   return getAdvertising()->stop();
 }// stopAdvertising
+#endif
 #endif// #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
 
 /**
@@ -164,6 +247,8 @@ Client *Device::createClient(Address peerAddress) {
  * @brief Delete the client object and remove it from the list.\n
  * Checks if it is connected or trying to connect and disconnects/stops it first.
  * @param [in] pClient A pointer to the client object.
+ * @details If notification callbacks of the client are still running the client is deleted when the last one returns,
+ * so this can be called from such a callback.
  */
 /* STATIC */
 bool Device::deleteClient(Client *pClient) {
@@ -200,7 +285,7 @@ bool Device::deleteClient(Client *pClient) {
   }
 
   m_cList.remove(pClient);
-  delete pClient;
+  pClient->release();
 
   return true;
 }// deleteClient
@@ -363,7 +448,7 @@ Address Device::getAddress() {
     ble_hs_id_copy_addr(BLE_ADDR_RANDOM, addr.val, nullptr);
   }
 
-  return {addr};
+  return Address(addr);
 }// getAddress
 
 /**
@@ -473,6 +558,9 @@ int Device::getNumBonds() {
 /*STATIC*/
 void Device::deleteAllBonds() {
   ble_store_clear();
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL) && CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  AttributeCache::eraseAll();
+#endif
 }
 
 /**
@@ -491,6 +579,10 @@ bool Device::deleteBond(const Address &address) {
     return false;
   }
 
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL) && CONFIG_NIMBLE_CPP_CLIENT_ATTRIBUTE_CACHE
+  AttributeCache::erase(address);
+#endif
+
   return true;
 }
 
@@ -531,14 +623,14 @@ Address Device::getBondedAddress(int index) {
 
   rc = ble_store_util_bonded_peers(&peer_id_addrs[0], &num_peers, MYNEWT_VAL(BLE_STORE_MAX_BONDS));
   if (rc != 0) {
-    return nullptr;
+    return Address();
   }
 
   if (index > num_peers || index < 0) {
-    return nullptr;
+    return Address();
   }
 
-  return {peer_id_addrs[index]};
+  return Address(peer_id_addrs[index]);
 }
 #endif
 
@@ -549,13 +641,7 @@ Address Device::getBondedAddress(int index) {
  */
 /*STATIC*/
 bool Device::onWhiteList(const Address &address) {
-  for (auto &it : m_whiteList) {
-    if (it == address) {
-      return true;
-    }
-  }
-
-  return false;
+  return m_whiteListSet.contains(address);
 }
 
 /**
@@ -570,6 +656,7 @@ bool Device::whiteListAdd(const Address &address) {
   }
 
   m_whiteList.push_back(address);
+  m_whiteListSet.insert(address);
   std::vector<ble_addr_t> wlVec;
   wlVec.reserve(m_whiteList.size());
 
@@ -580,7 +667,7 @@ bool Device::whiteListAdd(const Address &address) {
     wlVec.push_back(wlAddr);
   }
 
-  int rc = ble_gap_wl_set(&wlVec[0], wlVec.size());
+  int rc = ble_gap_wl_set(wlVec.data(), wlVec.size());
   if (rc != 0) {
     NIMBLE_LOGE(LOG_TAG, "Failed adding to whitelist rc=%d", rc);
     return false;
@@ -593,6 +680,7 @@ bool Device::whiteListAdd(const Address &address) {
  * @brief Remove a peer address from the whitelist.
  * @param [in] address The address to remove from the whitelist.
  * @returns true if successful.
+ * @details Like onWhiteList() the address is matched on its 6 bytes, whatever its type.
  */
 /*STATIC*/
 bool Device::whiteListRemove(const Address &address) {
@@ -612,7 +700,7 @@ bool Device::whiteListRemove(const Address &address) {
     }
   }
 
-  int rc = ble_gap_wl_set(&wlVec[0], wlVec.size());
+  int rc = ble_gap_wl_set(wlVec.data(), wlVec.size());
   if (rc != 0) {
     NIMBLE_LOGE(LOG_TAG, "Failed removing from whitelist rc=%d", rc);
     return false;
@@ -622,6 +710,7 @@ bool Device::whiteListRemove(const Address &address) {
   for (auto it = m_whiteList.begin(); it < m_whiteList.end(); ++it) {
     if ((*it) == address) {
       m_whiteList.erase(it);
+      m_whiteListSet.erase(address);
       break;
     }
   }
@@ -647,7 +736,7 @@ size_t Device::getWhiteListCount() {
 Address Device::getWhiteListAddress(size_t index) {
   if (index > m_whiteList.size()) {
     NIMBLE_LOGE(LOG_TAG, "Invalid index; %u", index);
-    return nullptr;
+    return Address();
   }
   return m_whiteList[index];
 }
@@ -728,9 +817,78 @@ void Device::hostTask(void *param) {
   /* This function will return only when nimble_port_stop() is executed */
   nimble_port_run();
 
-  nimble_port_freertos_deinit();
+  if (m_customHostTask) {
+    vTaskDelete(nullptr);
+  } else {
+    nimble_port_freertos_deinit();
+  }
 }// host_task
 
+/**
+ * @brief Initialize the %BLE environment with a custom placement of the host task.
+ * @param [in] deviceName The device name of the device.
+ * @param [in] hostTask The core, priority and stack size of the NimBLE host task.
+ * @param [in] taskCore The core of the tasks created by the library, such as the callback workers,
+ * TASK_CORE_OTHER for the core not running the host task or tskNO_AFFINITY.
+ * @details Overrides the Kconfig settings, has no effect if already initialized.
+ */
+/* STATIC */
+void Device::init(const std::string &deviceName, const TaskConfig &hostTask, BaseType_t taskCore) {
+  if (not m_isInitialized) {
+    m_customHostTask = true;
+    m_hostTaskConfig = hostTask;
+    m_taskCore = taskCore;
+  }
+
+  init(deviceName);
+}// init
+
+/**
+ * @brief Get the core running the NimBLE host task.
+ * @return The core number or tskNO_AFFINITY.
+ */
+/* STATIC */
+BaseType_t Device::getHostTaskCore() {
+  if (m_customHostTask) {
+    return validCore(m_hostTaskConfig.core);
+  }
+
+#ifdef CONFIG_BT_NIMBLE_PINNED_TO_CORE
+  return validCore(CONFIG_BT_NIMBLE_PINNED_TO_CORE);
+#else
+  return validCore(0);
+#endif
+}// getHostTaskCore
+
+/**
+ * @brief Get the core the library tasks are pinned to.
+ * @return The core number or tskNO_AFFINITY.
+ * @details With TASK_CORE_OTHER this is the core not running the host task on dual core chips.
+ */
+/* STATIC */
+BaseType_t Device::getTaskCore() {
+  if (m_taskCore != TASK_CORE_OTHER) {
+    return validCore(m_taskCore);
+  }
+
+  BaseType_t hostCore = getHostTaskCore();
+  if (portNUM_PROCESSORS < 2 || hostCore == tskNO_AFFINITY) {
+    return tskNO_AFFINITY;
+  }
+
+  return hostCore == 0 ? 1 : 0;
+}// getTaskCore
+
+/**
+ * @brief Check a core number against the cores of the chip.
+ * @param [in] core The core number.
+ * @return The core number, or tskNO_AFFINITY if the chip does not have this core.
+ */
+/* STATIC */
+BaseType_t Device::validCore(BaseType_t core) {
+  return (core >= 0 && core < portNUM_PROCESSORS) ? core : tskNO_AFFINITY;
+}// validCore
+
 /**
  * @brief Initialize the %BLE environment.
  * @param [in] deviceName The device name of the device.
@@ -773,7 +931,20 @@ void Device::init(const std::string &deviceName) {
 
     ble_store_config_init();
 
-    nimble_port_freertos_init(Device::hostTask);
+#if CONFIG_NIMBLE_CPP_LOG_DEFERRED
+    LogBuffer::start(getTaskCore());
+#endif
+
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+    CallbackDispatcher::start(getTaskCore());
+#endif
+
+    if (m_customHostTask) {
+      xTaskCreatePinnedToCore(Device::hostTask, "nimble_host", m_hostTaskConfig.stackSize, nullptr,
+                              m_hostTaskConfig.priority, nullptr, validCore(m_hostTaskConfig.core));
+    } else {
+      nimble_port_freertos_init(Device::hostTask);
+    }
   }
 
   // Wait for host and controller to sync before returning and accepting new tasks
@@ -795,6 +966,14 @@ void Device::deinit(bool clearAll) {
   if (ret == 0) {
     nimble_port_deinit();
 
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+    CallbackDispatcher::stop();
+#endif
+
+#if CONFIG_NIMBLE_CPP_LOG_DEFERRED
+    LogBuffer::stop();
+#endif
+
     m_isInitialized = false;
     m_isSynced = false;
 
@@ -806,6 +985,13 @@ void Device::deinit(bool clearAll) {
       }
 #endif
 
+#if CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+      if (Device::m_pL2CAPServer != nullptr) {
+        delete Device::m_pL2CAPServer;
+        Device::m_pL2CAPServer = nullptr;
+      }
+#endif
+
 #if defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER)
       if (Device::m_bleAdvertising != nullptr) {
         delete Device::m_bleAdvertising;
@@ -997,13 +1183,7 @@ int Device::startSecurity(uint16_t conn_id) {
  */
 /*STATIC*/
 bool Device::isIgnored(const Address &address) {
-  for (auto &it : m_ignoreList) {
-    if (it.equals(address)) {
-      return true;
-    }
-  }
-
-  return false;
+  return m_ignoreList.contains(address);
 }
 
 /**
@@ -1012,7 +1192,7 @@ bool Device::isIgnored(const Address &address) {
  */
 /*STATIC*/
 void Device::addIgnored(const Address &address) {
-  m_ignoreList.push_back(address);
+  m_ignoreList.insert(address);
 }
 
 /**
@@ -1021,12 +1201,41 @@ void Device::addIgnored(const Address &address) {
  */
 /*STATIC*/
 void Device::removeIgnored(const Address &address) {
-  for (auto it = m_ignoreList.begin(); it != m_ignoreList.end(); ++it) {
-    if ((*it).equals(address)) {
-      m_ignoreList.erase(it);
-      return;
-    }
-  }
+  m_ignoreList.erase(address);
+}
+
+/**
+ * @brief Get the event counters and latency histograms of the library.
+ * @return A copy of the statistics, all zero unless CONFIG_NIMBLE_CPP_STATS is enabled.
+ */
+/*STATIC*/
+DeviceStats Device::getStats() {
+#if CONFIG_NIMBLE_CPP_STATS
+  return Stats::snapshot();
+#else
+  return DeviceStats{};
+#endif
+}
+
+/**
+ * @brief Clear the event counters and latency histograms of the library, and restart the memory peaks.
+ */
+/*STATIC*/
+void Device::resetStats() {
+#if CONFIG_NIMBLE_CPP_STATS
+  Stats::reset();
+  Memory::reset();
+#endif
+}
+
+/**
+ * @brief Get the heap usage of the library by subsystem.
+ * @return The bytes, blocks, peaks and failed allocations of each subsystem, all zero unless
+ * CONFIG_NIMBLE_CPP_STATS is enabled, and the free internal RAM and PSRAM.
+ */
+/*STATIC*/
+MemoryStats Device::getMemoryStats() {
+  return Memory::snapshot();
 }
 
 /**
@@ -0,0 +1,1033 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if (defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_BROADCASTER) && CONFIG_BT_NIMBLE_EXT_ADV)
+
+#include "services/gap/ble_svc_gap.h"
+
+#include "nimble/Device.hpp"
+#include "nimble/ExtAdvertising.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static const char *LOG_TAG = "NimBLEExtAdvertising";
+
+namespace nimble {
+
+static ExtAdvertisingCallbacks defaultCallbacks;
+
+/**
+ * @brief Construct the extended advertising interface.
+ */
+ExtAdvertising::ExtAdvertising() : m_advStatus(CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES + 1)
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+                                   , m_periodicStatus(CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES + 1)
+#endif
+{
+  m_deleteCallbacks = true;
+  m_pCallbacks = &defaultCallbacks;
+}// ExtAdvertising
+
+/**
+ * @brief Destructor, deletes the callbacks if owned.
+ */
+ExtAdvertising::~ExtAdvertising() {
+  if (m_deleteCallbacks && m_pCallbacks != &defaultCallbacks) {
+    delete m_pCallbacks;
+  }
+}// ~ExtAdvertising
+
+/**
+ * @brief Register the extended advertisement data and parameters of an instance.
+ * @param [in] inst_id The extended advertisement instance ID to assign to this data.
+ * @param [in] adv The extended advertisement instance with the data and parameters to set.
+ * @return True if advertising the instance was configured successfully.
+ * @note The data is copied to the controller, the ExtAdvertisement object can be reused afterwards.
+ */
+bool ExtAdvertising::setInstanceData(uint8_t inst_id, ExtAdvertisement &adv) {
+  adv.m_params.sid = inst_id;
+
+  // Legacy advertising as connectable requires the scannable flag also.
+  if (adv.m_params.legacy_pdu && adv.m_params.connectable) {
+    adv.m_params.scannable = true;
+  }
+
+  // If connectable or not scannable disable the callback for scan response requests
+  if (adv.m_params.connectable || !adv.m_params.scannable) {
+    adv.m_params.scan_req_notif = false;
+  }
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+  Server *pServer = Device::getServer();
+  if (pServer != nullptr) {
+    if (!pServer->m_gattsStarted) {
+      pServer->start();
+    }
+  }
+
+  int rc = ble_gap_ext_adv_configure(inst_id,
+                                     &adv.m_params,
+                                     NULL,
+                                     (pServer != nullptr) ? Server::handleGapEvent : ExtAdvertising::handleGapEvent,
+                                     NULL);
+#else
+  int rc = ble_gap_ext_adv_configure(inst_id,
+                                     &adv.m_params,
+                                     NULL,
+                                     ExtAdvertising::handleGapEvent,
+                                     NULL);
+#endif
+
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Advertising config error: rc = %d", rc);
+    return false;
+  }
+
+  if (adv.m_params.scannable && !adv.m_params.legacy_pdu) {
+    // Extended scannable instances carry their data in the scan response only.
+    if (!setData(inst_id, adv.m_payload, true)) {
+      return false;
+    }
+  } else if (!setData(inst_id, adv.m_payload, false)) {
+    return false;
+  }
+
+  if (adv.m_setRandAddr) {
+    rc = ble_gap_ext_adv_set_addr(inst_id, &adv.m_randAddr);
+    if (rc != 0) {
+      NIMBLE_LOGE(LOG_TAG, "Error setting advertisement address: rc = %d", rc);
+      return false;
+    }
+  }
+
+  return true;
+}// setInstanceData
+
+/**
+ * @brief Set the scan response data for a legacy scannable instance.
+ * @param [in] inst_id The extended advertisement instance ID to assign to this data.
+ * @param [in] data The data to be set as the scan response data.
+ * @return True if the scan response data was set successfully.
+ * @note Only applicable to instances configured as scannable.
+ */
+bool ExtAdvertising::setScanResponseData(uint8_t inst_id, ExtAdvertisement &data) {
+  return setData(inst_id, data.m_payload, true);
+}// setScanResponseData
+
+/**
+ * @brief Copy a payload into an mbuf and hand it to the controller for an instance.
+ * @param [in] inst_id The instance ID.
+ * @param [in] payload The encoded advertisement data.
+ * @param [in] scanResponse True to set the scan response data instead of the advertisement data.
+ * @return True if the data was set successfully.
+ */
+bool ExtAdvertising::setData(uint8_t inst_id, const std::vector<uint8_t> &payload, bool scanResponse) {
+  os_mbuf *buf = ble_hs_mbuf_from_flat(payload.data(), payload.size());
+  if (buf == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Data buffer allocation failed");
+    return false;
+  }
+
+  int rc = scanResponse ? ble_gap_ext_adv_rsp_set_data(inst_id, buf) : ble_gap_ext_adv_set_data(inst_id, buf);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Invalid %s data: rc = %d, %s", scanResponse ? "scan response" : "advertisement",
+                rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// setData
+
+/**
+ * @brief Start extended advertising.
+ * @param [in] inst_id The instance ID to start advertising.
+ * @param [in] duration How long to advertise for in milliseconds, 0 = forever (default).
+ * @param [in] max_events Maximum number of advertisement events to send, 0 = no limit (default).
+ * @return True if advertising started successfully.
+ */
+bool ExtAdvertising::start(uint8_t inst_id, int duration, int max_events) {
+  NIMBLE_LOGD(LOG_TAG, ">> Extended Advertising start");
+
+  // If Host is not synced we cannot start advertising.
+  if (!Device::m_isSynced) {
+    NIMBLE_LOGE(LOG_TAG, "Host reset, wait for sync.");
+    return false;
+  }
+
+  int rc = ble_gap_ext_adv_start(inst_id, duration / 10, max_events);
+
+  switch (rc) {
+  case 0:
+    m_advStatus[inst_id] = true;
+    break;
+
+  case BLE_HS_EINVAL:
+    NIMBLE_LOGE(LOG_TAG, "Unable to advertise - Value Error");
+    break;
+
+  case BLE_HS_EALREADY:
+    NIMBLE_LOGI(LOG_TAG, "Advertisement Already active");
+    break;
+
+  case BLE_HS_ETIMEOUT_HCI:
+  case BLE_HS_EOS:
+  case BLE_HS_ECONTROLLER:
+  case BLE_HS_ENOTSYNCED:
+    NIMBLE_LOGE(LOG_TAG, "Unable to advertise - Host Reset");
+    break;
+
+  default:
+    NIMBLE_LOGE(LOG_TAG, "Error enabling advertising; rc=%d, %s",
+                rc, Utils::returnCodeToString(rc));
+    break;
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "<< Extended Advertising start");
+  return (rc == 0 || rc == BLE_HS_EALREADY);
+}// start
+
+/**
+ * @brief Stop and remove this instance data from the advertisement set.
+ * @param [in] inst_id The extended advertisement instance to remove.
+ * @return True if successful.
+ * @note The instance must be configured again with setInstanceData() before it can be restarted.
+ */
+bool ExtAdvertising::removeInstance(uint8_t inst_id) {
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+  if (m_periodicStatus[inst_id] && !stopPeriodic(inst_id)) {
+    return false;
+  }
+#endif
+
+  if (stop(inst_id)) {
+    int rc = ble_gap_ext_adv_remove(inst_id);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+      NIMBLE_LOGE(LOG_TAG, "ble_gap_ext_adv_remove rc = %d %s",
+                  rc, Utils::returnCodeToString(rc));
+      return false;
+    }
+    return true;
+  }
+
+  return false;
+}// removeInstance
+
+/**
+ * @brief Stop and remove all advertising instance data.
+ * @return True if successful.
+ */
+bool ExtAdvertising::removeAll() {
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+  for (uint8_t i = 0; i < m_periodicStatus.size(); i++) {
+    if (m_periodicStatus[i] && !stopPeriodic(i)) {
+      return false;
+    }
+  }
+#endif
+
+  if (stop()) {
+    int rc = ble_gap_ext_adv_clear();
+    if (rc == 0 || rc == BLE_HS_EALREADY) {
+      return true;
+    }
+
+    NIMBLE_LOGE(LOG_TAG, "ble_gap_ext_adv_clear rc = %d %s",
+                rc, Utils::returnCodeToString(rc));
+  }
+
+  return false;
+}// removeAll
+
+/**
+ * @brief Stop advertising this instance data.
+ * @param [in] inst_id The extended advertisement instance to stop advertising.
+ * @return True if successful.
+ */
+bool ExtAdvertising::stop(uint8_t inst_id) {
+  int rc = ble_gap_ext_adv_stop(inst_id);
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gap_ext_adv_stop rc = %d %s",
+                rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  m_advStatus[inst_id] = false;
+  return true;
+}// stop
+
+/**
+ * @brief Stop all advertisements.
+ * @return True if successful.
+ */
+bool ExtAdvertising::stop() {
+  bool ok = true;
+
+  for (uint8_t i = 0; i < m_advStatus.size(); i++) {
+    if (m_advStatus[i] && !stop(i)) {
+      ok = false;
+    }
+  }
+
+  return ok;
+}// stop
+
+/**
+ * @brief Set a callback to call when the advertisement stops.
+ * @param [in] pCallbacks A pointer to a callback function to be invoked when advertising stops.
+ * @param [in] deleteCallbacks If true callback class will be destroyed when advertising is destroyed.
+ */
+void ExtAdvertising::setCallbacks(ExtAdvertisingCallbacks *pCallbacks, bool deleteCallbacks) {
+  if (pCallbacks != nullptr) {
+    m_pCallbacks = pCallbacks;
+    m_deleteCallbacks = deleteCallbacks;
+  } else {
+    m_pCallbacks = &defaultCallbacks;
+  }
+}// setCallbacks
+
+/**
+ * @brief Check if currently advertising.
+ * @param [in] inst_id The instance ID of the advertised data to get the status of.
+ * @return True if advertising is active.
+ */
+bool ExtAdvertising::isActive(uint8_t inst_id) {
+  return m_advStatus[inst_id];
+}// isActive
+
+/**
+ * @brief Check if any instances are currently being advertised.
+ * @return True if any instance is active.
+ */
+bool ExtAdvertising::isAdvertising() {
+  for (auto it : m_advStatus) {
+    if (it) {
+      return true;
+    }
+  }
+
+  return false;
+}// isAdvertising
+
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+/**
+ * @brief Set the periodic advertising parameters of an instance.
+ * @param [in] inst_id The instance ID, already configured with setInstanceData().
+ * @param [in] minInterval The minimum periodic interval in 1.25ms units, 6 (7.5ms) to 65535 (81.9s).
+ * @param [in] maxInterval The maximum periodic interval in 1.25ms units.
+ * @param [in] includeTxPower If true the Tx power is included in the periodic advertising PDUs.
+ * @return True if the parameters were set.
+ * @note The instance must use extended PDUs and be neither connectable, scannable nor anonymous.
+ */
+bool ExtAdvertising::setPeriodicParams(uint8_t inst_id, uint16_t minInterval, uint16_t maxInterval, bool includeTxPower) {
+  ble_gap_periodic_adv_params params;
+  memset(&params, 0, sizeof(params));
+  params.itvl_min = minInterval;
+  params.itvl_max = maxInterval;
+  params.include_tx_power = includeTxPower;
+
+  int rc = ble_gap_periodic_adv_configure(inst_id, &params);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Periodic advertising config error: rc = %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// setPeriodicParams
+
+/**
+ * @brief Set the periodic advertising data of an instance.
+ * @param [in] inst_id The instance ID, configured with setPeriodicParams().
+ * @param [in] data The data to advertise, up to BLE_EXT_ADV_MAX_SIZE bytes.
+ * @return True if the data was set.
+ * @details The data can be updated while the periodic advertising is running, synchronized
+ * listeners receive the new data from the next periodic event.
+ */
+bool ExtAdvertising::setPeriodicData(uint8_t inst_id, ExtAdvertisement &data) {
+  os_mbuf *buf = ble_hs_mbuf_from_flat(data.m_payload.data(), data.m_payload.size());
+  if (buf == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Data buffer allocation failed");
+    return false;
+  }
+
+#if CONFIG_BT_NIMBLE_PERIODIC_ADV_ENH
+  ble_gap_periodic_adv_set_data_params params;
+  memset(&params, 0, sizeof(params));
+  int rc = ble_gap_periodic_adv_set_data(inst_id, buf, &params);
+#else
+  int rc = ble_gap_periodic_adv_set_data(inst_id, buf);
+#endif
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Invalid periodic advertisement data: rc = %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// setPeriodicData
+
+/**
+ * @brief Start periodic advertising of an instance.
+ * @param [in] inst_id The instance ID, configured with setPeriodicParams().
+ * @return True if periodic advertising started.
+ * @note Listeners find the periodic train through the extended advertising of the same
+ * instance, so the instance must also be started with start().
+ */
+bool ExtAdvertising::startPeriodic(uint8_t inst_id) {
+  if (!Device::m_isSynced) {
+    NIMBLE_LOGE(LOG_TAG, "Host reset, wait for sync.");
+    return false;
+  }
+
+#if CONFIG_BT_NIMBLE_PERIODIC_ADV_ENH
+  ble_gap_periodic_adv_start_params params;
+  memset(&params, 0, sizeof(params));
+  int rc = ble_gap_periodic_adv_start(inst_id, &params);
+#else
+  int rc = ble_gap_periodic_adv_start(inst_id);
+#endif
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "Error enabling periodic advertising; rc=%d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  m_periodicStatus[inst_id] = true;
+  return true;
+}// startPeriodic
+
+/**
+ * @brief Stop periodic advertising of an instance.
+ * @param [in] inst_id The instance ID.
+ * @return True if successful.
+ */
+bool ExtAdvertising::stopPeriodic(uint8_t inst_id) {
+  int rc = ble_gap_periodic_adv_stop(inst_id);
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gap_periodic_adv_stop rc = %d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  m_periodicStatus[inst_id] = false;
+  return true;
+}// stopPeriodic
+
+/**
+ * @brief Check if periodic advertising is active.
+ * @param [in] inst_id The instance ID.
+ * @return True if the instance is periodically advertising.
+ */
+bool ExtAdvertising::isPeriodicActive(uint8_t inst_id) {
+  return m_periodicStatus[inst_id];
+}// isPeriodicActive
+#endif
+
+/*
+ * Host reset seems to clear advertising data,
+ * we need clear the flag so it reloads it.
+ */
+void ExtAdvertising::onHostSync() {
+  NIMBLE_LOGD(LOG_TAG, "Host re-synced");
+  std::fill(m_advStatus.begin(), m_advStatus.end(), false);
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+  std::fill(m_periodicStatus.begin(), m_periodicStatus.end(), false);
+#endif
+}// onHostSync
+
+/**
+ * @brief Handler for gap events when not using peripheral role.
+ * @param [in] event the event data.
+ * @param [in] arg pointer to the advertising instance.
+ */
+/*STATIC*/
+int ExtAdvertising::handleGapEvent(struct ble_gap_event *event, void *arg) {
+  (void) arg;
+  ExtAdvertising *pAdv = Device::getAdvertising();
+
+  switch (event->type) {
+  case BLE_GAP_EVENT_ADV_COMPLETE: {
+    switch (event->adv_complete.reason) {
+    // Don't call the callback if host reset, we want to
+    // preserve the active flag until re-sync to restart advertising.
+    case BLE_HS_ETIMEOUT_HCI:
+    case BLE_HS_EOS:
+    case BLE_HS_ECONTROLLER:
+    case BLE_HS_ENOTSYNCED:
+      NIMBLE_LOGC(LOG_TAG, "host reset, rc = %d", event->adv_complete.reason);
+      Device::onReset(event->adv_complete.reason);
+      return 0;
+    default:
+      break;
+    }
+
+    pAdv->m_advStatus[event->adv_complete.instance] = false;
+    pAdv->m_pCallbacks->onStopped(pAdv, event->adv_complete.reason, event->adv_complete.instance);
+    break;
+  }
+
+  case BLE_GAP_EVENT_SCAN_REQ_RCVD: {
+    pAdv->m_pCallbacks->onScanRequest(pAdv, event->scan_req_rcvd.instance,
+                                      Address(event->scan_req_rcvd.scan_addr));
+    break;
+  }
+  }
+
+  return 0;
+}// handleGapEvent
+
+/**
+ * @brief Construct a BLE extended advertisement.
+ * @param [in] priPhy The primary Phy to advertise on, can be one of:
+ * * BLE_HCI_LE_PHY_1M    (1Mbit)
+ * * BLE_HCI_LE_PHY_CODED (Coded, long range)
+ *
+ * @param [in] secPhy The secondary Phy to advertise on, can be one of:
+ * * BLE_HCI_LE_PHY_1M    (1Mbit)
+ * * BLE_HCI_LE_PHY_2M    (2Mbit)
+ * * BLE_HCI_LE_PHY_CODED (Coded, long range)
+ */
+ExtAdvertisement::ExtAdvertisement(uint8_t priPhy, uint8_t secPhy) {
+  memset(&m_params, 0, sizeof(m_params));
+  memset(&m_dirAddr, 0, sizeof(m_dirAddr));
+  memset(&m_randAddr, 0, sizeof(m_randAddr));
+  m_setRandAddr = false;
+
+  m_params.own_addr_type = Device::m_own_addr_type;
+  m_params.primary_phy = priPhy;
+  m_params.secondary_phy = secPhy;
+  m_params.tx_power = 127;
+}// ExtAdvertisement
+
+/**
+ * @brief Sets wether the advertisement should use legacy (BLE 4.0, 31 bytes max) advertising.
+ * @param [in] val true = using legacy advertising.
+ */
+void ExtAdvertisement::setLegacyAdvertising(bool val) {
+  m_params.legacy_pdu = val;
+}// setLegacyAdvertising
+
+/**
+ * @brief Sets wether this advertisement can be connected to or not.
+ * @param [in] val True = connectable.
+ * @note An extended advertisement cannot be both connectable and scannable.
+ */
+void ExtAdvertisement::setConnectable(bool val) {
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+  m_params.connectable = val;
+#else
+  (void) val;
+#endif
+}// setConnectable
+
+/**
+ * @brief Set the advertisement to be scannable, the payload is then sent as the scan response.
+ * @param [in] val True = scannable.
+ * @note An extended advertisement cannot be both connectable and scannable.
+ */
+void ExtAdvertisement::setScannable(bool val) {
+  m_params.scannable = val;
+}// setScannable
+
+/**
+ * @brief Set the minimum advertising interval.
+ * @param [in] mininterval Minimum value for advertising interval in 0.625ms units, 0 = use default.
+ */
+void ExtAdvertisement::setMinInterval(uint32_t mininterval) {
+  m_params.itvl_min = mininterval;
+}// setMinInterval
+
+/**
+ * @brief Set the maximum advertising interval.
+ * @param [in] maxinterval Maximum value for advertising interval in 0.625ms units, 0 = use default.
+ */
+void ExtAdvertisement::setMaxInterval(uint32_t maxinterval) {
+  m_params.itvl_max = maxinterval;
+}// setMaxInterval
+
+/**
+ * @brief Set the primary physical layer to use for this advertisement.
+ * @param [in] phy The physical layer to use, can be one of:
+ * * BLE_HCI_LE_PHY_1M    (1Mbit)
+ * * BLE_HCI_LE_PHY_CODED (Coded, long range)
+ */
+void ExtAdvertisement::setPrimaryPhy(uint8_t phy) {
+  m_params.primary_phy = phy;
+}// setPrimaryPhy
+
+/**
+ * @brief Set the secondary physical layer to use for this advertisement.
+ * @param [in] phy The physical layer to use, can be one of:
+ * * BLE_HCI_LE_PHY_1M    (1Mbit)
+ * * BLE_HCI_LE_PHY_2M    (2Mbit)
+ * * BLE_HCI_LE_PHY_CODED (Coded, long range)
+ */
+void ExtAdvertisement::setSecondaryPhy(uint8_t phy) {
+  m_params.secondary_phy = phy;
+}// setSecondaryPhy
+
+/**
+ * @brief Set the filtering for the scan filter.
+ * @param [in] scanRequestWhitelistOnly If true, only allow scan requests from those on the white list.
+ * @param [in] connectWhitelistOnly If true, only allow connections from those on the white list.
+ */
+void ExtAdvertisement::setScanFilter(bool scanRequestWhitelistOnly, bool connectWhitelistOnly) {
+  if (!scanRequestWhitelistOnly && !connectWhitelistOnly) {
+    m_params.filter_policy = BLE_HCI_ADV_FILT_NONE;
+    return;
+  }
+  if (scanRequestWhitelistOnly && !connectWhitelistOnly) {
+    m_params.filter_policy = BLE_HCI_ADV_FILT_SCAN;
+    return;
+  }
+  if (!scanRequestWhitelistOnly && connectWhitelistOnly) {
+    m_params.filter_policy = BLE_HCI_ADV_FILT_CONN;
+    return;
+  }
+  if (scanRequestWhitelistOnly && connectWhitelistOnly) {
+    m_params.filter_policy = BLE_HCI_ADV_FILT_BOTH;
+    return;
+  }
+}// setScanFilter
+
+/**
+ * @brief Sets the peer to directly advertise to.
+ * @param [in] addr The address of the peer to direct the advertisements.
+ */
+void ExtAdvertisement::setDirectedPeer(const Address &addr) {
+  memcpy(&m_dirAddr.val, addr.getNative(), 6);
+  m_dirAddr.type = addr.getType();
+  m_params.peer = m_dirAddr;
+}// setDirectedPeer
+
+/**
+ * @brief Enable or disable direct advertisements to the peer set with setDirectedPeer.
+ * @param [in] val true = send directed advertisements to peer.
+ * @param [in] high_duty true = use fast advertising rate, default - true.
+ */
+void ExtAdvertisement::setDirected(bool val, bool high_duty) {
+  m_params.directed = val;
+  m_params.high_duty_directed = high_duty;
+}// setDirected
+
+/**
+ * @brief Set the advertising to be sent without the advertiser's address.
+ * @param [in] val True = anonymous advertising, only allowed for non-legacy, non-connectable instances.
+ */
+void ExtAdvertisement::setAnonymous(bool val) {
+  m_params.anonymous = val;
+}// setAnonymous
+
+/**
+ * @brief Set which advertising channels should be used.
+ * @param [in] ch37 true = use channel 37.
+ * @param [in] ch38 true = use channel 38.
+ * @param [in] ch39 true = use channel 39.
+ */
+void ExtAdvertisement::setPrimaryChannels(bool ch37, bool ch38, bool ch39) {
+  m_params.channel_map = (ch37 | (ch38 << 1) | (ch39 << 2));
+}// setPrimaryChannels
+
+/**
+ * @brief Set the transmission power level for the advertisement.
+ * @param [in] dbm The transmit power in dBm, 127 = no preference (default).
+ */
+void ExtAdvertisement::setTxPower(int8_t dbm) {
+  m_params.tx_power = dbm;
+}// setTxPower
+
+/**
+ * @brief Set the random address for this advertisement instance.
+ * @param [in] addr The random address to use, must be of type BLE_ADDR_RANDOM.
+ */
+void ExtAdvertisement::setAddress(const Address &addr) {
+  if (addr.getType() != BLE_ADDR_RANDOM) {
+    NIMBLE_LOGE(LOG_TAG, "Only random addresses can be set per instance");
+    return;
+  }
+
+  memcpy(&m_randAddr.val, addr.getNative(), 6);
+  m_randAddr.type = BLE_ADDR_RANDOM;
+  m_setRandAddr = true;
+  m_params.own_addr_type = BLE_OWN_ADDR_RANDOM;
+}// setAddress
+
+/**
+ * @brief Enable or disable scan request notifications, see ExtAdvertisingCallbacks::onScanRequest.
+ * @param [in] enable True = notify on scan requests.
+ */
+void ExtAdvertisement::enableScanRequestCallback(bool enable) {
+  m_params.scan_req_notif = enable;
+}// enableScanRequestCallback
+
+/**
+ * @brief Replace the advertisement payload with raw, already encoded, data.
+ * @param [in] data A pointer to the data.
+ * @param [in] length The length of the data.
+ * @return True if the data fits in an extended advertisement.
+ */
+bool ExtAdvertisement::setData(const uint8_t *data, size_t length) {
+  if (length > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.assign(data, data + length);
+  return true;
+}// setData
+
+/**
+ * @brief Add data to the payload to be advertised.
+ * @param [in] data The data to be added to the payload.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::addData(const std::string &data) {
+  return addData((const uint8_t *) data.data(), data.length());
+}// addData
+
+/**
+ * @brief Add data to the payload to be advertised.
+ * @param [in] data A pointer to the data to be added to the payload.
+ * @param [in] length The size of data to be added to the payload.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::addData(const uint8_t *data, size_t length) {
+  if ((m_payload.size() + length) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.insert(m_payload.end(), data, data + length);
+  return true;
+}// addData
+
+/**
+ * @brief Clear the advertisement data.
+ */
+void ExtAdvertisement::clearData() {
+  std::vector<uint8_t>().swap(m_payload);
+}// clearData
+
+/**
+ * @brief Get the size of the current data.
+ * @return The length of the encoded payload.
+ */
+size_t ExtAdvertisement::getDataSize() const {
+  return m_payload.size();
+}// getDataSize
+
+/**
+ * @brief Retrieve the payload that is to be advertised.
+ * @return The payload that is to be advertised.
+ */
+const std::vector<uint8_t> &ExtAdvertisement::getPayload() const {
+  return m_payload;
+}// getPayload
+
+/**
+ * @brief Set the appearance.
+ * @param [in] appearance The appearance code value.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setAppearance(uint16_t appearance) {
+  uint8_t cdata[4];
+  cdata[0] = 3;
+  cdata[1] = BLE_HS_ADV_TYPE_APPEARANCE;// 0x19
+  cdata[2] = appearance;
+  cdata[3] = appearance >> 8;
+  return addData(cdata, 4);
+}// setAppearance
+
+/**
+ * @brief Set the advertisement flags.
+ * @param [in] flag The flags to be set in the advertisement.
+ * * BLE_HS_ADV_F_DISC_LTD
+ * * BLE_HS_ADV_F_DISC_GEN
+ * * BLE_HS_ADV_F_BREDR_UNSUP - must always use with NimBLE
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setFlags(uint8_t flag) {
+  uint8_t cdata[3];
+  cdata[0] = 2;
+  cdata[1] = BLE_HS_ADV_TYPE_FLAGS;// 0x01
+  cdata[2] = flag | BLE_HS_ADV_F_BREDR_UNSUP;
+  return addData(cdata, 3);
+}// setFlags
+
+/**
+ * @brief Set manufacturer specific data.
+ * @param [in] data The manufacturer data to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setManufacturerData(const std::string &data) {
+  return setManufacturerData(std::vector<uint8_t>(data.begin(), data.end()));
+}// setManufacturerData
+
+/**
+ * @brief Set manufacturer specific data.
+ * @param [in] data The manufacturer data to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setManufacturerData(const std::vector<uint8_t> &data) {
+  if (data.size() > 254 || (m_payload.size() + data.size() + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.push_back(data.size() + 1);
+  m_payload.push_back(BLE_HS_ADV_TYPE_MFG_DATA);// 0xff
+  m_payload.insert(m_payload.end(), data.begin(), data.end());
+  return true;
+}// setManufacturerData
+
+/**
+ * @brief Set the URI to advertise.
+ * @param [in] uri The uri to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setURI(const std::string &uri) {
+  if (uri.length() > 254 || (m_payload.size() + uri.length() + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.push_back(uri.length() + 1);
+  m_payload.push_back(BLE_HS_ADV_TYPE_URI);
+  m_payload.insert(m_payload.end(), uri.begin(), uri.end());
+  return true;
+}// setURI
+
+/**
+ * @brief Set the complete name of this device.
+ * @param [in] name The name to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setName(const std::string &name) {
+  if (name.length() > 254 || (m_payload.size() + name.length() + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.push_back(name.length() + 1);
+  m_payload.push_back(BLE_HS_ADV_TYPE_COMP_NAME);// 0x09
+  m_payload.insert(m_payload.end(), name.begin(), name.end());
+  return true;
+}// setName
+
+/**
+ * @brief Set the short name.
+ * @param [in] name The short name of the device.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setShortName(const std::string &name) {
+  if (name.length() > 254 || (m_payload.size() + name.length() + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.push_back(name.length() + 1);
+  m_payload.push_back(BLE_HS_ADV_TYPE_INCOMP_NAME);// 0x08
+  m_payload.insert(m_payload.end(), name.begin(), name.end());
+  return true;
+}// setShortName
+
+/**
+ * @brief Set a single service to advertise as a complete list of services.
+ * @param [in] uuid The service to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setCompleteServices(const UUID &uuid) {
+  return setServices(true, uuid.bitSize(), {uuid});
+}// setCompleteServices
+
+/**
+ * @brief Set the complete list of 16 bit services to advertise.
+ * @param [in] v_uuid A vector of 16 bit UUID's to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setCompleteServices16(const std::vector<UUID> &v_uuid) {
+  return setServices(true, 16, v_uuid);
+}// setCompleteServices16
+
+/**
+ * @brief Set the complete list of 32 bit services to advertise.
+ * @param [in] v_uuid A vector of 32 bit UUID's to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setCompleteServices32(const std::vector<UUID> &v_uuid) {
+  return setServices(true, 32, v_uuid);
+}// setCompleteServices32
+
+/**
+ * @brief Set a single service to advertise as a partial list of services.
+ * @param [in] uuid The service to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setPartialServices(const UUID &uuid) {
+  return setServices(false, uuid.bitSize(), {uuid});
+}// setPartialServices
+
+/**
+ * @brief Set the partial list of 16 bit services to advertise.
+ * @param [in] v_uuid A vector of 16 bit UUID's to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setPartialServices16(const std::vector<UUID> &v_uuid) {
+  return setServices(false, 16, v_uuid);
+}// setPartialServices16
+
+/**
+ * @brief Set the partial list of 32 bit services to advertise.
+ * @param [in] v_uuid A vector of 32 bit UUID's to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setPartialServices32(const std::vector<UUID> &v_uuid) {
+  return setServices(false, 32, v_uuid);
+}// setPartialServices32
+
+/**
+ * @brief Utility function to create the list of service UUID's from a vector.
+ * @param [in] complete If true the vector is the complete set of services.
+ * @param [in] size The bit size of the UUID's in the vector. (16, 32, or 128).
+ * @param [in] v_uuid The vector of service UUID's to advertise.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setServices(const bool complete, const uint8_t size, const std::vector<UUID> &v_uuid) {
+  uint8_t type;
+  switch (size) {
+  case 16:
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS16 : BLE_HS_ADV_TYPE_INCOMP_UUIDS16;
+    break;
+  case 32:
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS32 : BLE_HS_ADV_TYPE_INCOMP_UUIDS32;
+    break;
+  case 128:
+    type = complete ? BLE_HS_ADV_TYPE_COMP_UUIDS128 : BLE_HS_ADV_TYPE_INCOMP_UUIDS128;
+    break;
+  default:
+    return false;
+  }
+
+  size_t bytes = (size / 8) * v_uuid.size();
+  if (bytes > 254 || (m_payload.size() + bytes + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  for (auto &it : v_uuid) {
+    if (it.bitSize() != size) {
+      NIMBLE_LOGE(LOG_TAG, "Service UUID(%d) invalid", size);
+      return false;
+    }
+  }
+
+  m_payload.push_back(bytes + 1);
+  m_payload.push_back(type);
+
+  for (auto &it : v_uuid) {
+    const uint8_t *value;
+    switch (size) {
+    case 16:
+      value = (const uint8_t *) &it.getNative()->u16.value;
+      break;
+    case 32:
+      value = (const uint8_t *) &it.getNative()->u32.value;
+      break;
+    default:
+      value = it.getNative()->u128.value;
+      break;
+    }
+    m_payload.insert(m_payload.end(), value, value + size / 8);
+  }
+
+  return true;
+}// setServices
+
+/**
+ * @brief Set the service data (UUID + data)
+ * @param [in] uuid The UUID to set with the service data.
+ * @param [in] data The data to be associated with the service data advertised.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setServiceData(const UUID &uuid, const std::string &data) {
+  uint8_t type;
+  const uint8_t *value;
+  uint8_t uuidLen = uuid.bitSize() / 8;
+
+  switch (uuid.bitSize()) {
+  case 16:
+    // [Len] [0x16] [UUID16] data
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID16;// 0x16
+    value = (const uint8_t *) &uuid.getNative()->u16.value;
+    break;
+  case 32:
+    // [Len] [0x20] [UUID32] data
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID32;// 0x20
+    value = (const uint8_t *) &uuid.getNative()->u32.value;
+    break;
+  case 128:
+    // [Len] [0x21] [UUID128] data
+    type = BLE_HS_ADV_TYPE_SVC_DATA_UUID128;// 0x21
+    value = uuid.getNative()->u128.value;
+    break;
+  default:
+    return false;
+  }
+
+  size_t bytes = uuidLen + data.length();
+  if (bytes > 254 || (m_payload.size() + bytes + 2) > BLE_EXT_ADV_MAX_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Advertisement data length exceeded");
+    return false;
+  }
+
+  m_payload.push_back(bytes + 1);
+  m_payload.push_back(type);
+  m_payload.insert(m_payload.end(), value, value + uuidLen);
+  m_payload.insert(m_payload.end(), data.begin(), data.end());
+  return true;
+}// setServiceData
+
+/**
+ * @brief Adds Tx power level to the advertisement data.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::addTxPower() {
+  uint8_t cdata[3];
+  cdata[0] = BLE_HS_ADV_TX_PWR_LVL_LEN + 1;
+  cdata[1] = BLE_HS_ADV_TYPE_TX_PWR_LVL;
+  cdata[2] = Device::getPower();
+  return addData(cdata, 3);
+}// addTxPower
+
+/**
+ * @brief Set the preferred connection interval parameters.
+ * @param [in] min The minimum interval desired.
+ * @param [in] max The maximum interval desired.
+ * @return True if the data was added.
+ */
+bool ExtAdvertisement::setPreferredParams(uint16_t min, uint16_t max) {
+  uint8_t cdata[6];
+  cdata[0] = BLE_HS_ADV_SLAVE_ITVL_RANGE_LEN + 1;
+  cdata[1] = BLE_HS_ADV_TYPE_SLAVE_ITVL_RANGE;
+  cdata[2] = min;
+  cdata[3] = min >> 8;
+  cdata[4] = max;
+  cdata[5] = max >> 8;
+  return addData(cdata, 6);
+}// setPreferredParams
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_BROADCASTER && CONFIG_BT_NIMBLE_EXT_ADV */
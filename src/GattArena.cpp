@@ -0,0 +1,122 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "nimble/GattArena.hpp"
+
+#include <cstring>
+
+#include "nimble/Log.hpp"
+#include "nimble/Memory.hpp"
+
+static const char *LOG_TAG = "NimBLEGattArena";
+
+namespace nimble {
+
+/**
+ * @brief Destructor, releases the block.
+ */
+GattArena::~GattArena() {
+  release();
+}// ~GattArena
+
+/**
+ * @brief Allocate the block, releasing any previous one.
+ * @param [in] size The size of the block in bytes.
+ * @return True if the block was allocated.
+ * @details Memory previously allocated from the arena must no longer be in use.
+ */
+bool GattArena::reserve(size_t size) {
+  release();
+
+  if (size == 0) {
+    return true;
+  }
+
+  m_pBuf = (uint8_t *) Memory::allocate(Memory::SERVER, size);
+  if (m_pBuf == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Failed to allocate %d bytes", size);
+    return false;
+  }
+
+  m_size = size;
+  NIMBLE_LOGD(LOG_TAG, "Reserved %d bytes", size);
+  return true;
+}// reserve
+
+/**
+ * @brief Allocate zero initialized memory from the block.
+ * @param [in] size The size in bytes.
+ * @param [in] align The required alignment, must be a power of 2.
+ * @return A pointer to the memory or nullptr if the block does not have enough space left.
+ */
+void *GattArena::allocate(size_t size, size_t align) {
+  if (m_pBuf == nullptr) {
+    return nullptr;
+  }
+
+  uintptr_t base = (uintptr_t) m_pBuf;
+  uintptr_t start = (base + m_used + align - 1) & ~(uintptr_t) (align - 1);
+  size_t end = (size_t) (start - base) + size;
+
+  if (end > m_size) {
+    NIMBLE_LOGD(LOG_TAG, "Arena full, %d bytes requested, %d free", size, m_size - m_used);
+    return nullptr;
+  }
+
+  m_used = end;
+  memset((void *) start, 0, size);
+  return (void *) start;
+}// allocate
+
+/**
+ * @brief Free the block and everything allocated from it.
+ */
+void GattArena::release() {
+  Memory::release(Memory::SERVER, m_pBuf, m_size);
+  m_pBuf = nullptr;
+  m_size = 0;
+  m_used = 0;
+}// release
+
+/**
+ * @brief Check if memory was allocated from this arena.
+ * @param [in] ptr A pointer to the memory.
+ * @return True if the pointer is inside the block.
+ */
+bool GattArena::owns(const void *ptr) const {
+  return m_pBuf != nullptr && ptr >= m_pBuf && ptr < m_pBuf + m_size;
+}// owns
+
+/**
+ * @brief Get the size of the block.
+ * @return The size in bytes, 0 if no block is reserved.
+ */
+size_t GattArena::capacity() const {
+  return m_size;
+}// capacity
+
+/**
+ * @brief Get how much of the block is allocated.
+ * @return The number of bytes allocated, including alignment padding.
+ */
+size_t GattArena::used() const {
+  return m_used;
+}// used
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
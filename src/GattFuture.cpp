@@ -0,0 +1,323 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+
+#include "nimble/GattFuture.hpp"
+
+#include <climits>
+
+#include <freertos/task.h>
+#include <host/ble_att.h>
+#include <host/ble_hs.h>
+
+#include "nimble/Log.hpp"
+#include "nimble/Utils.hpp"
+
+static const char *LOG_TAG = "NimBLEGattFuture";
+
+namespace nimble {
+
+/**
+ * @brief Shared state of an asynchronous operation.
+ * @details While the operation is pending the state holds a reference to itself so that it
+ * outlives every GattFuture handle, the reference is dropped when the operation completes.
+ */
+struct GattFuture::State {
+  std::shared_ptr<State> self;
+  gatt_complete_callback callback;
+  AttributeValue value;
+  TaskHandle_t waiter = nullptr;
+  volatile bool done = false;
+  int rc = BLE_HS_EBUSY;
+  uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;
+  uint16_t attrHandle = 0;
+  uint16_t mtu = 0;
+};
+
+/**
+ * @brief Construct a handle to an operation.
+ * @param [in] state The shared state of the operation.
+ */
+GattFuture::GattFuture(std::shared_ptr<State> state) : m_state(std::move(state)) {
+}// GattFuture
+
+/**
+ * @brief Check if this handle refers to an operation.
+ * @return True if the handle was returned by an asynchronous operation.
+ */
+bool GattFuture::valid() const {
+  return m_state != nullptr;
+}// valid
+
+/**
+ * @brief Check if the operation has completed.
+ * @return True if the operation completed, successfully or not.
+ */
+bool GattFuture::isDone() const {
+  return m_state != nullptr && m_state->done;
+}// isDone
+
+/**
+ * @brief Get the result code of the operation.
+ * @return 0 on success, BLE_HS_EBUSY while the operation is pending or a NimBLE error code.
+ */
+int GattFuture::getRc() const {
+  if (m_state == nullptr) {
+    return BLE_HS_EINVAL;
+  }
+
+  return m_state->done ? m_state->rc : BLE_HS_EBUSY;
+}// getRc
+
+/**
+ * @brief Get the value read by the operation.
+ * @return The value read, empty for writes or while the operation is pending.
+ */
+const AttributeValue &GattFuture::getValue() const {
+  static const AttributeValue empty;
+
+  if (m_state == nullptr || !m_state->done) {
+    return empty;
+  }
+
+  return m_state->value;
+}// getValue
+
+/**
+ * @brief Block the calling task until the operation completes.
+ * @param [in] timeout The maximum number of ticks to wait.
+ * @return True if the operation completed within the timeout.
+ * @details Must not be called from the NimBLE host task as the operation completes there.
+ */
+bool GattFuture::wait(TickType_t timeout) const {
+  if (m_state == nullptr) {
+    return false;
+  }
+
+  TaskHandle_t cur_task = xTaskGetCurrentTaskHandle();
+
+#ifdef ulTaskNotifyValueClear
+  // Clear the task notification value to ensure we block
+  ulTaskNotifyValueClear(cur_task, ULONG_MAX);
+#endif
+
+  ble_npl_hw_enter_critical();
+  if (m_state->done) {
+    ble_npl_hw_exit_critical(0);
+    return true;
+  }
+  m_state->waiter = cur_task;
+  ble_npl_hw_exit_critical(0);
+
+  ulTaskNotifyTake(pdTRUE, timeout);
+
+  ble_npl_hw_enter_critical();
+  m_state->waiter = nullptr;
+  bool done = m_state->done;
+  ble_npl_hw_exit_critical(0);
+
+  return done;
+}// wait
+
+/**
+ * @brief Create an operation that failed before it could be started.
+ * @param [in] rc The error code.
+ * @param [in] callback The completion callback, called before returning.
+ * @return A completed handle holding the error code.
+ */
+/*STATIC*/
+GattFuture GattFuture::failed(int rc, gatt_complete_callback callback) {
+  auto state = std::make_shared<State>();
+  state->callback = std::move(callback);
+  complete(state.get(), rc);
+  return GattFuture(state);
+}// failed
+
+/**
+ * @brief Start an asynchronous long read of an attribute.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [in] attr_handle The handle of the attribute to read.
+ * @param [in] callback The completion callback.
+ * @return A handle to the operation.
+ */
+/*STATIC*/
+GattFuture GattFuture::read(uint16_t conn_handle, uint16_t attr_handle, gatt_complete_callback callback) {
+  auto state = std::make_shared<State>();
+  state->callback = std::move(callback);
+  state->connHandle = conn_handle;
+  state->attrHandle = attr_handle;
+  state->self = state;
+
+  int rc = ble_gattc_read_long(conn_handle, attr_handle, 0, GattFuture::onReadCB, state.get());
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Error: Failed to read attribute; rc=%d, %s", rc, Utils::returnCodeToString(rc));
+    complete(state.get(), rc);
+  }
+
+  return GattFuture(state);
+}// read
+
+/**
+ * @brief Start an asynchronous write of an attribute.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [in] attr_handle The handle of the attribute to write.
+ * @param [in] data A pointer to the data to write, copied before returning.
+ * @param [in] length The length of the data.
+ * @param [in] response Whether we require a response from the write.
+ * @param [in] callback The completion callback.
+ * @return A handle to the operation.
+ * @details A write without response that fits in one packet completes before returning.
+ * Data longer than the MTU is written with a long write, if the peer does not support it
+ * the write is retried truncated to the MTU, as the blocking writes do.
+ */
+/*STATIC*/
+GattFuture GattFuture::write(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *data, size_t length,
+                             bool response, gatt_complete_callback callback) {
+  auto state = std::make_shared<State>();
+  state->callback = std::move(callback);
+  state->connHandle = conn_handle;
+  state->attrHandle = attr_handle;
+  state->mtu = ble_att_mtu(conn_handle) - 3;
+
+  int rc = 0;
+
+  if (length <= state->mtu && !response) {
+    rc = ble_gattc_write_no_rsp_flat(conn_handle, attr_handle, data, length);
+    complete(state.get(), rc);
+    return GattFuture(state);
+  }
+
+  state->self = state;
+
+  if (length > state->mtu) {
+    NIMBLE_LOGI(LOG_TAG, "long write %d bytes", length);
+    // Keep a copy in case the peer does not support long writes and we have to write again.
+    state->value.setValue(data, length);
+    os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
+    rc = ble_gattc_write_long(conn_handle, attr_handle, 0, om, GattFuture::onWriteCB, state.get());
+  } else {
+    rc = ble_gattc_write_flat(conn_handle, attr_handle, data, length, GattFuture::onWriteCB, state.get());
+  }
+
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Error: Failed to write attribute; rc=%d", rc);
+    complete(state.get(), rc);
+  }
+
+  return GattFuture(state);
+}// write
+
+/**
+ * @brief Complete an operation, call the callback and wake up any waiting task.
+ * @param [in] state The state of the operation.
+ * @param [in] rc The result code.
+ */
+/*STATIC*/
+void GattFuture::complete(State *state, int rc) {
+  // Keep the state alive until we are done with it, it may hold the last reference to itself.
+  std::shared_ptr<State> keep = std::move(state->self);
+
+  state->rc = rc;
+  if (state->callback) {
+    state->callback(rc, state->value);
+    state->callback = nullptr;
+  }
+
+  ble_npl_hw_enter_critical();
+  state->done = true;
+  TaskHandle_t waiter = state->waiter;
+  ble_npl_hw_exit_critical(0);
+
+  if (waiter != nullptr) {
+    xTaskNotifyGive(waiter);
+  }
+}// complete
+
+/**
+ * @brief Callback for asynchronous read operations.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int GattFuture::onReadCB(uint16_t conn_handle,
+                         const struct ble_gatt_error *error,
+                         struct ble_gatt_attr *attr, void *arg) {
+  State *state = (State *) arg;
+  int rc = error->status;
+
+  if (rc == 0 && attr) {
+    uint16_t data_len = OS_MBUF_PKTLEN(attr->om);
+    if ((state->value.size() + data_len) > BLE_ATT_ATTR_MAX_LEN) {
+      rc = BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    } else {
+      NIMBLE_LOGD(LOG_TAG, "Got %u bytes", data_len);
+      state->value.append(attr->om->om_data, data_len);
+      return 0;
+    }
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Read complete; status=%d conn_handle=%d", error->status, conn_handle);
+
+  switch (rc) {
+  case 0:
+  case BLE_HS_EDONE:
+  // Attribute is not long-readable, complete with what we have.
+  case BLE_HS_ATT_ERR(BLE_ATT_ERR_ATTR_NOT_LONG):
+    state->value.setTimeStamp();
+    complete(state, 0);
+    break;
+  default:
+    complete(state, rc);
+    break;
+  }
+
+  return rc == BLE_HS_EDONE ? 0 : rc;
+}// onReadCB
+
+/**
+ * @brief Callback for asynchronous write operations.
+ * @return success == 0 or error code.
+ */
+/*STATIC*/
+int GattFuture::onWriteCB(uint16_t conn_handle,
+                          const struct ble_gatt_error *error,
+                          struct ble_gatt_attr *attr, void *arg) {
+  State *state = (State *) arg;
+  int rc = error->status;
+
+  NIMBLE_LOGI(LOG_TAG, "Write complete; status=%d conn_handle=%d", rc, conn_handle);
+
+  if (rc == BLE_HS_ATT_ERR(BLE_ATT_ERR_ATTR_NOT_LONG) && state->value.size() > state->mtu) {
+    NIMBLE_LOGE(LOG_TAG, "Long write not supported by peer; Truncating length to %d", state->mtu);
+    rc = ble_gattc_write_flat(state->connHandle, state->attrHandle,
+                              state->value.data(), state->mtu,
+                              GattFuture::onWriteCB, state);
+    if (rc == 0) {
+      return 0;
+    }
+  }
+
+  // Release the copy of the written data, writes complete with an empty value.
+  if (state->value.size() > 0) {
+    state->value = AttributeValue();
+  }
+  complete(state, rc == BLE_HS_EDONE ? 0 : rc);
+
+  return 0;
+}// onWriteCB
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
@@ -0,0 +1,100 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "nimble/GattTable.hpp"
+
+#include "nimble/Log.hpp"
+
+static const char *LOG_TAG = "NimBLEGattTable";
+
+namespace nimble {
+
+/**
+ * @brief Convert a NimBLE UUID to a UUID.
+ * @param [in] uuid The NimBLE UUID.
+ * @return The UUID.
+ */
+static UUID toUUID(const ble_uuid_t *uuid) {
+  switch (uuid->type) {
+  case BLE_UUID_TYPE_16:
+    return UUID((uint16_t) BLE_UUID16(uuid)->value);
+  case BLE_UUID_TYPE_32:
+    return UUID((uint32_t) BLE_UUID32(uuid)->value);
+  default:
+    return UUID(BLE_UUID128(uuid));
+  }
+}// toUUID
+
+/**
+ * @brief Give the bound Characteristic and Descriptor objects the UUIDs and properties of their definitions.
+ * @param [in] pSvcs The service table.
+ * @details The access callbacks match attributes by UUID and the subscription handling checks
+ * the properties, so the objects must agree with the table whatever they were constructed with.
+ */
+/*STATIC*/
+void GattTable::bind(const ble_gatt_svc_def *pSvcs) {
+  for (const ble_gatt_svc_def *svc = pSvcs; svc->type != 0; ++svc) {
+    if (svc->characteristics == nullptr) {
+      continue;
+    }
+
+    for (const ble_gatt_chr_def *chr = svc->characteristics; chr->uuid != nullptr; ++chr) {
+      Characteristic *pChr = getCharacteristic(*chr);
+      if (pChr == nullptr) {
+        continue;
+      }
+
+      pChr->m_uuid = toUUID(chr->uuid);
+      pChr->m_properties = chr->flags;
+
+      if (chr->descriptors == nullptr) {
+        continue;
+      }
+
+      for (const ble_gatt_dsc_def *dsc = chr->descriptors; dsc->uuid != nullptr; ++dsc) {
+        if (dsc->access_cb != Descriptor::handleGapEvent) {
+          continue;
+        }
+
+        auto *pDsc = (Descriptor *) dsc->arg;
+        pDsc->m_uuid = toUUID(dsc->uuid);
+        pDsc->m_properties = dsc->att_flags;
+        pDsc->m_pCharacteristic = pChr;
+      }
+
+      NIMBLE_LOGD(LOG_TAG, "Bound characteristic %s", pChr->m_uuid.toString().c_str());
+    }
+  }
+}// bind
+
+/**
+ * @brief Get the Characteristic a definition is bound to.
+ * @param [in] def The characteristic definition.
+ * @return The Characteristic or nullptr if the definition uses its own access callback.
+ */
+/*STATIC*/
+Characteristic *GattTable::getCharacteristic(const ble_gatt_chr_def &def) {
+  if (def.access_cb != Characteristic::handleGapEvent) {
+    return nullptr;
+  }
+
+  return (Characteristic *) def.arg;
+}// getCharacteristic
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
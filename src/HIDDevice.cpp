@@ -123,6 +123,7 @@ void HIDDevice::hidInfo(uint8_t country, uint8_t flags) {
  * @brief Create input report characteristic
  * @param [in] reportID input report ID, the same as in report map for input object related to the characteristic
  * @return pointer to new input report characteristic
+ * @details Register it with a HIDReportSender to send reports with low latency.
  */
 Characteristic *HIDDevice::inputReport(uint8_t reportID) {
   Characteristic *inputReportCharacteristic = m_hidService->createCharacteristic((uint16_t) 0x2a4d, Property::READ | Property::NOTIFY | Property::READ_ENC);
@@ -0,0 +1,477 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "nimble/HIDReportSender.hpp"
+
+#include "nimble/ConnParamsManager.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Utils.hpp"
+
+#include <os/os_mbuf.h>
+
+#include <algorithm>
+#include <cstring>
+
+static const char *LOG_TAG = "NimBLEHIDReportSender";
+
+namespace nimble {
+
+/**
+ * @brief Constructor.
+ * @param [in] connHandle The connection of the HID host, can be set later with setConnHandle().
+ */
+HIDReportSender::HIDReportSender(uint16_t connHandle) {
+  m_connHandle = connHandle;
+  memset(&m_timer, 0, sizeof(m_timer));
+  ble_npl_callout_init(&m_timer, nimble_port_get_dflt_eventq(), HIDReportSender::timerCb, this);
+}// HIDReportSender
+
+/**
+ * @brief Destructor, drops the waiting reports and releases the spare mbufs.
+ */
+HIDReportSender::~HIDReportSender() {
+  ble_npl_callout_stop(&m_timer);
+  ble_npl_callout_deinit(&m_timer);
+
+  for (auto &slot : m_slots) {
+    if (slot.pSpare != nullptr) {
+      os_mbuf_free_chain(slot.pSpare);
+    }
+  }
+}// ~HIDReportSender
+
+/**
+ * @brief Register an input report.
+ * @param [in] reportId The report ID, as in the report map.
+ * @param [in] pCharacteristic The input report characteristic, from HIDDevice::inputReport().
+ * @param [in] length The length of the report, without the report ID.
+ * @return True if successful.
+ */
+bool HIDReportSender::addReport(uint8_t reportId, Characteristic *pCharacteristic, uint8_t length) {
+  if (pCharacteristic == nullptr || !(pCharacteristic->getProperties() & Property::NOTIFY)) {
+    NIMBLE_LOGE(LOG_TAG, "Report %d needs a characteristic with notify", reportId);
+    return false;
+  }
+
+  if (length == 0 || length > MAX_HID_REPORT_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "Invalid report length %d, max %d", length, MAX_HID_REPORT_SIZE);
+    return false;
+  }
+
+  if (findSlot(reportId) != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Report %d already added", reportId);
+    return false;
+  }
+
+  Slot slot{};
+  slot.pChr = pCharacteristic;
+  slot.pSpare = ble_hs_mbuf_att_pkt();
+  slot.reportId = reportId;
+  slot.length = length;
+  m_slots.push_back(slot);
+  return true;
+}// addReport
+
+/**
+ * @brief Mark a field of a report as relative, e.g. a mouse delta, so waiting reports are summed.
+ * @param [in] reportId The report ID.
+ * @param [in] offset The offset of the field in the report.
+ * @param [in] size The size of the field, 1 or 2 bytes, a signed little endian value.
+ * @return True if successful.
+ */
+bool HIDReportSender::addRelativeField(uint8_t reportId, uint8_t offset, uint8_t size) {
+  Slot *pSlot = findSlot(reportId);
+  if (pSlot == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Report %d not added", reportId);
+    return false;
+  }
+
+  if ((size != 1 && size != 2) || offset + size > pSlot->length || pSlot->fieldCount == MAX_FIELDS) {
+    NIMBLE_LOGE(LOG_TAG, "Invalid relative field at %d, size %d", offset, size);
+    return false;
+  }
+
+  pSlot->fields[pSlot->fieldCount++] = Field{offset, size};
+  for (uint8_t i = 0; i < size; i++) {
+    pSlot->relativeBytes |= 1ULL << (offset + i);
+  }
+
+  return true;
+}// addRelativeField
+
+/**
+ * @brief Set the connection the reports are sent to, waiting reports are dropped.
+ * @param [in] connHandle The connection handle of the HID host.
+ */
+void HIDReportSender::setConnHandle(uint16_t connHandle) {
+  ble_npl_hw_enter_critical();
+  m_connHandle = connHandle;
+  for (auto &slot : m_slots) {
+    slot.pending = false;
+    slot.sentAt = 0;
+  }
+  ble_npl_hw_exit_critical(0);
+}// setConnHandle
+
+/**
+ * @brief Get the connection the reports are sent to.
+ * @return The connection handle, BLE_HS_CONN_HANDLE_NONE if not set.
+ */
+uint16_t HIDReportSender::getConnHandle() const {
+  return m_connHandle;
+}// getConnHandle
+
+/**
+ * @brief Send an input report, or merge it into the waiting one if the report ID is busy.
+ * @param [in] reportId The report ID.
+ * @param [in] data The report, without the report ID.
+ * @param [in] length The length of the report, as registered.
+ * @return True if the report was sent or is waiting to be sent.
+ */
+bool HIDReportSender::send(uint8_t reportId, const uint8_t *data, size_t length) {
+  Slot *pSlot = findSlot(reportId);
+  if (pSlot == nullptr || length != pSlot->length) {
+    NIMBLE_LOGE(LOG_TAG, "Report %d not added or wrong length %d", reportId, length);
+    return false;
+  }
+
+  if (m_connHandle == BLE_HS_CONN_HANDLE_NONE) {
+    m_failed++;
+    return false;
+  }
+
+  Slot &slot = *pSlot;
+  const uint32_t now = Stats::now();
+  const uint32_t intervalUs = slot.fieldCount > 0 ? getIntervalUs() : 0;
+
+  ble_npl_hw_enter_critical();
+  if (slot.pending && slot.fieldCount > 0 && sameState(slot, slot.pendingData, data)) {
+    merge(slot, slot.pendingData, data, true);
+    ble_npl_hw_exit_critical(0);
+    m_coalesced++;
+    return true;
+  }
+
+  if (!slot.pending && (slot.sending || (now - slot.sentAt < intervalUs && sameState(slot, slot.sentData, data)))) {
+    const uint32_t delayUs = slot.sending ? 0 : intervalUs - (now - slot.sentAt);
+    memcpy(slot.pendingData, data, slot.length);
+    slot.queuedAt = now;
+    slot.pending = true;
+    ble_npl_hw_exit_critical(0);
+    schedule(delayUs);
+    return true;
+  }
+  ble_npl_hw_exit_critical(0);
+
+  // The state changed, the waiting report goes first so the host sees every state.
+  flush(slot);
+
+  ble_npl_hw_enter_critical();
+  if (slot.pending || slot.sending) {
+    // Still busy, the host is out of buffers.
+    if (slot.pending) {
+      merge(slot, slot.pendingData, data, true);
+    } else {
+      memcpy(slot.pendingData, data, slot.length);
+      slot.queuedAt = now;
+      slot.pending = true;
+    }
+    ble_npl_hw_exit_critical(0);
+    m_coalesced++;
+    schedule(0);
+    return true;
+  }
+  slot.sending = true;
+  ble_npl_hw_exit_critical(0);
+
+  int rc = transmit(slot, data, now);
+  return rc == 0 || rc == BLE_HS_ENOMEM;
+}// send
+
+/**
+ * @brief Request the 7.5ms connection interval, the shortest allowed.
+ * @details The host decides, many only accept 11.25ms or 15ms for HID devices.
+ * @param [in] latency The number of connection events the device may skip when it has nothing to send.
+ * @param [in] timeout The supervision timeout in 10ms units.
+ * @return True if the request was sent.
+ */
+bool HIDReportSender::requestLowLatency(uint16_t latency, uint16_t timeout) {
+  ble_gap_upd_params params{};
+  params.itvl_min = 6;// 7.5ms in 1.25ms units
+  params.itvl_max = 6;
+  params.latency = latency;
+  params.supervision_timeout = timeout;
+  params.min_ce_len = BLE_GAP_INITIAL_CONN_MIN_CE_LEN;
+  params.max_ce_len = BLE_GAP_INITIAL_CONN_MAX_CE_LEN;
+
+  int rc = ble_gap_update_params(m_connHandle, &params);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Update params error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// requestLowLatency
+
+/**
+ * @brief Get the counters and the latency histogram of the sender.
+ * @return A copy of the statistics.
+ */
+HIDReportSender::ReportStats HIDReportSender::getStats() const {
+  ReportStats stats{};
+  stats.sent = m_sent.load(std::memory_order_relaxed);
+  stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+  stats.failed = m_failed.load(std::memory_order_relaxed);
+  stats.latency = m_latency.snapshot();
+  return stats;
+}// getStats
+
+/**
+ * @brief Reset the counters and the latency histogram.
+ */
+void HIDReportSender::resetStats() {
+  m_sent = 0;
+  m_coalesced = 0;
+  m_failed = 0;
+  m_latency.reset();
+}// resetStats
+
+/**
+ * @brief Find the slot of a report ID.
+ * @param [in] reportId The report ID.
+ * @return The slot or nullptr if the report was not added.
+ */
+HIDReportSender::Slot *HIDReportSender::findSlot(uint8_t reportId) {
+  for (auto &slot : m_slots) {
+    if (slot.reportId == reportId) {
+      return &slot;
+    }
+  }
+
+  return nullptr;
+}// findSlot
+
+/**
+ * @brief Check if two reports only differ in their relative fields.
+ * @param [in] slot The slot of the reports.
+ * @param [in] a The first report.
+ * @param [in] b The second report.
+ * @return True if every other byte is the same.
+ */
+bool HIDReportSender::sameState(const Slot &slot, const uint8_t *a, const uint8_t *b) const {
+  for (uint8_t i = 0; i < slot.length; i++) {
+    if (!((slot.relativeBytes >> i) & 1) && a[i] != b[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}// sameState
+
+/**
+ * @brief Merge a report into another, summing the relative fields.
+ * @param [in] slot The slot of the reports.
+ * @param [in] dst The report merged into.
+ * @param [in] src The report merged.
+ * @param [in] srcIsNewer True if the other bytes of the merged report replace those of dst.
+ */
+void HIDReportSender::merge(const Slot &slot, uint8_t *dst, const uint8_t *src, bool srcIsNewer) const {
+  int32_t sums[MAX_FIELDS];
+  for (uint8_t i = 0; i < slot.fieldCount; i++) {
+    const Field &field = slot.fields[i];
+    if (field.size == 1) {
+      sums[i] = static_cast<int8_t>(dst[field.offset]) + static_cast<int8_t>(src[field.offset]);
+    } else {
+      sums[i] = static_cast<int16_t>(dst[field.offset] | (dst[field.offset + 1] << 8)) +
+                static_cast<int16_t>(src[field.offset] | (src[field.offset + 1] << 8));
+    }
+  }
+
+  if (srcIsNewer) {
+    memcpy(dst, src, slot.length);
+  }
+
+  // Saturate rather than wrap, a clipped movement is better than one in the wrong direction.
+  for (uint8_t i = 0; i < slot.fieldCount; i++) {
+    const Field &field = slot.fields[i];
+    const int32_t limit = field.size == 1 ? INT8_MAX : INT16_MAX;
+    const int32_t sum = sums[i] > limit ? limit : sums[i] < -limit - 1 ? -limit - 1 : sums[i];
+    dst[field.offset] = static_cast<uint8_t>(sum);
+    if (field.size == 2) {
+      dst[field.offset + 1] = static_cast<uint8_t>(sum >> 8);
+    }
+  }
+}// merge
+
+/**
+ * @brief Hand a report to the host, the caller has set the slot sending.
+ * @param [in] slot The slot of the report.
+ * @param [in] data The report.
+ * @param [in] queuedAt The time the oldest data of the report was passed to send().
+ * @return 0 on success, BLE_HS_ENOMEM if the report is waiting for buffers, otherwise the error
+ * the report was dropped for.
+ */
+int HIDReportSender::transmit(Slot &slot, const uint8_t *data, uint32_t queuedAt) {
+  int rc = BLE_HS_ENOTCONN;
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer != nullptr ? pServer->getPeerState(m_connHandle) : nullptr;
+
+  if (pState != nullptr && (slot.pChr->getSubscribeValue(pServer->getPeerIndex(pState)) & NIMBLE_SUB_NOTIFY)) {
+    os_mbuf *om = slot.pSpare != nullptr ? slot.pSpare : ble_hs_mbuf_att_pkt();
+    slot.pSpare = nullptr;
+
+    if (om == nullptr || os_mbuf_append(om, data, slot.length) != 0) {
+      if (om != nullptr) {
+        os_mbuf_free_chain(om);
+      }
+      rc = BLE_HS_ENOMEM;
+    } else {
+      // The mbuf is consumed whatever the result.
+      rc = ble_gattc_notify_custom(m_connHandle, slot.pChr->getHandle(), om);
+    }
+
+    NIMBLE_STAT_NOTIFY(rc);
+    NIMBLE_CONN_TRAFFIC(m_connHandle, slot.length);
+  }
+
+  const uint32_t now = Stats::now();
+
+  // Replace the spare once the report is on its way.
+  if (slot.pSpare == nullptr) {
+    slot.pSpare = ble_hs_mbuf_att_pkt();
+  }
+
+  bool retry = false;
+  ble_npl_hw_enter_critical();
+  slot.sending = false;
+  if (rc == 0) {
+    slot.sentAt = now;
+    memcpy(slot.sentData, data, slot.length);
+  } else if (rc == BLE_HS_ENOMEM) {
+    // Keep the report, merged with any report that arrived meanwhile, and retry.
+    if (slot.pending) {
+      merge(slot, slot.pendingData, data, false);
+      slot.queuedAt = queuedAt;
+    } else {
+      memcpy(slot.pendingData, data, slot.length);
+      slot.queuedAt = queuedAt;
+      slot.pending = true;
+    }
+  }
+  retry = slot.pending;
+  ble_npl_hw_exit_critical(0);
+
+  if (rc == 0) {
+    m_sent++;
+    m_latency.record(now - queuedAt);
+  } else if (rc != BLE_HS_ENOMEM) {
+    m_failed++;
+    NIMBLE_LOGD(LOG_TAG, "Report %d dropped; rc=%d %s", slot.reportId, rc, Utils::returnCodeToString(rc));
+  }
+
+  if (retry) {
+    schedule(0);
+  }
+
+  return rc;
+}// transmit
+
+/**
+ * @brief Send the waiting report of a slot, if any and not already sending.
+ * @param [in] slot The slot.
+ */
+void HIDReportSender::flush(Slot &slot) {
+  uint8_t data[MAX_HID_REPORT_SIZE];
+
+  ble_npl_hw_enter_critical();
+  if (!slot.pending || slot.sending) {
+    ble_npl_hw_exit_critical(0);
+    return;
+  }
+
+  memcpy(data, slot.pendingData, slot.length);
+  const uint32_t queuedAt = slot.queuedAt;
+  slot.pending = false;
+  slot.sending = true;
+  ble_npl_hw_exit_critical(0);
+
+  transmit(slot, data, queuedAt);
+}// flush
+
+/**
+ * @brief Arm the timer sending the waiting reports, unless it is already armed.
+ * @param [in] delayUs The time to wait, rounded up to the next tick.
+ */
+void HIDReportSender::schedule(uint32_t delayUs) {
+  if (ble_npl_callout_is_active(&m_timer)) {
+    return;
+  }
+
+  ble_npl_time_t ticks;
+  ble_npl_time_ms_to_ticks((delayUs + 999) / 1000, &ticks);
+  ble_npl_callout_reset(&m_timer, ticks > 0 ? ticks : 1);
+}// schedule
+
+/**
+ * @brief Get the connection interval of the HID host.
+ * @return The interval in microseconds, 0 if not connected.
+ */
+uint32_t HIDReportSender::getIntervalUs() const {
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer != nullptr ? pServer->getPeerState(m_connHandle) : nullptr;
+  return pState != nullptr ? pState->desc.conn_itvl * 1250 : 0;
+}// getIntervalUs
+
+/**
+ * @brief Send the waiting reports that are due, from the NimBLE host task.
+ * @param [in] event The timer event, its argument is the sender.
+ */
+/*STATIC*/
+void HIDReportSender::timerCb(ble_npl_event *event) {
+  auto *pSender = static_cast<HIDReportSender *>(ble_npl_event_get_arg(event));
+  const uint32_t intervalUs = pSender->getIntervalUs();
+  uint32_t nextUs = UINT32_MAX;
+
+  for (auto &slot : pSender->m_slots) {
+    ble_npl_hw_enter_critical();
+    const bool pending = slot.pending;
+    const uint32_t elapsed = Stats::now() - slot.sentAt;
+    const bool hold = pending && elapsed < intervalUs && pSender->sameState(slot, slot.pendingData, slot.sentData);
+    ble_npl_hw_exit_critical(0);
+
+    if (!pending) {
+      continue;
+    }
+
+    if (hold) {
+      nextUs = std::min(nextUs, intervalUs - elapsed);
+      continue;
+    }
+
+    pSender->flush(slot);
+  }
+
+  if (nextUs != UINT32_MAX) {
+    pSender->schedule(nextUs);
+  }
+}// timerCb
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
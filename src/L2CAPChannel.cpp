@@ -0,0 +1,390 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+
+#include "nimble/L2CAPChannel.hpp"
+
+#include <algorithm>
+#include <climits>
+
+#include <host/ble_hs.h>
+#include <nimble/nimble_npl.h>
+#include <os/os_mbuf.h>
+#include <os/os_mempool.h>
+
+#include "nimble/ConnParamsManager.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Utils.hpp"
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+#include "nimble/Client.hpp"
+#endif
+
+static const char *LOG_TAG = "NimBLEL2CAPChannel";
+
+namespace nimble {
+
+static L2CAPChannelCallbacks defaultCallbacks;
+
+/**
+ * @brief Delay before retrying a write when the host is out of mbufs.
+ */
+static constexpr uint32_t NO_MEM_RETRY_MS = 10;
+
+// Receive SDUs are reassembled into blocks of this pool, shared by all channels.
+static os_membuf_t s_sduMemory[OS_MEMPOOL_SIZE(CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS, CONFIG_NIMBLE_CPP_L2CAP_COC_BLOCK_SIZE)];
+static os_mempool s_sduMempool;
+static os_mbuf_pool s_sduPool;
+static bool s_poolInitialized = false;
+
+/**
+ * @brief Constructor.
+ * @param [in] psm The Protocol/Service Multiplexer of the channel.
+ * @param [in] mtu The largest SDU this side accepts.
+ * @param [in] pCallbacks The callbacks, may be nullptr.
+ */
+L2CAPChannel::L2CAPChannel(uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks) {
+  m_psm = psm;
+  m_mtu = mtu;
+  m_peerMtu = 0;
+  m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+  m_channel = nullptr;
+  m_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+  m_pWriter = nullptr;
+}// L2CAPChannel
+
+/**
+ * @brief Destructor, the channel must be disconnected first.
+ * @details The host keeps a pointer to the channel while it is connected.
+ */
+L2CAPChannel::~L2CAPChannel() {
+  if (m_channel != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Deleting connected channel, psm=%d", m_psm);
+  }
+}// ~L2CAPChannel
+
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+/**
+ * @brief Open a channel to a service of the peer of a client.
+ * @param [in] pClient The connected client.
+ * @param [in] psm The Protocol/Service Multiplexer of the peer service.
+ * @param [in] mtu The largest SDU this side accepts.
+ * @param [in] pCallbacks The callbacks, onConnect() or onConnectFail() is called with the result.
+ * @return The channel, owned by the caller, or nullptr if the request could not be sent.
+ */
+/*STATIC*/
+L2CAPChannel *L2CAPChannel::connect(Client *pClient, uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks) {
+  if (!pClient->isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Client not connected");
+    return nullptr;
+  }
+
+  os_mbuf *sdu = allocSdu();
+  if (sdu == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "No receive buffer for the channel");
+    return nullptr;
+  }
+
+  auto *pChannel = new L2CAPChannel(psm, mtu, pCallbacks);
+  int rc = ble_l2cap_connect(pClient->getConnId(), psm, mtu, sdu, L2CAPChannel::handleEvent, pChannel);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "L2CAP connect error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    os_mbuf_free_chain(sdu);
+    delete pChannel;
+    return nullptr;
+  }
+
+  return pChannel;
+}// connect
+#endif
+
+/**
+ * @brief Send data, split into SDUs of the peer MTU.
+ * @param [in] data The data.
+ * @param [in] length The length of the data.
+ * @param [in] timeoutMs The longest time to wait for the peer to grant credits, 0 to wait forever.
+ * @return True if all the data was handed to the host.
+ * @details Blocks while the peer has no credits left, must not be called from the NimBLE host task.
+ */
+bool L2CAPChannel::write(const uint8_t *data, size_t length, uint32_t timeoutMs) {
+  if (m_channel == nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Channel not connected");
+    return false;
+  }
+
+  size_t offset = 0;
+  bool success = true;
+  m_pWriter = xTaskGetCurrentTaskHandle();
+
+  while (offset < length) {
+    if (m_channel == nullptr) {
+      NIMBLE_LOGE(LOG_TAG, "Disconnected");
+      success = false;
+      break;
+    }
+
+    size_t sduLength = std::min<size_t>(length - offset, m_peerMtu);
+    os_mbuf *om = ble_hs_mbuf_from_flat(data + offset, sduLength);
+    if (om == nullptr) {
+      vTaskDelay(pdMS_TO_TICKS(NO_MEM_RETRY_MS));
+      continue;
+    }
+
+#ifdef ulTaskNotifyValueClear
+    // Clear the task notification value so only an unstall of this send wakes us.
+    ulTaskNotifyValueClear(m_pWriter, ULONG_MAX);
+#endif
+    int rc = ble_l2cap_send(m_channel, om);
+
+    // A stalled SDU is queued by the host and sent as the peer grants credits.
+    if (rc == 0 || rc == BLE_HS_ESTALLED) {
+      NIMBLE_CONN_TRAFFIC(m_connHandle, sduLength);
+      offset += sduLength;
+      if (rc == 0 || waitUnstalled(timeoutMs)) {
+        continue;
+      }
+      NIMBLE_LOGE(LOG_TAG, "Timeout waiting for credits");
+      success = false;
+      break;
+    }
+
+    // The previous SDU is still queued, this one was not taken.
+    if (rc == BLE_HS_EBUSY) {
+      os_mbuf_free_chain(om);
+      if (waitUnstalled(timeoutMs)) {
+        continue;
+      }
+      NIMBLE_LOGE(LOG_TAG, "Timeout waiting for credits");
+      success = false;
+      break;
+    }
+
+    if (rc == BLE_HS_EBADDATA || rc == BLE_HS_EINVAL) {
+      os_mbuf_free_chain(om);
+    }
+    NIMBLE_LOGE(LOG_TAG, "L2CAP send error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    success = false;
+    break;
+  }
+
+  m_pWriter = nullptr;
+  return success;
+}// write
+
+/**
+ * @brief Send data, split into SDUs of the peer MTU.
+ * @param [in] data The data.
+ * @param [in] timeoutMs The longest time to wait for the peer to grant credits, 0 to wait forever.
+ * @return True if all the data was handed to the host.
+ */
+bool L2CAPChannel::write(const std::vector<uint8_t> &data, uint32_t timeoutMs) {
+  return write(data.data(), data.size(), timeoutMs);
+}// write
+
+/**
+ * @brief Disconnect the channel, the connection stays up.
+ * @return True if the request was sent, onDisconnect() is called once done.
+ */
+bool L2CAPChannel::disconnect() {
+  if (m_channel == nullptr) {
+    return false;
+  }
+
+  int rc = ble_l2cap_disconnect(m_channel);
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "L2CAP disconnect error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// disconnect
+
+/**
+ * @brief Check if the channel is connected.
+ * @return True if data can be sent.
+ */
+bool L2CAPChannel::isConnected() const {
+  return m_channel != nullptr;
+}// isConnected
+
+/**
+ * @brief Get the Protocol/Service Multiplexer of the channel.
+ * @return The PSM.
+ */
+uint16_t L2CAPChannel::getPSM() const {
+  return m_psm;
+}// getPSM
+
+/**
+ * @brief Get the largest SDU this side accepts.
+ * @return The MTU in bytes.
+ */
+uint16_t L2CAPChannel::getMTU() const {
+  return m_mtu;
+}// getMTU
+
+/**
+ * @brief Get the largest SDU the peer accepts, writes are split into SDUs of this size.
+ * @return The MTU in bytes, 0 if not connected.
+ */
+uint16_t L2CAPChannel::getPeerMTU() const {
+  return m_peerMtu;
+}// getPeerMTU
+
+/**
+ * @brief Get the connection the channel runs on.
+ * @return The connection handle, BLE_HS_CONN_HANDLE_NONE if not connected.
+ */
+uint16_t L2CAPChannel::getConnHandle() const {
+  return m_connHandle;
+}// getConnHandle
+
+/**
+ * @brief Get an empty SDU from the receive pool.
+ * @return The mbuf, or nullptr if the pool is exhausted.
+ */
+/*STATIC*/
+os_mbuf *L2CAPChannel::allocSdu() {
+  ble_npl_hw_enter_critical();
+  if (!s_poolInitialized) {
+    os_mempool_init(&s_sduMempool, CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS, CONFIG_NIMBLE_CPP_L2CAP_COC_BLOCK_SIZE,
+                    s_sduMemory, "nimble_cpp_coc");
+    os_mbuf_pool_init(&s_sduPool, &s_sduMempool, CONFIG_NIMBLE_CPP_L2CAP_COC_BLOCK_SIZE,
+                      CONFIG_NIMBLE_CPP_L2CAP_COC_BUFFERS);
+    s_poolInitialized = true;
+  }
+  ble_npl_hw_exit_critical(0);
+
+  return os_mbuf_get_pkthdr(&s_sduPool, 0);
+}// allocSdu
+
+/**
+ * @brief Wait for the host to report that the peer granted credits again.
+ * @param [in] timeoutMs The longest time to wait, 0 to wait forever.
+ * @return True if the channel can send again, false on timeout or disconnect.
+ */
+bool L2CAPChannel::waitUnstalled(uint32_t timeoutMs) {
+  TickType_t ticks = timeoutMs == 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+  return ulTaskNotifyTake(pdTRUE, ticks) != 0 && m_channel != nullptr;
+}// waitUnstalled
+
+/**
+ * @brief Release a task blocked in write().
+ */
+void L2CAPChannel::wakeWriter() {
+  if (m_pWriter != nullptr) {
+    xTaskNotifyGive(m_pWriter);
+  }
+}// wakeWriter
+
+/**
+ * @brief Handle the L2CAP events of a channel.
+ * @param [in] event The event.
+ * @param [in] arg The channel.
+ */
+/*STATIC*/
+int L2CAPChannel::handleEvent(ble_l2cap_event *event, void *arg) {
+  auto *pChannel = (L2CAPChannel *) arg;
+
+  switch (event->type) {
+  case BLE_L2CAP_EVENT_COC_ACCEPT: {
+    // A service serves a single channel at a time.
+    if (pChannel->m_channel != nullptr) {
+      return BLE_HS_EBUSY;
+    }
+
+    if (!pChannel->m_pCallbacks->shouldAccept(pChannel, event->accept.peer_sdu_size)) {
+      return BLE_HS_EREJECT;
+    }
+
+    os_mbuf *sdu = allocSdu();
+    if (sdu == nullptr) {
+      NIMBLE_LOGE(LOG_TAG, "No receive buffer, rejecting channel");
+      return BLE_HS_ENOMEM;
+    }
+
+    ble_l2cap_recv_ready(event->accept.chan, sdu);
+    return 0;
+  }// BLE_L2CAP_EVENT_COC_ACCEPT
+
+  case BLE_L2CAP_EVENT_COC_CONNECTED: {
+    if (event->connect.status != 0) {
+      NIMBLE_LOGE(LOG_TAG, "L2CAP connect failed; status=%d %s",
+                  event->connect.status, Utils::returnCodeToString(event->connect.status));
+      pChannel->m_pCallbacks->onConnectFail(pChannel, event->connect.status);
+      return 0;
+    }
+
+    pChannel->m_channel = event->connect.chan;
+    pChannel->m_connHandle = event->connect.conn_handle;
+
+    ble_l2cap_chan_info info;
+    if (ble_l2cap_get_chan_info(event->connect.chan, &info) == 0) {
+      pChannel->m_peerMtu = info.peer_coc_mtu;
+    }
+
+    NIMBLE_LOGI(LOG_TAG, "L2CAP channel connected; psm=%d peer mtu=%d", pChannel->m_psm, pChannel->m_peerMtu);
+    pChannel->m_pCallbacks->onConnect(pChannel);
+    return 0;
+  }// BLE_L2CAP_EVENT_COC_CONNECTED
+
+  case BLE_L2CAP_EVENT_COC_DISCONNECTED: {
+    NIMBLE_LOGI(LOG_TAG, "L2CAP channel disconnected; psm=%d", pChannel->m_psm);
+    pChannel->m_channel = nullptr;
+    pChannel->m_connHandle = BLE_HS_CONN_HANDLE_NONE;
+    pChannel->m_peerMtu = 0;
+    pChannel->wakeWriter();
+    pChannel->m_pCallbacks->onDisconnect(pChannel);
+    return 0;
+  }// BLE_L2CAP_EVENT_COC_DISCONNECTED
+
+  case BLE_L2CAP_EVENT_COC_DATA_RECEIVED: {
+    os_mbuf *sdu = event->receive.sdu_rx;
+    if (sdu == nullptr) {
+      return 0;
+    }
+
+    uint16_t length = OS_MBUF_PKTLEN(sdu);
+    pChannel->m_rxBuffer.resize(length);
+    os_mbuf_copydata(sdu, 0, length, pChannel->m_rxBuffer.data());
+    os_mbuf_free_chain(sdu);
+
+    // Hand the host the next buffer before the callback runs, this returns the credits to the peer.
+    sdu = allocSdu();
+    if (sdu == nullptr) {
+      NIMBLE_LOGE(LOG_TAG, "No receive buffer, the peer is stalled");
+    } else {
+      ble_l2cap_recv_ready(event->receive.chan, sdu);
+    }
+
+    NIMBLE_CONN_TRAFFIC(event->receive.conn_handle, length);
+    pChannel->m_pCallbacks->onRead(pChannel, pChannel->m_rxBuffer.data(), length);
+    return 0;
+  }// BLE_L2CAP_EVENT_COC_DATA_RECEIVED
+
+  case BLE_L2CAP_EVENT_COC_TX_UNSTALLED: {
+    pChannel->wakeWriter();
+    return 0;
+  }// BLE_L2CAP_EVENT_COC_TX_UNSTALLED
+
+  default:
+    return 0;
+  }
+}// handleEvent
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM */
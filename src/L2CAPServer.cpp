@@ -0,0 +1,88 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+
+#include "nimble/L2CAPServer.hpp"
+
+#include <host/ble_hs.h>
+
+#include "nimble/Log.hpp"
+#include "nimble/Utils.hpp"
+
+static const char *LOG_TAG = "NimBLEL2CAPServer";
+
+namespace nimble {
+
+/**
+ * @brief Destructor, deletes the service channels.
+ */
+L2CAPServer::~L2CAPServer() {
+  for (auto &it : m_services) {
+    delete it;
+  }
+}// ~L2CAPServer
+
+/**
+ * @brief Listen for channels opened by peers on a PSM.
+ * @param [in] psm The Protocol/Service Multiplexer, 0x0080 - 0x00FF for dynamic services.
+ * @param [in] mtu The largest SDU accepted from the peers.
+ * @param [in] pCallbacks The callbacks of the channel, may be nullptr.
+ * @return The channel of the service, owned by the server, or nullptr on error.
+ */
+L2CAPChannel *L2CAPServer::createService(uint16_t psm, uint16_t mtu, L2CAPChannelCallbacks *pCallbacks) {
+  if (getService(psm) != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "A service already uses psm %d", psm);
+    return nullptr;
+  }
+
+  auto *pChannel = new L2CAPChannel(psm, mtu, pCallbacks);
+  int rc = ble_l2cap_create_server(psm, mtu, L2CAPChannel::handleEvent, pChannel);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "L2CAP create server error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    delete pChannel;
+    return nullptr;
+  }
+
+  m_services.push_back(pChannel);
+  return pChannel;
+}// createService
+
+/**
+ * @brief Get the channel of a service.
+ * @param [in] psm The Protocol/Service Multiplexer of the service.
+ * @return The channel, or nullptr if no service uses the PSM.
+ */
+L2CAPChannel *L2CAPServer::getService(uint16_t psm) const {
+  for (auto &it : m_services) {
+    if (it->getPSM() == psm) {
+      return it;
+    }
+  }
+
+  return nullptr;
+}// getService
+
+/**
+ * @brief Get the number of services.
+ * @return The number of PSMs listened on.
+ */
+size_t L2CAPServer::getServiceCount() const {
+  return m_services.size();
+}// getServiceCount
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM */
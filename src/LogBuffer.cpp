@@ -0,0 +1,164 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_NIMBLE_CPP_LOG_DEFERRED
+
+#include "nimble/LogBuffer.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nimble/nimble_npl.h>
+
+namespace nimble {
+
+static const char *LOG_TAG = "NimBLELogBuffer";
+
+static constexpr uint32_t FLUSH_INTERVAL_MS = 100;
+
+static LogBuffer::Record s_records[CONFIG_NIMBLE_CPP_LOG_DEFERRED_ENTRIES];
+static uint16_t s_head = 0;
+static uint16_t s_count = 0;
+static uint32_t s_dropped = 0;
+static TaskHandle_t s_task = nullptr;
+static volatile bool s_stop = false;
+
+/**
+ * @brief Start the task that formats the buffered records.
+ * @param [in] core The core to pin the task to, or tskNO_AFFINITY.
+ * @details Called by Device::init(), records written before are kept until the task runs.
+ */
+/*STATIC*/
+void LogBuffer::start(BaseType_t core) {
+  if (s_task != nullptr) {
+    return;
+  }
+
+  s_stop = false;
+  xTaskCreatePinnedToCore(LogBuffer::task, "nimble_log", CONFIG_NIMBLE_CPP_LOG_DEFERRED_TASK_STACK_SIZE,
+                          nullptr, tskIDLE_PRIORITY + 1, &s_task, core);
+}// start
+
+/**
+ * @brief Print the remaining records and stop the task.
+ */
+/*STATIC*/
+void LogBuffer::stop() {
+  if (s_task == nullptr) {
+    return;
+  }
+
+  s_stop = true;
+  xTaskNotifyGive(s_task);
+}// stop
+
+/**
+ * @brief Copy a record into the buffer, dropping it if the buffer is full.
+ * @param [in] level The log level.
+ * @param [in] tag The log tag.
+ * @param [in] format The printf format.
+ * @param [in] args MAX_ARGS argument values.
+ */
+/*STATIC*/
+void LogBuffer::push(esp_log_level_t level, const char *tag, const char *format, const uint32_t *args) {
+  uint32_t timestamp = esp_log_timestamp();
+
+  ble_npl_hw_enter_critical();
+  if (s_count >= CONFIG_NIMBLE_CPP_LOG_DEFERRED_ENTRIES) {
+    s_dropped++;
+    ble_npl_hw_exit_critical(0);
+    return;
+  }
+
+  Record &record = s_records[(s_head + s_count) % CONFIG_NIMBLE_CPP_LOG_DEFERRED_ENTRIES];
+  record.timestamp = timestamp;
+  record.tag = tag;
+  record.format = format;
+  for (size_t i = 0; i < MAX_ARGS; i++) {
+    record.args[i] = args[i];
+  }
+  record.level = level;
+  s_count++;
+  ble_npl_hw_exit_critical(0);
+}// push
+
+/**
+ * @brief Take the oldest record from the buffer.
+ * @param [out] record The record.
+ * @return True if a record was taken, false if the buffer is empty.
+ */
+/*STATIC*/
+bool LogBuffer::pop(Record *record) {
+  ble_npl_hw_enter_critical();
+  if (s_count == 0) {
+    ble_npl_hw_exit_critical(0);
+    return false;
+  }
+
+  *record = s_records[s_head];
+  s_head = (s_head + 1) % CONFIG_NIMBLE_CPP_LOG_DEFERRED_ENTRIES;
+  s_count--;
+  ble_npl_hw_exit_critical(0);
+  return true;
+}// pop
+
+/**
+ * @brief Format and print all buffered records.
+ */
+/*STATIC*/
+void LogBuffer::flush() {
+  static const char LEVEL_CHARS[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+
+  Record record;
+  char line[160];
+
+  while (pop(&record)) {
+    snprintf(line, sizeof(line), record.format,
+             record.args[0], record.args[1], record.args[2], record.args[3], record.args[4], record.args[5]);
+    esp_log_write(record.level, record.tag, "%c (%" PRIu32 ") %s: %s\n",
+                  LEVEL_CHARS[record.level], record.timestamp, record.tag, line);
+  }
+
+  ble_npl_hw_enter_critical();
+  uint32_t dropped = s_dropped;
+  s_dropped = 0;
+  ble_npl_hw_exit_critical(0);
+
+  if (dropped > 0) {
+    ESP_LOGW(LOG_TAG, "%" PRIu32 " log records dropped, buffer full", dropped);
+  }
+}// flush
+
+/**
+ * @brief The low priority task printing the buffered records.
+ */
+/*STATIC*/
+void LogBuffer::task(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLUSH_INTERVAL_MS));
+    flush();
+
+    if (s_stop) {
+      s_task = nullptr;
+      vTaskDelete(nullptr);
+    }
+  }
+}// task
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_NIMBLE_CPP_LOG_DEFERRED */
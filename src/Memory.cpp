@@ -0,0 +1,290 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include "nimble/Memory.hpp"
+
+#include "nimble/Log.hpp"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <esp_heap_caps.h>
+
+static const char *LOG_TAG = "NimBLEMemory";
+
+namespace nimble {
+
+/**
+ * @brief The live counters of one subsystem.
+ */
+struct SubsystemUsage {
+  std::atomic<uint32_t> bytes{0};
+  std::atomic<uint32_t> blocks{0};
+  std::atomic<uint32_t> peakBytes{0};
+  std::atomic<uint32_t> failures{0};
+};
+
+#if CONFIG_NIMBLE_CPP_MEMORY_SPIRAM
+static constexpr uint32_t HOT_CAPS = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+static constexpr uint32_t COLD_CAPS = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+#else
+static constexpr uint32_t HOT_CAPS = MALLOC_CAP_DEFAULT;
+static constexpr uint32_t COLD_CAPS = MALLOC_CAP_DEFAULT;
+#endif
+
+static void *defaultAllocate(size_t size, uint32_t caps) {
+  return heap_caps_malloc(size, caps);
+}
+
+static void *defaultReallocate(void *ptr, size_t size, uint32_t caps) {
+  return heap_caps_realloc(ptr, size, caps);
+}
+
+static void defaultRelease(void *ptr) {
+  heap_caps_free(ptr);
+}
+
+static const MemoryAllocator DEFAULT_ALLOCATOR = {defaultAllocate, defaultReallocate, defaultRelease};
+
+static const MemoryAllocator *s_pAllocator = &DEFAULT_ALLOCATOR;
+static std::atomic<uint32_t> s_caps[Memory::SUBSYSTEM_MAX] = {{COLD_CAPS}, {HOT_CAPS}, {COLD_CAPS}, {HOT_CAPS}};
+static SubsystemUsage s_usage[Memory::SUBSYSTEM_MAX];
+
+/**
+ * @brief Count an allocation or a release of a subsystem.
+ * @param [in] subsystem The subsystem.
+ * @param [in] added The bytes allocated.
+ * @param [in] removed The bytes released.
+ * @param [in] blocks The change of the number of live allocations.
+ */
+static void account(Memory::Subsystem subsystem, size_t added, size_t removed, int blocks) {
+#if CONFIG_NIMBLE_CPP_STATS
+  SubsystemUsage &usage = s_usage[subsystem];
+  // The counters wrap, adding the difference modulo 2^32 also subtracts.
+  const auto delta = (uint32_t) (added - removed);
+  uint32_t bytes = usage.bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+  usage.blocks.fetch_add((uint32_t) blocks, std::memory_order_relaxed);
+
+  uint32_t peak = usage.peakBytes.load(std::memory_order_relaxed);
+  while (bytes > peak && !usage.peakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+  }
+#endif
+}// account
+
+/**
+ * @brief Count a failed allocation of a subsystem.
+ * @param [in] subsystem The subsystem.
+ * @param [in] size The size requested.
+ */
+static void accountFailure(Memory::Subsystem subsystem, size_t size) {
+  NIMBLE_LOGE(LOG_TAG, "Failed to allocate %d bytes, subsystem %d", size, subsystem);
+#if CONFIG_NIMBLE_CPP_STATS
+  s_usage[subsystem].failures.fetch_add(1, std::memory_order_relaxed);
+#endif
+}// accountFailure
+
+/**
+ * @brief Replace the functions the subsystem memory is allocated with.
+ * @param [in] pAllocator The allocator, which must stay valid, or nullptr to restore the default heap_caps_* functions.
+ * @details Must be called before Device::init() and before any library object is created, memory is
+ * always released by the allocator that allocated it.
+ */
+/*STATIC*/
+void Memory::setAllocator(const MemoryAllocator *pAllocator) {
+  s_pAllocator = pAllocator != nullptr ? pAllocator : &DEFAULT_ALLOCATOR;
+}// setAllocator
+
+/**
+ * @brief Set the heap capabilities a subsystem allocates from.
+ * @param [in] subsystem The subsystem.
+ * @param [in] caps The MALLOC_CAP_* flags, e.g. MALLOC_CAP_SPIRAM to keep the scan results in PSRAM.
+ * @details Applies to the allocations made afterwards, memory already allocated stays where it is.
+ */
+/*STATIC*/
+void Memory::setCaps(Subsystem subsystem, uint32_t caps) {
+  s_caps[subsystem].store(caps, std::memory_order_relaxed);
+}// setCaps
+
+/**
+ * @brief Get the heap capabilities a subsystem allocates from.
+ * @param [in] subsystem The subsystem.
+ * @return The MALLOC_CAP_* flags.
+ */
+/*STATIC*/
+uint32_t Memory::getCaps(Subsystem subsystem) {
+  return s_caps[subsystem].load(std::memory_order_relaxed);
+}// getCaps
+
+/**
+ * @brief Allocate memory for a subsystem.
+ * @param [in] subsystem The subsystem.
+ * @param [in] size The size in bytes.
+ * @return The memory or nullptr if the heap is exhausted.
+ */
+/*STATIC*/
+void *Memory::allocate(Subsystem subsystem, size_t size) {
+  const uint32_t caps = getCaps(subsystem);
+  void *ptr = s_pAllocator->allocate(size, caps);
+  if (ptr == nullptr && (caps & MALLOC_CAP_SPIRAM)) {
+    ptr = s_pAllocator->allocate(size, MALLOC_CAP_DEFAULT);
+  }
+
+  if (ptr == nullptr) {
+    accountFailure(subsystem, size);
+    return nullptr;
+  }
+
+  account(subsystem, size, 0, 1);
+  return ptr;
+}// allocate
+
+/**
+ * @brief Resize memory of a subsystem.
+ * @param [in] subsystem The subsystem.
+ * @param [in] ptr The memory, may be nullptr to allocate.
+ * @param [in] oldSize The size the memory was allocated with.
+ * @param [in] size The new size in bytes.
+ * @return The memory, moved if needed, or nullptr if the heap is exhausted and ptr is left unchanged.
+ */
+/*STATIC*/
+void *Memory::reallocate(Subsystem subsystem, void *ptr, size_t oldSize, size_t size) {
+  if (ptr == nullptr) {
+    return allocate(subsystem, size);
+  }
+
+  const uint32_t caps = getCaps(subsystem);
+  void *res = s_pAllocator->reallocate(ptr, size, caps);
+  if (res == nullptr && (caps & MALLOC_CAP_SPIRAM)) {
+    res = s_pAllocator->reallocate(ptr, size, MALLOC_CAP_DEFAULT);
+  }
+
+  if (res == nullptr) {
+    accountFailure(subsystem, size);
+    return nullptr;
+  }
+
+  account(subsystem, size, oldSize, 0);
+  return res;
+}// reallocate
+
+/**
+ * @brief Release memory of a subsystem.
+ * @param [in] subsystem The subsystem.
+ * @param [in] ptr The memory, may be nullptr.
+ * @param [in] size The size the memory was allocated with.
+ */
+/*STATIC*/
+void Memory::release(Subsystem subsystem, void *ptr, size_t size) {
+  if (ptr == nullptr) {
+    return;
+  }
+
+  s_pAllocator->release(ptr);
+  account(subsystem, 0, size, -1);
+}// release
+
+/**
+ * @brief Allocate memory for an object of a subsystem, the library is built without exceptions.
+ * @param [in] subsystem The subsystem.
+ * @param [in] size The size in bytes.
+ * @return The memory, aborts if the heap is exhausted like the global operator new.
+ */
+/*STATIC*/
+void *Memory::allocateObject(Subsystem subsystem, size_t size) {
+  void *ptr = allocate(subsystem, size);
+  if (ptr == nullptr) {
+    abort();
+  }
+
+  return ptr;
+}// allocateObject
+
+/**
+ * @brief Get the heap usage of the subsystems.
+ * @return The usage counted so far, all zero unless CONFIG_NIMBLE_CPP_STATS is enabled, and the free heap.
+ */
+/*STATIC*/
+MemoryStats Memory::snapshot() {
+  MemoryUsage usage[SUBSYSTEM_MAX]{};
+  uint32_t total = 0;
+  for (size_t i = 0; i < SUBSYSTEM_MAX; i++) {
+    usage[i].bytes = s_usage[i].bytes.load(std::memory_order_relaxed);
+    usage[i].blocks = s_usage[i].blocks.load(std::memory_order_relaxed);
+    usage[i].peakBytes = s_usage[i].peakBytes.load(std::memory_order_relaxed);
+    usage[i].failures = s_usage[i].failures.load(std::memory_order_relaxed);
+    total += usage[i].bytes;
+  }
+
+  MemoryStats stats{};
+  stats.scan = usage[SCAN];
+  stats.attributeValues = usage[ATTRIBUTE_VALUE];
+  stats.clientAttributes = usage[CLIENT];
+  stats.serverDefinitions = usage[SERVER];
+  stats.totalBytes = total;
+  stats.freeInternal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  stats.freeSpiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  return stats;
+}// snapshot
+
+/**
+ * @brief Restart the peaks and failure counts from the current usage.
+ */
+/*STATIC*/
+void Memory::reset() {
+  for (auto &usage : s_usage) {
+    usage.peakBytes.store(usage.bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    usage.failures.store(0, std::memory_order_relaxed);
+  }
+}// reset
+
+/**
+ * @brief Append the usage of a subsystem as a JSON object.
+ * @param [in] out The string to append to.
+ * @param [in] name The key of the object.
+ * @param [in] usage The usage.
+ */
+static void appendJson(std::string &out, const char *name, const MemoryUsage &usage) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "\"%s\":{\"bytes\":%" PRIu32 ",\"blocks\":%" PRIu32 ",\"peak_bytes\":%" PRIu32 ",\"failures\":%" PRIu32 "},",
+           name, usage.bytes, usage.blocks, usage.peakBytes, usage.failures);
+  out += buf;
+}// appendJson
+
+/**
+ * @brief Format the heap usage as a single line JSON object.
+ * @return The usage of each subsystem by name, the total and the free heap.
+ */
+std::string MemoryStats::toJson() const {
+  std::string out("{");
+  out.reserve(4 * 100 + 96);
+  appendJson(out, "scan", scan);
+  appendJson(out, "attribute_values", attributeValues);
+  appendJson(out, "client_attributes", clientAttributes);
+  appendJson(out, "server_definitions", serverDefinitions);
+
+  char buf[96];
+  snprintf(buf, sizeof(buf), "\"total_bytes\":%" PRIu32 ",\"free_internal\":%" PRIu32 ",\"free_spiram\":%" PRIu32 "}",
+           totalBytes, freeInternal, freeSpiram);
+  out += buf;
+  return out;
+}// toJson
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
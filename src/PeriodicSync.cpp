@@ -0,0 +1,317 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER) && CONFIG_BT_NIMBLE_EXT_ADV && CONFIG_BT_NIMBLE_ENABLE_PERIODIC_SYNC
+
+#include "nimble/PeriodicSync.hpp"
+
+#include "nimble/AdvertisedDevice.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static const char *LOG_TAG = "NimBLEPeriodicSync";
+
+namespace nimble {
+
+static PeriodicSyncCallbacks defaultCallbacks;
+
+/**
+ * @brief The sync being established, the controller allows only one at a time.
+ * @details The establishment event is routed through this rather than the callback argument so a
+ * sync deleted while pending does not receive it.
+ */
+static PeriodicSync *s_pPending = nullptr;
+
+/**
+ * @brief Constructor.
+ * @param [in] pCallbacks The callbacks, may be nullptr.
+ */
+PeriodicSync::PeriodicSync(PeriodicSyncCallbacks *pCallbacks) {
+  m_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+  m_handle = 0;
+  m_interval = 0;
+  m_sid = 0;
+  m_phy = 0;
+  m_synced = false;
+}// PeriodicSync
+
+/**
+ * @brief Destructor, cancels or terminates the sync.
+ */
+PeriodicSync::~PeriodicSync() {
+  if (isPending()) {
+    cancel();
+    s_pPending = nullptr;
+  }
+
+  terminate();
+}// ~PeriodicSync
+
+/**
+ * @brief Start synchronizing with the periodic advertising of a device.
+ * @param [in] address The address of the advertiser.
+ * @param [in] sid The advertising set ID of the periodic advertising.
+ * @param [in] skip The number of periodic events that can be skipped, trading latency for power.
+ * @param [in] timeoutMs The time without receiving a periodic event after which the sync is lost,
+ * 100ms to 163840ms.
+ * @return True if the sync is being established, the result is passed to PeriodicSyncCallbacks::onSync().
+ */
+bool PeriodicSync::create(const Address &address, uint8_t sid, uint16_t skip, uint32_t timeoutMs) {
+  if (m_synced || isPending()) {
+    NIMBLE_LOGE(LOG_TAG, "Already synced or pending");
+    return false;
+  }
+
+  if (s_pPending != nullptr) {
+    NIMBLE_LOGE(LOG_TAG, "Another sync is being established");
+    return false;
+  }
+
+  ble_addr_t addr;
+  memcpy(&addr.val, address.getNative(), 6);
+  addr.type = address.getType();
+
+  ble_gap_periodic_sync_params params;
+  memset(&params, 0, sizeof(params));
+  params.skip = skip;
+  params.sync_timeout = std::min<uint32_t>(std::max<uint32_t>(timeoutMs / 10, 10), 0x4000);
+
+  int rc = ble_gap_periodic_adv_sync_create(&addr, sid, &params, PeriodicSync::handleGapEvent, this);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Sync create failed, rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  m_address = address;
+  m_sid = sid;
+  m_report.clear();
+  s_pPending = this;
+  return true;
+}// create
+
+/**
+ * @brief Start synchronizing with the periodic advertising of a scanned device.
+ * @param [in] pDevice The device, from an extended advertising report with a periodic interval.
+ * @param [in] skip The number of periodic events that can be skipped.
+ * @param [in] timeoutMs The time without receiving a periodic event after which the sync is lost.
+ * @return True if the sync is being established.
+ */
+bool PeriodicSync::create(AdvertisedDevice *pDevice, uint16_t skip, uint32_t timeoutMs) {
+  if (pDevice->getPeriodicInterval() == 0) {
+    NIMBLE_LOGE(LOG_TAG, "Device is not periodic advertising");
+    return false;
+  }
+
+  return create(pDevice->getAddress(), pDevice->getSetId(), skip, timeoutMs);
+}// create
+
+/**
+ * @brief Cancel a sync being established, onSync() is then called with an error status.
+ * @return True if successful.
+ */
+bool PeriodicSync::cancel() {
+  if (!isPending()) {
+    return true;
+  }
+
+  int rc = ble_gap_periodic_adv_sync_create_cancel();
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "Sync cancel failed, rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// cancel
+
+/**
+ * @brief Stop receiving the periodic advertising.
+ * @return True if successful.
+ * @note onLost() is not called for a sync terminated by the application.
+ */
+bool PeriodicSync::terminate() {
+  if (!m_synced) {
+    return true;
+  }
+
+  int rc = ble_gap_periodic_adv_sync_terminate(m_handle);
+  if (rc != 0 && rc != BLE_HS_ENOTCONN) {
+    NIMBLE_LOGE(LOG_TAG, "Sync terminate failed, rc=%d %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  m_synced = false;
+  m_report.clear();
+  return true;
+}// terminate
+
+/**
+ * @brief Set the callbacks.
+ * @param [in] pCallbacks The callbacks, nullptr for none.
+ */
+void PeriodicSync::setCallbacks(PeriodicSyncCallbacks *pCallbacks) {
+  m_pCallbacks = pCallbacks != nullptr ? pCallbacks : &defaultCallbacks;
+}// setCallbacks
+
+/**
+ * @brief Check if the sync is established.
+ * @return True if receiving the periodic advertising.
+ */
+bool PeriodicSync::isSynced() const {
+  return m_synced;
+}// isSynced
+
+/**
+ * @brief Check if the sync is being established.
+ * @return True if waiting for the first periodic event.
+ */
+bool PeriodicSync::isPending() const {
+  return s_pPending == this;
+}// isPending
+
+/**
+ * @brief Get the sync handle.
+ * @return The handle assigned by the controller, only valid when synced.
+ */
+uint16_t PeriodicSync::getHandle() const {
+  return m_handle;
+}// getHandle
+
+/**
+ * @brief Get the address of the advertiser.
+ * @return The address.
+ */
+Address PeriodicSync::getAddress() const {
+  return m_address;
+}// getAddress
+
+/**
+ * @brief Get the advertising set ID.
+ * @return The set ID.
+ */
+uint8_t PeriodicSync::getSetId() const {
+  return m_sid;
+}// getSetId
+
+/**
+ * @brief Get the periodic advertising interval.
+ * @return The interval in 1.25ms units, only valid when synced.
+ */
+uint16_t PeriodicSync::getInterval() const {
+  return m_interval;
+}// getInterval
+
+/**
+ * @brief Get the PHY of the periodic advertising.
+ * @return The PHY, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED.
+ */
+uint8_t PeriodicSync::getPhy() const {
+  return m_phy;
+}// getPhy
+
+/**
+ * @brief Reassemble a periodic report and pass it to the callbacks once complete.
+ * @param [in] event The periodic report event.
+ */
+void PeriodicSync::onReport(const ble_gap_event &event) {
+  const auto &report = event.periodic_report;
+
+  switch (report.data_status) {
+  case BLE_HCI_PERIODIC_DATA_STATUS_COMPLETE:
+    // Most reports fit one PDU, pass those straight from the event.
+    if (m_report.empty()) {
+      m_pCallbacks->onReport(this, report.data, report.data_length, report.rssi, report.tx_power);
+      break;
+    }
+
+    m_report.insert(m_report.end(), report.data, report.data + report.data_length);
+    m_pCallbacks->onReport(this, m_report.data(), m_report.size(), report.rssi, report.tx_power);
+    m_report.clear();
+    break;
+
+  case BLE_HCI_PERIODIC_DATA_STATUS_INCOMPLETE:
+    m_report.insert(m_report.end(), report.data, report.data + report.data_length);
+    break;
+
+  default:
+    NIMBLE_LOGD(LOG_TAG, "Truncated periodic report dropped");
+    m_report.clear();
+    break;
+  }
+}// onReport
+
+/**
+ * @brief Handle the periodic sync GAP events.
+ * @param [in] event The event.
+ * @param [in] arg The PeriodicSync the event is for.
+ */
+/*STATIC*/
+int PeriodicSync::handleGapEvent(ble_gap_event *event, void *arg) {
+  switch (event->type) {
+  case BLE_GAP_EVENT_PERIODIC_SYNC: {
+    PeriodicSync *pSync = s_pPending;
+    s_pPending = nullptr;
+
+    if (pSync == nullptr) {
+      // The sync was deleted while being established.
+      if (event->periodic_sync.status == 0) {
+        ble_gap_periodic_adv_sync_terminate(event->periodic_sync.sync_handle);
+      }
+      return 0;
+    }
+
+    if (event->periodic_sync.status == 0) {
+      pSync->m_handle = event->periodic_sync.sync_handle;
+      pSync->m_interval = event->periodic_sync.per_adv_ival;
+      pSync->m_phy = event->periodic_sync.adv_phy;
+      pSync->m_synced = true;
+      NIMBLE_LOGI(LOG_TAG, "Synced, handle=%d, interval=%d", pSync->m_handle, pSync->m_interval);
+    } else {
+      NIMBLE_LOGW(LOG_TAG, "Sync failed, status=%d", event->periodic_sync.status);
+    }
+
+    pSync->m_pCallbacks->onSync(pSync, event->periodic_sync.status);
+    return 0;
+  }
+
+  case BLE_GAP_EVENT_PERIODIC_REPORT: {
+    auto *pSync = static_cast<PeriodicSync *>(arg);
+    if (pSync->m_synced && event->periodic_report.sync_handle == pSync->m_handle) {
+      pSync->onReport(*event);
+    }
+    return 0;
+  }
+
+  case BLE_GAP_EVENT_PERIODIC_SYNC_LOST: {
+    auto *pSync = static_cast<PeriodicSync *>(arg);
+    if (pSync->m_synced && event->periodic_sync_lost.sync_handle == pSync->m_handle) {
+      NIMBLE_LOGI(LOG_TAG, "Sync lost, reason=%d", event->periodic_sync_lost.reason);
+      pSync->m_synced = false;
+      pSync->m_report.clear();
+      pSync->m_pCallbacks->onLost(pSync, event->periodic_sync_lost.reason);
+    }
+    return 0;
+  }
+
+  default:
+    return 0;
+  }
+}// handleGapEvent
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_OBSERVER && CONFIG_BT_NIMBLE_EXT_ADV && CONFIG_BT_NIMBLE_ENABLE_PERIODIC_SYNC */
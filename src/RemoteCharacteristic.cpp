@@ -17,8 +17,12 @@
 
 #include "nimble/RemoteCharacteristic.hpp"
 
+#include <algorithm>
 #include <climits>
 
+#include <os/os_mbuf.h>
+
+#include "nimble/ConnParamsManager.hpp"
 #include "nimble/Log.hpp"
 #include "nimble/Utils.hpp"
 
@@ -422,6 +426,14 @@ AttributeValue RemoteCharacteristic::getValue(time_t *timestamp) {
   return m_value;
 }// getValue
 
+/**
+ * @brief Get a view of the last value read or notified that does not copy it.
+ * @return A view of the value, valid until the value is next read or notified.
+ */
+AttributeValueView RemoteCharacteristic::getValueView() const {
+  return m_value.view();
+}// getValueView
+
 /**
  * @brief Read the value of the remote characteristic.
  * @param [in] timestamp A pointer to a time_t struct to store the time the value was read.
@@ -445,6 +457,7 @@ AttributeValue RemoteCharacteristic::readValue(time_t *timestamp) {
   ble_task_data_t taskData = {this, cur_task, 0, &value};
 
   do {
+    NIMBLE_STAT_START(start);
     rc = ble_gattc_read_long(pClient->getConnId(), m_handle, 0,
                              RemoteCharacteristic::onReadCB,
                              &taskData);
@@ -460,6 +473,9 @@ AttributeValue RemoteCharacteristic::readValue(time_t *timestamp) {
 #endif
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     rc = taskData.rc;
+#if CONFIG_NIMBLE_CPP_STATS
+    recordLatency(Stats::GATT_READ, start);
+#endif
 
     switch (rc) {
     case 0:
@@ -493,6 +509,38 @@ AttributeValue RemoteCharacteristic::readValue(time_t *timestamp) {
   return value;
 }// readValue
 
+/**
+ * @brief Read the value of the remote characteristic without blocking.
+ * @param [in] callback Called from the NimBLE host task when the read completes.
+ * @return A handle to the result of the read.
+ * @details On success the value returned by getValue() is updated before the callback is called.
+ * Insufficient authentication errors are reported to the callback rather than retried after
+ * securing the connection, as that would block the host task.
+ */
+GattFuture RemoteCharacteristic::readValueAsync(gatt_complete_callback callback) {
+  NIMBLE_LOGD(LOG_TAG, ">> readValueAsync(): handle: %d 0x%.2x", getHandle(), getHandle());
+
+  Client *pClient = getRemoteService()->getClient();
+
+  if (!pClient->isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return GattFuture::failed(BLE_HS_ENOTCONN, std::move(callback));
+  }
+
+  return GattFuture::read(pClient->getConnId(), m_handle,
+                          [this, start = NIMBLE_STAT_NOW(), callback = std::move(callback)](int rc, const AttributeValue &value) {
+#if CONFIG_NIMBLE_CPP_STATS
+                            recordLatency(Stats::GATT_READ, start);
+#endif
+                            if (rc == 0) {
+                              m_value = value;
+                            }
+                            if (callback) {
+                              callback(rc, value);
+                            }
+                          });
+}// readValueAsync
+
 /**
  * @brief Callback for characteristic read operation.
  * @return success == 0 or error code.
@@ -563,6 +611,7 @@ bool RemoteCharacteristic::setNotify(uint16_t val, notify_callback notifyCallbac
  * @param [in] response If true, require a write response from the descriptor write operation.
  * If NULL is provided then no callback is performed.
  * @return false if writing to the descriptor failed.
+ * @details To subscribe to several characteristics at once use Client::subscribeAll().
  */
 bool RemoteCharacteristic::subscribe(bool notifications, notify_callback notifyCallback, bool response) {
   if (notifications) {
@@ -684,6 +733,7 @@ bool RemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool r
   int rc = 0;
   int retryCount = 1;
   uint16_t mtu = ble_att_mtu(pClient->getConnId()) - 3;
+  NIMBLE_CONN_TRAFFIC(pClient->getConnId(), length);
 
   // Check if the data length is longer than we can write in one connection event.
   // If so we must do a long write which requires a response.
@@ -696,6 +746,7 @@ bool RemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool r
   ble_task_data_t taskData = {this, cur_task, 0, nullptr};
 
   do {
+    NIMBLE_STAT_START(start);
     if (length > mtu) {
       NIMBLE_LOGI(LOG_TAG, "long write %d bytes", length);
       os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
@@ -719,6 +770,9 @@ bool RemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool r
 #endif
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     rc = taskData.rc;
+#if CONFIG_NIMBLE_CPP_STATS
+    recordLatency(Stats::GATT_WRITE, start);
+#endif
 
     switch (rc) {
     case 0:
@@ -747,6 +801,135 @@ bool RemoteCharacteristic::writeValue(const uint8_t *data, size_t length, bool r
   return (rc == 0);
 }// writeValue
 
+/**
+ * @brief Write a new value to the remote characteristic without blocking.
+ * @param [in] data A pointer to a data buffer, copied before returning.
+ * @param [in] length The length of the data in the data buffer.
+ * @param [in] callback Called from the NimBLE host task when the write completes.
+ * @param [in] response Whether we require a response from the write.
+ * @return A handle to the result of the write.
+ * @details A write without response that fits in one packet completes before returning.
+ */
+GattFuture RemoteCharacteristic::writeValueAsync(const uint8_t *data, size_t length,
+                                                 gatt_complete_callback callback, bool response) {
+  NIMBLE_LOGD(LOG_TAG, ">> writeValueAsync(), length: %d", length);
+
+  Client *pClient = getRemoteService()->getClient();
+
+  if (!pClient->isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return GattFuture::failed(BLE_HS_ENOTCONN, std::move(callback));
+  }
+
+  NIMBLE_CONN_TRAFFIC(pClient->getConnId(), length);
+  return GattFuture::write(pClient->getConnId(), m_handle, data, length, response, std::move(callback));
+}// writeValueAsync
+
+/**
+ * @brief Get the round trip times of the reads and writes with response of this characteristic.
+ * @return The histogram of the latencies, empty unless CONFIG_NIMBLE_CPP_STATS is enabled.
+ */
+LatencyStats RemoteCharacteristic::getLatencyStats() const {
+#if CONFIG_NIMBLE_CPP_STATS
+  return m_latency.snapshot();
+#else
+  return LatencyStats{};
+#endif
+}// getLatencyStats
+
+#if CONFIG_NIMBLE_CPP_STATS
+/**
+ * @brief Add a round trip time to the global histogram and the one of this characteristic.
+ * @param [in] latency The global histogram, GATT_READ or GATT_WRITE.
+ * @param [in] start The Stats::now() timestamp taken when the request was sent.
+ */
+void RemoteCharacteristic::recordLatency(Stats::Latency latency, uint32_t start) {
+  uint32_t us = Stats::now() - start;
+  Stats::record(latency, us);
+  m_latency.record(us);
+}// recordLatency
+#endif
+
+/**
+ * @brief Stream a buffer to the remote characteristic with writes without response.
+ * @param [in] data A pointer to the data to write.
+ * @param [in] length The length of the data.
+ * @param [out] stats If not nullptr, filled with the statistics of the write.
+ * @param [in] stallTimeoutMs How long to wait for buffers to become available before giving up.
+ * @return True if all the data was queued for transmission.
+ * @details The data is split in chunks of the current MTU - 3 and queued as fast as the host accepts them.
+ * When the host runs out of buffers the writer waits until the controller has taken enough packets
+ * for the buffer pool to grow again, then resumes with the chunk that failed, so no data is lost or reordered.
+ * The calling task is blocked until the data is queued, this must not be called from the NimBLE host task.
+ */
+bool RemoteCharacteristic::writeStream(const uint8_t *data, size_t length, StreamStats *stats, uint32_t stallTimeoutMs) {
+  NIMBLE_LOGD(LOG_TAG, ">> writeStream(), length: %d", length);
+
+  StreamStats result{};
+  Client *pClient = getRemoteService()->getClient();
+  ble_npl_time_t start = ble_npl_time_get();
+  ble_npl_time_t stallTicks = 0;
+  ble_npl_time_ms_to_ticks(stallTimeoutMs, &stallTicks);
+
+  int rc = 0;
+  size_t offset = 0;
+
+  while (offset < length) {
+    if (!pClient->isConnected()) {
+      NIMBLE_LOGE(LOG_TAG, "Disconnected");
+      rc = BLE_HS_ENOTCONN;
+      break;
+    }
+
+    // Re-read the MTU every chunk in case it was exchanged while streaming.
+    size_t chunk = std::min<size_t>(length - offset, ble_att_mtu(pClient->getConnId()) - 3);
+    int freeBlocks = os_msys_num_free();
+
+    rc = ble_gattc_write_no_rsp_flat(pClient->getConnId(), m_handle, data + offset, chunk);
+    if (rc == 0) {
+      NIMBLE_CONN_TRAFFIC(pClient->getConnId(), chunk);
+      offset += chunk;
+      result.packets++;
+      continue;
+    }
+
+    if (rc != BLE_HS_ENOMEM) {
+      NIMBLE_LOGE(LOG_TAG, "Error: Failed to write characteristic; rc=%d, %s", rc, Utils::returnCodeToString(rc));
+      break;
+    }
+
+    // Out of buffers, wait for the controller to complete packets and release them.
+    result.stalls++;
+    ble_npl_time_t stallStart = ble_npl_time_get();
+    while (os_msys_num_free() <= freeBlocks && pClient->isConnected()) {
+      if (ble_npl_time_get() - stallStart > stallTicks) {
+        NIMBLE_LOGE(LOG_TAG, "Timed out waiting for buffers");
+        rc = BLE_HS_ETIMEOUT;
+        break;
+      }
+      ble_npl_time_delay(1);
+    }
+
+    if (rc == BLE_HS_ETIMEOUT) {
+      break;
+    }
+    rc = 0;
+  }
+
+  result.bytesWritten = offset;
+  result.elapsedMs = ble_npl_time_ticks_to_ms32(ble_npl_time_get() - start);
+  result.bytesPerSecond = result.elapsedMs ? (uint32_t) ((uint64_t) offset * 1000 / result.elapsedMs) : offset;
+  result.rc = rc;
+
+  if (stats != nullptr) {
+    *stats = result;
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "<< writeStream, %d bytes in %lu ms, %lu B/s, %lu stalls, rc: %d",
+              offset, result.elapsedMs, result.bytesPerSecond, result.stalls, rc);
+  return rc == 0;
+}// writeStream
+
 /**
  * @brief Callback for characteristic write operation.
  * @return success == 0 or error code.
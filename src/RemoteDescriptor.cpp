@@ -139,6 +139,26 @@ AttributeValue RemoteDescriptor::readValue() {
   return value;
 }// readValue
 
+/**
+ * @brief Read the value of the remote descriptor without blocking.
+ * @param [in] callback Called from the NimBLE host task when the read completes.
+ * @return A handle to the result of the read.
+ * @details Insufficient authentication errors are reported to the callback rather than retried
+ * after securing the connection, as that would block the host task.
+ */
+GattFuture RemoteDescriptor::readValueAsync(gatt_complete_callback callback) {
+  NIMBLE_LOGD(LOG_TAG, ">> Descriptor readValueAsync: handle: %d", m_handle);
+
+  Client *pClient = getRemoteCharacteristic()->getRemoteService()->getClient();
+
+  if (!pClient->isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return GattFuture::failed(BLE_HS_ENOTCONN, std::move(callback));
+  }
+
+  return GattFuture::read(pClient->getConnId(), m_handle, std::move(callback));
+}// readValueAsync
+
 /**
  * @brief Callback for Descriptor read operation.
  * @return success == 0 or error code.
@@ -320,6 +340,28 @@ bool RemoteDescriptor::writeValue(const uint8_t *data, size_t length, bool respo
   return (rc == 0);
 }// writeValue
 
+/**
+ * @brief Write a new value to the remote descriptor without blocking.
+ * @param [in] data The data to send to the remote descriptor, copied before returning.
+ * @param [in] length The length of the data to send.
+ * @param [in] callback Called from the NimBLE host task when the write completes.
+ * @param [in] response True if we expect a write response.
+ * @return A handle to the result of the write.
+ */
+GattFuture RemoteDescriptor::writeValueAsync(const uint8_t *data, size_t length,
+                                             gatt_complete_callback callback, bool response) {
+  NIMBLE_LOGD(LOG_TAG, ">> Descriptor writeValueAsync, length: %d", length);
+
+  Client *pClient = getRemoteCharacteristic()->getRemoteService()->getClient();
+
+  if (!pClient->isConnected()) {
+    NIMBLE_LOGE(LOG_TAG, "Disconnected");
+    return GattFuture::failed(BLE_HS_ENOTCONN, std::move(callback));
+  }
+
+  return GattFuture::write(pClient->getConnId(), m_handle, data, length, response, std::move(callback));
+}// writeValueAsync
+
 }
 
 #endif /* CONFIG_BT_ENABLED && CONFIG_BT_NIMBLE_ROLE_CENTRAL */
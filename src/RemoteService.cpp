@@ -57,7 +57,10 @@ RemoteService::RemoteService(Client *pClient, const struct ble_gatt_svc *service
  * @brief When deleting the service make sure we delete all characteristics and descriptors.
  */
 RemoteService::~RemoteService() {
-  deleteCharacteristics();
+  // Only deleted once retired by the client, its characteristics are out of the handle table and no longer read.
+  for (auto &it : m_characteristicVector) {
+    delete it;
+  }
 }
 
 /**
@@ -251,6 +254,8 @@ bool RemoteService::retrieveCharacteristics(const UUID *uuid_filter) {
       }
     }
 
+    m_pClient->rebuildHandleTable();
+
     NIMBLE_LOGD(LOG_TAG, "<< retrieveCharacteristics()");
     return true;
   }
@@ -301,7 +306,7 @@ std::string RemoteService::getValue(const UUID &characteristicUuid) {
   RemoteCharacteristic *pChar = getCharacteristic(characteristicUuid);
 
   if (pChar != nullptr) {
-    ret = pChar->readValue();
+    ret = std::string(pChar->readValue());
   }
 
   NIMBLE_LOGD(LOG_TAG, "<< readValue");
@@ -336,10 +341,12 @@ bool RemoteService::setValue(const UUID &characteristicUuid, const std::string &
  */
 void RemoteService::deleteCharacteristics() {
   NIMBLE_LOGD(LOG_TAG, ">> deleteCharacteristics");
-  for (auto &it : m_characteristicVector) {
-    delete it;
-  }
-  m_characteristicVector.clear();
+  // Remove the characteristics from the client handle table before deleting them.
+  std::vector<RemoteCharacteristic *> characteristics;
+  characteristics.swap(m_characteristicVector);
+  m_pClient->rebuildHandleTable();
+  m_pClient->retire({}, std::move(characteristics));
+
   NIMBLE_LOGD(LOG_TAG, "<< deleteCharacteristics");
 }// deleteCharacteristics
 
@@ -353,8 +360,10 @@ size_t RemoteService::deleteCharacteristic(const UUID &uuid) {
 
   for (auto it = m_characteristicVector.begin(); it != m_characteristicVector.end(); ++it) {
     if ((*it)->getUUID() == uuid) {
-      delete *it;
+      RemoteCharacteristic *pChr = *it;
       m_characteristicVector.erase(it);
+      m_pClient->rebuildHandleTable();
+      m_pClient->retire({}, {pChr});
       break;
     }
   }
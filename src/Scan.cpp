@@ -15,12 +15,21 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
 
+#include "nimble/CallbackDispatcher.hpp"
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
+#include "nimble/Memory.hpp"
 #include "nimble/Scan.hpp"
 
+#include <algorithm>
 #include <climits>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <utility>
+
+#include <esp_timer.h>
+#include <nimble/nimble_port.h>
 
 static const char *LOG_TAG = "NimBLEScan";
 
@@ -41,15 +50,75 @@ Scan::Scan() {
   m_pTaskData = nullptr;
   m_duration = BLE_HS_FOREVER;// make sure this is non-zero in the event of a host reset
   m_maxResults = 0xFF;
+  m_rawReports = false;
+  m_changeRSSI = 0;
+  m_changeRefreshMs = 0;
+  m_ttlMs = 0;
+  m_schedule = {0, 0, 50};
+  m_stats = ScanStats{};
+  m_endAt = 0;
+  m_burstStart = 0;
+  m_pauseCount = 0;
+  m_scheduled = false;
+  m_bursting = false;
+  ble_npl_callout_init(&m_scheduleTimer, nimble_port_get_dflt_eventq(), Scan::scheduleTimerCb, this);
+
+#if CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE > 0
+  // Allocate all the devices up front so the scan path does not use the heap.
+  m_devicePool = new AdvertisedDevice[CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE];
+  m_freeDevices.reserve(CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE);
+  for (int i = CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE - 1; i >= 0; i--) {
+    m_freeDevices.push_back(&m_devicePool[i]);
+  }
+  m_scanResults.m_advertisedDevicesVector.reserve(CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE);
+#endif
 }
 
 /**
  * @brief Scan destructor, release any allocated resources.
  */
 Scan::~Scan() {
+  ble_npl_callout_deinit(&m_scheduleTimer);
   clearResults();
+#if CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE > 0
+  delete[] m_devicePool;
+#endif
 }
 
+/**
+ * @brief Get a new advertised device to store a scan result in.
+ * @return A pointer to a default initialized device, nullptr if none are available.
+ * @details When the device pool is enabled the device is taken from the pool, otherwise it is allocated.
+ */
+AdvertisedDevice *Scan::allocDevice() {
+#if CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE > 0
+  if (m_freeDevices.empty()) {
+    return nullptr;
+  }
+
+  AdvertisedDevice *advertisedDevice = m_freeDevices.back();
+  m_freeDevices.pop_back();
+  *advertisedDevice = AdvertisedDevice();
+  return advertisedDevice;
+#else
+  return new AdvertisedDevice();
+#endif
+}// allocDevice
+
+/**
+ * @brief Release a device obtained from allocDevice().
+ * @param [in] advertisedDevice The device to release, may be nullptr.
+ */
+void Scan::freeDevice(AdvertisedDevice *advertisedDevice) {
+#if CONFIG_NIMBLE_CPP_SCAN_DEVICE_POOL_SIZE > 0
+  if (advertisedDevice != nullptr) {
+    m_freeDevices.push_back(advertisedDevice);
+  }
+#else
+  delete advertisedDevice;
+#endif
+}// freeDevice
+
 /**
  * @brief Handle GAP events related to scans.
  * @param [in] event The event type for this event.
@@ -64,78 +133,181 @@ int Scan::handleGapEvent(ble_gap_event *event, void *arg) {
 
   case BLE_GAP_EVENT_EXT_DISC:
   case BLE_GAP_EVENT_DISC: {
+    NIMBLE_STAT_INC(SCAN_REPORTS);
+    pScan->m_stats.reports++;
+
     if (pScan->m_ignoreResults) {
-      NIMBLE_LOGI(LOG_TAG, "Scan op in progress - ignoring results");
+      NIMBLE_LOGI_DEFER(LOG_TAG, "Scan op in progress - ignoring results");
+      NIMBLE_STAT_INC(SCAN_DROPPED);
       return 0;
     }
 
+#if CONFIG_BT_NIMBLE_EXT_ADV
+    // With extended advertising enabled the stack reports every advertisement as BLE_GAP_EVENT_EXT_DISC.
+    const auto &disc = event->ext_disc;
+    const bool isLegacyAdv = disc.props & BLE_HCI_ADV_LEGACY_MASK;
+    const auto event_type = isLegacyAdv ? disc.legacy_event_type : disc.props;
+    const uint8_t dataLength = disc.data_length;
+#else
     const auto &disc = event->disc;
     const bool isLegacyAdv = true;
     const auto event_type = disc.event_type;
+    const uint8_t dataLength = disc.length_data;
+#endif
+    const bool isScanResponse = isLegacyAdv && event_type == BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP;
+
+    // Reject the reports the application is not interested in before anything is looked up or stored.
+    // Scan responses are left to the lookup below, they are kept only for devices already stored.
+    if (!isScanResponse && !pScan->m_filter.matches(disc.addr, disc.rssi, disc.data, dataLength)) {
+      NIMBLE_STAT_INC(SCAN_FILTERED);
+      pScan->m_stats.filtered++;
+      return 0;
+    }
+
+    // In raw report mode hand the report straight to the application without storing it.
+    if (pScan->m_rawReports) {
+      if (pScan->m_pScanCallbacks != nullptr) {
+        pScan->m_pScanCallbacks->onRawReport(disc);
+      }
+      return 0;
+    }
+
+    const int64_t now = esp_timer_get_time();
+
+    // Age out the devices not seen for the TTL, a few per report so there is never a long pause.
+    if (pScan->m_ttlMs > 0) {
+      pScan->evictExpired(now);
+    }
 
     Address advertisedAddress(disc.addr);
 
     // Examine our list of ignored addresses and stop processing if we don't want to see it or are already connected
     if (Device::isIgnored(advertisedAddress)) {
-      NIMBLE_LOGI(LOG_TAG, "Ignoring device: address: %s", advertisedAddress.toString().c_str());
+      NIMBLE_LOGI_DEFER(LOG_TAG, "Ignoring device: address: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(disc.addr.val));
+      NIMBLE_STAT_INC(SCAN_DROPPED);
       return 0;
     }
 
-    AdvertisedDevice *advertisedDevice = nullptr;
-
-    // If we've seen this device before get a pointer to it from the vector
-    for (auto &it : pScan->m_scanResults.m_advertisedDevicesVector) {
-      if (it->getAddress() == advertisedAddress) {
-        advertisedDevice = it;
-        break;
-      }
-    }
+    // If we've seen this device before get a pointer to it from the results index
+    AdvertisedDevice *advertisedDevice = pScan->m_scanResults.find(advertisedAddress);
 
     // If we haven't seen this device before; create a new instance and insert it in the vector.
     // Otherwise just update the relevant parameters of the already known device.
-    if ((advertisedDevice == nullptr) and (event_type != BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP)) {
+    if ((advertisedDevice == nullptr) and !isScanResponse) {
       // Check if we have reach the scan results limit, ignore this one if so.
       // We still need to store each device when maxResults is 0 to be able to append the scan results
-      if (pScan->m_maxResults > 0 && pScan->m_maxResults < 0xFF && (pScan->m_scanResults.m_advertisedDevicesVector.size() >= pScan->m_maxResults)) {
+      const std::size_t count = pScan->m_scanResults.m_advertisedDevicesVector.size();
+      bool full = pScan->m_maxResults > 0 && pScan->m_maxResults < 0xFF && count >= pScan->m_maxResults;
+
+      // With a TTL set the least recently seen device makes room for the new one instead.
+      if ((full || pScan->m_scanResults.isFull()) && pScan->m_ttlMs > 0) {
+        full = !pScan->evictOldest();
+      }
+
+      if (full) {
+        pScan->m_stats.dropped++;
+        NIMBLE_STAT_INC(SCAN_DROPPED);
+        return 0;
+      }
+
+      advertisedDevice = pScan->allocDevice();
+      if (advertisedDevice == nullptr && pScan->m_ttlMs > 0 && pScan->evictOldest()) {
+        advertisedDevice = pScan->allocDevice();
+      }
+      if (advertisedDevice == nullptr) {
+        NIMBLE_LOGW_DEFER(LOG_TAG, "Device pool empty - ignoring: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(disc.addr.val));
+        pScan->m_stats.dropped++;
+        NIMBLE_STAT_INC(SCAN_DROPPED);
         return 0;
       }
 
-      advertisedDevice = new AdvertisedDevice();
       advertisedDevice->setAddress(advertisedAddress);
       advertisedDevice->setAdvType(event_type, isLegacyAdv);
-      pScan->m_scanResults.m_advertisedDevicesVector.push_back(advertisedDevice);
-      NIMBLE_LOGI(LOG_TAG, "New advertiser: %s", advertisedAddress.toString().c_str());
+#if CONFIG_BT_NIMBLE_EXT_ADV
+      advertisedDevice->setSetId(disc.sid);
+      advertisedDevice->setPrimaryPhy(disc.prim_phy);
+      advertisedDevice->setSecondaryPhy(disc.sec_phy);
+      advertisedDevice->setPeriodicInterval(disc.periodic_adv_itvl);
+#endif
+
+      if (not pScan->m_scanResults.insert(advertisedDevice)) {
+        NIMBLE_LOGW_DEFER(LOG_TAG, "Scan results full - ignoring: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(disc.addr.val));
+        pScan->freeDevice(advertisedDevice);
+        pScan->m_stats.dropped++;
+        NIMBLE_STAT_INC(SCAN_DROPPED);
+        return 0;
+      }
+
+      NIMBLE_LOGI_DEFER(LOG_TAG, "New advertiser: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(disc.addr.val));
     } else if (advertisedDevice != nullptr) {
-      NIMBLE_LOGI(LOG_TAG, "Updated advertiser: %s", advertisedAddress.toString().c_str());
+      NIMBLE_LOGI_DEFER(LOG_TAG, "Updated advertiser: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(disc.addr.val));
     } else {
       // Scan response from unknown device
+      NIMBLE_STAT_INC(SCAN_DROPPED);
       return 0;
     }
 
+    // In report on change mode a device already reported is reported again only if its data
+    // changed, its RSSI moved or the refresh interval passed.
+    bool changed = true;
+    if (pScan->m_changeRSSI > 0 && advertisedDevice->m_callbackSent >= 2 && !pScan->m_scan_params.filter_duplicates) {
+      changed = (!isScanResponse && (advertisedDevice->m_advLength != dataLength || memcmp(advertisedDevice->m_payload, disc.data, dataLength) != 0));
+    }
+
     advertisedDevice->m_timestamp = time(nullptr);
     advertisedDevice->setRSSI(disc.rssi);
-    advertisedDevice->setPayload(disc.data, disc.length_data, (event_type == BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP));
+    if (!isScanResponse) {
+      advertisedDevice->addSighting(disc.rssi, now);
+      pScan->m_scanResults.touch(advertisedDevice);
+    }
+    advertisedDevice->setPayload(disc.data, dataLength, isScanResponse);
+
+    if (!changed) {
+      changed = std::abs(advertisedDevice->getRSSIAverage() - advertisedDevice->m_reportedRSSI) >= pScan->m_changeRSSI ||
+                (pScan->m_changeRefreshMs > 0 && now - advertisedDevice->m_reportedAt >= (int64_t) pScan->m_changeRefreshMs * 1000);
+
+      if (!changed) {
+        NIMBLE_STAT_INC(SCAN_DEDUPED);
+        return 0;
+      }
+    }
 
     if (pScan->m_pScanCallbacks) {
       if (advertisedDevice->m_callbackSent == 0 || !pScan->m_scan_params.filter_duplicates) {
         advertisedDevice->m_callbackSent = 1;
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+        CallbackDispatcher::dispatchScan(false, advertisedDevice, pScan->m_pScanCallbacks);
+#else
         pScan->m_pScanCallbacks->onDiscovered(advertisedDevice);
+#endif
       }
 
       if (pScan->m_scan_params.filter_duplicates && advertisedDevice->m_callbackSent >= 2) {
+        NIMBLE_STAT_INC(SCAN_DEDUPED);
         return 0;
       }
 
       // If not active scanning or scan response is not available
       // or extended advertisement scanning, report the result to the callback now.
+      bool report = false;
       if (pScan->m_scan_params.passive != 0 or (advertisedDevice->getAdvType() != BLE_HCI_ADV_TYPE_ADV_IND and advertisedDevice->getAdvType() != BLE_HCI_ADV_TYPE_ADV_SCAN_IND)) {
         advertisedDevice->m_callbackSent = 2;
-        pScan->m_pScanCallbacks->onResult(advertisedDevice);
+        report = true;
 
         // Otherwise, wait for the scan response so we can report the complete data.
-      } else if (event_type == BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP) {
+      } else if (isScanResponse) {
         advertisedDevice->m_callbackSent = 2;
+        report = true;
+      }
+
+      if (report) {
+        advertisedDevice->m_reportedRSSI = advertisedDevice->getRSSIAverage();
+        advertisedDevice->m_reportedAt = now;
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+        CallbackDispatcher::dispatchScan(true, advertisedDevice, pScan->m_pScanCallbacks);
+#else
         pScan->m_pScanCallbacks->onResult(advertisedDevice);
+#endif
       }
       // If not storing results and we have invoked the callback, delete the device.
       if (pScan->m_maxResults == 0 && advertisedDevice->m_callbackSent >= 2) {
@@ -149,19 +321,14 @@ int Scan::handleGapEvent(ble_gap_event *event, void *arg) {
     NIMBLE_LOGD(LOG_TAG, "discovery complete; reason=%d",
                 event->disc_complete.reason);
 
-    if (pScan->m_maxResults == 0) {
-      pScan->clearResults();
-    }
+    pScan->endBurst();
 
-    if (pScan->m_pScanCallbacks != nullptr) {
-      pScan->m_pScanCallbacks->onScanEnd(pScan->m_scanResults);
-    }
-
-    if (pScan->m_pTaskData != nullptr) {
-      pScan->m_pTaskData->rc = event->disc_complete.reason;
-      xTaskNotifyGive(pScan->m_pTaskData->task);
+    // A burst of a scheduled scan ended, the scan goes on after the rest.
+    if (event->disc_complete.reason == 0 && pScan->nextBurst()) {
+      return 0;
     }
 
+    pScan->finish(event->disc_complete.reason);
     return 0;
   }
 
@@ -230,6 +397,96 @@ void Scan::setMaxResults(uint8_t maxResults) {
   m_maxResults = maxResults;
 }
 
+/**
+ * @brief Set whether advertisement reports are passed directly to ScanCallbacks::onRawReport.
+ * @param [in] enabled If true, reports are not checked against the ignore list, not stored
+ * in the scan results and onDiscovered/onResult are not called.
+ */
+void Scan::setRawReports(bool enabled) {
+  m_rawReports = enabled;
+}// setRawReports
+
+/**
+ * @brief Set the rules a report must pass to be stored or passed to the callbacks, see ScanFilter.
+ * @details The rules are evaluated on the raw report before any device is looked up or allocated,
+ * which keeps crowded environments cheap when only a few devices are of interest. They also apply
+ * to raw reports.
+ * @param [in] filter The rules, an empty ScanFilter to pass every report.
+ * @note Set the filters before starting the scan, they are read from the host task.
+ */
+void Scan::setFilters(const ScanFilter &filter) {
+  m_filter = filter;
+}// setFilters
+
+/**
+ * @brief Only call the callbacks again for a device already reported when something significant changed.
+ * @details Meant for presence detection with duplicates wanted, where every advertisement would
+ * otherwise call the callbacks. Every advertisement still updates the RSSI average and the other
+ * sighting aggregates of the device, but the callbacks are only called again when its advertising
+ * data changed, its average RSSI moved by at least rssiDelta since it was last reported or refreshMs
+ * passed since then.
+ * @param [in] rssiDelta The change of the average RSSI in dBm to report, 0 to report every advertisement.
+ * @param [in] refreshMs Report the device at least this often in milliseconds, 0 to report on change only.
+ * @note Has no effect when the duplicate filter is enabled, and needs the results to be stored,
+ * see setMaxResults().
+ */
+void Scan::setReportOnChange(uint8_t rssiDelta, uint32_t refreshMs) {
+  m_changeRSSI = rssiDelta;
+  m_changeRefreshMs = refreshMs;
+}// setReportOnChange
+
+/**
+ * @brief Remove the devices not seen for some time from the results, for scans running indefinitely.
+ * @details The devices are linked in the order they were last seen, so the oldest is always at hand.
+ * Each report removes at most a couple of expired devices, each in constant time, so the cost is
+ * spread over the scan rather than paid at once.
+ * While a TTL is set, a new device arriving with the results full replaces the least recently seen
+ * device instead of being ignored.
+ * @param [in] ttlMs The time in milliseconds a device stays in the results after it was last seen,
+ * 0 to keep them until clearResults().
+ * @note A removed device is deleted, pointers obtained from the results or in the callbacks must
+ * not be kept when a TTL is set.
+ */
+void Scan::setResultTTL(uint32_t ttlMs) {
+  m_ttlMs = ttlMs;
+}// setResultTTL
+
+/**
+ * @brief Remove the least recently seen device from the results.
+ * @return True if a device was removed, false if the results are empty.
+ * @details Constant time: the oldest device is the head of the last seen list and is removed through the index.
+ */
+bool Scan::evictOldest() {
+  AdvertisedDevice *pOldest = m_scanResults.m_pOldest;
+  if (pOldest == nullptr) {
+    return false;
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "Evicting: " NIMBLE_ADDR_FMT, NIMBLE_ADDR_ARGS(pOldest->m_address.getNative()));
+  freeDevice(m_scanResults.remove(pOldest->getAddress()));
+  m_stats.evicted++;
+  return true;
+}// evictOldest
+
+/**
+ * @brief Remove a bounded number of devices last seen longer than the TTL ago.
+ * @details At most EVICT_PER_REPORT constant time removals, whatever the number of stored devices.
+ * @param [in] now The current time in microseconds.
+ */
+void Scan::evictExpired(int64_t now) {
+  static constexpr uint8_t EVICT_PER_REPORT = 2;
+  const int64_t ttlUs = (int64_t) m_ttlMs * 1000;
+
+  for (uint8_t i = 0; i < EVICT_PER_REPORT; i++) {
+    const AdvertisedDevice *pOldest = m_scanResults.m_pOldest;
+    if (pOldest == nullptr || now - pOldest->m_lastSeen < ttlUs) {
+      break;
+    }
+
+    evictOldest();
+  }
+}// evictExpired
+
 /**
  * @brief Set the call backs to be invoked.
  * @param [in] pScanCallbacks Call backs to be invoked.
@@ -261,7 +518,7 @@ void Scan::setWindow(uint16_t windowMSecs) {
  * @return true if scanning or scan starting.
  */
 bool Scan::isScanning() {
-  return ble_gap_disc_active();
+  return m_scheduled || ble_gap_disc_active();
 }
 
 /**
@@ -286,7 +543,15 @@ bool Scan::start(uint32_t duration, bool is_continue) {
     m_ignoreResults = true;
   }
 
-  int rc = ble_gap_disc(Device::m_own_addr_type, duration, &m_scan_params, Scan::handleGapEvent, nullptr);
+  m_endAt = ble_npl_time_get() + ble_npl_time_ms_to_ticks32(duration);
+  m_scheduled = m_schedule.burstMs != 0;
+  ble_npl_callout_stop(&m_scheduleTimer);
+
+  // A scheduled scan started while paused begins with the first burst on resume().
+  int rc = (m_scheduled && m_pauseCount > 0) ? 0 : startBurst();
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    m_scheduled = false;
+  }
 
   switch (rc) {
   case 0:
@@ -333,17 +598,24 @@ bool Scan::start(uint32_t duration, bool is_continue) {
 bool Scan::stop() {
   NIMBLE_LOGD(LOG_TAG, ">> stop()");
 
+  // A scheduled scan resting between bursts is not discovering but still has to end.
+  bool scheduled = m_scheduled;
+  m_scheduled = false;
+  ble_npl_callout_stop(&m_scheduleTimer);
+
   int rc = ble_gap_disc_cancel();
   if (rc != 0 && rc != BLE_HS_EALREADY) {
     NIMBLE_LOGE(LOG_TAG, "Failed to cancel scan; rc=%d", rc);
     return false;
   }
 
+  endBurst();
+
   if (m_maxResults == 0) {
     clearResults();
   }
 
-  if (rc != BLE_HS_EALREADY && m_pScanCallbacks != nullptr) {
+  if ((rc != BLE_HS_EALREADY || scheduled) && m_pScanCallbacks != nullptr) {
     m_pScanCallbacks->onScanEnd(m_scanResults);
   }
 
@@ -372,13 +644,7 @@ void Scan::clearDuplicateCache() {
 void Scan::erase(const Address &address) {
   NIMBLE_LOGD(LOG_TAG, "erase device: %s", address.toString().c_str());
 
-  for (auto it = m_scanResults.m_advertisedDevicesVector.begin(); it != m_scanResults.m_advertisedDevicesVector.end(); ++it) {
-    if ((*it)->getAddress() == address) {
-      delete *it;
-      m_scanResults.m_advertisedDevicesVector.erase(it);
-      break;
-    }
-  }
+  freeDevice(m_scanResults.remove(address));
 }
 
 /**
@@ -386,6 +652,9 @@ void Scan::erase(const Address &address) {
  */
 void Scan::onHostReset() {
   m_ignoreResults = true;
+  m_scheduled = false;
+  m_bursting = false;
+  ble_npl_callout_stop(&m_scheduleTimer);
 }
 
 /**
@@ -400,13 +669,260 @@ void Scan::onHostSync() {
   }
 }
 
+/**
+ * @brief Set how the scan shares the radio with the connections.
+ * @param [in] schedule The schedule, a burstMs of 0 scans continuously as with no schedule.
+ * @details A scheduled scan runs in bursts of burstMs. With no connection the bursts follow each
+ * other and use the interval and window set with setInterval() and setWindow(). With connections
+ * the scan interval is set to the shortest connection interval, so each window falls between two
+ * connection events, the window takes maxDutyPercent of it divided by the number of connections + 1,
+ * and every burst is followed by restMs per connection without scanning. The scan also pauses while
+ * a Client connects or discovers attributes. Applies from the next start().
+ */
+void Scan::setSchedule(const ScanSchedule &schedule) {
+  m_schedule = schedule;
+  if (m_schedule.maxDutyPercent == 0 || m_schedule.maxDutyPercent > 100) {
+    m_schedule.maxDutyPercent = 100;
+  }
+}// setSchedule
+
+/**
+ * @brief Pause a scheduled scan until resume() is called.
+ * @details Calls nest, the scan resumes when every pause() is matched by a resume(). Used by
+ * Client around connecting and attribute discovery, a scan without a schedule is not paused.
+ */
+void Scan::pause() {
+  if (m_pauseCount++ != 0 || !m_scheduled) {
+    return;
+  }
+
+  m_stats.pauses++;
+  ble_npl_callout_stop(&m_scheduleTimer);
+  if (m_bursting) {
+    ble_gap_disc_cancel();
+    endBurst();
+  }
+}// pause
+
+/**
+ * @brief Resume a scan paused with pause().
+ */
+void Scan::resume() {
+  if (m_pauseCount == 0) {
+    return;
+  }
+
+  if (--m_pauseCount != 0 || !m_scheduled) {
+    return;
+  }
+
+  if (getRemaining() <= 0) {
+    m_scheduled = false;
+    finish(0);
+    return;
+  }
+
+  int rc = startBurst();
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    m_scheduled = false;
+    finish(rc);
+  }
+}// resume
+
+/**
+ * @brief Check if the scan is paused.
+ * @return True if pause() was called more often than resume().
+ */
+bool Scan::isPaused() const {
+  return m_pauseCount > 0;
+}// isPaused
+
+/**
+ * @brief Get the scan statistics.
+ * @return The statistics since the scan was created or resetStats() was called.
+ */
+ScanStats Scan::getStats() const {
+  ScanStats stats = m_stats;
+  if (m_bursting) {
+    stats.scanTimeMs += ble_npl_time_ticks_to_ms32(ble_npl_time_get() - m_burstStart);
+  }
+
+  if (stats.scanTimeMs > 0) {
+    stats.reportsPerSecond = (uint64_t) stats.reports * 1000 / stats.scanTimeMs;
+  }
+
+  return stats;
+}// getStats
+
+/**
+ * @brief Reset the scan statistics.
+ */
+void Scan::resetStats() {
+  m_stats = ScanStats{};
+  m_burstStart = ble_npl_time_get();
+}// resetStats
+
+/**
+ * @brief Get the time left in the current scan.
+ * @return The time in milliseconds, BLE_HS_FOREVER if scanning forever.
+ */
+int32_t Scan::getRemaining() const {
+  if (m_duration == 0) {
+    return BLE_HS_FOREVER;
+  }
+
+  int32_t ticks = (int32_t) (m_endAt - ble_npl_time_get());
+  return ticks > 0 ? (int32_t) ble_npl_time_ticks_to_ms32(ticks) : 0;
+}// getRemaining
+
+/**
+ * @brief Start discovery for the rest of the scan, or for one burst of a scheduled scan.
+ * @return The result of ble_gap_disc().
+ */
+int Scan::startBurst() {
+  ble_gap_disc_params params = m_scan_params;
+  int32_t duration = getRemaining();
+  if (duration <= 0) {
+    duration = 1;
+  }
+
+  if (m_scheduled) {
+    if (duration == BLE_HS_FOREVER || duration > m_schedule.burstMs) {
+      duration = m_schedule.burstMs;
+    }
+
+    std::vector<uint16_t> handles;
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+    for (auto pClient : *Device::getClientList()) {
+      if (pClient->isConnected()) {
+        handles.push_back(pClient->getConnId());
+      }
+    }
+#endif
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+    if (Device::getServer() != nullptr) {
+      for (auto handle : Device::getServer()->getPeerDevices()) {
+        handles.push_back(handle);
+      }
+    }
+#endif
+
+    uint16_t links = 0;
+    uint16_t minConnItvl = UINT16_MAX;
+    for (auto handle : handles) {
+      ble_gap_conn_desc desc;
+      if (ble_gap_conn_find(handle, &desc) == 0) {
+        links++;
+        minConnItvl = std::min(minConnItvl, desc.conn_itvl);
+      }
+    }
+
+    if (links > 0) {
+      // Connection intervals are in 1.25ms units, scan intervals in 0.625ms units.
+      params.itvl = std::min<uint32_t>(std::max<uint32_t>(minConnItvl * 2, 4), 0x4000);
+      params.window = std::max<uint32_t>(params.itvl * m_schedule.maxDutyPercent / 100 / (links + 1), 4);
+    }
+
+    NIMBLE_LOGD(LOG_TAG, "Scan burst %" PRId32 " ms, %d links, itvl=%d, window=%d", duration, links, params.itvl, params.window);
+  }
+
+  int rc = ble_gap_disc(Device::m_own_addr_type, duration, &params, Scan::handleGapEvent, nullptr);
+  if (rc == 0) {
+    m_bursting = true;
+    m_burstStart = ble_npl_time_get();
+    m_stats.bursts++;
+  }
+
+  return rc;
+}// startBurst
+
+/**
+ * @brief Account the time of the burst that ended.
+ */
+void Scan::endBurst() {
+  if (m_bursting) {
+    m_stats.scanTimeMs += ble_npl_time_ticks_to_ms32(ble_npl_time_get() - m_burstStart);
+    m_bursting = false;
+  }
+}// endBurst
+
+/**
+ * @brief Rest after a burst of a scheduled scan and start the next one.
+ * @return True if the scan goes on, false if it ended.
+ */
+bool Scan::nextBurst() {
+  if (!m_scheduled || getRemaining() <= 0) {
+    return false;
+  }
+
+  // Resumed by resume() when paused.
+  if (m_pauseCount > 0) {
+    return true;
+  }
+
+  size_t links = 0;
+#if defined(CONFIG_BT_NIMBLE_ROLE_CENTRAL)
+  for (auto pClient : *Device::getClientList()) {
+    links += pClient->isConnected();
+  }
+#endif
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+  if (Device::getServer() != nullptr) {
+    links += Device::getServer()->getConnectedCount();
+  }
+#endif
+
+  ble_npl_callout_reset(&m_scheduleTimer, ble_npl_time_ms_to_ticks32(m_schedule.restMs * links));
+  return true;
+}// nextBurst
+
+/**
+ * @brief Start the next burst of a scheduled scan after the rest.
+ * @param [in] event The timer event, the argument is the scan.
+ */
+/*STATIC*/
+void Scan::scheduleTimerCb(ble_npl_event *event) {
+  auto *pScan = static_cast<Scan *>(ble_npl_event_get_arg(event));
+  if (!pScan->m_scheduled || pScan->m_pauseCount > 0) {
+    return;
+  }
+
+  int rc = pScan->startBurst();
+  if (rc != 0 && rc != BLE_HS_EALREADY) {
+    NIMBLE_LOGE(LOG_TAG, "Scan burst failed; rc=%d, %s", rc, Utils::returnCodeToString(rc));
+    pScan->m_scheduled = false;
+    pScan->finish(rc);
+  }
+}// scheduleTimerCb
+
+/**
+ * @brief End the scan and report it to the callbacks and a blocked getResults().
+ * @param [in] reason The reason the scan ended, 0 when the duration expired.
+ */
+void Scan::finish(int reason) {
+  m_scheduled = false;
+
+  if (m_maxResults == 0) {
+    clearResults();
+  }
+
+  if (m_pScanCallbacks != nullptr) {
+    m_pScanCallbacks->onScanEnd(m_scanResults);
+  }
+
+  if (m_pTaskData != nullptr) {
+    m_pTaskData->rc = reason;
+    xTaskNotifyGive(m_pTaskData->task);
+  }
+}// finish
+
 /**
  * @brief Start scanning and block until scanning has been completed.
  * @param [in] duration The duration in milliseconds for which to scan.
  * @param [in] is_continue Set to true to save previous scan results, false to clear them.
- * @return The scan results.
+ * @return The results kept by the scan, they change with the next scan, copy them to keep the list.
  */
-ScanResults Scan::getResults(uint32_t duration, bool is_continue) {
+const ScanResults &Scan::getResults(uint32_t duration, bool is_continue) {
   if (duration == 0) {
     NIMBLE_LOGW(LOG_TAG, "Blocking scan called with duration = forever");
   }
@@ -429,9 +945,9 @@ ScanResults Scan::getResults(uint32_t duration, bool is_continue) {
 
 /**
  * @brief Get the results of the scan.
- * @return NimBLEScanResults object.
+ * @return The results kept by the scan, they change while scanning, copy them to keep the list.
  */
-ScanResults Scan::getResults() {
+const ScanResults &Scan::getResults() {
   return m_scanResults;
 }
 
@@ -440,18 +956,56 @@ ScanResults Scan::getResults() {
  */
 void Scan::clearResults() {
   for (auto &it : m_scanResults.m_advertisedDevicesVector) {
-    delete it;
+    freeDevice(it);
   }
-  m_scanResults.m_advertisedDevicesVector.clear();
+  m_scanResults.clear();
   clearDuplicateCache();
 }
 
+/**
+ * @brief Copy the results, the copy holds the same device pointers.
+ * @param [in] other The results to copy.
+ */
+ScanResults::ScanResults(const ScanResults &other) : m_advertisedDevicesVector(other.m_advertisedDevicesVector),
+                                                     m_pOldest(other.m_pOldest),
+                                                     m_pNewest(other.m_pNewest) {
+  if (other.m_indexSize > 0) {
+    m_index = (uint16_t *) Memory::allocate(Memory::SCAN, other.m_indexSize * sizeof(uint16_t));
+    if (m_index != nullptr) {
+      m_indexSize = other.m_indexSize;
+      memcpy(m_index, other.m_index, m_indexSize * sizeof(uint16_t));
+    }
+  }
+
+  // Without an index the copy can still be iterated, but not searched by address.
+  if (m_index == nullptr) {
+    m_indexSize = 0;
+  }
+}// ScanResults
+
+ScanResults &ScanResults::operator=(const ScanResults &other) {
+  if (this != &other) {
+    ScanResults copy(other);
+    std::swap(m_advertisedDevicesVector, copy.m_advertisedDevicesVector);
+    std::swap(m_index, copy.m_index);
+    std::swap(m_indexSize, copy.m_indexSize);
+    m_pOldest = copy.m_pOldest;
+    m_pNewest = copy.m_pNewest;
+  }
+
+  return *this;
+}// operator=
+
+ScanResults::~ScanResults() {
+  releaseIndex();
+}// ~ScanResults
+
 /**
  * @brief Dump the scan results to the log.
  */
-void ScanResults::dump() {
+void ScanResults::dump() const {
   NIMBLE_LOGD(LOG_TAG, ">> Dump scan results:");
-  for (int i = 0; i < getCount(); i++) {
+  for (std::size_t i = 0; i < getCount(); i++) {
     NIMBLE_LOGI(LOG_TAG, "- %s", getDevice(i).toString().c_str());
   }
 }// dump
@@ -460,7 +1014,7 @@ void ScanResults::dump() {
  * @brief Get the count of devices found in the last scan.
  * @return The number of devices found in the last scan.
  */
-std::size_t ScanResults::getCount() {
+std::size_t ScanResults::getCount() const {
   return m_advertisedDevicesVector.size();
 }// getCount
 
@@ -470,7 +1024,7 @@ std::size_t ScanResults::getCount() {
  * @param [in] i The index of the device.
  * @return The device at the specified index.
  */
-AdvertisedDevice ScanResults::getDevice(uint32_t i) {
+AdvertisedDevice ScanResults::getDevice(uint32_t i) const {
   return *m_advertisedDevicesVector[i];
 }
 
@@ -478,7 +1032,7 @@ AdvertisedDevice ScanResults::getDevice(uint32_t i) {
  * @brief Get iterator to the beginning of the vector of advertised device pointers.
  * @return An iterator to the beginning of the vector of advertised device pointers.
  */
-std::vector<AdvertisedDevice *>::iterator ScanResults::begin() {
+std::vector<AdvertisedDevice *>::const_iterator ScanResults::begin() const {
   return m_advertisedDevicesVector.begin();
 }
 
@@ -486,25 +1040,259 @@ std::vector<AdvertisedDevice *>::iterator ScanResults::begin() {
  * @brief Get iterator to the end of the vector of advertised device pointers.
  * @return An iterator to the end of the vector of advertised device pointers.
  */
-std::vector<AdvertisedDevice *>::iterator ScanResults::end() {
+std::vector<AdvertisedDevice *>::const_iterator ScanResults::end() const {
   return m_advertisedDevicesVector.end();
 }
 
 /**
  * @brief Get a pointer to the specified device at the given address.
  * If the address is not found a nullptr is returned.
- * @param [in] address The address of the device.
+ * @param [in] address The address of the device, the address type must match as well.
  * @return A pointer to the device at the specified address.
  */
-AdvertisedDevice *ScanResults::getDevice(const Address &address) {
-  for (auto & index : m_advertisedDevicesVector) {
-    if (index->getAddress() == address) {
-      return index;
+AdvertisedDevice *ScanResults::getDevice(const Address &address) const {
+  return find(address);
+}
+
+/**
+ * @brief Hash an address and its type into a starting slot of the index.
+ * @param [in] address The address to hash.
+ * @return The FNV-1a hash of the address bytes and type, not reduced to the index size.
+ */
+/*STATIC*/
+std::size_t ScanResults::hash(const Address &address) {
+  const uint8_t *value = address.getNative();
+  uint32_t hash = 2166136261UL;
+
+  for (std::size_t i = 0; i < 6; i++) {
+    hash = (hash ^ value[i]) * 16777619UL;
+  }
+
+  hash = (hash ^ address.getType()) * 16777619UL;
+  return hash;
+}// hash
+
+/**
+ * @brief Find the index slot for an address.
+ * @param [in] address The address to look for.
+ * @return The slot holding the address, or the empty slot where it would be inserted.
+ * @details The index must be allocated.
+ */
+std::size_t ScanResults::findSlot(const Address &address) const {
+  const std::size_t mask = m_indexSize - 1;
+  std::size_t slot = hash(address) & mask;
+
+  while (m_index[slot] != INDEX_EMPTY) {
+    const Address &slotAddress = m_advertisedDevicesVector[m_index[slot] - 1]->getAddress();
+
+    if (slotAddress == address and slotAddress.getType() == address.getType()) {
+      break;
     }
+
+    slot = (slot + 1) & mask;
   }
 
-  return nullptr;
-}
+  return slot;
+}// findSlot
+
+/**
+ * @brief Look up a device by address and type.
+ * @param [in] address The address of the device.
+ * @return A pointer to the device or nullptr if not found.
+ */
+AdvertisedDevice *ScanResults::find(const Address &address) const {
+  if (m_indexSize == 0) {
+    return nullptr;
+  }
+
+  const std::size_t slot = findSlot(address);
+
+  if (m_index[slot] == INDEX_EMPTY) {
+    return nullptr;
+  }
+
+  return m_advertisedDevicesVector[m_index[slot] - 1];
+}// find
+
+/**
+ * @brief Check if a new device can be added.
+ * @return True if CONFIG_NIMBLE_CPP_SCAN_RESULTS_MAX devices, or as many as the index can address, are stored.
+ */
+bool ScanResults::isFull() const {
+  const std::size_t count = m_advertisedDevicesVector.size();
+#if CONFIG_NIMBLE_CPP_SCAN_RESULTS_MAX > 0
+  if (count >= CONFIG_NIMBLE_CPP_SCAN_RESULTS_MAX) {
+    return true;
+  }
+#endif
+  return count >= MAX_DEVICES;
+}// isFull
+
+/**
+ * @brief Double the index, or allocate it, and insert the stored devices again.
+ * @return False if out of memory, the index is then unchanged.
+ */
+bool ScanResults::growIndex() {
+  const std::size_t size = m_indexSize == 0 ? MIN_INDEX_SIZE : m_indexSize * 2;
+  auto *pIndex = (uint16_t *) Memory::allocate(Memory::SCAN, size * sizeof(uint16_t));
+  if (pIndex == nullptr) {
+    return false;
+  }
+
+  releaseIndex();
+  memset(pIndex, 0, size * sizeof(uint16_t));
+  m_index = pIndex;
+  m_indexSize = size;
+
+  for (std::size_t i = 0; i < m_advertisedDevicesVector.size(); i++) {
+    m_index[findSlot(m_advertisedDevicesVector[i]->getAddress())] = i + 1;
+  }
+
+  return true;
+}// growIndex
+
+/**
+ * @brief Free the index.
+ */
+void ScanResults::releaseIndex() {
+  if (m_index != nullptr) {
+    Memory::release(Memory::SCAN, m_index, m_indexSize * sizeof(uint16_t));
+  }
+
+  m_index = nullptr;
+  m_indexSize = 0;
+}// releaseIndex
+
+/**
+ * @brief Add a device to the results and the index.
+ * @param [in] advertisedDevice The device to add, must not already be in the results.
+ * @return True if added, false if the results are full or the index could not grow.
+ */
+bool ScanResults::insert(AdvertisedDevice *advertisedDevice) {
+  if (isFull()) {
+    return false;
+  }
+
+  if ((m_advertisedDevicesVector.size() + 1) * 2 > m_indexSize && !growIndex()) {
+    return false;
+  }
+
+  m_advertisedDevicesVector.push_back(advertisedDevice);
+  m_index[findSlot(advertisedDevice->getAddress())] = m_advertisedDevicesVector.size();
+  link(advertisedDevice);
+  return true;
+}// insert
+
+/**
+ * @brief Remove a device from the results and the index.
+ * @param [in] address The address of the device to remove.
+ * @return A pointer to the removed device, to be deleted by the caller, or nullptr if not found.
+ * @details Constant time: the last device takes the place of the removed one and only its index slot
+ * is updated. The order the devices were last seen in is kept by their links, not by their positions.
+ */
+AdvertisedDevice *ScanResults::remove(const Address &address) {
+  if (m_indexSize == 0) {
+    return nullptr;
+  }
+
+  const std::size_t mask = m_indexSize - 1;
+  std::size_t slot = findSlot(address);
+
+  if (m_index[slot] == INDEX_EMPTY) {
+    return nullptr;
+  }
+
+  const std::size_t position = m_index[slot] - 1;
+  AdvertisedDevice *advertisedDevice = m_advertisedDevicesVector[position];
+
+  // Backward shift deletion, move up any entry whose probe sequence passes through the freed slot.
+  std::size_t next = (slot + 1) & mask;
+  while (m_index[next] != INDEX_EMPTY) {
+    const std::size_t home = hash(m_advertisedDevicesVector[m_index[next] - 1]->getAddress()) & mask;
+
+    const bool inPlace = (slot <= next) ? (slot < home and home <= next) : (slot < home or home <= next);
+
+    if (not inPlace) {
+      m_index[slot] = m_index[next];
+      slot = next;
+    }
+
+    next = (next + 1) & mask;
+  }
+  m_index[slot] = INDEX_EMPTY;
+
+  // Fill the hole with the last device and point its index slot at the new position.
+  const std::size_t last = m_advertisedDevicesVector.size() - 1;
+  if (position != last) {
+    AdvertisedDevice *pMoved = m_advertisedDevicesVector[last];
+    m_index[findSlot(pMoved->getAddress())] = position + 1;
+    m_advertisedDevicesVector[position] = pMoved;
+  }
+  m_advertisedDevicesVector.pop_back();
+
+  unlink(advertisedDevice);
+  return advertisedDevice;
+}// remove
+
+/**
+ * @brief Remove all devices from the results and free the index.
+ * @details The devices are not deleted.
+ */
+void ScanResults::clear() {
+  m_advertisedDevicesVector.clear();
+  releaseIndex();
+  m_pOldest = nullptr;
+  m_pNewest = nullptr;
+}// clear
+
+/**
+ * @brief Mark a device as the most recently seen.
+ * @param [in] advertisedDevice The device, must be in the results.
+ */
+void ScanResults::touch(AdvertisedDevice *advertisedDevice) {
+  if (advertisedDevice != m_pNewest) {
+    unlink(advertisedDevice);
+    link(advertisedDevice);
+  }
+}// touch
+
+/**
+ * @brief Append a device to the least recently seen list as the newest.
+ * @param [in] advertisedDevice The device, must not be linked.
+ */
+void ScanResults::link(AdvertisedDevice *advertisedDevice) {
+  advertisedDevice->m_pOlder = m_pNewest;
+  advertisedDevice->m_pNewer = nullptr;
+
+  if (m_pNewest != nullptr) {
+    m_pNewest->m_pNewer = advertisedDevice;
+  } else {
+    m_pOldest = advertisedDevice;
+  }
+
+  m_pNewest = advertisedDevice;
+}// link
+
+/**
+ * @brief Take a device out of the least recently seen list.
+ * @param [in] advertisedDevice The device, must be linked.
+ */
+void ScanResults::unlink(AdvertisedDevice *advertisedDevice) {
+  if (advertisedDevice->m_pOlder != nullptr) {
+    advertisedDevice->m_pOlder->m_pNewer = advertisedDevice->m_pNewer;
+  } else {
+    m_pOldest = advertisedDevice->m_pNewer;
+  }
+
+  if (advertisedDevice->m_pNewer != nullptr) {
+    advertisedDevice->m_pNewer->m_pOlder = advertisedDevice->m_pOlder;
+  } else {
+    m_pNewest = advertisedDevice->m_pOlder;
+  }
+
+  advertisedDevice->m_pOlder = nullptr;
+  advertisedDevice->m_pNewer = nullptr;
+}// unlink
 
 }// namespace nimble
 
@@ -0,0 +1,334 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_OBSERVER)
+
+#include "nimble/ScanFilter.hpp"
+
+#include "host/ble_hs_adv.h"
+
+#include "nimble/Log.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+static const char *LOG_TAG = "NimBLEScanFilter";
+
+namespace nimble {
+
+/**
+ * @brief Constructor, the filter passes every report until a rule is added.
+ */
+ScanFilter::ScanFilter() {
+  clear();
+}// ScanFilter
+
+/**
+ * @brief Pass the reports listing a service UUID.
+ * @details A 16 bit UUID also matches its 128 bit form and a 128 bit UUID built on the
+ * %BLE base UUID also matches its 16 bit form.
+ * @param [in] uuid The service UUID.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::addServiceUUID(const UUID &uuid) {
+  addUUID(SERVICE_UUID, uuid);
+  return *this;
+}// addServiceUUID
+
+/**
+ * @brief Pass the reports carrying service data for a UUID.
+ * @param [in] uuid The UUID of the service data.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::addServiceData(const UUID &uuid) {
+  addUUID(SERVICE_DATA, uuid);
+  return *this;
+}// addServiceData
+
+/**
+ * @brief Pass the reports with manufacturer data of a company.
+ * @param [in] companyId The Bluetooth SIG company identifier, e.g. 0x004C.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::addManufacturerId(uint16_t companyId) {
+  const uint8_t value[2] = {static_cast<uint8_t>(companyId), static_cast<uint8_t>(companyId >> 8)};
+  addPattern(MANUFACTURER_ID, value, sizeof(value));
+  return *this;
+}// addManufacturerId
+
+/**
+ * @brief Pass the reports with a name starting with a prefix.
+ * @param [in] prefix The prefix, compared with the shortened or complete name in the advertisement.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::addNamePrefix(const std::string &prefix) {
+  if (prefix.length() > MAX_PATTERN_LENGTH) {
+    NIMBLE_LOGE(LOG_TAG, "Name prefix too long, max %d", MAX_PATTERN_LENGTH);
+    return *this;
+  }
+
+  addPattern(NAME_PREFIX, reinterpret_cast<const uint8_t *>(prefix.data()), prefix.length());
+  return *this;
+}// addNamePrefix
+
+/**
+ * @brief Reject the reports received weaker than a signal strength.
+ * @param [in] rssi The lowest RSSI passed, in dBm.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::setMinRSSI(int8_t rssi) {
+  m_minRSSI = rssi;
+  return *this;
+}// setMinRSSI
+
+/**
+ * @brief Reject the reports from addresses not starting with a prefix.
+ * @param [in] address The address holding the prefix, e.g. the first 3 bytes for a manufacturer OUI.
+ * @param [in] length The number of leading bytes compared, as written in the address string, 0 to disable.
+ * @return The filter, to chain the rules.
+ */
+ScanFilter &ScanFilter::setAddressPrefix(const Address &address, uint8_t length) {
+  m_addrPrefixLength = std::min<uint8_t>(length, sizeof(m_addrPrefix));
+
+  // The native address is little endian, the prefix is kept in the printed order.
+  const uint8_t *native = address.getNative();
+  for (uint8_t i = 0; i < m_addrPrefixLength; i++) {
+    m_addrPrefix[i] = native[5 - i];
+  }
+
+  return *this;
+}// setAddressPrefix
+
+/**
+ * @brief Remove all the rules.
+ */
+void ScanFilter::clear() {
+  m_patterns.clear();
+  memset(m_types, 0, sizeof(m_types));
+  memset(m_addrPrefix, 0, sizeof(m_addrPrefix));
+  m_addrPrefixLength = 0;
+  m_minRSSI = INT8_MIN;
+}// clear
+
+/**
+ * @brief Check if the filter has any rule.
+ * @return True if every report passes.
+ */
+bool ScanFilter::isEmpty() const {
+  return m_patterns.empty() && m_addrPrefixLength == 0 && m_minRSSI == INT8_MIN;
+}// isEmpty
+
+/**
+ * @brief Check a raw advertising report against the rules.
+ * @param [in] addr The address of the advertiser.
+ * @param [in] rssi The RSSI of the report.
+ * @param [in] data The advertising data.
+ * @param [in] length The length of the advertising data.
+ * @return True if the report passes.
+ */
+bool ScanFilter::matches(const ble_addr_t &addr, int8_t rssi, const uint8_t *data, size_t length) const {
+  if (rssi < m_minRSSI) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < m_addrPrefixLength; i++) {
+    if (addr.val[5 - i] != m_addrPrefix[i]) {
+      return false;
+    }
+  }
+
+  if (m_patterns.empty()) {
+    return true;
+  }
+
+  size_t index = 0;
+  while (index + 1 < length) {
+    const uint8_t fieldLength = data[index];
+
+    // A zero length field pads the end of the data, a field running past the end is malformed.
+    if (fieldLength == 0 || index + 1 + fieldLength > length) {
+      break;
+    }
+
+    const uint8_t type = data[index + 1];
+    if (wants(type) && matchField(type, data + index + 2, fieldLength - 1)) {
+      return true;
+    }
+
+    index += 1 + fieldLength;
+  }
+
+  return false;
+}// matches
+
+/**
+ * @brief Compile a rule into a pattern and mark the advertising data types it is matched against.
+ * @param [in] kind The kind of rule.
+ * @param [in] value The bytes to match, little endian for UUIDs and company IDs.
+ * @param [in] length The number of bytes, at most MAX_PATTERN_LENGTH.
+ */
+void ScanFilter::addPattern(Kind kind, const uint8_t *value, uint8_t length) {
+  Pattern pattern{};
+  pattern.kind = kind;
+  pattern.length = length;
+  memcpy(pattern.value, value, length);
+  m_patterns.push_back(pattern);
+
+  auto want = [this](uint8_t type) { m_types[type >> 5] |= 1UL << (type & 31); };
+
+  switch (kind) {
+  case SERVICE_UUID:
+    if (length == 2) {
+      want(BLE_HS_ADV_TYPE_INCOMP_UUIDS16);
+      want(BLE_HS_ADV_TYPE_COMP_UUIDS16);
+    } else if (length == 4) {
+      want(BLE_HS_ADV_TYPE_INCOMP_UUIDS32);
+      want(BLE_HS_ADV_TYPE_COMP_UUIDS32);
+    } else {
+      want(BLE_HS_ADV_TYPE_INCOMP_UUIDS128);
+      want(BLE_HS_ADV_TYPE_COMP_UUIDS128);
+    }
+    break;
+
+  case SERVICE_DATA:
+    want(length == 2 ? BLE_HS_ADV_TYPE_SVC_DATA_UUID16 : length == 4 ? BLE_HS_ADV_TYPE_SVC_DATA_UUID32 : BLE_HS_ADV_TYPE_SVC_DATA_UUID128);
+    break;
+
+  case MANUFACTURER_ID:
+    want(BLE_HS_ADV_TYPE_MFG_DATA);
+    break;
+
+  case NAME_PREFIX:
+    want(BLE_HS_ADV_TYPE_INCOMP_NAME);
+    want(BLE_HS_ADV_TYPE_COMP_NAME);
+    break;
+  }
+}// addPattern
+
+/**
+ * @brief Add the patterns of a UUID rule, in the size of the UUID and its alias.
+ * @param [in] kind SERVICE_UUID or SERVICE_DATA.
+ * @param [in] uuid The UUID.
+ */
+void ScanFilter::addUUID(Kind kind, const UUID &uuid) {
+  if (uuid.bitSize() == 0) {
+    NIMBLE_LOGE(LOG_TAG, "Invalid UUID");
+    return;
+  }
+
+  UUID alias = uuid;
+  if (uuid.bitSize() == 128) {
+    alias.to16();
+  } else {
+    alias.to128();
+  }
+
+  const UUID *uuids[] = {&uuid, &alias};
+  const size_t count = alias.bitSize() != uuid.bitSize() ? 2 : 1;
+
+  for (size_t i = 0; i < count; i++) {
+    const ble_uuid_any_t *native = uuids[i]->getNative();
+    uint8_t value[16];
+    uint8_t length = uuids[i]->bitSize() / 8;
+
+    if (length == 2) {
+      value[0] = static_cast<uint8_t>(native->u16.value);
+      value[1] = static_cast<uint8_t>(native->u16.value >> 8);
+    } else if (length == 4) {
+      for (uint8_t j = 0; j < 4; j++) {
+        value[j] = static_cast<uint8_t>(native->u32.value >> (8 * j));
+      }
+    } else {
+      memcpy(value, native->u128.value, sizeof(value));
+    }
+
+    addPattern(kind, value, length);
+  }
+}// addUUID
+
+/**
+ * @brief Match one advertising data field against the patterns.
+ * @param [in] type The advertising data type of the field.
+ * @param [in] value The value of the field.
+ * @param [in] length The length of the value.
+ * @return True if a pattern matches.
+ */
+bool ScanFilter::matchField(uint8_t type, const uint8_t *value, uint8_t length) const {
+  Kind kind;
+  uint8_t uuidLength = 0;
+
+  switch (type) {
+  case BLE_HS_ADV_TYPE_INCOMP_UUIDS16:
+  case BLE_HS_ADV_TYPE_COMP_UUIDS16:
+    kind = SERVICE_UUID;
+    uuidLength = 2;
+    break;
+  case BLE_HS_ADV_TYPE_INCOMP_UUIDS32:
+  case BLE_HS_ADV_TYPE_COMP_UUIDS32:
+    kind = SERVICE_UUID;
+    uuidLength = 4;
+    break;
+  case BLE_HS_ADV_TYPE_INCOMP_UUIDS128:
+  case BLE_HS_ADV_TYPE_COMP_UUIDS128:
+    kind = SERVICE_UUID;
+    uuidLength = 16;
+    break;
+  case BLE_HS_ADV_TYPE_SVC_DATA_UUID16:
+    kind = SERVICE_DATA;
+    uuidLength = 2;
+    break;
+  case BLE_HS_ADV_TYPE_SVC_DATA_UUID32:
+    kind = SERVICE_DATA;
+    uuidLength = 4;
+    break;
+  case BLE_HS_ADV_TYPE_SVC_DATA_UUID128:
+    kind = SERVICE_DATA;
+    uuidLength = 16;
+    break;
+  case BLE_HS_ADV_TYPE_MFG_DATA:
+    kind = MANUFACTURER_ID;
+    break;
+  case BLE_HS_ADV_TYPE_INCOMP_NAME:
+  case BLE_HS_ADV_TYPE_COMP_NAME:
+    kind = NAME_PREFIX;
+    break;
+  default:
+    return false;
+  }
+
+  for (const auto &pattern : m_patterns) {
+    if (pattern.kind != kind || (uuidLength != 0 && pattern.length != uuidLength)) {
+      continue;
+    }
+
+    // A UUID list holds several UUIDs, every other field holds the pattern at its start.
+    if (kind == SERVICE_UUID) {
+      for (uint8_t offset = 0; offset + uuidLength <= length; offset += uuidLength) {
+        if (memcmp(value + offset, pattern.value, uuidLength) == 0) {
+          return true;
+        }
+      }
+    } else if (pattern.length <= length && memcmp(value, pattern.value, pattern.length) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}// matchField
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_OBSERVER */
@@ -15,9 +15,13 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
 
+#include "nimble/CallbackDispatcher.hpp"
+#include "nimble/ConnParamsManager.hpp"
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
 #include "nimble/Server.hpp"
+#include "nimble/ServerSnapshot.hpp"
+#include "nimble/Stats.hpp"
 
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
@@ -25,7 +29,7 @@
 namespace nimble {
 
 static const char *LOG_TAG = "NimBLEServer";
-static NimBLEServerCallbacks defaultCallbacks;
+static ServerCallbacks defaultCallbacks;
 
 /**
  * @brief Construct a %BLE Server
@@ -34,7 +38,11 @@ static NimBLEServerCallbacks defaultCallbacks;
  * the NimBLEDevice class.
  */
 Server::Server() {
-  memset(m_indWait, BLE_HS_CONN_HANDLE_NONE, sizeof(m_indWait));
+  for (auto &it : m_peerStates) {
+    it.desc.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    it.mtu = 0;
+    memset(&it.indications, 0, sizeof(it.indications));
+  }
   //    m_svcChgChrHdl          = 0xffff; // Future Use
   m_pServerCallbacks = &defaultCallbacks;
   m_gattsStarted = false;
@@ -137,8 +145,8 @@ Service *Server::getServiceByHandle(uint16_t handle) {
  * @brief Retrieve the advertising object that can be used to advertise the existence of the server.
  * @return An advertising object.
  */
-NimBLEExtAdvertising *NimBLEServer::getAdvertising() {
-  return NimBLEDevice::getAdvertising();
+ExtAdvertising *Server::getAdvertising() {
+  return Device::getAdvertising();
 }// getAdvertising
 #endif
 
@@ -199,6 +207,7 @@ void Server::start() {
 */
   // Get the assigned service handles and build a vector of characteristics
   // with Notify / Indicate capabilities for event handling
+  m_notifyChrVec.clear();
   for (auto &svc : m_svcVec) {
     if (svc->m_removed == 0) {
       rc = ble_gatts_find_svc(&svc->getUUID().getNative()->u, &svc->m_handle);
@@ -207,7 +216,7 @@ void Server::start() {
       }
     }
 
-    for (auto &chr : svc->m_chrVec) {
+    for (auto &chr : svc->m_characteristics) {
       // if Notify / Indicate is enabled but we didn't create the descriptor
       // we do it now.
       if ((chr->m_properties & BLE_GATT_CHR_F_INDICATE) || (chr->m_properties & BLE_GATT_CHR_F_NOTIFY)) {
@@ -216,9 +225,70 @@ void Server::start() {
     }
   }
 
+  // Characteristics of the compile time tables.
+  for (auto &table : m_tables) {
+    for (const ble_gatt_svc_def *svc = table; svc->type != 0; ++svc) {
+      if (svc->characteristics == nullptr) {
+        continue;
+      }
+
+      for (const ble_gatt_chr_def *def = svc->characteristics; def->uuid != nullptr; ++def) {
+        Characteristic *chr = GattTable::getCharacteristic(*def);
+        if (chr != nullptr && (chr->m_properties & (BLE_GATT_CHR_F_INDICATE | BLE_GATT_CHR_F_NOTIFY))) {
+          m_notifyChrVec.push_back(chr);
+        }
+      }
+    }
+  }
+
+  // Index them by value handle, the handles of the local database are small and dense.
+  uint16_t maxHandle = 0;
+  for (auto &chr : m_notifyChrVec) {
+    maxHandle = std::max(maxHandle, chr->m_handle);
+  }
+
+  m_notifyChrByHandle.assign(maxHandle + 1, nullptr);
+  for (auto &chr : m_notifyChrVec) {
+    m_notifyChrByHandle[chr->m_handle] = chr;
+  }
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+  ServerSnapshot::onStart();
+#endif
+
   m_gattsStarted = true;
 }// start
 
+/**
+ * @brief Register a GATT table built at compile time with GattTable.
+ * @param [in] pSvcs The service table, must remain valid for the lifetime of the server.
+ * @return True if the services were added.
+ * @details Can be called right after the server is created, before or after createService().
+ * The table is added again when the server attributes are reset.
+ */
+bool Server::addTable(const ble_gatt_svc_def *pSvcs) {
+  if (m_gattsStarted) {
+    NIMBLE_LOGE(LOG_TAG, "Cannot add a table after the server has started");
+    return false;
+  }
+
+  int rc = ble_gatts_count_cfg(pSvcs);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gatts_count_cfg failed, rc= %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  rc = ble_gatts_add_svcs(pSvcs);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "ble_gatts_add_svcs, rc= %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  GattTable::bind(pSvcs);
+  m_tables.push_back(pSvcs);
+  return true;
+}// addTable
+
 /**
  * @brief Disconnect the specified client with optional reason.
  * @param [in] connId Connection Id of the client to disconnect.
@@ -299,6 +369,11 @@ ConnectionInfo Server::getPeerInfo(const Address &address) {
  * @param [in] id The connection id of the peer.
  */
 ConnectionInfo Server::getPeerIDInfo(uint16_t id) {
+  PeerState *pState = getPeerState(id);
+  if (pState != nullptr) {
+    return ConnectionInfo(pState->desc);
+  }
+
   ConnectionInfo peerInfo;
 
   int rc = ble_gap_conn_find(id, &peerInfo.m_desc);
@@ -323,7 +398,7 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
 
   int rc = 0;
   ConnectionInfo peerInfo;
-  Server *pServer = NimBLEDevice::getServer();
+  Server *pServer = Device::getServer();
 
   switch (event->type) {
 
@@ -332,17 +407,26 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
       /* Connection failed; resume advertising */
       NIMBLE_LOGE(LOG_TAG, "Connection failed");
 #if !CONFIG_BT_NIMBLE_EXT_ADV
-      NimBLEDevice::startAdvertising();
+      Device::startAdvertising();
 #endif
     } else {
       pServer->m_connectedPeersVec.push_back(event->connect.conn_handle);
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+      ConnParamsManager::onConnect(event->connect.conn_handle);
+#endif
 
-      rc = ble_gap_conn_find(event->connect.conn_handle, &peerInfo.m_desc);
-      if (rc != 0) {
+      PeerState *pState = pServer->updatePeerState(event->connect.conn_handle);
+      if (pState == nullptr) {
         return 0;
       }
 
+      peerInfo.m_desc = pState->desc;
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+      // Dropped if the queue stays full for CONFIG_NIMBLE_CPP_DISPATCH_CONNECTION_TIMEOUT_MS, never run out of order here.
+      CallbackDispatcher::dispatchConnect(pServer, pServer->m_pServerCallbacks, peerInfo.m_desc);
+#else
       pServer->m_pServerCallbacks->onConnect(pServer, peerInfo);
+#endif
     }
 
     return 0;
@@ -357,7 +441,7 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
     case BLE_HS_ECONTROLLER:
     case BLE_HS_ENOTSYNCED:
       NIMBLE_LOGC(LOG_TAG, "Disconnect - host reset, rc=%d", event->disconnect.reason);
-      NimBLEDevice::onReset(event->disconnect.reason);
+      Device::onReset(event->disconnect.reason);
       break;
     default:
       break;
@@ -367,13 +451,33 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
                                                    pServer->m_connectedPeersVec.end(),
                                                    event->disconnect.conn.conn_handle),
                                        pServer->m_connectedPeersVec.end());
+    pServer->purgeIndications(event->disconnect.conn.conn_handle);
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+    ConnParamsManager::onDisconnect(event->disconnect.conn.conn_handle);
+#endif
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+    ServerSnapshot::onDisconnect(event->disconnect.conn.conn_handle);
+#endif
+    PeerState *pState = pServer->getPeerState(event->disconnect.conn.conn_handle);
+    if (pState != nullptr) {
+      // The slot will be reused by the next connection, drop the subscriptions it held.
+      size_t peerIndex = pServer->getPeerIndex(pState);
+      for (auto &it : pServer->m_notifyChrVec) {
+        it->clearSubscribe(peerIndex);
+      }
+    }
+    pServer->removePeerState(event->disconnect.conn.conn_handle);
 
     if (pServer->m_svcChanged) {
       pServer->resetGATT();
     }
 
+#if CONFIG_NIMBLE_CPP_CALLBACK_DISPATCHER
+    CallbackDispatcher::dispatchDisconnect(pServer, pServer->m_pServerCallbacks, event->disconnect.conn, event->disconnect.reason);
+#else
     ConnectionInfo peerInfo(event->disconnect.conn);
     pServer->m_pServerCallbacks->onDisconnect(pServer, peerInfo, event->disconnect.reason);
+#endif
 
 #if !CONFIG_BT_NIMBLE_EXT_ADV
     if (pServer->m_advertiseOnDisconnect) {
@@ -388,24 +492,23 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
                 event->subscribe.attr_handle,
                 (event->subscribe.cur_notify ? "true" : "false"));
 
-    for (auto &it : pServer->m_notifyChrVec) {
-      if (it->getHandle() == event->subscribe.attr_handle) {
-        if ((it->getProperties() & BLE_GATT_CHR_F_READ_AUTHEN) || (it->getProperties() & BLE_GATT_CHR_F_READ_AUTHOR) || (it->getProperties() & BLE_GATT_CHR_F_READ_ENC)) {
-          rc = ble_gap_conn_find(event->subscribe.conn_handle, &peerInfo.m_desc);
-          if (rc != 0) {
-            break;
-          }
-
-          if (!peerInfo.isEncrypted()) {
-            NimBLEDevice::startSecurity(event->subscribe.conn_handle);
-          }
-        }
+    Characteristic *pChar = pServer->getNotifyCharacteristic(event->subscribe.attr_handle);
+    if (pChar == nullptr) {
+      return 0;
+    }
+
+    if ((pChar->getProperties() & BLE_GATT_CHR_F_READ_AUTHEN) || (pChar->getProperties() & BLE_GATT_CHR_F_READ_AUTHOR) || (pChar->getProperties() & BLE_GATT_CHR_F_READ_ENC)) {
+      PeerState *pState = pServer->getPeerState(event->subscribe.conn_handle);
+      if (pState == nullptr) {
+        pState = pServer->updatePeerState(event->subscribe.conn_handle);
+      }
 
-        it->setSubscribe(event);
-        break;
+      if (pState != nullptr && !pState->desc.sec_state.encrypted) {
+        Device::startSecurity(event->subscribe.conn_handle);
       }
     }
 
+    pChar->setSubscribe(event);
     return 0;
   }// BLE_GAP_EVENT_SUBSCRIBE
 
@@ -414,8 +517,15 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
                 event->mtu.conn_handle,
                 event->mtu.value);
 
-    rc = ble_gap_conn_find(event->mtu.conn_handle, &peerInfo.m_desc);
-    if (rc != 0) {
+    // The cache is updated when the peer has one, the callback runs either way.
+    PeerState *pState = pServer->getPeerState(event->mtu.conn_handle);
+    if (pState != nullptr) {
+      pState->mtu = event->mtu.value;
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+      ServerSnapshot::onUpdate(event->mtu.conn_handle);
+#endif
+      peerInfo.m_desc = pState->desc;
+    } else if (ble_gap_conn_find(event->mtu.conn_handle, &peerInfo.m_desc) != 0) {
       return 0;
     }
 
@@ -423,35 +533,59 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
     return 0;
   }// BLE_GAP_EVENT_MTU
 
-  case BLE_GAP_EVENT_NOTIFY_TX: {
-    Characteristic *pChar = nullptr;
-
-    for (auto &it : pServer->m_notifyChrVec) {
-      if (it->getHandle() == event->notify_tx.attr_handle) {
-        pChar = it;
-      }
+  case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE: {
+    if (event->phy_updated.status != 0) {
+      NIMBLE_LOGW(LOG_TAG, "PHY update failed; conn_handle=%d status=%d",
+                  event->phy_updated.conn_handle, event->phy_updated.status);
+      return 0;
     }
 
-    if (pChar == nullptr) {
+    NIMBLE_LOGI(LOG_TAG, "PHY update; conn_handle=%d tx=%d rx=%d",
+                event->phy_updated.conn_handle, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+
+    PeerState *pState = pServer->getPeerState(event->phy_updated.conn_handle);
+    if (pState != nullptr) {
+      peerInfo.m_desc = pState->desc;
+    } else if (ble_gap_conn_find(event->phy_updated.conn_handle, &peerInfo.m_desc) != 0) {
       return 0;
     }
 
+    pServer->m_pServerCallbacks->onPhyUpdate(peerInfo, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+    return 0;
+  }// BLE_GAP_EVENT_PHY_UPDATE_COMPLETE
+
+  case BLE_GAP_EVENT_NOTIFY_TX: {
+    if (event->notify_tx.indication && event->notify_tx.status == 0) {
+      return 0;// Indication sent but not yet acknowledged.
+    }
+
+    Characteristic *pChar = pServer->getNotifyCharacteristic(event->notify_tx.attr_handle);
+    if (pChar != nullptr) {
+      pChar->m_pCallbacks->onStatus(pChar, event->notify_tx.status);
+    }
+
+    // The indication is confirmed or failed, send the next one queued for this peer.
     if (event->notify_tx.indication) {
-      if (event->notify_tx.status == 0) {
-        return 0;// Indication sent but not yet acknowledged.
+#if CONFIG_NIMBLE_CPP_STATS
+      if (event->notify_tx.status == BLE_HS_EDONE) {
+        PeerState *pState = pServer->getPeerState(event->notify_tx.conn_handle);
+        if (pState != nullptr) {
+          NIMBLE_STAT_LATENCY(INDICATION_RTT, pState->indications.sentAt);
+        }
+      } else {
+        NIMBLE_STAT_INC(INDICATE_FAILED);
       }
-      pServer->clearIndicateWait(event->notify_tx.conn_handle);
+#endif
+      pServer->sendNextIndication(event->notify_tx.conn_handle);
     }
 
-    pChar->m_pCallbacks->onStatus(pChar, event->notify_tx.status);
-
     return 0;
   }// BLE_GAP_EVENT_NOTIFY_TX
 
   case BLE_GAP_EVENT_ADV_COMPLETE:
 #if CONFIG_BT_NIMBLE_EXT_ADV
   case BLE_GAP_EVENT_SCAN_REQ_RCVD:
-    return NimBLEExtAdvertising::handleGapEvent(event, arg);
+    return ExtAdvertising::handleGapEvent(event, arg);
 #else
     return Advertising::handleGapEvent(event, arg);
 #endif
@@ -459,6 +593,13 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
 
   case BLE_GAP_EVENT_CONN_UPDATE: {
     NIMBLE_LOGD(LOG_TAG, "Connection parameters updated.");
+    pServer->updatePeerState(event->conn_update.conn_handle);
+#if CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+    ConnParamsManager::onConnUpdate(event->conn_update.conn_handle, event->conn_update.status);
+#endif
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+    ServerSnapshot::onUpdate(event->conn_update.conn_handle);
+#endif
     return 0;
   }// BLE_GAP_EVENT_CONN_UPDATE
 
@@ -483,11 +624,16 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
   }// BLE_GAP_EVENT_REPEAT_PAIRING
 
   case BLE_GAP_EVENT_ENC_CHANGE: {
-    rc = ble_gap_conn_find(event->enc_change.conn_handle, &peerInfo.m_desc);
-    if (rc != 0) {
+    PeerState *pState = pServer->updatePeerState(event->enc_change.conn_handle);
+    if (pState == nullptr) {
       return BLE_ATT_ERR_INVALID_HANDLE;
     }
 
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+    ServerSnapshot::onEncrypted(event->enc_change.conn_handle, event->enc_change.status);
+#endif
+    peerInfo.m_desc = pState->desc;
+
     pServer->m_pServerCallbacks->onAuthenticationComplete(peerInfo);
     return 0;
   }// BLE_GAP_EVENT_ENC_CHANGE
@@ -498,7 +644,7 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
     if (event->passkey.params.action == BLE_SM_IOACT_DISP) {
       pkey.action = event->passkey.params.action;
       // backward compatibility
-      pkey.passkey = NimBLEDevice::getSecurityPasskey();// This is the passkey to be entered on peer
+      pkey.passkey = Device::getSecurityPasskey();// This is the passkey to be entered on peer
       // if the (static)passkey is the default, check the callback for custom value
       // both values default to the same.
       if (pkey.passkey == 123456) {
@@ -559,7 +705,7 @@ int Server::handleGapEvent(struct ble_gap_event *event, void *arg) {
  * @param [in] pCallbacks The callbacks to be invoked.
  * @param [in] deleteCallbacks if true callback class will be deleted when server is destructed.
  */
-void Server::setCallbacks(NimBLEServerCallbacks *pCallbacks, bool deleteCallbacks) {
+void Server::setCallbacks(ServerCallbacks *pCallbacks, bool deleteCallbacks) {
   if (pCallbacks != nullptr) {
     m_pServerCallbacks = pCallbacks;
     m_deleteCallbacks = deleteCallbacks;
@@ -612,7 +758,7 @@ void Server::removeService(Service *service, bool deleteSvc) {
   service->m_removed = deleteSvc ? NIMBLE_ATT_REMOVE_DELETE : NIMBLE_ATT_REMOVE_HIDE;
   serviceChanged();
 #if !CONFIG_BT_NIMBLE_EXT_ADV
-  NimBLEDevice::getAdvertising()->removeServiceUUID(service->getUUID());
+  Device::getAdvertising()->removeServiceUUID(service->getUUID());
 #endif
 }
 
@@ -649,11 +795,25 @@ void Server::resetGATT() {
     return;
   }
 
-  NimBLEDevice::stopAdvertising();
+  Device::stopAdvertising();
   ble_gatts_reset();
   ble_svc_gap_init();
   ble_svc_gatt_init();
 
+#if CONFIG_NIMBLE_CPP_GATT_ARENA
+  // The host no longer references the definitions, drop them all with the arena so that
+  // it is sized again for the current attributes when the services are started below.
+  for (auto &it : m_svcVec) {
+    it->freeDefinition();
+  }
+  m_gattArena.release();
+#endif
+
+  for (auto &it : m_tables) {
+    ble_gatts_count_cfg(it);
+    ble_gatts_add_svcs(it);
+  }
+
   for (auto it = m_svcVec.begin(); it != m_svcVec.end();) {
     if ((*it)->m_removed > 0) {
       if ((*it)->m_removed == NIMBLE_ATT_REMOVE_DELETE) {
@@ -673,6 +833,54 @@ void Server::resetGATT() {
   m_gattsStarted = false;
 }
 
+/**
+ * @brief Get the arena the service definition tables are allocated from.
+ * @return The arena or nullptr if disabled or it could not be allocated.
+ * @details The arena is sized on first use for the definitions of every service added so far,
+ * services started later are allocated from the heap until the next GATT reset.
+ */
+GattArena *Server::getGattArena() {
+#if CONFIG_NIMBLE_CPP_GATT_ARENA
+  if (m_gattArena.capacity() == 0) {
+    size_t size = 0;
+    for (auto &it : m_svcVec) {
+      if (it->m_removed == 0) {
+        size += it->getDefinitionSize();
+      }
+    }
+
+    if (!m_gattArena.reserve(size)) {
+      return nullptr;
+    }
+  }
+
+  return &m_gattArena;
+#else
+  return nullptr;
+#endif
+}// getGattArena
+
+#if CONFIG_BT_NIMBLE_EXT_ADV
+/**
+ * @brief Start advertising an instance.
+ * @param [in] inst_id The extended advertisement instance ID to start.
+ * @param [in] duration How long to advertise for in milliseconds, 0 = forever (default).
+ * @param [in] max_events Maximum number of advertisement events to send, 0 = no limit (default).
+ * @return True if advertising started successfully.
+ */
+bool Server::startAdvertising(uint8_t inst_id, int duration, int max_events) {
+  return getAdvertising()->start(inst_id, duration, max_events);
+}// startAdvertising
+
+/**
+ * @brief Stop advertising an instance.
+ * @param [in] inst_id The extended advertisement instance ID to stop.
+ * @return True if advertising stopped successfully.
+ */
+bool Server::stopAdvertising(uint8_t inst_id) {
+  return getAdvertising()->stop(inst_id);
+}// stopAdvertising
+#else
 /**
  * @brief Start advertising.
  * @param [in] duration The duration in milliseconds to advertise for, default = forever.
@@ -683,6 +891,7 @@ void Server::resetGATT() {
 bool Server::startAdvertising(uint32_t duration) {
   return getAdvertising()->start(duration);
 }// startAdvertising
+#endif
 
 /**
  * @brief Stop advertising.
@@ -697,6 +906,11 @@ bool Server::stopAdvertising() {
  * @returns The client MTU or 0 if not found/connected.
  */
 uint16_t Server::getPeerMTU(uint16_t conn_id) {
+  PeerState *pState = getPeerState(conn_id);
+  if (pState != nullptr) {
+    return pState->mtu;
+  }
+
   return ble_att_mtu(conn_id);
 }//getPeerMTU
 
@@ -749,24 +963,385 @@ void Server::setDataLen(uint16_t conn_handle, uint16_t tx_octets) {
 #endif
 }// setDataLen
 
-bool Server::setIndicateWait(uint16_t conn_handle) {
-  for (unsigned short i : m_indWait) {
-    if (i == conn_handle) {
-      return false;
-    }
+/**
+ * @brief Request a change of the PHY of a connection.
+ * * Can only be used after a connection has been established.
+ * @details The controller negotiates the PHYs with the peer, the result is passed to
+ * ServerCallbacks::onPhyUpdate().
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [in] txPhyMask The preferred transmit PHYs, a bitmask of BLE_GAP_LE_PHY_1M_MASK,
+ * BLE_GAP_LE_PHY_2M_MASK and BLE_GAP_LE_PHY_CODED_MASK.
+ * @param [in] rxPhyMask The preferred receive PHYs, same bitmask.
+ * @param [in] phyOptions The coding of the Coded PHY:
+ * * 0x00 BLE_GAP_LE_PHY_CODED_ANY
+ * * 0x01 BLE_GAP_LE_PHY_CODED_S2
+ * * 0x02 BLE_GAP_LE_PHY_CODED_S8
+ * @return True if the request was sent.
+ */
+bool Server::setPhy(uint16_t conn_handle, uint8_t txPhyMask, uint8_t rxPhyMask, uint16_t phyOptions) {
+  int rc = ble_gap_set_prefered_le_phy(conn_handle, txPhyMask, rxPhyMask, phyOptions);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Set PHY error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
   }
 
   return true;
-}
+}// setPhy
+
+/**
+ * @brief Read the current PHY of a connection.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [out] txPhy The transmit PHY, BLE_HCI_LE_PHY_1M, BLE_HCI_LE_PHY_2M or BLE_HCI_LE_PHY_CODED.
+ * @param [out] rxPhy The receive PHY.
+ * @return True if successful.
+ */
+bool Server::getPhy(uint16_t conn_handle, uint8_t *txPhy, uint8_t *rxPhy) {
+  int rc = ble_gap_read_le_phy(conn_handle, txPhy, rxPhy);
+  if (rc != 0) {
+    NIMBLE_LOGE(LOG_TAG, "Read PHY error: %d, %s", rc, Utils::returnCodeToString(rc));
+    return false;
+  }
+
+  return true;
+}// getPhy
+
+/**
+ * @brief Send an indication, or queue it if the peer has not confirmed the previous one yet.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [in] pChr The characteristic the value belongs to.
+ * @param [in] om The value to send, always consumed.
+ * @return 0 if the indication was sent or queued, otherwise a NimBLE error code.
+ * @details With CONFIG_NIMBLE_CPP_INDICATION_COALESCE a value queued for the same characteristic
+ * is replaced rather than adding another entry. The queue is drained from the host task as each
+ * indication is confirmed.
+ */
+int Server::queueIndication(uint16_t conn_handle, Characteristic *pChr, os_mbuf *om) {
+  PeerState *pState = getPeerState(conn_handle);
+  if (pState == nullptr) {
+    os_mbuf_free_chain(om);
+    NIMBLE_STAT_INC(INDICATE_FAILED);
+    return BLE_HS_ENOTCONN;
+  }
+
+  IndicationQueue &queue = pState->indications;
 
-void Server::clearIndicateWait(uint16_t conn_handle) {
-  for (auto i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
-    if (m_indWait[i] == conn_handle) {
-      m_indWait[i] = BLE_HS_CONN_HANDLE_NONE;
+  ble_npl_hw_enter_critical();
+  if (!queue.inFlight) {
+    queue.inFlight = true;
+    ble_npl_hw_exit_critical(0);
+
+#if CONFIG_NIMBLE_CPP_STATS
+    queue.sentAt = Stats::now();
+#endif
+    int rc = ble_gattc_indicate_custom(conn_handle, pChr->m_handle, om);
+    if (rc != 0) {
+      NIMBLE_STAT_INC(INDICATE_FAILED);
+      // Nothing will confirm it, release the slot or start on the queue.
+      sendNextIndication(conn_handle);
+    } else {
+      NIMBLE_STAT_INC(INDICATE_SENT);
+    }
+    return rc;
+  }
+
+#if CONFIG_NIMBLE_CPP_INDICATION_COALESCE
+  for (uint8_t i = 0; i < queue.count; i++) {
+    IndicationQueue::Entry &entry = queue.entries[(queue.head + i) % CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH];
+    if (entry.pChr == pChr) {
+      os_mbuf *old = entry.om;
+      entry.om = om;
+      ble_npl_hw_exit_critical(0);
+
+      os_mbuf_free_chain(old);
+      return 0;
+    }
+  }
+#endif
+
+  if (queue.count >= CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH) {
+    ble_npl_hw_exit_critical(0);
+    os_mbuf_free_chain(om);
+    NIMBLE_STAT_INC(INDICATE_FAILED);
+    return BLE_HS_ENOMEM;
+  }
+
+  queue.entries[(queue.head + queue.count) % CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH] = {pChr, om};
+  queue.count++;
+  ble_npl_hw_exit_critical(0);
+  NIMBLE_STAT_INC(INDICATE_SENT);
+  return 0;
+}// queueIndication
+
+/**
+ * @brief Send the oldest queued indication of a peer, called when the previous one completed.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @details Entries that fail to send are reported through CharacteristicCallbacks::onStatus().
+ */
+void Server::sendNextIndication(uint16_t conn_handle) {
+  PeerState *pState = getPeerState(conn_handle);
+  if (pState == nullptr) {
+    return;
+  }
+
+  IndicationQueue &queue = pState->indications;
+
+  for (;;) {
+    ble_npl_hw_enter_critical();
+    if (queue.count == 0) {
+      queue.inFlight = false;
+      ble_npl_hw_exit_critical(0);
       return;
     }
+
+    IndicationQueue::Entry entry = queue.entries[queue.head];
+    queue.head = (queue.head + 1) % CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH;
+    queue.count--;
+    ble_npl_hw_exit_critical(0);
+
+#if CONFIG_NIMBLE_CPP_STATS
+    queue.sentAt = Stats::now();
+#endif
+    int rc = ble_gattc_indicate_custom(conn_handle, entry.pChr->m_handle, entry.om);
+    if (rc == 0) {
+      return;
+    }
+
+    NIMBLE_LOGE(LOG_TAG, "Queued indication failed; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    NIMBLE_STAT_INC(INDICATE_FAILED);
+    entry.pChr->m_pCallbacks->onStatus(entry.pChr, rc);
   }
-}
+}// sendNextIndication
+
+/**
+ * @brief Drop the queued indications of a peer.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @param [in] pChr Only drop the values of this characteristic, or nullptr to drop all of them.
+ * @details The indication in flight, if any, is not affected.
+ */
+void Server::purgeIndications(uint16_t conn_handle, Characteristic *pChr) {
+  PeerState *pState = getPeerState(conn_handle);
+  if (pState == nullptr) {
+    return;
+  }
+
+  IndicationQueue &queue = pState->indications;
+  IndicationQueue::Entry dropped[CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH];
+  uint8_t numDropped = 0;
+
+  ble_npl_hw_enter_critical();
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < queue.count; i++) {
+    IndicationQueue::Entry &entry = queue.entries[(queue.head + i) % CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH];
+    if (pChr == nullptr || entry.pChr == pChr) {
+      dropped[numDropped++] = entry;
+    } else {
+      queue.entries[(queue.head + kept++) % CONFIG_NIMBLE_CPP_INDICATION_QUEUE_DEPTH] = entry;
+    }
+  }
+  queue.count = kept;
+  ble_npl_hw_exit_critical(0);
+
+  for (uint8_t i = 0; i < numDropped; i++) {
+    os_mbuf_free_chain(dropped[i].om);
+  }
+}// purgeIndications
+
+/**
+ * @brief Send the values of several characteristics to the subscribed peers.
+ * @param [in] batch The characteristics and values to send.
+ * @param [in] conn_handle Connection handle to send to, or BLE_HCI_LE_CONN_HANDLE_MAX + 1 to send to all connected peers.
+ * @details The MTU and encryption state of each peer are looked up once for the whole batch.
+ * Each value is sent as a notification, or as an indication to peers only subscribed to indications.
+ */
+void Server::notifyBatch(const NotifyBatch &batch, uint16_t conn_handle) {
+  NIMBLE_LOGD(LOG_TAG, ">> notifyBatch: count: %d", batch.size());
+
+  bool reqSec = false;
+  for (auto &entry : batch.m_entries) {
+    Characteristic *pChar = entry.pCharacteristic;
+    if (pChar->getSubscribedCount() > 0) {
+      pChar->m_pCallbacks->onNotify(pChar);
+    }
+
+    reqSec |= (pChar->m_properties & (BLE_GATT_CHR_F_READ_AUTHEN | BLE_GATT_CHR_F_READ_AUTHOR | BLE_GATT_CHR_F_READ_ENC)) != 0;
+  }
+
+  for (uint16_t peer : m_connectedPeersVec) {
+    if ((conn_handle <= BLE_HCI_LE_CONN_HANDLE_MAX) && (peer != conn_handle)) {
+      continue;
+    }
+
+    PeerState *pState = getPeerState(peer);
+    if (pState == nullptr || pState->mtu <= 3) {
+      continue;
+    }
+
+    uint16_t mtu = pState->mtu - 3;
+    size_t peerIndex = getPeerIndex(pState);
+    bool encrypted = pState->desc.sec_state.encrypted;
+
+    for (auto &entry : batch.m_entries) {
+      Characteristic *pChar = entry.pCharacteristic;
+
+      uint16_t subVal = pChar->getSubscribeValue(peerIndex);
+      if (subVal == 0) {
+        continue;
+      }
+
+      if (!encrypted && (pChar->m_properties & (BLE_GATT_CHR_F_READ_AUTHEN | BLE_GATT_CHR_F_READ_AUTHOR | BLE_GATT_CHR_F_READ_ENC))) {
+        continue;
+      }
+
+      if (entry.length > mtu) {
+        NIMBLE_LOGW(LOG_TAG, "- Truncating to %d bytes (maximum notify size)", mtu);
+      }
+
+      os_mbuf *om = ble_hs_mbuf_from_flat(entry.value, entry.length);
+      if (om == nullptr) {
+        NIMBLE_LOGE(LOG_TAG, "<< notifyBatch: out of mbufs");
+        NIMBLE_STAT_INC(NOTIFY_ENOMEM);
+        return;
+      }
+
+      NIMBLE_CONN_TRAFFIC(peer, entry.length);
+      if (subVal & NIMBLE_SUB_NOTIFY) {
+        int rc = ble_gattc_notify_custom(peer, pChar->m_handle, om);
+        NIMBLE_STAT_NOTIFY(rc);
+        continue;
+      }
+
+      int rc = queueIndication(peer, pChar, om);
+      if (rc != 0) {
+        NIMBLE_LOGE(LOG_TAG, "Indication not sent; rc=%d %s", rc, Utils::returnCodeToString(rc));
+      }
+    }
+  }
+
+  NIMBLE_LOGD(LOG_TAG, "<< notifyBatch");
+}// notifyBatch
+
+/**
+ * @brief Add a characteristic value to the batch.
+ * @param [in] pCharacteristic The characteristic to send the value of.
+ * @param [in] value A pointer to the data to send, must remain valid until the batch is sent.
+ * @param [in] length The length of the data to send.
+ */
+void NotifyBatch::add(Characteristic *pCharacteristic, const uint8_t *value, size_t length) {
+  m_entries.push_back({pCharacteristic, value, length});
+}// add
+
+/**
+ * @brief Add a characteristic to the batch to send its current value.
+ * @param [in] pCharacteristic The characteristic to send the value of.
+ * @details The value must not be changed until the batch is sent.
+ */
+void NotifyBatch::add(Characteristic *pCharacteristic) {
+  m_entries.push_back({pCharacteristic, pCharacteristic->m_value.data(), pCharacteristic->m_value.length()});
+}// add
+
+/**
+ * @brief Remove all entries from the batch, the allocated storage is kept for reuse.
+ */
+void NotifyBatch::clear() {
+  m_entries.clear();
+}// clear
+
+/**
+ * @brief Get the number of entries in the batch.
+ * @return The number of characteristic values in the batch.
+ */
+size_t NotifyBatch::size() const {
+  return m_entries.size();
+}// size
+
+/**
+ * @brief Get the cached state of a connected peer.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @return A pointer to the peer state or nullptr if the peer is not connected to the server.
+ * @details The state is updated from the host task, the entry for a handle is normally
+ * found at the first index checked.
+ */
+Server::PeerState *Server::getPeerState(uint16_t conn_handle) {
+  PeerState *pState = &m_peerStates[conn_handle % CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+  if (pState->desc.conn_handle == conn_handle) {
+    return pState;
+  }
+
+  for (auto &it : m_peerStates) {
+    if (it.desc.conn_handle == conn_handle) {
+      return &it;
+    }
+  }
+
+  return nullptr;
+}// getPeerState
+
+/**
+ * @brief Refresh the cached state of a peer from the host, adding it if needed.
+ * @param [in] conn_handle The connection handle of the peer.
+ * @return A pointer to the peer state or nullptr if the connection was not found.
+ */
+Server::PeerState *Server::updatePeerState(uint16_t conn_handle) {
+  PeerState *pState = getPeerState(conn_handle);
+
+  if (pState == nullptr) {
+    PeerState *pHome = &m_peerStates[conn_handle % CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+    if (pHome->desc.conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+      pState = pHome;
+    } else {
+      pState = getPeerState(BLE_HS_CONN_HANDLE_NONE);
+    }
+
+    if (pState == nullptr) {
+      NIMBLE_LOGE(LOG_TAG, "No free peer state for conn: %d", conn_handle);
+      return nullptr;
+    }
+
+    pState->mtu = ble_att_mtu(conn_handle);
+    memset(&pState->indications, 0, sizeof(pState->indications));
+  }
+
+  if (ble_gap_conn_find(conn_handle, &pState->desc) != 0) {
+    pState->desc.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    return nullptr;
+  }
+
+  return pState;
+}// updatePeerState
+
+/**
+ * @brief Get the slot of a peer in the cached state table.
+ * @param [in] pState A pointer to the peer state, as returned by getPeerState().
+ * @return The index of the slot, below CONFIG_BT_NIMBLE_MAX_CONNECTIONS.
+ */
+size_t Server::getPeerIndex(const PeerState *pState) const {
+  return pState - m_peerStates;
+}// getPeerIndex
+
+/**
+ * @brief Get a characteristic with notify or indicate properties by its value handle.
+ * @param [in] handle The value handle.
+ * @return The characteristic or nullptr if not found.
+ */
+Characteristic *Server::getNotifyCharacteristic(uint16_t handle) {
+  if (handle >= m_notifyChrByHandle.size()) {
+    return nullptr;
+  }
+
+  return m_notifyChrByHandle[handle];
+}// getNotifyCharacteristic
+
+/**
+ * @brief Remove a peer from the cached state table.
+ * @param [in] conn_handle The connection handle of the peer.
+ */
+void Server::removePeerState(uint16_t conn_handle) {
+  PeerState *pState = getPeerState(conn_handle);
+  if (pState != nullptr) {
+    pState->desc.conn_handle = BLE_HS_CONN_HANDLE_NONE;
+    pState->mtu = 0;
+  }
+}// removePeerState
 
 /** Default callback handlers */
 void ServerCallbacks::onConnect(Server *pServer, ConnectionInfo &connInfo) {
@@ -796,6 +1371,10 @@ bool ServerCallbacks::onConfirmPIN(uint32_t pin) {
   return true;
 }// onConfirmPIN
 
+void ServerCallbacks::onPhyUpdate(ConnectionInfo &connInfo, uint8_t txPhy, uint8_t rxPhy) {
+  NIMBLE_LOGD("NimBLEServerCallbacks", "onPhyUpdate: default");
+}// onPhyUpdate
+
 }
 
 #endif /* CONFIG_BT_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
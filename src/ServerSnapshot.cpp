@@ -0,0 +1,342 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED) && defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "nimble/ServerSnapshot.hpp"
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT
+
+#include <cstddef>
+#include <cstring>
+
+#include <esp_rom_crc.h>
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_NVS
+#include <nvs.h>
+#else
+#include <esp_attr.h>
+#endif
+
+#include "nimble/ConnParamsManager.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Log.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Utils.hpp"
+
+static const char *LOG_TAG = "NimBLEServerSnapshot";
+
+namespace nimble {
+
+static constexpr uint32_t SNAPSHOT_MAGIC = 0x4E425332;// "NBS2"
+
+struct SnapshotPeer {
+  uint32_t sequence;/// Order of the last update, 0 for an empty entry.
+  uint8_t address[6];
+  uint8_t addressType;
+  uint16_t mtu;
+  uint16_t interval;
+  uint16_t latency;
+  uint16_t timeout;
+};
+
+struct Snapshot {
+  uint32_t magic;
+  uint32_t sequence;
+  SnapshotPeer peers[CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_PEERS];
+  uint32_t crc;
+};
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_NVS
+static const char *NVS_NAMESPACE = "nimble_srv";
+static const char *NVS_KEY = "snapshot";
+static Snapshot s_snapshot;
+static bool s_dirty = false;
+#else
+// Not initialized at boot, so it survives deep sleep and software resets, validated by its CRC.
+RTC_NOINIT_ATTR static Snapshot s_snapshot;
+#endif
+
+// The encrypted connection each peer slot restored, only those are recorded.
+static uint16_t s_restored[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+
+/**
+ * @brief Compute the CRC of the snapshot, everything but the CRC itself.
+ */
+static uint32_t snapshotCrc() {
+  return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&s_snapshot), offsetof(Snapshot, crc));
+}// snapshotCrc
+
+/**
+ * @brief Find the entry of a peer.
+ * @param [in] address The identity address of the peer.
+ * @return The entry or nullptr if the peer has none.
+ */
+static SnapshotPeer *findEntry(const ble_addr_t &address) {
+  for (auto &entry : s_snapshot.peers) {
+    if (entry.sequence != 0 && entry.addressType == address.type && memcmp(entry.address, address.val, 6) == 0) {
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}// findEntry
+
+/**
+ * @brief Write the snapshot to its storage now, with NVS storage.
+ * @details With RTC memory storage the snapshot is always up to date and this does nothing.
+ */
+/*STATIC*/
+void ServerSnapshot::save() {
+  persist(true);
+}// save
+
+/**
+ * @brief Erase the snapshot of a peer, e.g. after deleting its bond.
+ * @param [in] address The identity address of the peer.
+ */
+/*STATIC*/
+void ServerSnapshot::erase(const Address &address) {
+  ble_addr_t addr;
+  memcpy(addr.val, address.getNative(), 6);
+  addr.type = address.getType();
+
+  SnapshotPeer *pEntry = findEntry(addr);
+  if (pEntry != nullptr) {
+    memset(pEntry, 0, sizeof(*pEntry));
+    persist(true);
+  }
+}// erase
+
+/**
+ * @brief Erase the snapshots of all peers.
+ */
+/*STATIC*/
+void ServerSnapshot::eraseAll() {
+  memset(s_snapshot.peers, 0, sizeof(s_snapshot.peers));
+  persist(true);
+}// eraseAll
+
+/**
+ * @brief Load the snapshot when the server starts.
+ * @details The entries of peers that are no longer bonded are dropped.
+ */
+/*STATIC*/
+void ServerSnapshot::onStart() {
+  for (auto &it : s_restored) {
+    it = BLE_HS_CONN_HANDLE_NONE;
+  }
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_NVS
+  nvs_handle_t handle;
+  size_t length = sizeof(s_snapshot);
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (err == ESP_OK) {
+    err = nvs_get_blob(handle, NVS_KEY, &s_snapshot, &length);
+    nvs_close(handle);
+  }
+
+  if (err != ESP_OK || length != sizeof(s_snapshot)) {
+    s_snapshot.magic = 0;
+  }
+#endif
+
+  if (s_snapshot.magic != SNAPSHOT_MAGIC || s_snapshot.crc != snapshotCrc()) {
+    NIMBLE_LOGD(LOG_TAG, "No valid snapshot");
+    memset(&s_snapshot, 0, sizeof(s_snapshot));
+    s_snapshot.magic = SNAPSHOT_MAGIC;
+  }
+
+  size_t restored = 0;
+  for (auto &entry : s_snapshot.peers) {
+    if (entry.sequence == 0) {
+      continue;
+    }
+
+    ble_addr_t addr;
+    memcpy(addr.val, entry.address, 6);
+    addr.type = entry.addressType;
+    if (!Device::isBonded(Address(addr))) {
+      memset(&entry, 0, sizeof(entry));
+      continue;
+    }
+
+    restored++;
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Snapshot of %d peers loaded", restored);
+  persist(false);
+}// onStart
+
+/**
+ * @brief Restore the state of a bonded peer once the link is encrypted with its bond.
+ * @param [in] connHandle The connection handle.
+ * @param [in] status The status of the encryption change.
+ * @details Only then is the peer known to hold the bond keys, not just to use the address of a bonded peer.
+ */
+/*STATIC*/
+void ServerSnapshot::onEncrypted(uint16_t connHandle, int status) {
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer->getPeerState(connHandle);
+  if (status != 0 || pState == nullptr || !pState->desc.sec_state.encrypted || !pState->desc.sec_state.bonded) {
+    return;
+  }
+
+  const size_t peerIndex = pServer->getPeerIndex(pState);
+  if (s_restored[peerIndex] != connHandle) {
+    s_restored[peerIndex] = connHandle;
+    restore(connHandle);
+  }
+
+  onUpdate(connHandle);
+}// onEncrypted
+
+/**
+ * @brief Record the state of a bonded peer after its MTU or connection parameters changed.
+ * @param [in] connHandle The connection handle.
+ * @details Only connections encrypted with the bond of the peer are recorded.
+ */
+/*STATIC*/
+void ServerSnapshot::onUpdate(uint16_t connHandle) {
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer->getPeerState(connHandle);
+  if (pState == nullptr || s_restored[pServer->getPeerIndex(pState)] != connHandle) {
+    return;
+  }
+
+  SnapshotPeer *pEntry = findEntry(pState->desc.peer_id_addr);
+  if (pEntry == nullptr) {
+    // Take an empty entry, or the least recently updated one.
+    pEntry = &s_snapshot.peers[0];
+    for (auto &entry : s_snapshot.peers) {
+      if (entry.sequence < pEntry->sequence) {
+        pEntry = &entry;
+      }
+    }
+
+    memset(pEntry, 0, sizeof(*pEntry));
+    memcpy(pEntry->address, pState->desc.peer_id_addr.val, 6);
+    pEntry->addressType = pState->desc.peer_id_addr.type;
+  }
+
+  pEntry->sequence = ++s_snapshot.sequence;
+  pEntry->mtu = pState->mtu;
+  pEntry->interval = pState->desc.conn_itvl;
+  pEntry->latency = pState->desc.conn_latency;
+  pEntry->timeout = pState->desc.supervision_timeout;
+
+  persist(false);
+}// onUpdate
+
+/**
+ * @brief Write the snapshot when a peer disconnects, with NVS storage.
+ * @param [in] connHandle The connection handle.
+ */
+/*STATIC*/
+void ServerSnapshot::onDisconnect(uint16_t connHandle) {
+  for (auto &it : s_restored) {
+    if (it == connHandle) {
+      it = BLE_HS_CONN_HANDLE_NONE;
+    }
+  }
+
+  persist(true);
+}// onDisconnect
+
+/**
+ * @brief Apply the snapshot of a bonded peer to its encrypted connection.
+ * @param [in] connHandle The connection handle.
+ * @details The subscriptions are not part of the snapshot, the NimBLE store restores the CCCDs of
+ * bonded peers once the link is encrypted and reports them with BLE_GAP_SUBSCRIBE_REASON_RESTORE.
+ */
+/*STATIC*/
+void ServerSnapshot::restore(uint16_t connHandle) {
+  Server *pServer = Device::getServer();
+  Server::PeerState *pState = pServer->getPeerState(connHandle);
+  if (pState == nullptr) {
+    return;
+  }
+
+  SnapshotPeer *pEntry = findEntry(pState->desc.peer_id_addr);
+  if (pEntry == nullptr) {
+    return;
+  }
+
+  NIMBLE_LOGI(LOG_TAG, "Restoring mtu=%d, interval=%d", pEntry->mtu, pEntry->interval);
+
+  // The MTU is only used once the exchange completes, starting it here saves waiting for the peer.
+  if (pEntry->mtu > BLE_ATT_MTU_DFLT && pState->mtu <= BLE_ATT_MTU_DFLT) {
+    int rc = ble_gattc_exchange_mtu(connHandle, nullptr, nullptr);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+      NIMBLE_LOGD(LOG_TAG, "MTU exchange error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    }
+  }
+
+#if !CONFIG_NIMBLE_CPP_ADAPTIVE_CONN_PARAMS
+  // The connection parameter manager chooses the parameters itself when enabled.
+  if (pEntry->interval != 0 && (pEntry->interval != pState->desc.conn_itvl || pEntry->latency != pState->desc.conn_latency ||
+                                pEntry->timeout != pState->desc.supervision_timeout)) {
+    ble_gap_upd_params params{};
+    params.itvl_min = pEntry->interval;
+    params.itvl_max = pEntry->interval;
+    params.latency = pEntry->latency;
+    params.supervision_timeout = pEntry->timeout;
+    params.min_ce_len = BLE_GAP_INITIAL_CONN_MIN_CE_LEN;
+    params.max_ce_len = BLE_GAP_INITIAL_CONN_MAX_CE_LEN;
+
+    int rc = ble_gap_update_params(connHandle, &params);
+    if (rc != 0) {
+      NIMBLE_LOGD(LOG_TAG, "Update params error; rc=%d %s", rc, Utils::returnCodeToString(rc));
+    }
+  }
+#endif
+}// restore
+
+/**
+ * @brief Update the CRC of the snapshot and write it to NVS if requested.
+ * @param [in] commit True to write the snapshot to NVS now, otherwise it is written on the next disconnect.
+ */
+/*STATIC*/
+void ServerSnapshot::persist(bool commit) {
+  s_snapshot.crc = snapshotCrc();
+
+#if CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT_NVS
+  s_dirty |= !commit;
+  if (!commit || !s_dirty) {
+    return;
+  }
+
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(handle, NVS_KEY, &s_snapshot, sizeof(s_snapshot));
+    if (err == ESP_OK) {
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+
+  if (err != ESP_OK) {
+    NIMBLE_LOGE(LOG_TAG, "Failed to store the snapshot; err=%d", err);
+    return;
+  }
+
+  s_dirty = false;
+#endif
+}// persist
+
+}// namespace nimble
+
+#endif /* CONFIG_NIMBLE_CPP_SERVER_SNAPSHOT */
+#endif /* CONFIG_BT_NIMBLE_ENABLED && CONFIG_BT_NIMBLE_ROLE_PERIPHERAL */
@@ -17,9 +17,11 @@
 
 #include "nimble/Device.hpp"
 #include "nimble/Log.hpp"
+#include "nimble/Memory.hpp"
 #include "nimble/Service.hpp"
 #include "nimble/Utils.hpp"
 
+#include <cstring>
 #include <string>
 
 namespace nimble {
@@ -28,6 +30,39 @@ static const char *LOG_TAG = "NimBLEService";// Tag for logging.
 
 #define NULL_HANDLE (0xffff)
 
+/**
+ * @brief Allocate a zero initialized array of definitions, from the arena if there is room.
+ * @param [in] pArena The arena to try first, may be nullptr.
+ * @param [in] count The number of definitions.
+ * @return A pointer to the array.
+ */
+template<typename T>
+static T *allocDefs(GattArena *pArena, size_t count) {
+  T *defs = pArena != nullptr ? pArena->allocate<T>(count) : nullptr;
+  if (defs == nullptr) {
+    defs = static_cast<T *>(Memory::allocateObject(Memory::SERVER, count * sizeof(T)));
+    memset(defs, 0, count * sizeof(T));
+  }
+  return defs;
+}
+
+/**
+ * @brief Free an array of definitions allocated with allocDefs.
+ * @param [in] arena The arena the array may have been allocated from.
+ * @param [in] defs A pointer to the array, may be nullptr.
+ * @details The arrays end with an entry without UUID, which gives their size.
+ */
+template<typename T>
+static void freeDefs(const GattArena &arena, T *defs) {
+  if (defs != nullptr && !arena.owns(defs)) {
+    size_t count = 1;
+    while (defs[count - 1].uuid != nullptr) {
+      count++;
+    }
+    Memory::release(Memory::SERVER, (void *) defs, count * sizeof(T));
+  }
+}
+
 /**
  * @brief Construct an instance of the NimBLEService
  * @param [in] uuid The UUID of the service.
@@ -49,16 +84,7 @@ Service::Service(const UUID &uuid) {
 }// NimBLEService
 
 Service::~Service() {
-  if (m_pSvcDef != nullptr) {
-    if (m_pSvcDef->characteristics != nullptr) {
-      for (int i = 0; m_pSvcDef->characteristics[i].uuid != nullptr; ++i) {
-        delete (m_pSvcDef->characteristics[i].descriptors);
-      }
-      delete (m_pSvcDef->characteristics);
-    }
-
-    delete (m_pSvcDef);
-  }
+  freeDefinition();
 
   for (auto const &characteristic : m_characteristics) {
     delete characteristic;
@@ -109,19 +135,16 @@ bool Service::start() {
 
   // Rebuild the service definition if the server attributes have changed.
   if (getServer()->m_svcChanged && m_pSvcDef != nullptr) {
-    if (m_pSvcDef[0].characteristics) {
-      delete (m_pSvcDef[0].characteristics[0].descriptors);
-      delete (m_pSvcDef[0].characteristics);
-    }
-    delete (m_pSvcDef);
-    m_pSvcDef = nullptr;
+    freeDefinition();
   }
 
   if (m_pSvcDef == nullptr) {
+    GattArena *pArena = getServer()->getGattArena();
+
     // Nimble requires an array of services to be sent to the api
     // Since we are adding 1 at a time we create an array of 2 and set the type
     // of the second service to 0 to indicate the end of the array.
-    auto svc = new ble_gatt_svc_def[2];
+    auto svc = allocDefs<ble_gatt_svc_def>(pArena, 2);
     ble_gatt_chr_def *pChr_a;
     ble_gatt_dsc_def *pDsc_a;
 
@@ -154,7 +177,7 @@ bool Service::start() {
       // Nimble requires the last characteristic to have it's uuid = 0 to indicate the end
       // of the characteristics for the service. We create 1 extra and set it to null
       // for this purpose.
-      pChr_a = new ble_gatt_chr_def[numChrs + 1]{};
+      pChr_a = allocDefs<ble_gatt_chr_def>(pArena, numChrs + 1);
       int i = 0;
       for (auto &m_characteristic : m_characteristics) {
         if (m_characteristic->m_removed > 0) {
@@ -183,7 +206,7 @@ bool Service::start() {
           pChr_a[i].descriptors = nullptr;
         } else {
           // Must have last descriptor uuid = 0 so we have to create 1 extra
-          pDsc_a = new ble_gatt_dsc_def[numDscs + 1];
+          pDsc_a = allocDefs<ble_gatt_dsc_def>(pArena, numDscs + 1);
           int d = 0;
           for (auto &dsc_it : m_characteristic->m_dscVec) {
             if (dsc_it->m_removed > 0) {
@@ -235,6 +258,59 @@ bool Service::start() {
   return true;
 }// start
 
+/**
+ * @brief Get the memory needed for the definition tables of this service.
+ * @return The size in bytes, including the worst case alignment padding.
+ */
+size_t Service::getDefinitionSize() {
+  size_t numChrs = 0;
+  size_t size = GattArena::sizeOf<ble_gatt_svc_def>(2);
+
+  for (auto &chr : m_characteristics) {
+    if (chr->m_removed > 0) {
+      continue;
+    }
+
+    size_t numDscs = 0;
+    for (auto &dsc : chr->m_dscVec) {
+      if (dsc->m_removed == 0) {
+        numDscs++;
+      }
+    }
+
+    if (numDscs > 0) {
+      size += GattArena::sizeOf<ble_gatt_dsc_def>(numDscs + 1);
+    }
+    numChrs++;
+  }
+
+  if (numChrs > 0) {
+    size += GattArena::sizeOf<ble_gatt_chr_def>(numChrs + 1);
+  }
+
+  return size;
+}// getDefinitionSize
+
+/**
+ * @brief Free the definition tables of this service, tables in the server arena are left to it.
+ */
+void Service::freeDefinition() {
+  if (m_pSvcDef == nullptr) {
+    return;
+  }
+
+  const GattArena &arena = getServer()->m_gattArena;
+  if (m_pSvcDef->characteristics != nullptr) {
+    for (int i = 0; m_pSvcDef->characteristics[i].uuid != nullptr; ++i) {
+      freeDefs(arena, m_pSvcDef->characteristics[i].descriptors);
+    }
+    freeDefs(arena, m_pSvcDef->characteristics);
+  }
+
+  freeDefs(arena, m_pSvcDef);
+  m_pSvcDef = nullptr;
+}// freeDefinition
+
 /**
  * @brief Get the handle associated with this service.
  * @return The handle associated with this service.
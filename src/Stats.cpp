@@ -0,0 +1,264 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ENABLED)
+
+#include "nimble/Stats.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <host/ble_hs.h>
+
+namespace nimble {
+
+/**
+ * @brief Upper limits of the histogram buckets in microseconds, the last bucket is unbounded.
+ * @details Spans a fraction of a connection interval up to slow connections and discoveries.
+ */
+static constexpr uint32_t BUCKET_LIMITS_US[LatencyStats::BUCKETS - 1] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000};
+
+/**
+ * @brief The counters of one core, aligned so each core writes its own cache line.
+ */
+struct alignas(32) CoreCounters {
+  std::atomic<uint32_t> value[Stats::COUNTER_MAX];
+};
+
+static CoreCounters s_counters[portNUM_PROCESSORS];
+static LatencyHistogram s_latency[Stats::LATENCY_MAX];
+
+/**
+ * @brief Get the upper limit of a bucket.
+ * @param [in] bucket The index of the bucket.
+ * @return The limit in microseconds, UINT32_MAX for the last bucket.
+ */
+/*STATIC*/
+uint32_t LatencyStats::getBucketLimitUs(size_t bucket) {
+  return bucket < BUCKETS - 1 ? BUCKET_LIMITS_US[bucket] : UINT32_MAX;
+}// getBucketLimitUs
+
+/**
+ * @brief Estimate a percentile of the samples.
+ * @param [in] percentile The percentile, 0 to 100.
+ * @return The upper limit of the bucket holding the percentile, or the largest sample if it is in the last bucket.
+ */
+uint32_t LatencyStats::getPercentileUs(uint8_t percentile) const {
+  if (count == 0) {
+    return 0;
+  }
+
+  uint32_t target = ((uint64_t) count * percentile + 99) / 100;
+  uint32_t seen = 0;
+  for (size_t i = 0; i < BUCKETS - 1; i++) {
+    seen += buckets[i];
+    if (seen >= target) {
+      return BUCKET_LIMITS_US[i] < maxUs ? BUCKET_LIMITS_US[i] : maxUs;
+    }
+  }
+
+  return maxUs;
+}// getPercentileUs
+
+/**
+ * @brief Append a histogram as a JSON object.
+ * @param [in] out The string to append to.
+ * @param [in] name The key of the object.
+ * @param [in] stats The histogram.
+ */
+static void appendJson(std::string &out, const char *name, const LatencyStats &stats) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), ",\"%s\":{\"count\":%" PRIu32 ",\"max_us\":%" PRIu32
+                             ",\"p50_us\":%" PRIu32 ",\"p90_us\":%" PRIu32 ",\"p99_us\":%" PRIu32 ",\"buckets\":[",
+           name, stats.count, stats.maxUs,
+           stats.getPercentileUs(50), stats.getPercentileUs(90), stats.getPercentileUs(99));
+  out += buf;
+
+  for (size_t i = 0; i < LatencyStats::BUCKETS; i++) {
+    snprintf(buf, sizeof(buf), i == 0 ? "%" PRIu32 : ",%" PRIu32, stats.buckets[i]);
+    out += buf;
+  }
+  out += "]}";
+}// appendJson
+
+/**
+ * @brief Format the statistics as a single line JSON object.
+ * @return The counters by name and, for each histogram, the sample count, maximum, estimated
+ * percentiles and bucket counts. Meant to be logged or uploaded by benchmarks and compared
+ * between releases.
+ */
+std::string DeviceStats::toJson() const {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"scan_reports\":%" PRIu32 ",\"scan_dropped\":%" PRIu32 ",\"scan_deduped\":%" PRIu32
+           ",\"scan_filtered\":%" PRIu32
+           ",\"notify_sent\":%" PRIu32 ",\"notify_failed\":%" PRIu32 ",\"notify_nomem\":%" PRIu32
+           ",\"indicate_sent\":%" PRIu32 ",\"indicate_failed\":%" PRIu32,
+           scanReports, scanDropped, scanDeduped, scanFiltered, notifySent, notifyFailed, notifyNoMem,
+           indicateSent, indicateFailed);
+
+  std::string out(buf);
+  out.reserve(out.length() + 5 * 160);
+  appendJson(out, "indication_rtt", indicationRtt);
+  appendJson(out, "gatt_read", gattRead);
+  appendJson(out, "gatt_write", gattWrite);
+  appendJson(out, "connect", connect);
+  appendJson(out, "discovery", discovery);
+  out += "}";
+  return out;
+}// toJson
+
+/**
+ * @brief Add a sample.
+ * @param [in] us The latency in microseconds.
+ */
+void LatencyHistogram::record(uint32_t us) {
+  size_t bucket = 0;
+  while (bucket < LatencyStats::BUCKETS - 1 && us >= BUCKET_LIMITS_US[bucket]) {
+    bucket++;
+  }
+
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+
+  uint32_t max = m_maxUs.load(std::memory_order_relaxed);
+  while (us > max && !m_maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+  }
+}// record
+
+/**
+ * @brief Clear all samples.
+ */
+void LatencyHistogram::reset() {
+  for (auto &it : m_buckets) {
+    it.store(0, std::memory_order_relaxed);
+  }
+  m_count.store(0, std::memory_order_relaxed);
+  m_maxUs.store(0, std::memory_order_relaxed);
+}// reset
+
+/**
+ * @brief Get a copy of the histogram.
+ * @return The samples recorded so far, samples added while copying may be partially included.
+ */
+LatencyStats LatencyHistogram::snapshot() const {
+  LatencyStats stats{};
+  for (size_t i = 0; i < LatencyStats::BUCKETS; i++) {
+    stats.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+  }
+  stats.count = m_count.load(std::memory_order_relaxed);
+  stats.maxUs = m_maxUs.load(std::memory_order_relaxed);
+  return stats;
+}// snapshot
+
+/**
+ * @brief Increment a counter of the current core.
+ * @param [in] counter The counter to increment.
+ */
+/*STATIC*/
+void Stats::increment(Counter counter) {
+  s_counters[xPortGetCoreID()].value[counter].fetch_add(1, std::memory_order_relaxed);
+}// increment
+
+/**
+ * @brief Count the result of handing a notification to the host.
+ * @param [in] rc The return code of ble_gattc_notify_custom().
+ */
+/*STATIC*/
+void Stats::countNotify(int rc) {
+  switch (rc) {
+  case 0:
+    increment(NOTIFY_SENT);
+    break;
+  case BLE_HS_ENOMEM:
+    increment(NOTIFY_ENOMEM);
+    break;
+  default:
+    increment(NOTIFY_FAILED);
+    break;
+  }
+}// countNotify
+
+/**
+ * @brief Add a sample to a latency histogram.
+ * @param [in] latency The histogram.
+ * @param [in] us The latency in microseconds.
+ */
+/*STATIC*/
+void Stats::record(Latency latency, uint32_t us) {
+  s_latency[latency].record(us);
+}// record
+
+/**
+ * @brief Get a timestamp to measure latencies with.
+ * @return The time since boot in microseconds, wrapping every 71 minutes.
+ */
+/*STATIC*/
+uint32_t Stats::now() {
+  return (uint32_t) esp_timer_get_time();
+}// now
+
+/**
+ * @brief Get a copy of all the statistics.
+ * @return The counters summed over the cores and the histograms.
+ */
+/*STATIC*/
+DeviceStats Stats::snapshot() {
+  uint32_t counters[COUNTER_MAX] = {};
+  for (auto &core : s_counters) {
+    for (size_t i = 0; i < COUNTER_MAX; i++) {
+      counters[i] += core.value[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  DeviceStats stats{};
+  stats.scanReports = counters[SCAN_REPORTS];
+  stats.scanDropped = counters[SCAN_DROPPED];
+  stats.scanDeduped = counters[SCAN_DEDUPED];
+  stats.scanFiltered = counters[SCAN_FILTERED];
+  stats.notifySent = counters[NOTIFY_SENT];
+  stats.notifyFailed = counters[NOTIFY_FAILED];
+  stats.notifyNoMem = counters[NOTIFY_ENOMEM];
+  stats.indicateSent = counters[INDICATE_SENT];
+  stats.indicateFailed = counters[INDICATE_FAILED];
+  stats.indicationRtt = s_latency[INDICATION_RTT].snapshot();
+  stats.gattRead = s_latency[GATT_READ].snapshot();
+  stats.gattWrite = s_latency[GATT_WRITE].snapshot();
+  stats.connect = s_latency[CONNECT].snapshot();
+  stats.discovery = s_latency[DISCOVERY].snapshot();
+  return stats;
+}// snapshot
+
+/**
+ * @brief Clear all counters and histograms.
+ */
+/*STATIC*/
+void Stats::reset() {
+  for (auto &core : s_counters) {
+    for (auto &it : core.value) {
+      it.store(0, std::memory_order_relaxed);
+    }
+  }
+  for (auto &it : s_latency) {
+    it.reset();
+  }
+}// reset
+
+}// namespace nimble
+
+#endif /* CONFIG_BT_NIMBLE_ENABLED */
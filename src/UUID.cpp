@@ -20,11 +20,25 @@
 #include "nimble/Utils.hpp"
 
 #include <algorithm>
+#include <cstring>
 
 static const char *LOG_TAG = "NimBLEUUID";
 
 namespace nimble {
 
+/**
+ * @brief The first 12 bytes of the %BLE base UUID, least significant first.
+ */
+static const uint8_t BASE_UUID[12] = {0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00,
+                                      0x00, 0x80, 0x00, 0x10, 0x00, 0x00};
+
+/**
+ * @brief Create a UUID from a UUID parsed at compile time.
+ * @param [in] uuid The parsed UUID, see operator""_uuid().
+ */
+UUID::UUID(const UUIDLiteral &uuid) : UUID(uuid.value, uuid.size, false) {
+}// NimBLEUUID
+
 /**
  * @brief Create a UUID from a string.
  *
@@ -39,33 +53,24 @@ namespace nimble {
  * ```
  *
  * This has a length of 36 characters.  We need to parse this into 16 bytes.
+ * The 4 and 8 character forms are 16 and 32 bit UUIDs. The string is parsed in place,
+ * nothing is allocated.
  *
  * @param [in] value The string to build a UUID from.
  */
-UUID::UUID(const std::string &value) {
-  m_valueSet = true;
-  if (value.length() == 4) {
-    m_uuid.u.type = BLE_UUID_TYPE_16;
-    m_uuid.u16.value = strtoul(value.c_str(), nullptr, 16);
-  } else if (value.length() == 8) {
-    m_uuid.u.type = BLE_UUID_TYPE_32;
-    m_uuid.u32.value = strtoul(value.c_str(), nullptr, 16);
-  } else if (value.length() == 16) {
-    *this = UUID((uint8_t *) value.data(), 16, true);
-  } else if (value.length() == 36) {
-    // If the length of the string is 36 bytes then we will assume it is a long hex string in
-    // UUID format.
-    char *position = const_cast<char *>(value.c_str());
-    uint32_t first = strtoul(position, &position, 16);
-    uint16_t second = strtoul(position + 1, &position, 16);
-    uint16_t third = strtoul(position + 1, &position, 16);
-    uint16_t fourth = strtoul(position + 1, &position, 16);
-    uint64_t fifth = strtoull(position + 1, nullptr, 16);
-    *this = UUID(first, second, third, (uint64_t(fourth) << 48) + fifth);
+UUID::UUID(std::string_view value) {
+  if (value.length() == 16) {
+    *this = UUID((const uint8_t *) value.data(), 16, true);
+    return;
+  }
+
+  const UUIDLiteral uuid = UUIDLiteral::parse(value.data(), value.length());
+  if (uuid.size != 0) {
+    *this = UUID(uuid);
   } else {
     m_valueSet = false;
   }
-}// NimBLEUUID(std::string)
+}// NimBLEUUID(std::string_view)
 
 /**
  * @brief Create a UUID from 2, 4, 16 bytes of memory.
@@ -189,24 +194,13 @@ bool UUID::equals(const UUID &uuid) const {
  *
  * @param [in] uuid The string to create the UUID from.
  */
-UUID UUID::fromString(const std::string &uuid) {
-  uint8_t start = 0;
-  if (strstr(uuid.c_str(), "0x") != nullptr) {// If the string starts with 0x, skip those characters.
-    start = 2;
-  }
-  uint8_t len = uuid.length() - start;// Calculate the length of the string we are going to use.
-
-  if (len == 4) {
-    uint16_t x = strtoul(uuid.substr(start, len).c_str(), nullptr, 16);
-    return UUID(x);
-  } else if (len == 8) {
-    uint32_t x = strtoul(uuid.substr(start, len).c_str(), nullptr, 16);
-    return UUID(x);
-  } else if (len == 36) {
-    return UUID(uuid);
+UUID UUID::fromString(std::string_view uuid) {
+  const UUIDLiteral parsed = UUIDLiteral::parse(uuid.data(), uuid.length());
+  if (parsed.size == 0) {
+    return {};
   }
 
-  return {};
+  return UUID(parsed);
 }// fromString
 
 /**
@@ -255,9 +249,7 @@ const UUID &UUID::to16() {
   }
 
   if (m_uuid.u.type == BLE_UUID_TYPE_128) {
-    uint8_t base128[] = {0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00,
-                         0x00, 0x80, 0x00, 0x10, 0x00, 0x00};
-    if (memcmp(m_uuid.u128.value, base128, sizeof(base128)) == 0) {
+    if (memcmp(m_uuid.u128.value, BASE_UUID, sizeof(BASE_UUID)) == 0) {
       *this = UUID(*(uint16_t *) (m_uuid.u128.value + 12));
     }
   }
@@ -281,40 +273,125 @@ std::string UUID::toString() const {
 }// toString
 
 /**
- * @brief Convenience operator to check if this UUID is equal to another.
+ * @brief Format the UUID into a buffer, without allocating.
+ * @details The format is the one of toString(), "0x180d", "0x0000180d" or the full 128 bit form.
+ * @param [out] buf The buffer, STR_LEN bytes fit any UUID.
+ * @param [in] size The size of the buffer.
+ * @return The length of the string written, 0 if the buffer is too small or the UUID is not set.
  */
-bool UUID::operator==(const UUID &rhs) const {
-  if (m_valueSet && rhs.m_valueSet) {
-    if (m_uuid.u.type != rhs.m_uuid.u.type) {
-      uint8_t uuidBase[16] = {
-          0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
-          0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-      if (m_uuid.u.type == BLE_UUID_TYPE_128) {
-        if (rhs.m_uuid.u.type == BLE_UUID_TYPE_16) {
-          memcpy(uuidBase + 12, &rhs.m_uuid.u16.value, 2);
-        } else if (rhs.m_uuid.u.type == BLE_UUID_TYPE_32) {
-          memcpy(uuidBase + 12, &rhs.m_uuid.u32.value, 4);
-        }
-        return memcmp(m_uuid.u128.value, uuidBase, 16) == 0;
-
-      } else if (rhs.m_uuid.u.type == BLE_UUID_TYPE_128) {
-        if (m_uuid.u.type == BLE_UUID_TYPE_16) {
-          memcpy(uuidBase + 12, &m_uuid.u16.value, 2);
-        } else if (m_uuid.u.type == BLE_UUID_TYPE_32) {
-          memcpy(uuidBase + 12, &m_uuid.u32.value, 4);
-        }
-        return memcmp(rhs.m_uuid.u128.value, uuidBase, 16) == 0;
-
-      } else {
-        return false;
+size_t UUID::toChars(char *buf, size_t size) const {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  const size_t length = !m_valueSet                        ? 0
+                        : m_uuid.u.type == BLE_UUID_TYPE_16 ? 6
+                        : m_uuid.u.type == BLE_UUID_TYPE_32 ? 10
+                                                            : 36;
+  if (length == 0 || size <= length) {
+    if (size > 0) {
+      buf[0] = '\0';
+    }
+    return 0;
+  }
+
+  if (m_uuid.u.type != BLE_UUID_TYPE_128) {
+    const uint32_t value = m_uuid.u.type == BLE_UUID_TYPE_16 ? m_uuid.u16.value : m_uuid.u32.value;
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (size_t i = 2; i < length; i++) {
+      buf[i] = HEX_DIGITS[(value >> (4 * (length - 1 - i))) & 0x0f];
+    }
+  } else {
+    // Most significant byte first, with a dash after bytes 4, 6, 8 and 10.
+    size_t pos = 0;
+    for (size_t i = 0; i < 16; i++) {
+      if (i == 4 || i == 6 || i == 8 || i == 10) {
+        buf[pos++] = '-';
       }
+      const uint8_t byte = m_uuid.u128.value[15 - i];
+      buf[pos++] = HEX_DIGITS[byte >> 4];
+      buf[pos++] = HEX_DIGITS[byte & 0x0f];
     }
+  }
+
+  buf[length] = '\0';
+  return length;
+}// toChars
 
-    return ble_uuid_cmp(&m_uuid.u, &rhs.m_uuid.u) == 0;
+/**
+ * @brief Get the value of a UUID that has a 32 bit form.
+ * @param [out] value The 16 or 32 bit value, or bytes 12 to 15 of a 128 bit UUID built on the base UUID.
+ * @return True if the UUID has a 32 bit form.
+ */
+bool UUID::getShortValue(uint32_t *value) const {
+  switch (m_uuid.u.type) {
+  case BLE_UUID_TYPE_16:
+    *value = m_uuid.u16.value;
+    return true;
+  case BLE_UUID_TYPE_32:
+    *value = m_uuid.u32.value;
+    return true;
+  default:
+    if (memcmp(m_uuid.u128.value, BASE_UUID, sizeof(BASE_UUID)) != 0) {
+      return false;
+    }
+    memcpy(value, m_uuid.u128.value + 12, 4);
+    return true;
+  }
+}// getShortValue
+
+/**
+ * @brief Get a hash of the UUID.
+ * @details The hash is taken over the 32 bit form when there is one, so equal UUIDs of different
+ * sizes hash the same.
+ * @return The FNV-1a hash of the UUID.
+ */
+std::size_t UUID::hash() const {
+  if (!m_valueSet) {
+    return 0;
+  }
+
+  uint8_t bytes[16];
+  size_t length = 16;
+  uint32_t value;
+  if (getShortValue(&value)) {
+    memcpy(bytes, &value, 4);
+    length = 4;
+  } else {
+    memcpy(bytes, m_uuid.u128.value, 16);
+  }
+
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619UL;
+  }
+
+  return hash;
+}// hash
+
+/**
+ * @brief Convenience operator to check if this UUID is equal to another.
+ * @details UUIDs of the same size compare their values directly, otherwise both are compared in
+ * their 32 bit form, which a 128 bit UUID only has if it is built on the base UUID.
+ */
+bool UUID::operator==(const UUID &rhs) const {
+  if (!m_valueSet || !rhs.m_valueSet) {
+    return m_valueSet == rhs.m_valueSet;
+  }
+
+  if (m_uuid.u.type == rhs.m_uuid.u.type) {
+    switch (m_uuid.u.type) {
+    case BLE_UUID_TYPE_16:
+      return m_uuid.u16.value == rhs.m_uuid.u16.value;
+    case BLE_UUID_TYPE_32:
+      return m_uuid.u32.value == rhs.m_uuid.u32.value;
+    default:
+      return memcmp(m_uuid.u128.value, rhs.m_uuid.u128.value, 16) == 0;
+    }
   }
 
-  return m_valueSet == rhs.m_valueSet;
+  uint32_t value;
+  uint32_t rhsValue;
+  return getShortValue(&value) && rhs.getShortValue(&rhsValue) && value == rhsValue;
 }
 
 /**
@@ -334,9 +411,8 @@ UUID::operator std::string() const {
     return {};// If we have no value, nothing to format.
   }
 
-  char buf[BLE_UUID_STR_LEN];
-
-  return ble_uuid_to_str(&m_uuid.u, buf);
+  char buf[STR_LEN];
+  return std::string(buf, toChars(buf, sizeof(buf)));
 }
 
 }// namespace nimble
@@ -18,6 +18,7 @@
 #include "nimble/Log.hpp"
 #include "nimble/Utils.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 
 static const char* LOG_TAG = "NimBLEUtils";
@@ -420,6 +421,33 @@ char*Utils::buildHexData(uint8_t* target, const uint8_t* source, uint8_t length)
 } // buildHexData
 
 
+/**
+ * @brief Format data as hex into a buffer, without allocating.
+ *
+ * @param [out] buf Where to write the hex string.
+ * @param [in] size The size of the buffer, the data is truncated to what fits.
+ * @param [in] data The start of the binary data.
+ * @param [in] length The length of the data to convert.
+ * @return The length of the string written.
+ */
+size_t Utils::toHex(char* buf, size_t size, const uint8_t* data, size_t length) {
+    static const char hexDigits[] = "0123456789abcdef";
+
+    if (size == 0) {
+        return 0;
+    }
+
+    length = std::min(length, (size - 1) / 2);
+    for (size_t i = 0; i < length; i++) {
+        buf[i * 2] = hexDigits[data[i] >> 4];
+        buf[i * 2 + 1] = hexDigits[data[i] & 0x0f];
+    }
+    buf[length * 2] = 0;
+
+    return length * 2;
+} // toHex
+
+
 /**
  * @brief Utility function to log the gap event info.
  * @param [in] event A pointer to the gap event structure.
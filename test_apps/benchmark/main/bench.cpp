@@ -0,0 +1,110 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.hpp"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include <esp_chip_info.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+#include "nimble/Device.hpp"
+#include "nimble/Memory.hpp"
+
+namespace bench {
+
+namespace {
+
+std::atomic<size_t> s_allocations{0};
+
+void *countingAllocate(size_t size, uint32_t caps) {
+  s_allocations++;
+  return heap_caps_malloc(size, caps);
+}
+
+void *countingReallocate(void *ptr, size_t size, uint32_t caps) {
+  s_allocations++;
+  return heap_caps_realloc(ptr, size, caps);
+}
+
+void countingRelease(void *ptr) {
+  heap_caps_free(ptr);
+}
+
+const nimble::MemoryAllocator COUNTING_ALLOCATOR = {countingAllocate, countingReallocate, countingRelease};
+
+}// namespace
+
+/**
+ * @brief Count the calls to the library allocator, must be called before Device::init().
+ */
+void installAllocator() {
+  nimble::Memory::setAllocator(&COUNTING_ALLOCATOR);
+}// installAllocator
+
+void resetAllocations() {
+  s_allocations = 0;
+}// resetAllocations
+
+size_t allocations() {
+  return s_allocations;
+}// allocations
+
+/**
+ * @brief Print the line identifying the run, the build and the board the results come from.
+ * @details Every line of the results starts with "BENCH " so they can be picked out of the monitor output.
+ */
+void printHeader(const char *mode) {
+  esp_chip_info_t chip;
+  esp_chip_info(&chip);
+  printf("BENCH {\"bench\":\"info\",\"mode\":\"%s\",\"idf\":\"%s\",\"built\":\"%s %s\",\"chip_model\":%d,\"chip_revision\":%d,\"cores\":%d}\n",
+         mode, esp_get_idf_version(), __DATE__, __TIME__, (int) chip.model, (int) chip.revision, (int) chip.cores);
+}// printHeader
+
+/**
+ * @brief Print the result of a synthetic bench.
+ */
+void report(const Result &result) {
+  uint32_t iterations = result.iterations ? result.iterations : 1;
+  printf("BENCH {\"bench\":\"%s\"", result.bench);
+  if (result.param != nullptr) {
+    printf(",\"%s\":%" PRId32, result.param, result.value);
+  }
+  printf(",\"iterations\":%" PRIu32 ",\"ns_per_op\":%" PRId64 ",\"allocs_per_op\":%.3f}\n",
+         result.iterations, result.elapsedUs * 1000 / iterations, (double) result.allocations / iterations);
+}// report
+
+/**
+ * @brief Print the result of a throughput phase.
+ */
+void reportThroughput(const char *bench, uint64_t bytes, uint32_t packets, uint32_t elapsedMs, uint32_t stalls) {
+  uint64_t bytesPerSecond = elapsedMs ? bytes * 1000 / elapsedMs : 0;
+  printf("BENCH {\"bench\":\"%s\",\"bytes\":%" PRIu64 ",\"packets\":%" PRIu32 ",\"elapsed_ms\":%" PRIu32
+         ",\"bytes_per_second\":%" PRIu64 ",\"stalls\":%" PRIu32 "}\n",
+         bench, bytes, packets, elapsedMs, bytesPerSecond, stalls);
+}// reportThroughput
+
+/**
+ * @brief Print the statistics of the device collected during the run.
+ */
+void reportStats() {
+  printf("BENCH {\"bench\":\"stats\",\"device\":%s,\"memory\":%s}\n",
+         nimble::Device::getStats().toJson().c_str(), nimble::Device::getMemoryStats().toJson().c_str());
+}// reportStats
+
+}// namespace bench
@@ -0,0 +1,87 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_timer.h>
+#include <host/ble_gap.h>
+
+namespace bench {
+
+/**
+ * @brief One line of the results, printed as a JSON object.
+ */
+struct Result {
+  const char *bench;     /// Name of the bench.
+  const char *param;     /// Name of the parameter of the bench, nullptr if it has none.
+  int32_t value;         /// Value of the parameter.
+  uint32_t iterations;   /// Number of operations measured.
+  int64_t elapsedUs;     /// Time taken by all the operations.
+  size_t allocations;    /// Calls to the library allocator made by all the operations.
+};
+
+void installAllocator();
+void resetAllocations();
+size_t allocations();
+
+void printHeader(const char *mode);
+void report(const Result &result);
+void reportThroughput(const char *bench, uint64_t bytes, uint32_t packets, uint32_t elapsedMs, uint32_t stalls);
+void reportStats();
+
+/**
+ * @brief Time a number of calls to a function.
+ * @param [in] bench The name of the bench.
+ * @param [in] param The name of the parameter of the bench, nullptr if it has none.
+ * @param [in] value The value of the parameter.
+ * @param [in] iterations The number of calls.
+ * @param [in] body The function, called with the index of the iteration.
+ */
+template <typename F>
+void run(const char *bench, const char *param, int32_t value, uint32_t iterations, F &&body) {
+  resetAllocations();
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < iterations; i++) {
+    body(i);
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+  report({bench, param, value, iterations, elapsed, allocations()});
+}
+
+/**
+ * @brief Hooks of the linker wrappers around the host GAP and GATT calls of the library.
+ * @details While intercepting, scanning and advertising are recorded instead of reaching the controller
+ * and the handlers the library registers can be fed synthetic events from the calling task.
+ * Connections added here are answered by the wrappers, notifications to them are counted and dropped.
+ */
+namespace hooks {
+
+void intercept(bool enabled);
+int sendDiscEvent(ble_gap_event &event);
+int sendAdvEvent(ble_gap_event &event);
+bool addConnection(uint16_t connHandle, const ble_addr_t &peer, uint16_t mtu);
+void removeConnection(uint16_t connHandle);
+uint32_t notifyCount();
+void resetCounters();
+
+}// namespace hooks
+
+void runLocal();
+void runPeripheral();
+void runCentral();
+
+}// namespace bench
@@ -0,0 +1,251 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * The synthetic benches, one board and no peer: scan reports through Scan::handleGapEvent,
+ * notification fan-out through Characteristic::notify, AttributeValue allocations and
+ * the AdvertisedDevice getters. The host build in host_test/ runs the same paths against a fake host.
+ */
+
+#include "bench.hpp"
+
+#include "sdkconfig.h"
+
+#include <vector>
+
+#include <host/ble_hs.h>
+
+#include "nimble/AdvertisedDevice.hpp"
+#include "nimble/AttributeValue.hpp"
+#include "nimble/Characteristic.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/Scan.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Service.hpp"
+
+using namespace nimble;
+
+namespace {
+
+constexpr uint32_t ITERATIONS = CONFIG_BENCH_ITERATIONS;
+
+/** Above the handles the controller hands out, so they never collide with a real connection. */
+constexpr uint16_t FIRST_CONN_HANDLE = 0x0E00;
+
+/** Flags, a 16 bit service UUID, a manufacturer data field and a complete name. */
+const uint8_t PAYLOAD[] = {
+    0x02, BLE_HS_ADV_TYPE_FLAGS, 0x06,
+    0x03, BLE_HS_ADV_TYPE_COMP_UUIDS16, 0x0D, 0x18,
+    0x07, BLE_HS_ADV_TYPE_MFG_DATA, 0xE5, 0x02, 0x01, 0x02, 0x03, 0x04,
+    0x0D, BLE_HS_ADV_TYPE_COMP_NAME, 'b', 'e', 'n', 'c', 'h', '-', 'd', 'e', 'v', 'i', 'c', 'e',
+};
+
+ble_addr_t peerAddress(uint32_t index) {
+  ble_addr_t addr{};
+  addr.type = BLE_ADDR_RANDOM;
+  addr.val[0] = (uint8_t) index;
+  addr.val[1] = (uint8_t) (index >> 8);
+  addr.val[2] = (uint8_t) (index >> 16);
+  addr.val[5] = 0xC0;
+  return addr;
+}
+
+ble_gap_event discEvent(uint32_t index) {
+  ble_gap_event event{};
+  event.type = BLE_GAP_EVENT_DISC;
+  event.disc.event_type = BLE_HCI_ADV_RPT_EVTYPE_ADV_IND;
+  event.disc.addr = peerAddress(index);
+  event.disc.rssi = (int8_t) (-40 - (int8_t) (index % 40));
+  event.disc.data = PAYLOAD;
+  event.disc.length_data = sizeof(PAYLOAD);
+  return event;
+}
+
+Scan *startScan() {
+  Scan *pScan = Device::getScan();
+  pScan->stop();
+  pScan->clearResults();
+  pScan->start(0);
+  return pScan;
+}
+
+void benchScan() {
+  // Reports from a population of devices, each one seen again once every `devices` reports.
+  for (uint32_t devices : {1, 16, 64, 256}) {
+    Scan *pScan = startScan();
+    std::vector<ble_gap_event> events;
+    for (uint32_t i = 0; i < devices; i++) {
+      events.push_back(discEvent(i));
+    }
+
+    bench::run("scan_report", "devices", devices, ITERATIONS, [&](uint32_t i) {
+      bench::hooks::sendDiscEvent(events[i % devices]);
+    });
+    pScan->stop();
+  }
+
+  // Reports rejected by the filters before anything is looked up.
+  Scan *pScan = startScan();
+  ScanFilter filter;
+  filter.setMinRSSI(-20);
+  pScan->setFilters(filter);
+  ble_gap_event event = discEvent(1);
+  bench::run("scan_report_filtered", nullptr, 0, ITERATIONS, [&](uint32_t) {
+    bench::hooks::sendDiscEvent(event);
+  });
+  pScan->setFilters(ScanFilter());
+  pScan->stop();
+}
+
+void benchAdvertisedDevice() {
+  Scan *pScan = startScan();
+  ble_gap_event event = discEvent(7);
+  bench::hooks::sendDiscEvent(event);
+  AdvertisedDevice *pDevice = pScan->getResults().getDevice(Address(event.disc.addr));
+  if (pDevice == nullptr) {
+    printf("BENCH {\"bench\":\"advertised_device\",\"error\":\"the report was not stored\"}\n");
+    pScan->stop();
+    return;
+  }
+
+  volatile size_t sink = 0;
+  bench::run("advertised_device_view_getters", nullptr, 0, ITERATIONS, [&](uint32_t) {
+    sink += pDevice->getNameView().size();
+    sink += pDevice->getManufacturerDataView().size();
+    sink += pDevice->getServiceUUID().bitSize();
+    sink += pDevice->getAdvFlags();
+    sink += pDevice->getRSSI();
+  });
+
+  // The std::string getters copy the field, compare with the view getters above.
+  bench::run("advertised_device_string_getters", nullptr, 0, ITERATIONS, [&](uint32_t) {
+    sink += pDevice->getName().size();
+    sink += pDevice->getManufacturerData().size();
+  });
+  pScan->stop();
+  pScan->clearResults();
+}
+
+void benchAttributeValue() {
+  for (uint16_t length : {8, 20, 244, 512}) {
+    const std::vector<uint8_t> data(length, 0xA5);
+    AttributeValue value;
+    bench::run("attribute_value_set", "length", length, ITERATIONS, [&](uint32_t) {
+      value.setValue(data.data(), (uint16_t) data.size());
+    });
+  }
+
+  // A value written with ever larger payloads, like a characteristic fed by a sensor.
+  const std::vector<uint8_t> data(BLE_ATT_ATTR_MAX_LEN, 0x5A);
+  bench::run("attribute_value_growing", nullptr, 0, ITERATIONS, [&](uint32_t) {
+    AttributeValue value;
+    for (uint16_t len = 8; len <= BLE_ATT_ATTR_MAX_LEN; len *= 2) {
+      value.setValue(data.data(), len);
+    }
+  });
+
+  for (uint16_t length : {20, 512}) {
+    const AttributeValue source(std::vector<uint8_t>(length, 0x3C));
+    bench::run("attribute_value_copy", "length", length, ITERATIONS, [&](uint32_t) {
+      AttributeValue copy(source);
+      (void) copy;
+    });
+  }
+}
+
+void connectPeers(Characteristic *pCharacteristic, size_t count, uint16_t mtu) {
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t connHandle = FIRST_CONN_HANDLE + i;
+    bench::hooks::addConnection(connHandle, peerAddress(i), mtu);
+
+    ble_gap_event event{};
+    event.type = BLE_GAP_EVENT_CONNECT;
+    event.connect.conn_handle = connHandle;
+    bench::hooks::sendAdvEvent(event);
+
+    event = {};
+    event.type = BLE_GAP_EVENT_SUBSCRIBE;
+    event.subscribe.conn_handle = connHandle;
+    event.subscribe.attr_handle = pCharacteristic->getHandle();
+    event.subscribe.reason = BLE_GAP_SUBSCRIBE_REASON_WRITE;
+    event.subscribe.cur_notify = 1;
+    bench::hooks::sendAdvEvent(event);
+  }
+}
+
+void disconnectPeers(size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t connHandle = FIRST_CONN_HANDLE + i;
+
+    ble_gap_event event{};
+    event.type = BLE_GAP_EVENT_DISCONNECT;
+    event.disconnect.reason = BLE_HS_HCI_ERR(BLE_ERR_REM_USER_CONN_TERM);
+    ble_gap_conn_find(connHandle, &event.disconnect.conn);
+    bench::hooks::removeConnection(connHandle);
+    bench::hooks::sendAdvEvent(event);
+  }
+}
+
+void benchNotify() {
+  Server *pServer = Device::createServer();
+  Service *pService = pServer->createService(UUID((uint16_t) 0x180D));
+  Characteristic *pCharacteristic = pService->createCharacteristic((uint16_t) 0x2A37, Property::READ | Property::NOTIFY);
+  pService->start();
+  pServer->start();
+  pServer->startAdvertising();
+
+  // The early return when nobody subscribed, the cost paid by every periodic notify of an idle server.
+  const std::vector<uint8_t> idle(20, 0);
+  bench::run("notify_no_subscribers", nullptr, 0, ITERATIONS, [&](uint32_t) {
+    pCharacteristic->notify(idle.data(), idle.size());
+  });
+
+  for (size_t peers = 1; peers <= CONFIG_BT_NIMBLE_MAX_CONNECTIONS; peers *= 2) {
+    for (uint16_t length : {20, 244}) {
+      const std::vector<uint8_t> value(length, 0x42);
+      connectPeers(pCharacteristic, peers, 247);
+      if (pCharacteristic->getSubscribedCount() != peers) {
+        printf("BENCH {\"bench\":\"notify_fan_out\",\"peers\":%d,\"error\":\"the peers did not subscribe\"}\n", (int) peers);
+        disconnectPeers(peers);
+        continue;
+      }
+
+      bench::hooks::resetCounters();
+      bench::run(length == 20 ? "notify_fan_out_20" : "notify_fan_out_244", "peers", peers, ITERATIONS, [&](uint32_t) {
+        pCharacteristic->notify(value.data(), value.size());
+      });
+      printf("BENCH {\"bench\":\"notify_fan_out_sent\",\"peers\":%d,\"length\":%d,\"notifications\":%lu}\n",
+             (int) peers, length, (unsigned long) bench::hooks::notifyCount());
+      disconnectPeers(peers);
+    }
+  }
+}
+
+}// namespace
+
+namespace bench {
+
+/**
+ * @brief Run all the synthetic benches, scanning and advertising never reach the controller.
+ */
+void runLocal() {
+  hooks::intercept(true);
+  benchScan();
+  benchAdvertisedDevice();
+  benchAttributeValue();
+  benchNotify();
+  hooks::intercept(false);
+}// runLocal
+
+}// namespace bench
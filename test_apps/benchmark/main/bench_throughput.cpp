@@ -0,0 +1,220 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Over the air throughput between two boards.
+ * The central streams writes without response to the peripheral for CONFIG_BENCH_THROUGHPUT_SECONDS,
+ * then subscribes and the peripheral notifies for as long. Each side reports what it sent and received.
+ */
+
+#include "bench.hpp"
+
+#include "sdkconfig.h"
+
+#include <atomic>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <host/ble_hs.h>
+
+#include "nimble/Client.hpp"
+#include "nimble/Device.hpp"
+#include "nimble/RemoteCharacteristic.hpp"
+#include "nimble/RemoteService.hpp"
+#include "nimble/Scan.hpp"
+#include "nimble/Server.hpp"
+#include "nimble/Service.hpp"
+
+using namespace nimble;
+
+namespace {
+
+constexpr uint32_t PHASE_MS = CONFIG_BENCH_THROUGHPUT_SECONDS * 1000;
+
+const char *SERVICE_UUID = "8d53dc1d-1db7-4cd3-868b-8a527460aa84";
+const char *RX_UUID = "8d53dc1d-1db7-4cd3-868b-8a527460aa85";
+const char *TX_UUID = "8d53dc1d-1db7-4cd3-868b-8a527460aa86";
+
+uint32_t millis() {
+  return (uint32_t) (esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief Bytes received by one side, with the time of the first and the last packet.
+ */
+struct Received {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint32_t> packets{0};
+  std::atomic<uint32_t> firstMs{0};
+  std::atomic<uint32_t> lastMs{0};
+
+  void add(size_t length) {
+    uint32_t now = millis();
+    if (packets++ == 0) {
+      firstMs = now;
+    }
+    lastMs = now;
+    bytes += length;
+  }
+
+  void reset() {
+    bytes = 0;
+    packets = 0;
+    firstMs = 0;
+    lastMs = 0;
+  }
+
+  void report(const char *bench) const {
+    bench::reportThroughput(bench, bytes, packets, lastMs - firstMs, 0);
+  }
+};
+
+Received s_received;
+TaskHandle_t s_benchTask = nullptr;
+std::atomic<uint16_t> s_connHandle{BLE_HS_CONN_HANDLE_NONE};
+
+class RxCallbacks : public CharacteristicCallbacks {
+  bool onWriteRaw(CharacteristicPtr characteristic, const os_mbuf *om, ConnectionInfo &connInfo) override {
+    s_received.add(OS_MBUF_PKTLEN(om));
+    return true;
+  }
+};
+
+class TxCallbacks : public CharacteristicCallbacks {
+  void onSubscribe(CharacteristicPtr characteristic, ConnectionInfo &connInfo, uint16_t subValue) override {
+    if (subValue & NIMBLE_SUB_NOTIFY) {
+      s_connHandle = connInfo.getConnHandle();
+      xTaskNotifyGive(s_benchTask);
+    }
+  }
+};
+
+RxCallbacks s_rxCallbacks;
+TxCallbacks s_txCallbacks;
+
+}// namespace
+
+namespace bench {
+
+/**
+ * @brief Advertise the bench service and serve every central that connects, one at a time.
+ * @details The write phase of a central ends when it subscribes to the notifications.
+ */
+void runPeripheral() {
+  s_benchTask = xTaskGetCurrentTaskHandle();
+
+  Server *pServer = Device::createServer();
+  pServer->advertiseOnDisconnect(true);
+  Service *pService = pServer->createService(SERVICE_UUID);
+  pService->createCharacteristic(RX_UUID, Property::WRITE_NR)->setCallbacks(&s_rxCallbacks);
+  Characteristic *pTx = pService->createCharacteristic(TX_UUID, Property::NOTIFY);
+  pTx->setCallbacks(&s_txCallbacks);
+  pService->start();
+  pServer->start();
+
+  Device::getAdvertising()->addServiceUUID(SERVICE_UUID);
+  pServer->startAdvertising();
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    s_received.report("write_no_rsp_rx");
+    s_received.reset();
+
+    const uint16_t connHandle = s_connHandle;
+    const std::vector<uint8_t> payload(pServer->getPeerMTU(connHandle) - 3, 0x55);
+    const DeviceStats before = Device::getStats();
+    uint32_t stalls = 0;
+    uint32_t start = millis();
+
+    while (millis() - start < PHASE_MS && pServer->getConnectedCount() > 0) {
+      // Characteristic::notify() does not report a lack of buffers, wait for the controller to free some.
+      if (os_msys_num_free() < 2) {
+        stalls++;
+        vTaskDelay(1);
+        continue;
+      }
+      pTx->notify(payload.data(), payload.size(), true, connHandle);
+    }
+
+    const DeviceStats after = Device::getStats();
+    const uint32_t sent = after.notifySent - before.notifySent;
+    reportThroughput("notify_tx", (uint64_t) sent * payload.size(), sent, millis() - start, stalls);
+    reportStats();
+  }
+}// runPeripheral
+
+/**
+ * @brief Find the peripheral, stream writes to it, then receive its notifications.
+ */
+void runCentral() {
+  Device::setMTU(BLE_ATT_MTU_MAX);
+  Scan *pScan = Device::getScan();
+  pScan->setActiveScan(true);
+
+  AdvertisedDevice *pPeer = nullptr;
+  while (pPeer == nullptr) {
+    pScan->getResults(5000);
+    for (auto pDevice : pScan->getResults()) {
+      if (pDevice->isAdvertisingService(UUID(SERVICE_UUID))) {
+        pPeer = pDevice;
+        break;
+      }
+    }
+  }
+
+  Client *pClient = Device::createClient();
+  if (!pClient->connect(pPeer)) {
+    printf("BENCH {\"bench\":\"throughput\",\"error\":\"connection failed\"}\n");
+    return;
+  }
+
+  RemoteService *pService = pClient->getService(SERVICE_UUID);
+  RemoteCharacteristic *pRx = pService != nullptr ? pService->getCharacteristic(RX_UUID) : nullptr;
+  RemoteCharacteristic *pTx = pService != nullptr ? pService->getCharacteristic(TX_UUID) : nullptr;
+  if (pRx == nullptr || pTx == nullptr) {
+    printf("BENCH {\"bench\":\"throughput\",\"error\":\"the bench service was not found\"}\n");
+    pClient->disconnect();
+    return;
+  }
+
+  const std::vector<uint8_t> buffer(16 * 1024, 0xAA);
+  uint64_t bytes = 0;
+  uint32_t packets = 0;
+  uint32_t stalls = 0;
+  uint32_t start = millis();
+
+  while (millis() - start < PHASE_MS) {
+    RemoteCharacteristic::StreamStats stats{};
+    bool ok = pRx->writeStream(buffer.data(), buffer.size(), &stats);
+    bytes += stats.bytesWritten;
+    packets += stats.packets;
+    stalls += stats.stalls;
+    if (!ok) {
+      break;
+    }
+  }
+  reportThroughput("write_no_rsp_tx", bytes, packets, millis() - start, stalls);
+
+  s_received.reset();
+  pTx->subscribe(true, [](RemoteCharacteristic *, uint8_t *, size_t length, bool) { s_received.add(length); });
+  vTaskDelay(pdMS_TO_TICKS(PHASE_MS + 2000));
+  pTx->unsubscribe();
+  s_received.report("notify_rx");
+
+  reportStats();
+  pClient->disconnect();
+}// runCentral
+
+}// namespace bench
@@ -0,0 +1,240 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Linker wrappers, see main/CMakeLists.txt, of the host calls the library makes to scan, advertise and notify.
+ * They let the synthetic benches drive Scan::handleGapEvent and Server::handleGapEvent with events built
+ * in the bench task, and stand in for connections that do not exist.
+ */
+
+#include "bench.hpp"
+
+#include "sdkconfig.h"
+
+#include <atomic>
+
+#include <host/ble_att.h>
+#include <host/ble_gatt.h>
+#include <host/ble_hs.h>
+
+namespace {
+
+struct Connection {
+  bool used;
+  uint16_t mtu;
+  ble_gap_conn_desc desc;
+};
+
+std::atomic<bool> s_intercept{false};
+std::atomic<bool> s_discActive{false};
+std::atomic<bool> s_advActive{false};
+
+ble_gap_event_fn *s_discCb = nullptr;
+void *s_discArg = nullptr;
+ble_gap_event_fn *s_advCb = nullptr;
+void *s_advArg = nullptr;
+
+Connection s_connections[CONFIG_BT_NIMBLE_MAX_CONNECTIONS]{};
+std::atomic<uint32_t> s_notifyCount{0};
+
+/**
+ * @brief Find a connection added with hooks::addConnection().
+ */
+Connection *findConnection(uint16_t connHandle) {
+  for (auto &connection : s_connections) {
+    if (connection.used && connection.desc.conn_handle == connHandle) {
+      return &connection;
+    }
+  }
+
+  return nullptr;
+}// findConnection
+
+}// namespace
+
+extern "C" {
+
+int __real_ble_gap_disc(uint8_t own_addr_type, int32_t duration_ms, const struct ble_gap_disc_params *disc_params,
+                        ble_gap_event_fn *cb, void *cb_arg);
+int __real_ble_gap_disc_active(void);
+int __real_ble_gap_disc_cancel(void);
+int __real_ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                             const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg);
+int __real_ble_gap_adv_active(void);
+int __real_ble_gap_adv_stop(void);
+int __real_ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc);
+uint16_t __real_ble_att_mtu(uint16_t conn_handle);
+int __real_ble_gattc_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om);
+
+int __wrap_ble_gap_disc(uint8_t own_addr_type, int32_t duration_ms, const struct ble_gap_disc_params *disc_params,
+                        ble_gap_event_fn *cb, void *cb_arg) {
+  if (!s_intercept) {
+    return __real_ble_gap_disc(own_addr_type, duration_ms, disc_params, cb, cb_arg);
+  }
+
+  s_discCb = cb;
+  s_discArg = cb_arg;
+  s_discActive = true;
+  return 0;
+}// __wrap_ble_gap_disc
+
+int __wrap_ble_gap_disc_active(void) {
+  return s_intercept ? (int) s_discActive : __real_ble_gap_disc_active();
+}// __wrap_ble_gap_disc_active
+
+int __wrap_ble_gap_disc_cancel(void) {
+  if (!s_intercept) {
+    return __real_ble_gap_disc_cancel();
+  }
+
+  return s_discActive.exchange(false) ? 0 : BLE_HS_EALREADY;
+}// __wrap_ble_gap_disc_cancel
+
+int __wrap_ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                             const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg) {
+  if (!s_intercept) {
+    return __real_ble_gap_adv_start(own_addr_type, direct_addr, duration_ms, adv_params, cb, cb_arg);
+  }
+
+  s_advCb = cb;
+  s_advArg = cb_arg;
+  s_advActive = true;
+  return 0;
+}// __wrap_ble_gap_adv_start
+
+int __wrap_ble_gap_adv_active(void) {
+  return s_intercept ? (int) s_advActive : __real_ble_gap_adv_active();
+}// __wrap_ble_gap_adv_active
+
+int __wrap_ble_gap_adv_stop(void) {
+  if (!s_intercept) {
+    return __real_ble_gap_adv_stop();
+  }
+
+  return s_advActive.exchange(false) ? 0 : BLE_HS_EALREADY;
+}// __wrap_ble_gap_adv_stop
+
+int __wrap_ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc) {
+  Connection *pConnection = findConnection(handle);
+  if (pConnection == nullptr) {
+    return __real_ble_gap_conn_find(handle, out_desc);
+  }
+
+  if (out_desc != nullptr) {
+    *out_desc = pConnection->desc;
+  }
+  return 0;
+}// __wrap_ble_gap_conn_find
+
+uint16_t __wrap_ble_att_mtu(uint16_t conn_handle) {
+  Connection *pConnection = findConnection(conn_handle);
+  return pConnection != nullptr ? pConnection->mtu : __real_ble_att_mtu(conn_handle);
+}// __wrap_ble_att_mtu
+
+int __wrap_ble_gattc_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om) {
+  if (findConnection(conn_handle) == nullptr) {
+    return __real_ble_gattc_notify_custom(conn_handle, att_handle, om);
+  }
+
+  // The host consumes the mbuf whatever the outcome, so does this.
+  s_notifyCount++;
+  os_mbuf_free_chain(om);
+  return 0;
+}// __wrap_ble_gattc_notify_custom
+
+}// extern "C"
+
+namespace bench::hooks {
+
+/**
+ * @brief Start or stop intercepting scanning and advertising.
+ * @details Stopping forgets the recorded handlers, the next start of a scan or of advertising reaches the host.
+ */
+void intercept(bool enabled) {
+  s_intercept = enabled;
+  if (!enabled) {
+    s_discActive = false;
+    s_advActive = false;
+    s_discCb = nullptr;
+    s_advCb = nullptr;
+  }
+}// intercept
+
+/**
+ * @brief Deliver an event to the handler of the intercepted scan.
+ * @return The return of the handler, BLE_HS_EALREADY if no scan is running.
+ */
+int sendDiscEvent(ble_gap_event &event) {
+  if (!s_discActive || s_discCb == nullptr) {
+    return BLE_HS_EALREADY;
+  }
+
+  return s_discCb(&event, s_discArg);
+}// sendDiscEvent
+
+/**
+ * @brief Deliver an event to the handler of the intercepted advertising.
+ * @return The return of the handler, BLE_HS_EALREADY if advertising never started.
+ */
+int sendAdvEvent(ble_gap_event &event) {
+  if (s_advCb == nullptr) {
+    return BLE_HS_EALREADY;
+  }
+
+  return s_advCb(&event, s_advArg);
+}// sendAdvEvent
+
+/**
+ * @brief Add a connection the GAP and ATT wrappers answer for.
+ * @param [in] connHandle A handle the controller does not use, above the real ones.
+ * @return False if all the slots are used.
+ */
+bool addConnection(uint16_t connHandle, const ble_addr_t &peer, uint16_t mtu) {
+  for (auto &connection : s_connections) {
+    if (!connection.used) {
+      connection = {};
+      connection.mtu = mtu;
+      connection.desc.conn_handle = connHandle;
+      connection.desc.peer_id_addr = peer;
+      connection.desc.peer_ota_addr = peer;
+      connection.desc.role = BLE_GAP_ROLE_SLAVE;
+      connection.desc.conn_itvl = 24;
+      connection.desc.supervision_timeout = 400;
+      connection.used = true;
+      return true;
+    }
+  }
+
+  return false;
+}// addConnection
+
+void removeConnection(uint16_t connHandle) {
+  Connection *pConnection = findConnection(connHandle);
+  if (pConnection != nullptr) {
+    pConnection->used = false;
+  }
+}// removeConnection
+
+/**
+ * @brief The number of notifications sent to the added connections.
+ */
+uint32_t notifyCount() {
+  return s_notifyCount;
+}// notifyCount
+
+void resetCounters() {
+  s_notifyCount = 0;
+}// resetCounters
+
+}// namespace bench::hooks
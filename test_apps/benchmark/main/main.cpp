@@ -0,0 +1,43 @@
+// Copyright 2024 Pavel Suprunov
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.hpp"
+
+#include "sdkconfig.h"
+
+#include <cstdio>
+
+#include "nimble/Device.hpp"
+
+extern "C" void app_main(void) {
+  bench::installAllocator();
+
+#if CONFIG_BENCH_MODE_LOCAL
+  bench::printHeader("local");
+  nimble::Device::init("nimble-bench");
+  nimble::Device::resetStats();
+  bench::runLocal();
+#elif CONFIG_BENCH_MODE_PERIPHERAL
+  bench::printHeader("peripheral");
+  nimble::Device::init("nimble-bench-peripheral");
+  bench::runPeripheral();
+#else
+  bench::printHeader("central");
+  nimble::Device::init("nimble-bench-central");
+  bench::runCentral();
+#endif
+
+  bench::reportStats();
+  printf("BENCH {\"bench\":\"done\"}\n");
+}